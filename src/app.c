@@ -1,5 +1,7 @@
 #include "app.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
@@ -7,10 +9,15 @@
 
 #include <stb_image.h>
 
+#include "core/job.h"
+#include "core/timer.h"
 #include "debug/assert.h"
+#include "events/mouse_event.h"
 #include "events/window_event.h"
 #include "gfx/context.h"
 #include "gfx/renderer.h"
+#include "io/heightmap.h"
+#include "io/mesh_export.h"
 #include "math/noise.h"
 
 static bool on_window_close(event_bus_t *bus, bool handled, void *user_pointer, window_close_event_t *event)
@@ -20,14 +27,35 @@ static bool on_window_close(event_bus_t *bus, bool handled, void *user_pointer,
 	return true;
 }
 
+static bool on_brush_press(event_bus_t *bus, bool handled, void *user_pointer, mouse_press_event_t *event)
+{
+	app_state_t *state = (app_state_t *)user_pointer;
+	if (handled || !state->brush.enabled || event->button != GLFW_MOUSE_BUTTON_LEFT || igGetIO()->WantCaptureMouse) return false;
+
+	// keeps the camera from panning while painting
+	state->brush.painting = true;
+	return true;
+}
+
+static bool on_brush_release(event_bus_t *bus, bool handled, void *user_pointer, mouse_release_event_t *event)
+{
+	app_state_t *state = (app_state_t *)user_pointer;
+	if (!state->brush.painting || event->button != GLFW_MOUSE_BUTTON_LEFT) return false;
+
+	state->brush.painting = false;
+	return true;
+}
+
 static void init_libs()
 {
 	HE_VERIFY(glfwInit(), "Failed to initialize GLFW");
 	stbi_set_flip_vertically_on_load(true);
+	job_system_shared_init(&(job_system_desc_t){ 0 });
 }
 
 static void shutdown_libs()
 {
+	job_system_shared_free();
 	glfwTerminate();
 }
 
@@ -41,36 +69,462 @@ static void init_resources(app_state_t *state)
 		.window = state->window,
 	}, &state->camera);
 
-	terrain_init(&(terrain_desc_t){
+	HE_VERIFY(terrain_init(&(terrain_desc_t){
 		.position = { 0.0f, 0.0f, 0.0f },
 		.size = { 500, 500 },
 		.noise_function = (terrain_noise_function_t)perlin_noise_2d,
 		.seed = time(0),
 		.scale_scalar = 0.4f,
 		.elevation = 100.0f,
-	}, &state->terrain);
+	}, &state->terrain), "Failed to create the terrain");
+
+	state->regen.builder = terrain_builder_create(&(terrain_builder_desc_t){
+		.noise_function = state->terrain->noise_function,
+	});
+	HE_VERIFY(terrain_init(&(terrain_desc_t){
+		.position = { 0.0f, 0.0f, 0.0f },
+		.size = { 2, 2 },
+		.noise_function = state->terrain->noise_function,
+		.seed = state->terrain->seed,
+		.scale_scalar = state->terrain->scale_scalar,
+		.elevation = state->terrain->elevation,
+	}, &state->regen.proxy), "Failed to create the regeneration proxy");
+
+	HE_VERIFY(terrain_init(&(terrain_desc_t){
+		.position = { 0.0f, 0.0f, 0.0f },
+		.size = { 2, 2 },
+		.noise_function = state->terrain->noise_function,
+		.seed = state->terrain->seed,
+		.scale_scalar = state->terrain->scale_scalar,
+		.elevation = state->terrain->elevation,
+	}, &state->preview_terrain), "Failed to create the preview terrain");
 
 	state->config = APP_DEFAULT_CONFIGURATION;
 	state->erosion_desc = EROSION_DEFAULT_DESC;
+	strcpy(state->heightmap_path, "heightmap.png");
+	state->resize_filter = RESAMPLE_FILTER_BICUBIC;
+	state->import_resample = false;
+	strcpy(state->timelapse_path, "erosion" TIMELAPSE_EXTENSION);
+	state->brush.radius = 20;
+	state->brush.drops = 200;
 }
 
 static void free_resources(app_state_t *state)
 {
+	sim_worker_free(state->sim_data.worker);
+	timelapse_recorder_free(state->timelapse);
+	terrain_archive_writer_free(state->archive_writer);
+	erosion_preview_free(state->preview);
+	terrain_free(state->preview_terrain);
+	free(state->brush.mask);
+	terrain_builder_free(state->regen.builder);
+	free(state->regen.source);
+	free(state->regen.proxy_source);
+	terrain_free(state->regen.proxy);
 	terrain_free(state->terrain);
 	camera_free(state->camera);
 }
 
-static void run_simulation(terrain_t *t, const erosion_desc_t *params, int iterations)
+static void run_simulation(terrain_t *t, const erosion_desc_t *params, erosion_state_t *state, int iterations)
+{
+	erosion_run(t, params, state, iterations);
+
+	double start = timer_now();
+	terrain_update_mesh(t);
+	state->stats.mesh_seconds += timer_now() - start;
+}
+
+static void draw_erosion_stats(const erosion_stats_t *stats)
 {
-	for (int i = 0; i < iterations; i++)
+	float budget = (float)(stats->steps + stats->saved_steps);
+	igText("Steps: %llu (%llu effective, %llu no-op)", (unsigned long long)stats->steps, (unsigned long long)stats->effective_steps, (unsigned long long)stats->noop_steps);
+	igText("Steps saved by early termination: %llu (%.1f%%)", (unsigned long long)stats->saved_steps, budget > 0 ? 100.0f * stats->saved_steps / budget : 0.0f);
+	igText("Average path length: %.2f", erosion_stats_avg_path_length(stats));
+	igText("Killed by bounds: %llu, water: %llu, velocity: %llu, pit: %llu", (unsigned long long)stats->out_of_bounds_kills, (unsigned long long)stats->water_kills, (unsigned long long)stats->velocity_kills, (unsigned long long)stats->pit_kills);
+	igText("Eroded: %.3f, deposited: %.3f", stats->eroded, stats->deposited);
+	igText("Max brush clip: %u cells", stats->max_brush_clip);
+	igText("Simulate: %.3fs, mesh: %.3fs", stats->simulate_seconds, stats->mesh_seconds);
+}
+
+static bool is_archive_path(const char *path)
+{
+	size_t len = strlen(path);
+	size_t ext_len = strlen(TERRAIN_ARCHIVE_EXTENSION);
+	return len > ext_len && strcmp(path + len - ext_len, TERRAIN_ARCHIVE_EXTENSION) == 0;
+}
+
+static void archive_io(app_state_t *state, bool import)
+{
+	if (import)
 	{
-		hydraulic_erosion(t, params);
+		terrain_archive_t *archive = terrain_archive_create(&(terrain_archive_desc_t){ .path = state->heightmap_path });
+		if (archive != NULL && terrain_archive_load(archive, &(terrain_archive_region_t){ 0 }, state->terrain))
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Loaded %ux%u archive, %u levels",
+				archive->size.w, archive->size.h, archive->level_count);
+		}
+		else
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Failed to load %s", state->heightmap_path);
+		}
+		terrain_archive_free(archive);
+		return;
 	}
-	terrain_update_mesh(t);
+
+	if (state->archive_writer != NULL && terrain_archive_writer_busy(state->archive_writer))
+	{
+		snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Still writing the previous archive");
+		return;
+	}
+
+	// the writer is bound to its path, and idle here, so replacing it is free
+	terrain_archive_writer_free(state->archive_writer);
+	state->archive_writer = terrain_archive_writer_create(&(terrain_archive_writer_desc_t){ .path = state->heightmap_path });
+	terrain_archive_writer_submit(state->archive_writer, state->terrain, &state->erosion_desc, &state->sim_data.erosion);
+	snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Writing archive...");
+}
+
+static void submit_preview(app_state_t *state)
+{
+	if (state->preview == NULL)
+	{
+		terrain_t *terrain = state->terrain;
+		state->preview = erosion_preview_create(&(erosion_preview_desc_t){
+			.base = terrain->height_map,
+			.base_size = terrain->size,
+			.size = EROSION_PREVIEW_DEFAULT_SIZE,
+			.seed = (uint32_t)terrain->seed,
+		});
+		state->preview_terrain->scale_scalar = terrain->scale_scalar * state->preview->stride;
+		state->preview_ready = false;
+	}
+
+	erosion_preview_submit(state->preview, &state->erosion_desc, (uint64_t)state->config.iterations);
+}
+
+// the terrain the preview was taken from is about to change or be eroded
+static void stop_preview(app_state_t *state)
+{
+	erosion_preview_free(state->preview);
+	state->preview = NULL;
+	state->preview_ready = false;
+}
+
+static void update_preview(app_state_t *state)
+{
+	// a new base is taken once the terrain has settled again
+	if (state->preview_enabled && state->preview == NULL && !state->regen.active) submit_preview(state);
+	if (state->preview != NULL && erosion_preview_poll(state->preview, state->preview_terrain)) state->preview_ready = true;
+}
+
+static void update_brush(app_state_t *state)
+{
+	app_brush_t *brush = &state->brush;
+	brush->hovering = false;
+	if (!brush->enabled || state->mode == APP_MODE_SIMULATE || state->regen.active) return;
+
+	ImGuiIO *io = igGetIO();
+	if (io->WantCaptureMouse && !brush->painting) return;
+
+	vec2 ndc = { 2.0f * io->MousePos.x / io->DisplaySize.x - 1.0f, 1.0f - 2.0f * io->MousePos.y / io->DisplaySize.y };
+	vec3 origin, direction;
+	camera_screen_ray(state->camera, ndc, origin, direction);
+	brush->hovering = terrain_raycast(state->terrain, origin, direction, APP_BRUSH_RAY_DISTANCE, brush->hit);
+	if (!brush->hovering || !brush->painting) return;
+
+	// the square under the brush clipped to the map, weighted with a smooth
+	// falloff towards the rim
+	terrain_t *terrain = state->terrain;
+	int radius = brush->radius;
+	int x0 = (int)brush->hit[0] - radius, z0 = (int)brush->hit[1] - radius;
+	int x1 = (int)brush->hit[0] + radius, z1 = (int)brush->hit[1] + radius;
+	if (x0 < 0) x0 = 0;
+	if (z0 < 0) z0 = 0;
+	if (x1 > (int)terrain->size.w - 1) x1 = (int)terrain->size.w - 1;
+	if (z1 > (int)terrain->size.h - 1) z1 = (int)terrain->size.h - 1;
+
+	erosion_region_t region = {
+		.origin = { .x = (uint32_t)x0, .y = (uint32_t)z0 },
+		.size = { .w = (uint32_t)(x1 - x0 + 1), .h = (uint32_t)(z1 - z0 + 1) },
+	};
+	brush->mask = realloc(brush->mask, (size_t)region.size.w * region.size.h * sizeof(float));
+	for (uint32_t z = 0; z < region.size.h; z++)
+	{
+		for (uint32_t x = 0; x < region.size.w; x++)
+		{
+			float dx = (x0 + x + 0.5f - brush->hit[0]) / radius;
+			float dz = (z0 + z + 0.5f - brush->hit[1]) / radius;
+			float falloff = 1.0f - (dx * dx + dz * dz);
+			brush->mask[x + z * region.size.w] = falloff > 0.0f ? falloff * falloff : 0.0f;
+		}
+	}
+	region.mask = brush->mask;
+
+	erosion_region_t changed;
+	double start = timer_now();
+	erosion_run_region(terrain, &state->erosion_desc, &region, &brush->erosion, brush->drops, &changed);
+	double mesh_start = timer_now();
+	terrain_update_mesh_region(terrain, changed.origin, changed.size);
+	brush->erosion_ms = (mesh_start - start) * 1000.0;
+	brush->mesh_ms = (timer_now() - mesh_start) * 1000.0;
+	brush->changed = changed.size;
+}
+
+static void update_proxy(app_state_t *state)
+{
+	app_regen_t *regen = &state->regen;
+	terrain_build_t *target = &regen->target;
+
+	// every stride'th sample of the target, spread as far apart
+	uint32_t longest = target->size.w > target->size.h ? target->size.w : target->size.h;
+	uint32_t stride = (longest + APP_REGEN_PROXY_SIZE - 1) / APP_REGEN_PROXY_SIZE;
+	uvec2 size = { .w = (target->size.w - 1) / stride + 1, .h = (target->size.h - 1) / stride + 1 };
+	if (size.w < 2) size.w = 2;
+	if (size.h < 2) size.h = 2;
+
+	// a proxy that cannot be resized keeps showing the last one
+	terrain_t *proxy = regen->proxy;
+	proxy->seed = target->seed;
+	proxy->scale_scalar = target->scale_scalar * (float)stride;
+	if (target->source != NULL)
+	{
+		if (!terrain_allocate(proxy, size)) return;
+		resample(regen->proxy_source, regen->proxy_source_size, proxy->height_map, size, target->filter);
+		terrain_update_mesh(proxy);
+	}
+	else
+	{
+		terrain_resize(proxy, size);
+	}
+}
+
+// false if the copies cannot be allocated, nothing is captured then
+static bool capture_source(app_state_t *state)
+{
+	app_regen_t *regen = &state->regen;
+	terrain_t *terrain = state->terrain;
+
+	// the proxy resamples a point sampled copy, not the full map
+	uint32_t longest = terrain->size.w > terrain->size.h ? terrain->size.w : terrain->size.h;
+	uint32_t stride = (longest + APP_REGEN_PROXY_SIZE - 1) / APP_REGEN_PROXY_SIZE;
+	uvec2 size = { .w = (terrain->size.w - 1) / stride + 1, .h = (terrain->size.h - 1) / stride + 1 };
+
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+	regen->source = malloc(count * sizeof(float));
+	regen->proxy_source = malloc((size_t)size.w * size.h * sizeof(float));
+	if (regen->source == NULL || regen->proxy_source == NULL)
+	{
+		free(regen->source);
+		free(regen->proxy_source);
+		regen->source = NULL;
+		regen->proxy_source = NULL;
+		return false;
+	}
+
+	memcpy(regen->source, terrain->height_map, count * sizeof(float));
+	regen->target.source = regen->source;
+	regen->target.source_size = terrain->size;
+	regen->proxy_source_size = size;
+	for (uint32_t y = 0; y < size.h; y++)
+	{
+		for (uint32_t x = 0; x < size.w; x++)
+		{
+			regen->proxy_source[x + y * size.w] = terrain->height_map[x * stride + (size_t)y * stride * terrain->size.w];
+		}
+	}
+	return true;
+}
+
+static void request_regen(app_state_t *state, bool noise)
+{
+	app_regen_t *regen = &state->regen;
+	if (!regen->active)
+	{
+		regen->target.source = NULL;
+		if (!noise && state->resize_filter < RESAMPLE_FILTER_COUNT__ && !capture_source(state))
+		{
+			// without a copy a resample would fall back to noise, keep the terrain
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Not enough memory to resize to %ux%u",
+				regen->target.size.w, regen->target.size.h);
+			return;
+		}
+		regen->active = true;
+	}
+	else if (noise)
+	{
+		// new noise replaces the heights for the rest of the edit
+		regen->target.source = NULL;
+	}
+	stop_preview(state);
+	regen->target.filter = state->resize_filter < RESAMPLE_FILTER_COUNT__ ? (resample_filter_t)state->resize_filter : RESAMPLE_FILTER_BICUBIC;
+
+	// whatever is being built is stale now
+	terrain_builder_cancel(regen->builder);
+	regen->changed = timer_now();
+	update_proxy(state);
+}
+
+static void end_regen(app_state_t *state)
+{
+	app_regen_t *regen = &state->regen;
+	regen->active = false;
+	regen->target.source = NULL;
+	free(regen->source);
+	free(regen->proxy_source);
+	regen->source = NULL;
+	regen->proxy_source = NULL;
+}
+
+static void update_regen(app_state_t *state)
+{
+	app_regen_t *regen = &state->regen;
+	if (!regen->active) return;
+
+	if (regen->changed > 0.0 && timer_now() - regen->changed >= APP_REGEN_SETTLE_SECONDS)
+	{
+		terrain_builder_submit(regen->builder, &regen->target);
+		regen->changed = 0.0;
+	}
+
+	// idle before the poll, so a build finishing in between is still applied
+	bool idle = regen->changed == 0.0 && !terrain_builder_busy(regen->builder);
+	terrain_builder_poll(regen->builder, state->terrain);
+	if (idle) end_regen(state);
+}
+
+// builds the edited terrain right away, for anything that needs it now
+static void finish_regen(app_state_t *state)
+{
+	app_regen_t *regen = &state->regen;
+	if (!regen->active) return;
+
+	if (regen->changed > 0.0) terrain_builder_submit(regen->builder, &regen->target);
+	regen->changed = 0.0;
+	terrain_builder_flush(regen->builder);
+	terrain_builder_poll(regen->builder, state->terrain);
+	end_regen(state);
+}
+
+static bool import_heightmap(app_state_t *state, heightmap_format_t format, heightmap_info_t *info)
+{
+	uvec2 size = state->terrain->size;
+	if (!heightmap_load(state->heightmap_path, format, state->terrain, info)) return false;
+
+	if (state->import_resample && (info->size.w != size.w || info->size.h != size.h))
+	{
+		resample_filter_t filter = state->resize_filter < RESAMPLE_FILTER_COUNT__ ? (resample_filter_t)state->resize_filter : RESAMPLE_FILTER_BICUBIC;
+		return terrain_resample(state->terrain, size, filter);
+	}
+	return true;
+}
+
+static void draw_heightmap_io(app_state_t *state)
+{
+	igInputText("Path", state->heightmap_path, sizeof(state->heightmap_path), 0, NULL, NULL);
+	igCheckbox("Resample to Terrain Size", &state->import_resample);
+	bool import = igButton("Import", (ImVec2){ 0, 0 }); igSameLine(0.0f, -1.0f);
+	bool export = igButton("Export", (ImVec2){ 0, 0 });
+	if (import || export) finish_regen(state);
+	if (import) stop_preview(state);
+
+	terrain_archive_writer_t *writer = state->archive_writer;
+	// counters are stable once the writer is idle
+	if (writer != NULL && !terrain_archive_writer_busy(writer) && writer->written + writer->failed > 0)
+	{
+		snprintf(state->heightmap_status, sizeof(state->heightmap_status), writer->written > 0 ? "Archive written in %.2fs" : "Failed to write archive",
+			writer->write_seconds);
+		terrain_archive_writer_free(writer);
+		state->archive_writer = NULL;
+	}
+
+	mesh_export_format_t mesh_format = mesh_export_format_from_path(state->heightmap_path);
+	if ((import || export) && is_archive_path(state->heightmap_path))
+	{
+		archive_io(state, import);
+	}
+	else if (export && mesh_format != MESH_EXPORT_FORMAT_COUNT__)
+	{
+		mesh_export_stats_t stats;
+		if (mesh_export(state->terrain, &(mesh_export_desc_t){ .path = state->heightmap_path, .format = mesh_format }, &stats))
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Exported %llu triangles in %.2fs",
+				(unsigned long long)stats.triangles, stats.seconds);
+		}
+		else
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Failed to export %s", state->heightmap_path);
+		}
+	}
+	else if (import || export)
+	{
+		heightmap_format_t format = heightmap_format_from_path(state->heightmap_path);
+		heightmap_info_t info;
+		if (format == HEIGHTMAP_FORMAT_COUNT__)
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Use a .png, .pgm, .raw or " TERRAIN_ARCHIVE_EXTENSION " path, or .obj, .ply or .glb to export the mesh");
+		}
+		else if (import && import_heightmap(state, format, &info))
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Imported %ux%u, heights %.3f to %.3f",
+				info.size.w, info.size.h, info.min_height, info.max_height);
+		}
+		else if (export && heightmap_save(state->heightmap_path, format, state->terrain, &info))
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Exported %ux%u, heights %.3f to %.3f",
+				info.size.w, info.size.h, info.min_height, info.max_height);
+		}
+		else
+		{
+			snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Failed to %s %s", import ? "import" : "export", state->heightmap_path);
+		}
+	}
+
+	if (state->heightmap_status[0] != '\0') igTextUnformatted(state->heightmap_status, NULL);
+}
+
+static void start_timelapse(app_state_t *state)
+{
+	state->timelapse = timelapse_recorder_create(&(timelapse_recorder_desc_t){
+		.path = state->timelapse_path,
+		.size = state->terrain->size,
+		.interval_drops = (uint64_t)(state->config.timelapse_drops > 0 ? state->config.timelapse_drops : 1),
+		.compress = true,
+	});
+	if (state->timelapse == NULL)
+	{
+		snprintf(state->timelapse_status, sizeof(state->timelapse_status), "Failed to create %s", state->timelapse_path);
+		return;
+	}
+
+	timelapse_recorder_submit(state->timelapse, state->terrain, state->sim_data.erosion.next_drop);
+	state->timelapse_status[0] = '\0';
+}
+
+static void stop_timelapse(app_state_t *state)
+{
+	timelapse_recorder_t *recorder = state->timelapse;
+	if (recorder == NULL) return;
+
+	// end on the final terrain, even if the last poll found the queue full
+	uint64_t drop = state->sim_data.erosion.next_drop;
+	if (recorder->queued_drop != drop)
+	{
+		timelapse_recorder_flush(recorder);
+		timelapse_recorder_submit(recorder, state->terrain, drop);
+	}
+	timelapse_recorder_flush(recorder);
+
+	snprintf(state->timelapse_status, sizeof(state->timelapse_status), "Recorded %u frames, %u skipped, %.1f MB",
+		recorder->frames, recorder->skipped, recorder->bytes_written / (1024.0 * 1024.0));
+	timelapse_recorder_free(recorder);
+	state->timelapse = NULL;
 }
 
 static void on_app_configure(app_state_t *state, float delta)
 {
+	update_regen(state);
+	update_preview(state);
+
 	if (igBegin("Configuration", NULL, ImGuiWindowFlags_None))
 	{
 		// animation settings
@@ -84,6 +538,7 @@ static void on_app_configure(app_state_t *state, float delta)
 			}
 
 			igSliderInt("Duration", &state->config.duration, 1, 60, "%d sec", 0);
+			igSliderFloat("Frame Budget", &state->config.frame_budget, 1.0f, 100.0f, "%.1f ms", 0);
 
 			if (!state->config.animate)
 			{
@@ -97,89 +552,235 @@ static void on_app_configure(app_state_t *state, float delta)
 		// terrain settings
 		if (igTreeNodeEx_Str("Terrain", ImGuiTreeNodeFlags_DefaultOpen))
 		{
-			bool reset = false;
-			reset |= igInputInt("Seed", &state->terrain->seed, INT_MIN, INT_MAX, ImGuiInputTextFlags_EnterReturnsTrue);
-			reset |= igDragInt2("Size", state->terrain->size.size, 1, 2, 10000, "%d", 0);
-			reset |= igDragFloat("Scale", &state->terrain->scale_scalar, 0.05f, 0.01f, 100.0f, "%.2f", 0);
+			static const char *resize_modes[RESAMPLE_FILTER_COUNT__ + 1] = { "Bilinear", "Bicubic", "Lanczos", "Regenerate" };
 
-			if (reset)
+			// edits go to the target, the terrain follows once it is built
+			terrain_build_t *target = &state->regen.target;
+			if (!state->regen.active)
 			{
-				terrain_reset(state->terrain);
+				target->size = state->terrain->size;
+				target->seed = state->terrain->seed;
+				target->scale_scalar = state->terrain->scale_scalar;
 			}
+
+			bool noise = igInputInt("Seed", &target->seed, INT_MIN, INT_MAX, ImGuiInputTextFlags_EnterReturnsTrue);
+			bool resize = igDragInt2("Size", (int *)target->size.size, 1, 2, 10000, "%d", 0);
+			noise |= igDragFloat("Scale", &target->scale_scalar, 0.05f, 0.01f, 100.0f, "%.2f", 0);
+			igCombo_Str_arr("On Resize", &state->resize_filter, resize_modes, RESAMPLE_FILTER_COUNT__ + 1, -1);
+
+			if (noise || resize) request_regen(state, noise);
+			if (state->regen.active) igTextUnformatted("Building terrain...", NULL);
+			igTreePop();
+		}
+
+		// heightmap files
+		if (igTreeNodeEx_Str("Heightmap", 0))
+		{
+			draw_heightmap_io(state);
 			igTreePop();
 		}
 
 		// erosion settings
+		bool changed = false;
 		if (igTreeNodeEx_Str("Erosion", ImGuiTreeNodeFlags_DefaultOpen))
 		{
-			igInputInt("Drop Lifetime", &state->erosion_desc.drop_lifetime, 0, INT_MAX, 0);
-			igSliderFloat("Inertia", &state->erosion_desc.inertia, 0, 1, "%.2f", 0);
-			igDragFloat("Capacity Multiplier", &state->erosion_desc.capacity, 0.1f, 1.0f, FLT_MAX, "%.2f", 0);
-			igDragFloat("Minimum Capacity", &state->erosion_desc.min_capacity, 0.1f, 0.0f, FLT_MAX, "%.2f", 0);
-			igDragFloat("Deposition Speed", &state->erosion_desc.deposition, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
-			igDragFloat("Erosion Speed", &state->erosion_desc.erosion, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
-			igDragInt("Erosion Radius", &state->erosion_desc.radius, 1, 1, 100, "%d", 0);
-			igDragFloat("Gravity", &state->erosion_desc.gravity, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
-			igDragFloat("Evaporation Speed", &state->erosion_desc.evaporation, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
+			if (igCheckbox("Live Preview", &state->preview_enabled))
+			{
+				// the brush paints the terrain the preview would hide
+				if (state->preview_enabled) state->brush.enabled = false;
+				else stop_preview(state);
+			}
+			if (state->preview != NULL) igText("Previewing on %ux%u", state->preview->size.w, state->preview->size.h);
+
+			changed |= igInputInt("Drop Lifetime", &state->erosion_desc.drop_lifetime, 0, INT_MAX, 0);
+			changed |= igSliderFloat("Inertia", &state->erosion_desc.inertia, 0, 1, "%.2f", 0);
+			changed |= igDragFloat("Capacity Multiplier", &state->erosion_desc.capacity, 0.1f, 1.0f, FLT_MAX, "%.2f", 0);
+			changed |= igDragFloat("Minimum Capacity", &state->erosion_desc.min_capacity, 0.1f, 0.0f, FLT_MAX, "%.2f", 0);
+			changed |= igDragFloat("Deposition Speed", &state->erosion_desc.deposition, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
+			changed |= igDragFloat("Erosion Speed", &state->erosion_desc.erosion, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
+			changed |= igDragInt("Erosion Radius", &state->erosion_desc.radius, 1, 1, 100, "%d", 0);
+			changed |= igDragFloat("Gravity", &state->erosion_desc.gravity, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
+			changed |= igDragFloat("Evaporation Speed", &state->erosion_desc.evaporation, 0.1f, 0.01f, FLT_MAX, "%.2f", 0);
+
+			if (igTreeNodeEx_Str("Early Termination", 0))
+			{
+				changed |= igDragFloat("Minimum Water", &state->erosion_desc.min_water, 0.001f, 0.0f, 1.0f, "%.3f", 0);
+				changed |= igDragFloat("Minimum Velocity", &state->erosion_desc.min_velocity, 0.01f, 0.0f, FLT_MAX, "%.2f", 0);
+				changed |= igDragInt("Max Pit Steps", &state->erosion_desc.max_pit_steps, 1, 0, INT_MAX, "%d", 0);
+				igTreePop();
+			}
+
+			igTreePop();
+		}
 
+		// erosion brush
+		if (igTreeNodeEx_Str("Brush", 0))
+		{
+			app_brush_t *brush = &state->brush;
+			if (igCheckbox("Erosion Brush", &brush->enabled) && brush->enabled)
+			{
+				erosion_state_init(&brush->erosion, (uint32_t)time(0));
+				state->preview_enabled = false;
+				stop_preview(state);
+			}
+			igDragInt("Brush Radius", &brush->radius, 1, 1, 500, "%d cells", 0);
+			igDragInt("Drops per Frame", &brush->drops, 10, 1, 100000, "%d", 0);
+			if (brush->hovering) igText("Cursor at %.0f, %.0f", brush->hit[0], brush->hit[1]);
+			igText("Last stroke: %.2f ms erosion, %.2f ms mesh for %ux%u cells", brush->erosion_ms, brush->mesh_ms, brush->changed.w, brush->changed.h);
 			igTreePop();
 		}
 
 		// simulation settings
 		if (igTreeNodeEx_Str("Simulation", ImGuiTreeNodeFlags_DefaultOpen))
 		{
-			igInputInt("Iterations", &state->config.iterations, 1, 100, 0);
+			changed |= igInputInt("Iterations", &state->config.iterations, 1, 100, 0);
+			igCheckbox("Record Timelapse", &state->config.record_timelapse);
+			if (state->config.record_timelapse)
+			{
+				igInputText("Timelapse Path", state->timelapse_path, sizeof(state->timelapse_path), 0, NULL, NULL);
+				igInputInt("Drops per Frame", &state->config.timelapse_drops, 1000, 10000, 0);
+			}
+			if (state->timelapse_status[0] != '\0') igTextUnformatted(state->timelapse_status, NULL);
 			igTreePop();
 		}
 
+		// the preview drops anything it was running and starts over
+		if (changed && state->preview != NULL) submit_preview(state);
+
 		// start the simulation
 		if (igButton("Start", (ImVec2){ 0, 0 }))
 		{
+			finish_regen(state);
+			stop_preview(state);
 			memset(&state->sim_data, 0, sizeof(state->sim_data));
+			erosion_state_init(&state->sim_data.erosion, (uint32_t)time(0));
+			frame_pacer_init(&state->sim_data.pacer, &(frame_pacer_desc_t){
+				.total_drops = state->config.iterations,
+				.duration = (float)state->config.duration,
+				.frame_budget_ms = state->config.frame_budget,
+			});
+			if (state->config.record_timelapse) start_timelapse(state);
 			state->mode = APP_MODE_SIMULATE;
 		}
 	}
 	igEnd();
 }
 
-static void on_app_simulate(app_state_t *state, float delta)
+static void update_mesh_timed(app_state_t *state)
 {
-	if (!state->config.animate)
-	{
-		float start = glfwGetTime();
-		run_simulation(state->terrain, &state->erosion_desc, state->config.iterations);
-		float end = glfwGetTime();
+	double start = timer_now();
+	terrain_update_mesh(state->terrain);
+	state->sim_data.erosion.stats.mesh_seconds += timer_now() - start;
+}
 
-		state->sim_data.cur_iterations = state->config.iterations;
-		state->sim_data.duration = end - start;
-		state->mode = APP_MODE_COMPLETE;
+static void simulate_background(app_state_t *state, float delta)
+{
+	app_simulation_data_t *sim = &state->sim_data;
+
+	if (sim->worker == NULL)
+	{
+		sim->worker = sim_worker_create(&(sim_worker_desc_t){
+			.terrain = state->terrain,
+			.params = state->erosion_desc,
+			.state = sim->erosion,
+			.total_drops = state->config.iterations,
+			.publish_interval = 0.1,
+			.timelapse = state->timelapse,
+		});
 	}
-	else
+
+	sim->duration += delta / 1000.0f;
+	sim->cur_iterations = (int)sim_worker_progress(sim->worker);
+
+	if (sim_worker_poll(sim->worker, state->terrain)) update_mesh_timed(state);
+
+	if (sim_worker_finished(sim->worker))
 	{
-		float delta_seconds = delta / 1000.0f;
+		// the worker's state does not know about the mesh updates done here
+		double mesh_seconds = sim->erosion.stats.mesh_seconds;
+		sim_worker_join(sim->worker, &sim->erosion);
+		sim->erosion.stats.mesh_seconds = mesh_seconds;
 
-		int delta_iter = (int)((float)state->config.iterations / (float)state->config.duration) * delta_seconds;
-		int remaining_iter = state->config.iterations - state->sim_data.cur_iterations;
-		int iterations = fmin((float)remaining_iter, delta_iter);
-		run_simulation(state->terrain, &state->erosion_desc, iterations);
+		if (sim_worker_poll(sim->worker, state->terrain)) update_mesh_timed(state);
 
-		state->sim_data.cur_iterations += iterations;
-		state->sim_data.duration += delta_seconds;
+		sim->cur_iterations = (int)sim_worker_progress(sim->worker);
+		sim_worker_free(sim->worker);
+		sim->worker = NULL;
+		state->mode = APP_MODE_COMPLETE;
+		return;
+	}
 
-		if (igBegin("Simulation Data", NULL, 0))
-		{
-			float progress = ((float)state->sim_data.cur_iterations / (float)state->config.iterations);
-			igProgressBar(progress, (ImVec2){ -FLT_MIN, 0 }, "Progress");
-			igValue_Int("Iterations", state->sim_data.cur_iterations);
-			igText("Duration: %f", state->sim_data.duration);
-		}
-		igEnd();
+	if (igBegin("Simulation Data", NULL, 0))
+	{
+		float progress = ((float)sim->cur_iterations / (float)state->config.iterations);
+		igProgressBar(progress, (ImVec2){ -FLT_MIN, 0 }, "Progress");
+		igValue_Int("Iterations", sim->cur_iterations);
+		igText("Duration: %f", sim->duration);
+		igText("Droplets/sec: %.0f", sim->duration > 0 ? sim->cur_iterations / sim->duration : 0.0f);
 
-		if (state->sim_data.cur_iterations >= state->config.iterations)
+		if (igButton("Cancel", (ImVec2){ 0, 0 }))
 		{
-			state->mode = APP_MODE_COMPLETE;
+			sim_worker_cancel(sim->worker);
+			sim->cancelled = true;
 		}
 	}
+	igEnd();
+}
+
+static void simulate_animated(app_state_t *state, float delta)
+{
+	float delta_seconds = delta / 1000.0f;
+	frame_pacer_t *pacer = &state->sim_data.pacer;
+
+	int iterations = frame_pacer_next(pacer, delta_seconds);
+	if (iterations > 0)
+	{
+		erosion_state_t *erosion = &state->sim_data.erosion;
+		double simulate_start = erosion->stats.simulate_seconds;
+		double mesh_start = erosion->stats.mesh_seconds;
+
+		run_simulation(state->terrain, &state->erosion_desc, erosion, iterations);
+		if (state->timelapse != NULL) timelapse_recorder_poll(state->timelapse, state->terrain, erosion->next_drop);
+
+		frame_pacer_report(pacer, iterations,
+			(erosion->stats.simulate_seconds - simulate_start) * 1000.0,
+			(erosion->stats.mesh_seconds - mesh_start) * 1000.0);
+	}
+
+	state->sim_data.cur_iterations += iterations;
+	state->sim_data.duration += delta_seconds;
+
+	if (igBegin("Simulation Data", NULL, 0))
+	{
+		float progress = ((float)state->sim_data.cur_iterations / (float)state->config.iterations);
+		igProgressBar(progress, (ImVec2){ -FLT_MIN, 0 }, "Progress");
+		igValue_Int("Iterations", state->sim_data.cur_iterations);
+		igText("Duration: %f", state->sim_data.duration);
+		igText("Behind schedule: %d drops", frame_pacer_target(pacer) - state->sim_data.cur_iterations);
+		igText("Estimated remaining: %.1f sec", frame_pacer_estimated_remaining(pacer));
+		igText("Droplets/ms: %.1f, mesh update: %.2fms", pacer->drops_per_ms, pacer->mesh_ms);
+		draw_erosion_stats(&state->sim_data.erosion.stats);
+	}
+	igEnd();
+
+	if (state->sim_data.cur_iterations >= state->config.iterations)
+	{
+		state->mode = APP_MODE_COMPLETE;
+	}
+}
+
+static void on_app_simulate(app_state_t *state, float delta)
+{
+	if (!state->config.animate)
+	{
+		simulate_background(state, delta);
+	}
+	else
+	{
+		simulate_animated(state, delta);
+	}
+
+	if (state->mode == APP_MODE_COMPLETE) stop_timelapse(state);
 }
 
 static void on_app_complete(app_state_t *state, float delta)
@@ -188,15 +789,22 @@ static void on_app_complete(app_state_t *state, float delta)
 	igSetNextWindowPos((ImVec2){ io->DisplaySize.x * 0.5f, io->DisplaySize.y * 0.5f }, ImGuiCond_Once, (ImVec2){ 0.5f,0.5f });
 	if (igBegin("Simulation Complete", NULL, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings))
 	{
-		igText("Simulation complete!");
+		if (state->sim_data.cancelled) igText("Simulation cancelled!");
+		else igText("Simulation complete!");
 		igText("%d iterations run in %f seconds", state->sim_data.cur_iterations, state->sim_data.duration);
+		draw_erosion_stats(&state->sim_data.erosion.stats);
+		if (state->timelapse_status[0] != '\0') igTextUnformatted(state->timelapse_status, NULL);
+
 		bool reset = igButton("Reset", (ImVec2){ 0, 0 }); igSameLine(0.0f, -1.0f);
 		bool continue_ = igButton("Continue", (ImVec2){ 0, 0 });
 
 		if (reset)
 		{
 			state->mode = APP_MODE_CONFIGURE;
-			terrain_reset(state->terrain);
+			if (!terrain_reset(state->terrain))
+			{
+				snprintf(state->heightmap_status, sizeof(state->heightmap_status), "Failed to reset the terrain");
+			}
 		}
 		else if (continue_)
 		{
@@ -255,6 +863,8 @@ bool app_init(app_state_t *state)
 
 	// subscribe to events
 	event_subscribe(state->event_bus, EVENT_TYPE_WINDOW_CLOSE, EVENT_LAYER_APP, state, (event_callback_fn_t)on_window_close);
+	event_subscribe(state->event_bus, EVENT_TYPE_MOUSE_PRESS, EVENT_LAYER_APP, state, (event_callback_fn_t)on_brush_press);
+	event_subscribe(state->event_bus, EVENT_TYPE_MOUSE_RELEASE, EVENT_LAYER_APP, state, (event_callback_fn_t)on_brush_release);
 
 	return true;
 }
@@ -285,6 +895,7 @@ void app_run(app_state_t *state)
 			on_app_complete(state, delta);
 			break;
 		}
+		update_brush(state);
 		on_app_any(state, delta);
 
 		imgui_context_end(state->imgui);
@@ -295,7 +906,9 @@ void app_run(app_state_t *state)
 			.depth = 1,
 		});
 
-		terrain_draw(state->camera, (vec3) { 0.0f, 100.0f, 0.0f }, state->terrain);
+		terrain_t *terrain = state->regen.active ? state->regen.proxy : state->terrain;
+		if (state->mode == APP_MODE_CONFIGURE && state->preview_ready) terrain = state->preview_terrain;
+		terrain_draw(state->camera, (vec3) { 0.0f, 100.0f, 0.0f }, terrain);
 
 		imgui_context_render(state->imgui);
 
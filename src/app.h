@@ -10,9 +10,21 @@
 #include "events/event.h"
 #include "gfx/window.h"
 #include "imgui/imgui_context.h"
+#include "io/terrain_archive.h"
+#include "io/timelapse.h"
 #include "erosion.h"
+#include "frame_pacer.h"
+#include "erosion_preview.h"
+#include "sim_worker.h"
+#include "terrain_builder.h"
 
 #define APP_NAME "Hydraulic Erosion"
+// longest side of the terrain shown while an edit is being built
+#define APP_REGEN_PROXY_SIZE (256)
+// how long size and scale have to stay put before a build starts
+#define APP_REGEN_SETTLE_SECONDS (0.25)
+// how far the brush looks for the terrain under the cursor, the far plane
+#define APP_BRUSH_RAY_DISTANCE (1000.0f)
 
 typedef enum app_mode_t
 {
@@ -25,22 +37,77 @@ typedef struct app_simulation_config_t
 {
 	bool animate;
 	int duration;
+	float frame_budget;
 
 	int iterations;
+
+	bool record_timelapse;
+	int timelapse_drops;
 } app_simulation_config_t;
 
 #define APP_DEFAULT_CONFIGURATION (app_simulation_config_t) {\
 		.animate = false, \
 		.duration = 10, \
-		.iterations = 200000 \
+		.frame_budget = 12.0f, \
+		.iterations = 200000, \
+		.record_timelapse = false, \
+		.timelapse_drops = 10000 \
 	}
 
 typedef struct app_simulation_data_t
 {
 	int cur_iterations;
 	float duration;
+	erosion_state_t erosion;
+	frame_pacer_t pacer;
+
+	// only set while a non animated run is in progress
+	sim_worker_t *worker;
+	bool cancelled;
 } app_simulation_data_t;
 
+// size, seed and scale edits show a coarse proxy right away, the full
+// terrain is built in the background once the values settle
+typedef struct app_regen_t
+{
+	terrain_builder_t *builder;
+	terrain_t *proxy;
+
+	// the settings the panel shows, the terrain takes them on once built
+	terrain_build_t target;
+	// heights a resize resamples from, and a coarse copy for the proxy
+	float *source;
+	float *proxy_source;
+	uvec2 proxy_source_size;
+
+	// time of the last edit, zero once it has been submitted
+	double changed;
+	// the proxy is drawn instead of the terrain
+	bool active;
+} app_regen_t;
+
+// paints erosion under the cursor while the left button is held. drops only
+// spawn under the brush, and only the cells they changed are re-meshed
+typedef struct app_brush_t
+{
+	bool enabled;
+	bool painting;
+	int radius;
+	int drops;
+	erosion_state_t erosion;
+	// spawn weights of the cells under the brush
+	float *mask;
+
+	// grid position under the cursor, only valid while hovering
+	bool hovering;
+	vec2 hit;
+
+	// cost of the last frame painted
+	double erosion_ms;
+	double mesh_ms;
+	uvec2 changed;
+} app_brush_t;
+
 typedef struct app_state_t
 {
 	bool running;
@@ -55,6 +122,34 @@ typedef struct app_state_t
 	erosion_desc_t erosion_desc;
 
 	terrain_t *terrain;
+	// size changes resample the heights with this filter,
+	// RESAMPLE_FILTER_COUNT__ generates new noise instead
+	int resize_filter;
+	app_regen_t regen;
+
+	// erosion parameter changes rerun a preview on a downsampled copy of the
+	// terrain, the full run only happens on Start
+	bool preview_enabled;
+	erosion_preview_t *preview;
+	terrain_t *preview_terrain;
+	// set once the preview terrain holds a finished preview
+	bool preview_ready;
+
+	app_brush_t brush;
+
+	// heightmap import and export, the format follows the extension
+	char heightmap_path[256];
+	char heightmap_status[128];
+	// fit imports to the current size instead of taking on theirs
+	bool import_resample;
+	// .hta paths go to a terrain archive, written in the background
+	terrain_archive_writer_t *archive_writer;
+
+	// only set while a simulation is being recorded
+	timelapse_recorder_t *timelapse;
+	char timelapse_path[256];
+	// holds a message around the full path
+	char timelapse_status[sizeof("Failed to create ") + 256];
 
 	camera_t *camera;
 } app_state_t;
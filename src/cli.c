@@ -0,0 +1,1173 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "components/terrain.h"
+#include "core/crc32.h"
+#include "core/job.h"
+#include "core/perf_counter.h"
+#include "core/timer.h"
+#include "io/checkpoint.h"
+#include "io/height_codec.h"
+#include "io/heightmap.h"
+#include "io/mesh_export.h"
+#include "io/terrain_archive.h"
+#include "io/timelapse.h"
+#include "io/tile_store.h"
+#include "math/noise.h"
+#include "erosion.h"
+#include "erosion_parallel.h"
+#include "erosion_sweep.h"
+#include "erosion_tiled.h"
+
+typedef struct cli_options_t
+{
+	terrain_desc_t terrain;
+	erosion_desc_t erosion;
+	int iterations;
+	uint32_t erosion_seed;
+	bool erosion_seed_set;
+
+	bool parallel;
+	erosion_parallel_desc_t parallel_desc;
+
+	bool wavefront;
+	erosion_wavefront_desc_t wavefront_desc;
+
+	bool deltas;
+	erosion_delta_desc_t delta_desc;
+
+	bool speculative;
+	erosion_speculative_desc_t speculative_desc;
+
+	bool atomic;
+	erosion_atomic_desc_t atomic_desc;
+
+	bool region;
+	erosion_region_t region_desc;
+	bool compare_serial;
+	bool perf;
+
+	job_system_desc_t jobs;
+
+	const char *checkpoint_path;
+	int checkpoint_drops;
+	float checkpoint_seconds;
+	bool checkpoint_compress;
+	const char *resume_path;
+
+	const char *tiled_path;
+	int tile_size;
+	int tile_cache;
+	int tile_halo;
+
+	erosion_sweep_desc_t sweep;
+	const char *sweep_csv_path;
+
+	const char *import_path;
+	const char *export_path;
+	const char *mesh_path;
+	int mesh_stride;
+
+	const char *archive_path;
+	int archive_tile;
+	const char *load_archive_path;
+	terrain_archive_region_t archive_region;
+
+	bool codec_bench;
+	int codec_tile;
+
+	const char *timelapse_path;
+	int timelapse_drops;
+	int timelapse_queue;
+	int timelapse_tile;
+	bool timelapse_compress;
+	const char *replay_path;
+	int replay_frame;
+	const char *resample_filter;
+
+	const char *json_path;
+} cli_options_t;
+
+// drops simulated between checkpoint polls
+#define CLI_BATCH_SIZE (4096)
+#define CLI_PARALLEL_BATCH_SIZE (1 << 20)
+// the wavefront pool drains at the end of every call, so give it more drops
+#define CLI_WAVEFRONT_BATCH_SIZE (1 << 23)
+
+static void print_usage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"terrain:\n"
+		"  --size <w> <h>          terrain size (default 500 500)\n"
+		"  --seed <n>              noise seed (default: current time)\n"
+		"  --scale <f>             noise scale (default 0.4)\n"
+		"  --map <path>            keep the heights in a mapped raw f32 file, eroded in place.\n"
+		"                          an existing file has to match --size\n"
+		"  --map-private <path>    erode a copy on write view of an existing raw f32 file\n"
+		"  --import <path>         start from a .png, .pgm or .raw heightmap instead of noise\n"
+		"  --load-archive <path>   start from a terrain archive instead of noise\n"
+		"  --archive-level <n>     pyramid level to load, 0 is full resolution\n"
+		"  --archive-region <x> <y> <w> <h> load only this part of the level\n"
+		"  --replay <path>         start from a frame of a timelapse instead of noise\n"
+		"  --replay-frame <n>      timelapse frame to start from (default: the last)\n"
+		"  --resample <filter>     resample the loaded heights to --size with bilinear, bicubic or lanczos\n"
+		"\n"
+		"simulation:\n"
+		"  --iterations <n>        droplets to simulate (default 200000)\n"
+		"  --lifetime <n>          droplet lifetime\n"
+		"  --inertia <f>\n"
+		"  --capacity <f>\n"
+		"  --min-capacity <f>\n"
+		"  --deposition <f>\n"
+		"  --erosion <f>\n"
+		"  --radius <n>\n"
+		"  --gravity <f>\n"
+		"  --evaporation <f>\n"
+		"  --min-water <f>         kill droplets with less water than this\n"
+		"  --min-velocity <f>      kill droplets slower than this\n"
+		"  --max-pit-steps <n>     kill droplets stuck in a pit for this many steps\n"
+		"  --erosion-seed <n>      droplet spawn seed (default: terrain seed)\n"
+		"\n"
+		"parallel:\n"
+		"  --parallel <backend>    simulate on 'threads' or worker 'processes' sharing the map\n"
+		"  --workers <n>           workers of any parallel mode (default: hardware concurrency)\n"
+		"  --parallel-tile <n>     tile size, raised to the safe minimum (default 2 * (lifetime + radius + 2))\n"
+		"  --wavefront <n>         advance n drops in flight step by step, sorted by cell (0 for 1048576)\n"
+		"  --sort-interval <n>     wavefront steps between re-sorts (default 1)\n"
+		"  --deltas                simulate lanes in parallel against frozen epochs, reduced in lane order\n"
+		"  --epoch <n>             drops per delta epoch (default 16384)\n"
+		"  --lanes <n>             delta lanes per epoch (default 16)\n"
+		"  --speculative           run drops concurrently, commit in order and replay conflicts, same result as serial\n"
+		"  --spec-batch <n>        drops speculated between commits (default 64 per worker)\n"
+		"  --atomic                share the map between workers with atomic adds, fast but not repeatable\n"
+		"  --region <x> <y> <w> <h> only spawn droplets in this rectangle, they may flow out of it\n"
+		"  --compare-serial        also run the serial engine and report how far the result is from it\n"
+		"  --perf                  count cache misses of the simulation with perf events (linux)\n"
+		"  --jobs <n>              threads in the shared job system (default: hardware concurrency - 1)\n"
+		"  --pin                   pin job system threads to cpus\n"
+		"\n"
+		"checkpoints:\n"
+		"  --checkpoint <path>     write checkpoints to this file in the background\n"
+		"  --checkpoint-drops <n>  checkpoint every n droplets\n"
+		"  --checkpoint-seconds <f> checkpoint every f seconds\n"
+		"  --checkpoint-compress   store checkpoint heights with the lossless height codec\n"
+		"  --resume <path>         continue a run from a checkpoint, up to --iterations in total\n"
+		"\n"
+		"timelapse:\n"
+		"  --timelapse <path>      record the erosion as a timelapse, written in the background\n"
+		"  --timelapse-drops <n>   droplets between frames (default 100000)\n"
+		"  --timelapse-queue <n>   frames waiting for the writer before one is dropped (default 2)\n"
+		"  --timelapse-tile <n>    tile size frames are diffed in, 8 to 4096 (default 128)\n"
+		"  --timelapse-compress    store the changed tiles with the lossless height codec\n"
+		"\n"
+		"out of core:\n"
+		"  --tiled <path>          erode a tile store on disk, created from --size if missing\n"
+		"  --tile-size <n>         tile side length for new stores (default 512)\n"
+		"  --tile-cache <n>        tiles kept in memory (default 16)\n"
+		"  --tile-halo <n>         halo around each tile (default lifetime + radius + 2)\n"
+		"\n"
+		"sweeps:\n"
+		"  --sweep <name=a:b:n>    run n values of a parameter from a to b, repeat for a grid of configs.\n"
+		"                          inertia, capacity, min_capacity, deposition, erosion, evaporation,\n"
+		"                          gravity, radius or lifetime\n"
+		"  --sweep-out <dir>       checkpoint every finished config into this directory\n"
+		"  --sweep-csv <path>      write the results table as csv ('-' for stdout)\n"
+		"\n"
+		"output:\n"
+		"  --export <path>         write the eroded heights as .png, .pgm (16 bit) or .raw (f32)\n"
+		"  --export-mesh <path>    write the eroded terrain mesh as .obj, .ply or .glb\n"
+		"  --mesh-stride <n>       keep every nth sample of the exported mesh (default 1)\n"
+		"  --archive <path>        write the eroded terrain as a tiled archive with a mip pyramid\n"
+		"  --archive-tile <n>      archive tile size, a power of two (default 256)\n"
+		"  --codec-bench           compress the eroded heights losslessly, check the round trip and\n"
+		"                          report ratio and throughput\n"
+		"  --codec-tile <n>        height codec tile size, 8 to 4096 (default 256)\n"
+		"  --json <path>           write the run statistics as json ('-' for stdout)\n",
+		program);
+}
+
+static bool parse_options(int argc, char **argv, cli_options_t *options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		int remaining = argc - i - 1;
+
+#define CLI_INT(NAME, DEST) if (strcmp(arg, NAME) == 0 && remaining >= 1) { DEST = atoi(argv[++i]); continue; }
+#define CLI_FLOAT(NAME, DEST) if (strcmp(arg, NAME) == 0 && remaining >= 1) { DEST = (float)atof(argv[++i]); continue; }
+#define CLI_STRING(NAME, DEST) if (strcmp(arg, NAME) == 0 && remaining >= 1) { DEST = argv[++i]; continue; }
+
+		if (strcmp(arg, "--size") == 0 && remaining >= 2)
+		{
+			options->terrain.size.w = (uint32_t)atoi(argv[++i]);
+			options->terrain.size.h = (uint32_t)atoi(argv[++i]);
+			continue;
+		}
+		CLI_INT("--seed", options->terrain.seed);
+		CLI_FLOAT("--scale", options->terrain.scale_scalar);
+
+		if ((strcmp(arg, "--map") == 0 || strcmp(arg, "--map-private") == 0) && remaining >= 1)
+		{
+			options->terrain.storage = strcmp(arg, "--map") == 0 ? TERRAIN_STORAGE_MAPPED : TERRAIN_STORAGE_MAPPED_PRIVATE;
+			options->terrain.storage_path = argv[++i];
+			continue;
+		}
+
+		CLI_INT("--iterations", options->iterations);
+		CLI_INT("--lifetime", options->erosion.drop_lifetime);
+		CLI_FLOAT("--inertia", options->erosion.inertia);
+		CLI_FLOAT("--capacity", options->erosion.capacity);
+		CLI_FLOAT("--min-capacity", options->erosion.min_capacity);
+		CLI_FLOAT("--deposition", options->erosion.deposition);
+		CLI_FLOAT("--erosion", options->erosion.erosion);
+		CLI_INT("--radius", options->erosion.radius);
+		CLI_FLOAT("--gravity", options->erosion.gravity);
+		CLI_FLOAT("--evaporation", options->erosion.evaporation);
+		CLI_FLOAT("--min-water", options->erosion.min_water);
+		CLI_FLOAT("--min-velocity", options->erosion.min_velocity);
+		CLI_INT("--max-pit-steps", options->erosion.max_pit_steps);
+
+		if (strcmp(arg, "--erosion-seed") == 0 && remaining >= 1)
+		{
+			options->erosion_seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+			options->erosion_seed_set = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--parallel") == 0 && remaining >= 1)
+		{
+			const char *backend = argv[++i];
+			if (strcmp(backend, "threads") == 0) options->parallel_desc.backend = EROSION_PARALLEL_THREADS;
+			else if (strcmp(backend, "processes") == 0) options->parallel_desc.backend = EROSION_PARALLEL_PROCESSES;
+			else
+			{
+				fprintf(stderr, "unknown parallel backend '%s'\n", backend);
+				return false;
+			}
+			options->parallel = true;
+			continue;
+		}
+		CLI_INT("--workers", options->parallel_desc.workers);
+		if (strcmp(arg, "--wavefront") == 0 && remaining >= 1)
+		{
+			options->wavefront_desc.pool_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+			options->wavefront = true;
+			continue;
+		}
+		CLI_INT("--sort-interval", options->wavefront_desc.sort_interval);
+		if (strcmp(arg, "--deltas") == 0)
+		{
+			options->deltas = true;
+			continue;
+		}
+		CLI_INT("--epoch", options->delta_desc.epoch_drops);
+		CLI_INT("--lanes", options->delta_desc.lanes);
+		if (strcmp(arg, "--speculative") == 0)
+		{
+			options->speculative = true;
+			continue;
+		}
+		CLI_INT("--spec-batch", options->speculative_desc.batch_drops);
+		if (strcmp(arg, "--atomic") == 0)
+		{
+			options->atomic = true;
+			continue;
+		}
+		if (strcmp(arg, "--region") == 0 && remaining >= 4)
+		{
+			options->region = true;
+			options->region_desc.origin.x = (uint32_t)atoi(argv[++i]);
+			options->region_desc.origin.y = (uint32_t)atoi(argv[++i]);
+			options->region_desc.size.w = (uint32_t)atoi(argv[++i]);
+			options->region_desc.size.h = (uint32_t)atoi(argv[++i]);
+			continue;
+		}
+		if (strcmp(arg, "--compare-serial") == 0)
+		{
+			options->compare_serial = true;
+			continue;
+		}
+		if (strcmp(arg, "--perf") == 0)
+		{
+			options->perf = true;
+			continue;
+		}
+		CLI_INT("--jobs", options->jobs.workers);
+		if (strcmp(arg, "--pin") == 0)
+		{
+			options->jobs.pin_threads = true;
+			continue;
+		}
+		CLI_INT("--parallel-tile", options->parallel_desc.tile_size);
+
+		CLI_STRING("--checkpoint", options->checkpoint_path);
+		CLI_INT("--checkpoint-drops", options->checkpoint_drops);
+		CLI_FLOAT("--checkpoint-seconds", options->checkpoint_seconds);
+		if (strcmp(arg, "--checkpoint-compress") == 0)
+		{
+			options->checkpoint_compress = true;
+			continue;
+		}
+		CLI_STRING("--resume", options->resume_path);
+
+		CLI_STRING("--timelapse", options->timelapse_path);
+		CLI_INT("--timelapse-drops", options->timelapse_drops);
+		CLI_INT("--timelapse-queue", options->timelapse_queue);
+		CLI_INT("--timelapse-tile", options->timelapse_tile);
+		if (strcmp(arg, "--timelapse-compress") == 0)
+		{
+			options->timelapse_compress = true;
+			continue;
+		}
+		CLI_STRING("--replay", options->replay_path);
+		CLI_INT("--replay-frame", options->replay_frame);
+		CLI_STRING("--resample", options->resample_filter);
+
+		CLI_STRING("--tiled", options->tiled_path);
+		CLI_INT("--tile-size", options->tile_size);
+		CLI_INT("--tile-cache", options->tile_cache);
+		CLI_INT("--tile-halo", options->tile_halo);
+
+		if (strcmp(arg, "--sweep") == 0 && remaining >= 1)
+		{
+			if (options->sweep.axis_count == EROSION_SWEEP_MAX_AXES)
+			{
+				fprintf(stderr, "at most %d parameters can be swept\n", EROSION_SWEEP_MAX_AXES);
+				return false;
+			}
+			if (!erosion_sweep_axis_parse(argv[++i], &options->sweep.axes[options->sweep.axis_count++]))
+			{
+				fprintf(stderr, "invalid sweep '%s'\n", argv[i]);
+				return false;
+			}
+			continue;
+		}
+		CLI_STRING("--sweep-out", options->sweep.output_dir);
+		CLI_STRING("--sweep-csv", options->sweep_csv_path);
+
+		CLI_STRING("--import", options->import_path);
+		CLI_STRING("--archive", options->archive_path);
+		CLI_INT("--archive-tile", options->archive_tile);
+		CLI_STRING("--load-archive", options->load_archive_path);
+		CLI_INT("--archive-level", options->archive_region.level);
+		if (strcmp(arg, "--archive-region") == 0 && remaining >= 4)
+		{
+			options->archive_region.x = (uint32_t)atoi(argv[++i]);
+			options->archive_region.y = (uint32_t)atoi(argv[++i]);
+			options->archive_region.w = (uint32_t)atoi(argv[++i]);
+			options->archive_region.h = (uint32_t)atoi(argv[++i]);
+			continue;
+		}
+		CLI_STRING("--export", options->export_path);
+		CLI_STRING("--export-mesh", options->mesh_path);
+		CLI_INT("--mesh-stride", options->mesh_stride);
+		if (strcmp(arg, "--codec-bench") == 0)
+		{
+			options->codec_bench = true;
+			continue;
+		}
+		CLI_INT("--codec-tile", options->codec_tile);
+		CLI_STRING("--json", options->json_path);
+
+#undef CLI_INT
+#undef CLI_FLOAT
+#undef CLI_STRING
+
+		fprintf(stderr, "unknown or incomplete option '%s'\n", arg);
+		return false;
+	}
+
+	if (options->terrain.size.w < 2 || options->terrain.size.h < 2)
+	{
+		fprintf(stderr, "terrain size must be at least 2x2\n");
+		return false;
+	}
+
+	if (!erosion_desc_valid(&options->erosion))
+	{
+		fprintf(stderr, "erosion parameters out of range: rates must be non-negative, inertia at most 1, "
+			"the radius between 1 and %d and lifetime and pit steps non-negative\n", EROSION_MAX_RADIUS);
+		return false;
+	}
+
+	if (!options->erosion_seed_set) options->erosion_seed = (uint32_t)options->terrain.seed;
+
+	if (options->archive_tile != 0 && (options->archive_tile < 16 || (options->archive_tile & (options->archive_tile - 1)) != 0))
+	{
+		fprintf(stderr, "archive tiles must be a power of two of at least 16\n");
+		return false;
+	}
+	if (options->codec_tile != 0 && (options->codec_tile < 8 || options->codec_tile > 4096))
+	{
+		fprintf(stderr, "codec tiles must be between 8 and 4096\n");
+		return false;
+	}
+	if (options->timelapse_tile != 0 && (options->timelapse_tile < 8 || options->timelapse_tile > 4096))
+	{
+		fprintf(stderr, "timelapse tiles must be between 8 and 4096\n");
+		return false;
+	}
+	if (options->tile_size < 1 || options->tile_halo < 0)
+	{
+		fprintf(stderr, "tiles must be positive and halos non-negative\n");
+		return false;
+	}
+	if (options->tile_cache < 4)
+	{
+		fprintf(stderr, "the tile cache must hold at least 4 tiles\n");
+		return false;
+	}
+	if (options->timelapse_drops < 1 || options->timelapse_queue < 0)
+	{
+		fprintf(stderr, "timelapse intervals and queues must be positive\n");
+		return false;
+	}
+	if ((options->import_path != NULL) + (options->load_archive_path != NULL) + (options->replay_path != NULL) > 1)
+	{
+		fprintf(stderr, "only one of --import, --load-archive and --replay can be used\n");
+		return false;
+	}
+	// the tiled run starts from its tile store and a sweep cannot replay,
+	// so a load they would skip is an error rather than a run on noise
+	if (options->tiled_path != NULL && (options->import_path != NULL || options->load_archive_path != NULL || options->replay_path != NULL))
+	{
+		fprintf(stderr, "--import, --load-archive and --replay cannot be used with --tiled\n");
+		return false;
+	}
+	if (options->sweep.axis_count > 0 && options->replay_path != NULL)
+	{
+		fprintf(stderr, "--replay cannot be used with --sweep\n");
+		return false;
+	}
+	if (options->resample_filter != NULL && resample_filter_from_name(options->resample_filter) == RESAMPLE_FILTER_COUNT__)
+	{
+		fprintf(stderr, "unknown resample filter '%s'\n", options->resample_filter);
+		return false;
+	}
+
+	if (options->mesh_path != NULL && mesh_export_format_from_path(options->mesh_path) == MESH_EXPORT_FORMAT_COUNT__)
+	{
+		fprintf(stderr, "unknown mesh format of '%s'\n", options->mesh_path);
+		return false;
+	}
+	if (options->mesh_stride < 1)
+	{
+		fprintf(stderr, "the mesh stride must be positive\n");
+		return false;
+	}
+
+	const char *heightmap_paths[] = { options->import_path, options->export_path };
+	for (int i = 0; i < 2; i++)
+	{
+		if (heightmap_paths[i] != NULL && heightmap_format_from_path(heightmap_paths[i]) == HEIGHTMAP_FORMAT_COUNT__)
+		{
+			fprintf(stderr, "unknown heightmap format of '%s'\n", heightmap_paths[i]);
+			return false;
+		}
+	}
+
+	if ((int)options->parallel + (int)options->wavefront + (int)options->deltas + (int)options->speculative + (int)options->atomic + (int)options->region > 1)
+	{
+		fprintf(stderr, "only one of --parallel, --wavefront, --deltas, --speculative, --atomic and --region can be used\n");
+		return false;
+	}
+	options->delta_desc.workers = options->parallel_desc.workers;
+	options->speculative_desc.workers = options->parallel_desc.workers;
+	options->atomic_desc.workers = options->parallel_desc.workers;
+
+	if (options->parallel && !erosion_parallel_supported(options->parallel_desc.backend))
+	{
+		fprintf(stderr, "the parallel backend is not supported on this platform\n");
+		return false;
+	}
+
+	return true;
+}
+
+static uint32_t terrain_checksum(terrain_t *terrain)
+{
+	return crc32_update(CRC32_INIT, terrain->height_map, (size_t)terrain->size.w * terrain->size.h * sizeof(float));
+}
+
+// widens acc to also cover add, empty regions are ignored
+static void grow_region(erosion_region_t *acc, const erosion_region_t *add)
+{
+	if (add->size.w == 0 || add->size.h == 0) return;
+	if (acc->size.w == 0 || acc->size.h == 0)
+	{
+		*acc = *add;
+		return;
+	}
+
+	uint32_t x1 = acc->origin.x + acc->size.w > add->origin.x + add->size.w ? acc->origin.x + acc->size.w : add->origin.x + add->size.w;
+	uint32_t y1 = acc->origin.y + acc->size.h > add->origin.y + add->size.h ? acc->origin.y + acc->size.h : add->origin.y + add->size.h;
+	if (add->origin.x < acc->origin.x) acc->origin.x = add->origin.x;
+	if (add->origin.y < acc->origin.y) acc->origin.y = add->origin.y;
+	acc->size.w = x1 - acc->origin.x;
+	acc->size.h = y1 - acc->origin.y;
+}
+
+static bool import_heightmap(const char *path, terrain_t *terrain)
+{
+	heightmap_info_t info;
+	heightmap_format_t format = heightmap_format_from_path(path);
+
+	double start = timer_now();
+	if (!heightmap_load(path, format, terrain, &info))
+	{
+		fprintf(stderr, "failed to import '%s'\n", path);
+		return false;
+	}
+	printf("imported %ux%u %s heightmap in %f seconds, heights %g to %g%s\n", info.size.w, info.size.h, heightmap_format_name(format),
+		timer_now() - start, info.min_height, info.max_height, info.recorded_range ? "" : " (no recorded range)");
+	return true;
+}
+
+static bool export_heightmap(const char *path, terrain_t *terrain)
+{
+	heightmap_info_t info;
+	heightmap_format_t format = heightmap_format_from_path(path);
+
+	double start = timer_now();
+	if (!heightmap_save(path, format, terrain, &info))
+	{
+		fprintf(stderr, "failed to export '%s'\n", path);
+		return false;
+	}
+	printf("exported %s heightmap in %f seconds, heights %g to %g\n", heightmap_format_name(format),
+		timer_now() - start, info.min_height, info.max_height);
+	return true;
+}
+
+static bool export_mesh(const cli_options_t *options, terrain_t *terrain)
+{
+	mesh_export_stats_t stats;
+	mesh_export_format_t format = mesh_export_format_from_path(options->mesh_path);
+	if (!mesh_export(terrain, &(mesh_export_desc_t){ .path = options->mesh_path, .format = format, .stride = (uint32_t)options->mesh_stride }, &stats))
+	{
+		fprintf(stderr, "failed to export mesh '%s'\n", options->mesh_path);
+		return false;
+	}
+	printf("exported %ux%u %s mesh in %f seconds, %llu triangles, %.1f MB (%.1f MB/s)\n", stats.grid.w, stats.grid.h,
+		mesh_export_format_name(format), stats.seconds, (unsigned long long)stats.triangles, stats.bytes / (1024.0 * 1024.0),
+		stats.seconds > 0.0 ? stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0.0);
+	return true;
+}
+
+static void print_storage_error(const cli_options_t *options)
+{
+	const terrain_desc_t *t = &options->terrain;
+	if (t->storage == TERRAIN_STORAGE_HEAP)
+	{
+		fprintf(stderr, "failed to allocate a %ux%u terrain\n", t->size.w, t->size.h);
+		return;
+	}
+	fprintf(stderr, "failed to map '%s' as a %ux%u terrain, an existing file has to hold exactly that many floats\n",
+		t->storage_path, t->size.w, t->size.h);
+}
+
+static bool resample_loaded(const cli_options_t *options, terrain_t *terrain)
+{
+	if (options->resample_filter == NULL) return true;
+
+	resample_filter_t filter = resample_filter_from_name(options->resample_filter);
+	uvec2 from = terrain->size;
+	double start = timer_now();
+	if (!terrain_resample(terrain, options->terrain.size, filter))
+	{
+		fprintf(stderr, "failed to resize terrain storage to %ux%u\n", options->terrain.size.w, options->terrain.size.h);
+		return false;
+	}
+	printf("resampled %ux%u to %ux%u (%s) in %f seconds\n", from.w, from.h, terrain->size.w, terrain->size.h,
+		resample_filter_name(filter), timer_now() - start);
+	return true;
+}
+
+static bool load_archive(const cli_options_t *options, terrain_t *terrain)
+{
+	double start = timer_now();
+	terrain_archive_t *archive = terrain_archive_create(&(terrain_archive_desc_t){ .path = options->load_archive_path });
+	if (archive == NULL)
+	{
+		fprintf(stderr, "failed to open archive '%s'\n", options->load_archive_path);
+		return false;
+	}
+
+	const terrain_archive_region_t *region = &options->archive_region;
+	if (!terrain_archive_load(archive, region, terrain))
+	{
+		fprintf(stderr, "failed to load level %u region %ux%u at (%u, %u) from '%s'\n",
+			region->level, region->w, region->h, region->x, region->y, options->load_archive_path);
+		terrain_archive_free(archive);
+		return false;
+	}
+
+	uint32_t ts = archive->tile_size;
+	uint32_t x = region->w > 0 ? region->x : 0;
+	uint32_t y = region->h > 0 ? region->y : 0;
+	uint32_t touched = ((x + terrain->size.w - 1) / ts - x / ts + 1) * ((y + terrain->size.h - 1) / ts - y / ts + 1);
+	printf("loaded %ux%u from level %u of a %ux%u archive (%u levels, %u tiles of %u) in %f seconds, %u tiles read, %llu drops\n",
+		terrain->size.w, terrain->size.h, region->level, archive->size.w, archive->size.h, archive->level_count,
+		archive->tile_count, ts, timer_now() - start, touched, (unsigned long long)archive->drops);
+	terrain_archive_free(archive);
+	return true;
+}
+
+static bool load_replay(const cli_options_t *options, terrain_t *terrain)
+{
+	timelapse_t *timelapse = timelapse_create(&(timelapse_desc_t){ .path = options->replay_path });
+	if (timelapse == NULL)
+	{
+		fprintf(stderr, "failed to open timelapse '%s'\n", options->replay_path);
+		return false;
+	}
+
+	// frames only hold what changed, so play every one up to the requested
+	while ((options->replay_frame < 0 || timelapse->frame < options->replay_frame) && timelapse_next(timelapse)) {}
+
+	bool ok = timelapse->frame >= 0 && (options->replay_frame < 0 || timelapse->frame == options->replay_frame);
+	if (ok && !terrain_allocate(terrain, timelapse->size))
+	{
+		fprintf(stderr, "failed to resize terrain storage to %ux%u\n", timelapse->size.w, timelapse->size.h);
+		ok = false;
+	}
+	else if (ok)
+	{
+		memcpy(terrain->height_map, timelapse->heights, (size_t)timelapse->size.w * timelapse->size.h * sizeof(float));
+		terrain_update_mesh(terrain);
+		printf("replayed frame %d of '%s', %ux%u at drop %llu\n", timelapse->frame, options->replay_path,
+			timelapse->size.w, timelapse->size.h, (unsigned long long)timelapse->drop);
+	}
+	else
+	{
+		fprintf(stderr, "timelapse '%s' has no frame %d\n", options->replay_path, options->replay_frame);
+	}
+
+	timelapse_free(timelapse);
+	return ok;
+}
+
+static bool write_archive(const cli_options_t *options, terrain_t *terrain, const erosion_state_t *state)
+{
+	terrain_archive_writer_t *writer = terrain_archive_writer_create(&(terrain_archive_writer_desc_t){
+		.path = options->archive_path,
+		.tile_size = (uint32_t)options->archive_tile,
+	});
+
+	double start = timer_now();
+	terrain_archive_writer_submit(writer, terrain, &options->erosion, state);
+	double submit_seconds = timer_now() - start;
+	terrain_archive_writer_flush(writer);
+
+	bool ok = writer->written == 1;
+	if (ok) printf("archive written in %f seconds, %f of them blocking\n", writer->write_seconds, submit_seconds);
+	else fprintf(stderr, "failed to write archive '%s'\n", options->archive_path);
+	terrain_archive_writer_free(writer);
+	return ok;
+}
+
+static void compare_with_serial(cli_options_t *options, terrain_t *terrain, terrain_t *initial, erosion_state_t *state, uint64_t drops)
+{
+	terrain_t *reference = terrain_clone(initial);
+	erosion_state_t reference_state = *state;
+	reference_state.next_drop -= drops;
+
+	double start = timer_now();
+	while (drops > 0)
+	{
+		int batch = drops < CLI_BATCH_SIZE ? (int)drops : CLI_BATCH_SIZE;
+		erosion_run(reference, &options->erosion, &reference_state, batch);
+		drops -= (uint64_t)batch;
+	}
+	double seconds = timer_now() - start;
+
+	// the difference to the serial result, relative to how much the serial
+	// run changed the terrain in the first place
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+	double diff_sq = 0, change_sq = 0, max_diff = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		double diff = (double)terrain->height_map[i] - reference->height_map[i];
+		double change = (double)reference->height_map[i] - initial->height_map[i];
+		diff_sq += diff * diff;
+		change_sq += change * change;
+		if (fabs(diff) > max_diff) max_diff = fabs(diff);
+	}
+	double rms_diff = sqrt(diff_sq / count);
+	double rms_change = sqrt(change_sq / count);
+
+	printf("serial reference:    %f seconds, checksum %08x\n", seconds, terrain_checksum(reference));
+	printf("vs serial:           max |dh| %g, rms %g (%.2f%% of the serial rms change)\n",
+		max_diff, rms_diff, rms_change > 0 ? 100.0 * rms_diff / rms_change : 0.0);
+
+	terrain_free(reference);
+}
+
+static bool bench_codec(const cli_options_t *options, terrain_t *terrain, height_codec_stats_t *stats)
+{
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+	size_t capacity = height_codec_bound(terrain->size, (uint32_t)options->codec_tile);
+	uint8_t *encoded = malloc(capacity);
+	float *decoded = malloc(count * sizeof(float));
+
+	size_t size = height_codec_encode(terrain->height_map, terrain->size, (uint32_t)options->codec_tile, encoded, capacity, stats);
+	bool ok = size > 0 && height_codec_decode(encoded, size, decoded, terrain->size, stats);
+	// bitwise, so negative zeros and nans count too
+	bool exact = ok && memcmp(decoded, terrain->height_map, count * sizeof(float)) == 0;
+
+	free(decoded);
+	free(encoded);
+
+	if (!ok)
+	{
+		fprintf(stderr, "height codec round trip failed\n");
+		return false;
+	}
+
+	double mb = stats->raw_bytes / (1024.0 * 1024.0);
+	printf("codec:               %.2fx, %.1f MB to %.1f MB in %u tiles, encode %.0f MB/s, decode %.0f MB/s, %s\n",
+		stats->encoded_bytes > 0 ? (double)stats->raw_bytes / stats->encoded_bytes : 0.0, mb, stats->encoded_bytes / (1024.0 * 1024.0),
+		stats->tiles, stats->encode_seconds > 0 ? mb / stats->encode_seconds : 0.0, stats->decode_seconds > 0 ? mb / stats->decode_seconds : 0.0,
+		exact ? "lossless" : "MISMATCH");
+	printf("codec predictors:   ");
+	for (int p = 0; p < HEIGHT_CODEC_PREDICTOR_COUNT__; p++)
+	{
+		printf(" %s %u", height_codec_predictor_name((height_codec_predictor_t)p), stats->predictors[p]);
+	}
+	printf(", planes");
+	for (int s = 0; s < HEIGHT_CODEC_STAGE_COUNT__; s++)
+	{
+		printf(" %s %u", height_codec_stage_name((height_codec_stage_t)s), stats->stages[s]);
+	}
+	printf("\n");
+
+	return exact;
+}
+
+static void write_json(const cli_options_t *options, terrain_t *terrain, const erosion_stats_t *stats, const height_codec_stats_t *codec,
+	uint64_t drops, double seconds)
+{
+	FILE *file = strcmp(options->json_path, "-") == 0 ? stdout : fopen(options->json_path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "failed to open '%s' for writing\n", options->json_path);
+		return;
+	}
+
+	fprintf(file, "{\"size\": [%u, %u], \"seed\": %d, \"iterations\": %d, \"seconds\": %f, \"drops_per_second\": %f, \"checksum\": \"%08x\", \"stats\": ",
+		terrain->size.w, terrain->size.h, terrain->seed, options->iterations,
+		seconds, seconds > 0 ? drops / seconds : 0.0, terrain_checksum(terrain));
+	erosion_stats_write_json(stats, file);
+	if (codec != NULL)
+	{
+		fprintf(file, ", \"codec\": {\"raw_bytes\": %llu, \"encoded_bytes\": %llu, \"ratio\": %f, \"tiles\": %u, ",
+			(unsigned long long)codec->raw_bytes, (unsigned long long)codec->encoded_bytes,
+			codec->encoded_bytes > 0 ? (double)codec->raw_bytes / codec->encoded_bytes : 0.0, codec->tiles);
+		fprintf(file, "\"encode_seconds\": %f, \"decode_seconds\": %f, \"encode_mb_per_second\": %f, \"decode_mb_per_second\": %f}",
+			codec->encode_seconds, codec->decode_seconds,
+			codec->encode_seconds > 0 ? codec->raw_bytes / (1024.0 * 1024.0) / codec->encode_seconds : 0.0,
+			codec->decode_seconds > 0 ? codec->raw_bytes / (1024.0 * 1024.0) / codec->decode_seconds : 0.0);
+	}
+	fprintf(file, "}\n");
+
+	if (file != stdout) fclose(file);
+}
+
+static int run_tiled(cli_options_t *options)
+{
+	tile_store_t *store = tile_store_create(&(tile_store_desc_t){
+		.path = options->tiled_path,
+		.cache_tiles = (uint32_t)options->tile_cache,
+	});
+
+	if (store == NULL)
+	{
+		store = tile_store_create(&(tile_store_desc_t){
+			.path = options->tiled_path,
+			.size = options->terrain.size,
+			.tile_size = (uint32_t)options->tile_size,
+			.cache_tiles = (uint32_t)options->tile_cache,
+		});
+		if (store == NULL)
+		{
+			fprintf(stderr, "failed to create tile store '%s'\n", options->tiled_path);
+			return 1;
+		}
+
+		double start = timer_now();
+		tile_store_generate(store, options->terrain.noise_function, options->terrain.seed, options->terrain.scale_scalar);
+		printf("generated %ux%u in %u tiles in %f seconds\n", store->size.w, store->size.h, store->tiles.w * store->tiles.h, timer_now() - start);
+	}
+
+	erosion_state_t state;
+	erosion_state_init(&state, options->erosion_seed);
+
+	tile_store_stats_t before = store->stats;
+	erosion_tiled_stats_t tiled_stats = { 0 };
+
+	double start = timer_now();
+	erosion_tiled_run(store, &options->erosion, (uint32_t)options->tile_halo, &state, (uint64_t)options->iterations, &tiled_stats);
+	tile_store_flush(store);
+	double seconds = timer_now() - start;
+
+	tile_store_stats_t *after = &store->stats;
+	double tile_mb = (double)store->tile_size * store->tile_size * sizeof(float) / (1024.0 * 1024.0);
+	uint64_t page_ins = after->page_ins - before.page_ins;
+	uint64_t page_outs = after->page_outs - before.page_outs;
+
+	printf("%d iterations on %ux%u in %f seconds (%.0f drops/sec)\n", options->iterations, store->size.w, store->size.h, seconds, options->iterations / seconds);
+	erosion_stats_print(&state.stats, stdout);
+	printf("windows:             %llu (gather %fs, simulate %fs, scatter %fs)\n", (unsigned long long)tiled_stats.windows,
+		tiled_stats.gather_seconds, tiled_stats.simulate_seconds, tiled_stats.scatter_seconds);
+	printf("tile cache:          %u of %u tiles, %.1f MB\n", store->slot_count, store->tiles.w * store->tiles.h, store->slot_count * tile_mb);
+	printf("paging:              %llu in (%.1f MB), %llu out (%.1f MB), %llu hits, %llu evictions\n",
+		(unsigned long long)page_ins, page_ins * tile_mb, (unsigned long long)page_outs, page_outs * tile_mb,
+		(unsigned long long)(after->hits - before.hits), (unsigned long long)(after->evictions - before.evictions));
+
+	tile_store_free(store);
+	return 0;
+}
+
+static int run_sweep(cli_options_t *options)
+{
+	erosion_sweep_desc_t *sweep = &options->sweep;
+	sweep->base = options->erosion;
+	sweep->seed = options->erosion_seed;
+	sweep->drops = (uint64_t)options->iterations;
+
+	uint32_t count = erosion_sweep_config_count(sweep);
+	erosion_sweep_result_t *results = calloc(count, sizeof(erosion_sweep_result_t));
+
+	double start = timer_now();
+	terrain_t *base = terrain_create(&options->terrain);
+	if (base == NULL)
+	{
+		print_storage_error(options);
+		free(results);
+		return 1;
+	}
+	printf("terrain ready in %f seconds\n", timer_now() - start);
+	if ((options->import_path != NULL && !import_heightmap(options->import_path, base)) ||
+		(options->load_archive_path != NULL && !load_archive(options, base)) ||
+		!resample_loaded(options, base))
+	{
+		terrain_free(base);
+		free(results);
+		return 1;
+	}
+
+	start = timer_now();
+	erosion_sweep_run(base, sweep, results);
+	double seconds = timer_now() - start;
+
+	double config_seconds = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		config_seconds += results[i].seconds;
+	}
+	printf("%u configs of %d iterations on %ux%u in %f seconds (%.2f configs in flight on average)\n", count, options->iterations,
+		base->size.w, base->size.h, seconds, seconds > 0 ? config_seconds / seconds : 0.0);
+	erosion_sweep_print_table(sweep, results, stdout);
+
+	int status = 0;
+	if (options->sweep_csv_path != NULL)
+	{
+		FILE *file = strcmp(options->sweep_csv_path, "-") == 0 ? stdout : fopen(options->sweep_csv_path, "w");
+		if (file != NULL)
+		{
+			erosion_sweep_write_csv(sweep, results, file);
+			if (file != stdout) fclose(file);
+		}
+		else
+		{
+			fprintf(stderr, "failed to open '%s' for writing\n", options->sweep_csv_path);
+			status = 1;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!results[i].saved) status = 1;
+	}
+
+	terrain_free(base);
+	free(results);
+	job_system_shared_free();
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	cli_options_t options = {
+		.terrain = {
+			.size = { 500, 500 },
+			.noise_function = (terrain_noise_function_t)perlin_noise_2d,
+			.seed = (int)time(0),
+			.scale_scalar = 0.4f,
+			.elevation = 100.0f,
+			.headless = true,
+		},
+		.erosion = EROSION_DEFAULT_DESC,
+		.iterations = 200000,
+		.tile_size = 512,
+		.tile_cache = 16,
+		.timelapse_drops = 100000,
+		.mesh_stride = 1,
+		.replay_frame = -1,
+	};
+
+	if (!parse_options(argc, argv, &options))
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	job_system_shared_init(&options.jobs);
+
+	if (options.tiled_path != NULL) return run_tiled(&options);
+	if (options.sweep.axis_count > 0) return run_sweep(&options);
+
+	double create_start = timer_now();
+	terrain_t *terrain = terrain_create(&options.terrain);
+	if (terrain == NULL)
+	{
+		print_storage_error(&options);
+		return 1;
+	}
+	printf("terrain ready in %f seconds\n", timer_now() - create_start);
+	if ((options.import_path != NULL && !import_heightmap(options.import_path, terrain)) ||
+		(options.load_archive_path != NULL && !load_archive(&options, terrain)) ||
+		(options.replay_path != NULL && !load_replay(&options, terrain)) ||
+		!resample_loaded(&options, terrain))
+	{
+		terrain_free(terrain);
+		return 1;
+	}
+
+	erosion_state_t state;
+	erosion_state_init(&state, options.erosion_seed);
+
+	if (options.resume_path != NULL)
+	{
+		if (!checkpoint_load(options.resume_path, terrain, &options.erosion, &state))
+		{
+			fprintf(stderr, "failed to resume from '%s'\n", options.resume_path);
+			terrain_free(terrain);
+			return 1;
+		}
+		printf("resumed at drop %llu\n", (unsigned long long)state.next_drop);
+	}
+
+	checkpoint_writer_t *checkpoints = NULL;
+	if (options.checkpoint_path != NULL)
+	{
+		checkpoints = checkpoint_writer_create(&(checkpoint_writer_desc_t){
+			.path = options.checkpoint_path,
+			.interval_drops = (uint64_t)options.checkpoint_drops,
+			.interval_seconds = options.checkpoint_seconds,
+			.compress = options.checkpoint_compress,
+		});
+	}
+
+	timelapse_recorder_t *timelapse = NULL;
+	if (options.timelapse_path != NULL)
+	{
+		timelapse = timelapse_recorder_create(&(timelapse_recorder_desc_t){
+			.path = options.timelapse_path,
+			.size = terrain->size,
+			.interval_drops = (uint64_t)options.timelapse_drops,
+			.queue_frames = (uint32_t)options.timelapse_queue,
+			.tile_size = (uint32_t)options.timelapse_tile,
+			.compress = options.timelapse_compress,
+		});
+		if (timelapse == NULL)
+		{
+			fprintf(stderr, "failed to create timelapse '%s'\n", options.timelapse_path);
+			checkpoint_writer_free(checkpoints);
+			terrain_free(terrain);
+			return 1;
+		}
+		// the first frame is the terrain before any erosion
+		timelapse_recorder_submit(timelapse, terrain, state.next_drop);
+		timelapse->last_drop = state.next_drop;
+	}
+
+	terrain_t *initial = options.compare_serial ? terrain_clone(terrain) : NULL;
+
+	uint64_t first_drop = state.next_drop;
+	erosion_parallel_stats_t parallel_stats = { 0 };
+	erosion_wavefront_stats_t wavefront_stats = { 0 };
+	erosion_delta_stats_t delta_stats = { 0 };
+	erosion_speculative_stats_t speculative_stats = { 0 };
+	erosion_region_t region_changed = { 0 };
+
+	perf_counter_t *perf = options.perf ? perf_counter_create() : NULL;
+	if (perf != NULL) perf_counter_start(perf);
+
+	double start = timer_now();
+	while (state.next_drop < (uint64_t)options.iterations)
+	{
+		uint64_t remaining = (uint64_t)options.iterations - state.next_drop;
+		if (timelapse != NULL)
+		{
+			// stop on the frame boundary so frames land on their interval
+			uint64_t until_frame = timelapse->last_drop + timelapse->interval_drops - state.next_drop;
+			if (until_frame < remaining) remaining = until_frame;
+		}
+		if (options.parallel)
+		{
+			if (!erosion_parallel_run(terrain, &options.erosion, &options.parallel_desc, &state,
+				remaining < CLI_PARALLEL_BATCH_SIZE ? remaining : CLI_PARALLEL_BATCH_SIZE, &parallel_stats))
+			{
+				fprintf(stderr, "parallel erosion failed at drop %llu\n", (unsigned long long)state.next_drop);
+				checkpoint_writer_free(checkpoints);
+				timelapse_recorder_free(timelapse);
+				perf_counter_free(perf);
+				terrain_free(initial);
+				terrain_free(terrain);
+				return 1;
+			}
+		}
+		else if (options.wavefront)
+		{
+			erosion_run_wavefront(terrain, &options.erosion, &options.wavefront_desc, &state,
+				remaining < CLI_WAVEFRONT_BATCH_SIZE ? remaining : CLI_WAVEFRONT_BATCH_SIZE, &wavefront_stats);
+		}
+		else if (options.deltas)
+		{
+			erosion_run_deltas(terrain, &options.erosion, &options.delta_desc, &state,
+				remaining < CLI_PARALLEL_BATCH_SIZE ? remaining : CLI_PARALLEL_BATCH_SIZE, &delta_stats);
+		}
+		else if (options.speculative)
+		{
+			erosion_run_speculative(terrain, &options.erosion, &options.speculative_desc, &state,
+				remaining < CLI_PARALLEL_BATCH_SIZE ? remaining : CLI_PARALLEL_BATCH_SIZE, &speculative_stats);
+		}
+		else if (options.atomic)
+		{
+			erosion_run_atomic(terrain, &options.erosion, &options.atomic_desc, &state,
+				remaining < CLI_PARALLEL_BATCH_SIZE ? remaining : CLI_PARALLEL_BATCH_SIZE);
+		}
+		else if (options.region)
+		{
+			erosion_region_t changed;
+			erosion_run_region(terrain, &options.erosion, &options.region_desc, &state,
+				remaining < CLI_BATCH_SIZE ? (int)remaining : CLI_BATCH_SIZE, &changed);
+			grow_region(&region_changed, &changed);
+		}
+		else
+		{
+			erosion_run(terrain, &options.erosion, &state, remaining < CLI_BATCH_SIZE ? (int)remaining : CLI_BATCH_SIZE);
+		}
+
+		if (checkpoints != NULL) checkpoint_writer_poll(checkpoints, terrain, &options.erosion, &state);
+		if (timelapse != NULL) timelapse_recorder_poll(timelapse, terrain, state.next_drop);
+	}
+	double seconds = timer_now() - start;
+
+	if (perf != NULL) perf_counter_stop(perf);
+
+	if (checkpoints != NULL)
+	{
+		// always leave a checkpoint of the finished run behind
+		checkpoint_writer_flush(checkpoints);
+		checkpoint_writer_submit(checkpoints, terrain, &options.erosion, &state);
+		checkpoint_writer_flush(checkpoints);
+		printf("checkpoints: %u written, %u skipped while busy, %u failed, %fs copying, %fs writing, %.1f MB stored (%.2fx)\n",
+			checkpoints->written, checkpoints->skipped, checkpoints->failed, checkpoints->copy_seconds, checkpoints->write_seconds,
+			checkpoints->stored_bytes / (1024.0 * 1024.0), checkpoints->stored_bytes > 0 ? (double)checkpoints->raw_bytes / checkpoints->stored_bytes : 0.0);
+		checkpoint_writer_free(checkpoints);
+	}
+
+	if (timelapse != NULL)
+	{
+		// always end on the finished terrain
+		if (timelapse->queued_drop != state.next_drop)
+		{
+			timelapse_recorder_flush(timelapse);
+			timelapse_recorder_submit(timelapse, terrain, state.next_drop);
+		}
+		timelapse_recorder_flush(timelapse);
+		printf("timelapse: %u frames, %u skipped while busy, %u failed, %.1f%% of tiles changed, %.1f MB, "
+			"%fs copying (%.2f%% of the run), %fs writing\n",
+			timelapse->frames, timelapse->skipped, timelapse->failed,
+			timelapse->tiles_total > 0 ? 100.0 * timelapse->tiles_written / timelapse->tiles_total : 0.0,
+			timelapse->bytes_written / (1024.0 * 1024.0), timelapse->copy_seconds,
+			seconds > 0 ? 100.0 * timelapse->copy_seconds / seconds : 0.0, timelapse->write_seconds);
+		timelapse_recorder_free(timelapse);
+	}
+
+	uint64_t drops = state.next_drop - first_drop;
+	printf("%llu iterations on %ux%u in %f seconds\n", (unsigned long long)drops, terrain->size.w, terrain->size.h, seconds);
+	erosion_stats_print(&state.stats, stdout);
+	if (options.parallel)
+	{
+		printf("parallel:            %u %s, %u tiles of %u, %llu batches (sort %fs, simulate %fs)\n",
+			parallel_stats.workers, options.parallel_desc.backend == EROSION_PARALLEL_THREADS ? "threads" : "processes",
+			((terrain->size.w + parallel_stats.tile_size - 1) / parallel_stats.tile_size) * ((terrain->size.h + parallel_stats.tile_size - 1) / parallel_stats.tile_size),
+			parallel_stats.tile_size, (unsigned long long)parallel_stats.batches, parallel_stats.sort_seconds, parallel_stats.simulate_seconds);
+	}
+	if (options.wavefront && wavefront_stats.rounds > 0)
+	{
+		printf("wavefront:           %llu rounds, %.1f%% average occupancy, sort %fs\n", (unsigned long long)wavefront_stats.rounds,
+			100.0 * wavefront_stats.occupancy / wavefront_stats.rounds, wavefront_stats.sort_seconds);
+	}
+	if (options.region)
+	{
+		printf("region:              spawned in %ux%u at %u,%u, changed %ux%u at %u,%u (%.2f%% of the map)\n",
+			options.region_desc.size.w, options.region_desc.size.h, options.region_desc.origin.x, options.region_desc.origin.y,
+			region_changed.size.w, region_changed.size.h, region_changed.origin.x, region_changed.origin.y,
+			100.0 * region_changed.size.w * region_changed.size.h / ((double)terrain->size.w * terrain->size.h));
+	}
+	if (options.deltas && delta_stats.epochs > 0)
+	{
+		printf("deltas:              %llu epochs, reduce %fs, at most %u tiles (%.1f MB) in one lane\n",
+			(unsigned long long)delta_stats.epochs, delta_stats.reduce_seconds, delta_stats.peak_tiles,
+			delta_stats.peak_tiles * 16.0 * 16.0 * sizeof(float) / (1024.0 * 1024.0));
+	}
+	if (options.speculative && speculative_stats.batches > 0)
+	{
+		printf("speculative:         %llu batches, %llu replays (%.2f%%), commit %fs, at most %u tiles in one drop\n",
+			(unsigned long long)speculative_stats.batches, (unsigned long long)speculative_stats.replays,
+			drops > 0 ? 100.0 * speculative_stats.replays / drops : 0.0, speculative_stats.commit_seconds, speculative_stats.peak_tiles);
+	}
+	if (perf != NULL)
+	{
+		if (!perf_counter_any_available(perf)) printf("perf:                no hardware events available\n");
+		for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+		{
+			if (!perf->available[i]) continue;
+			printf("perf:                %llu %s (%.2f per drop)\n", (unsigned long long)perf->values[i],
+				perf_counter_event_name((perf_counter_event_t)i), drops > 0 ? (double)perf->values[i] / drops : 0.0);
+		}
+		perf_counter_free(perf);
+	}
+	printf("checksum:            %08x\n", terrain_checksum(terrain));
+
+	if (initial != NULL)
+	{
+		compare_with_serial(&options, terrain, initial, &state, drops);
+		terrain_free(initial);
+	}
+
+	int status = 0;
+	height_codec_stats_t codec = { 0 };
+	if (options.codec_bench && !bench_codec(&options, terrain, &codec)) status = 1;
+
+	if (options.json_path != NULL) write_json(&options, terrain, &state.stats, options.codec_bench ? &codec : NULL, drops, seconds);
+
+	if (options.export_path != NULL && !export_heightmap(options.export_path, terrain)) status = 1;
+	if (options.mesh_path != NULL && !export_mesh(&options, terrain)) status = 1;
+	if (options.archive_path != NULL && !write_archive(&options, terrain, &state)) status = 1;
+
+	terrain_sync(terrain);
+	terrain_free(terrain);
+	job_system_shared_free();
+	return status;
+}
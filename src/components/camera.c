@@ -183,3 +183,20 @@ void camera_set_target(camera_t *camera, vec3 target)
 	glm_vec3_copy(target, camera->target);
 	update_camera_position(camera);
 }
+
+void camera_screen_ray(camera_t *camera, vec2 ndc, vec3 origin, vec3 direction)
+{
+	mat4 view, view_projection, inverse;
+	camera_create_view_matrix(camera, view);
+	glm_mat4_mul(camera->projection, view, view_projection);
+	glm_mat4_inv(view_projection, inverse);
+
+	// the point on the far plane, the ray starts at the camera
+	vec4 far = { ndc[0], ndc[1], 1.0f, 1.0f };
+	glm_mat4_mulv(inverse, far, far);
+	vec3 target = { far[0] / far[3], far[1] / far[3], far[2] / far[3] };
+
+	glm_vec3_copy(camera->position, origin);
+	glm_vec3_sub(target, camera->position, direction);
+	glm_vec3_normalize(direction);
+}
@@ -49,5 +49,7 @@ void camera_update_projection(camera_t *camera);
 void camera_create_view_matrix(camera_t *camera, mat4 view);
 void camera_move(camera_t *camera, float distance_offset, vec3 target_offset, vec2 angle_offset);
 void camera_set_target(camera_t *camera, vec3 target);
+// world space ray through a point in normalized device coordinates
+void camera_screen_ray(camera_t *camera, vec2 ndc, vec3 origin, vec3 direction);
 
 #endif /* __components_camera_h__ */
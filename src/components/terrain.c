@@ -1,9 +1,14 @@
 #include "terrain.h"
 
 #include <stdlib.h>
+#include <string.h>
 
+#include "core/job.h"
 #include "debug/assert.h"
-#include "io/file.h"
+#include "io/resource.h"
+
+// rows per job when generating heights or building the mesh
+#define TERRAIN_JOB_ROWS (32)
 
 typedef struct terrain_vertex_t
 {
@@ -11,35 +16,27 @@ typedef struct terrain_vertex_t
 	vec3 normal;
 } terrain_vertex_t;
 
-static shader_t *create_shader(const char *path, shader_type_t type)
+static shader_t *create_shader(const char *name, shader_type_t type)
 {
-	size_t file_size = 0;
-	FILE *file = NULL;
-
-	file = file_open(path);
-
-	HE_ASSERT(file != NULL, "Failed to open shader file");
-
-	file_read(file, &file_size, NULL);
-	char *source = malloc(file_size + 1);
-	file_read(file, &file_size, source);
-	source[file_size] = '\0';
-	file_close(file);
+	resource_t *resource = resource_create(&(resource_desc_t){ .name = name });
+	HE_ASSERT(resource != NULL, "Failed to load shader");
 
+	// the source is handed to gl straight from the resource
 	shader_t *shader = shader_create(&(shader_desc_t){
 		.type = type,
-		.source = source,
+		.source = resource->data,
+		.source_size = resource->size,
 	});
 
-	free(source);
+	resource_free(resource);
 
 	return shader;
 }
 
 static void terrain_init_pipeline(terrain_t *terrain)
 {
-	shader_t *vs = create_shader("res/shaders/terrain.vs.glsl", SHADER_TYPE_VERTEX);
-	shader_t *fs = create_shader("res/shaders/terrain.fs.glsl", SHADER_TYPE_FRAGMENT);
+	shader_t *vs = create_shader("shaders/terrain.vs.glsl", SHADER_TYPE_VERTEX);
+	shader_t *fs = create_shader("shaders/terrain.fs.glsl", SHADER_TYPE_FRAGMENT);
 
 	pipeline_desc_t desc = {
 		.vs = vs,
@@ -62,7 +59,7 @@ static void terrain_init_pipeline(terrain_t *terrain)
 
 	pipeline_init(&desc, &terrain->pipeline);
 #ifndef NDEBUG
-	shader_t *wireframe_fs = create_shader("res/shaders/terrain_wireframe.fs.glsl", SHADER_TYPE_FRAGMENT);
+	shader_t *wireframe_fs = create_shader("shaders/terrain_wireframe.fs.glsl", SHADER_TYPE_FRAGMENT);
 
 	desc.wireframe = true,
 	desc.fs = wireframe_fs;
@@ -75,6 +72,43 @@ static void terrain_init_pipeline(terrain_t *terrain)
 	shader_free(fs);
 }
 
+typedef struct generate_job_t
+{
+	terrain_t *terrain;
+	uint32_t first_row;
+} generate_job_t;
+
+static void generate_rows(void *user_pointer, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	generate_job_t *job = user_pointer;
+	terrain_t *terrain = job->terrain;
+	for (uint32_t z = z0 + job->first_row; z < z1 + job->first_row; z++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			terrain_set_height(terrain, x, z, terrain->noise_function(terrain->seed, (float) x * terrain->scale_scalar, (float) z * terrain->scale_scalar));
+		}
+	}
+}
+
+void terrain_generate_rows(terrain_t *terrain, uint32_t z0, uint32_t z1)
+{
+	HE_ASSERT(terrain != NULL, "Cannot generate NULL");
+	HE_ASSERT(z0 <= z1 && z1 <= terrain->size.h, "Rows outside terrain bounds");
+
+	// whole rows per job, so a mapped height map is still written in long
+	// sequential runs
+	generate_job_t job = { .terrain = terrain, .first_row = z0 };
+	job_parallel_for_2d(job_system_shared(), terrain->size.w, z1 - z0, terrain->size.w, TERRAIN_JOB_ROWS, generate_rows, &job);
+}
+
+static void terrain_generate(terrain_t *terrain)
+{
+	terrain_advise(terrain, TERRAIN_ACCESS_SEQUENTIAL);
+	terrain_generate_rows(terrain, 0, terrain->size.h);
+	terrain_advise(terrain, TERRAIN_ACCESS_RANDOM);
+}
+
 static void terrain_init_mesh(terrain_t *terrain)
 {
 	mesh_init(&(mesh_desc_t){
@@ -82,12 +116,14 @@ static void terrain_init_mesh(terrain_t *terrain)
 	}, &terrain->mesh);
 }
 
-void terrain_init(const terrain_desc_t *desc, terrain_t **terrain)
+bool terrain_init(const terrain_desc_t *desc, terrain_t **terrain)
 {
 	HE_ASSERT(terrain != NULL, "Cannot initialize NULL");
 	HE_ASSERT(desc != NULL, "A terrain description is required");
 	HE_ASSERT(desc->noise_function != NULL, "A terrain noise function is required");
 	HE_ASSERT(desc->elevation != 0, "Elevation of zero will flatten terrain");
+	HE_ASSERT(desc->storage < TERRAIN_STORAGE_COUNT__, "Invalid terrain storage");
+	HE_ASSERT(desc->storage == TERRAIN_STORAGE_HEAP || desc->storage_path != NULL, "Mapped terrain storage requires a path");
 
 	terrain_t *result = malloc(sizeof(terrain_t));
 
@@ -96,24 +132,87 @@ void terrain_init(const terrain_desc_t *desc, terrain_t **terrain)
 	result->scale_scalar = desc->scale_scalar;
 	result->elevation = desc->elevation;
 	result->height_map = NULL;
+	result->size = (uvec2){ 0 };
+	result->storage = desc->storage;
+	result->storage_path = NULL;
+	result->mapping = NULL;
+	result->mesh = NULL;
+	result->pipeline = NULL;
+#ifndef NDEBUG
+	result->pipeline_wireframe = NULL;
+#endif
 
-	terrain_init_pipeline(result);
-	terrain_init_mesh(result);
+	if (!desc->headless)
+	{
+		terrain_init_pipeline(result);
+		terrain_init_mesh(result);
+	}
 
-	terrain_resize(result, desc->size);
+	if (desc->storage != TERRAIN_STORAGE_HEAP)
+	{
+		size_t path_len = strlen(desc->storage_path) + 1;
+		result->storage_path = malloc(path_len);
+		memcpy(result->storage_path, desc->storage_path, path_len);
+	}
+
+	if (!terrain_allocate(result, desc->size))
+	{
+		terrain_free(result);
+		return false;
+	}
+
+	// a mapped base map that already exists is used as is, its pages are
+	// only read in once they are touched
+	if (result->mapping == NULL || !result->mapping->existed) terrain_generate(result);
+	terrain_update_mesh(result);
 
 	glm_vec3_copy(desc->position, result->position);
 
 	*terrain = result;
+	return true;
 }
 
 terrain_t *terrain_create(const terrain_desc_t *desc)
 {
 	terrain_t *terrain;
-	terrain_init(desc, &terrain);
+	if (!terrain_init(desc, &terrain)) return NULL;
 	return terrain;
 }
 
+terrain_t *terrain_clone(terrain_t *terrain)
+{
+	HE_ASSERT(terrain != NULL, "Cannot clone NULL");
+
+	// clones are always headless, they only exist to be simulated on
+	terrain_t *result = malloc(sizeof(terrain_t));
+	*result = *terrain;
+	result->mesh = NULL;
+	result->pipeline = NULL;
+#ifndef NDEBUG
+	result->pipeline_wireframe = NULL;
+#endif
+	result->storage = TERRAIN_STORAGE_HEAP;
+	result->storage_path = NULL;
+	result->mapping = NULL;
+
+	size_t bytes = (size_t)terrain->size.w * terrain->size.h * sizeof(float);
+	result->height_map = malloc(bytes);
+	memcpy(result->height_map, terrain->height_map, bytes);
+
+	return result;
+}
+
+terrain_t terrain_view(uvec2 size, float *heights)
+{
+	// a headless terrain over caller owned heights. it owns nothing and must
+	// never be passed to terrain_free
+	terrain_t view;
+	memset(&view, 0, sizeof(terrain_t));
+	view.size = size;
+	view.height_map = heights;
+	return view;
+}
+
 void terrain_free(terrain_t *terrain)
 {
 	if (terrain == NULL) return;
@@ -123,7 +222,9 @@ void terrain_free(terrain_t *terrain)
 #ifndef NDEBUG
 	pipeline_free(terrain->pipeline_wireframe);
 #endif
-	free(terrain->height_map);
+	if (terrain->mapping != NULL) mapped_file_free(terrain->mapping);
+	else free(terrain->height_map);
+	free(terrain->storage_path);
 	free(terrain);
 }
 
@@ -132,6 +233,7 @@ void terrain_draw(camera_t *camera, vec3 light_pos, terrain_t *terrain)
 	HE_ASSERT(terrain != NULL, "Cannot draw NULL terrain");
 	HE_ASSERT(light_pos != NULL, "Cannot draw terrain without a light");
 	HE_ASSERT(camera != NULL, "Cannot draw terrain without a camera");
+	HE_ASSERT(terrain->mesh != NULL, "Cannot draw headless terrain");
 
 	// calculate the cordinate system
 	mat4 model = GLM_MAT4_IDENTITY_INIT;
@@ -166,98 +268,247 @@ void terrain_draw(camera_t *camera, vec3 light_pos, terrain_t *terrain)
 	pipeline_bind(last_pip);
 }
 
-void terrain_update_mesh(terrain_t *terrain)
+typedef struct mesh_build_t
 {
-	size_t vertex_count = terrain->size.w * terrain->size.h;
-	terrain_vertex_t *vertices = malloc(vertex_count * sizeof(terrain_vertex_t));
+	terrain_t *terrain;
+	terrain_vertex_t *vertices;
+	int *indices;
 
-	size_t index_count = (terrain->size.w - 1) * (terrain->size.h - 1) * 6;
-	int *indices = malloc(index_count * sizeof(int));
+	// the vertices cover the cells from origin on in rows of stride, and the
+	// jobs run over a range that starts at first within them
+	uvec2 origin;
+	uvec2 first;
+	uint32_t stride;
+} mesh_build_t;
+
+static void build_positions(void *user_pointer, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	mesh_build_t *build = user_pointer;
+	terrain_t *terrain = build->terrain;
 
-	// thanks brackeys
-	int i = 0;
-	for (int z = 0; z < terrain->size.h; z++)
+	for (uint32_t lz = build->first.y + z0; lz < build->first.y + z1; lz++)
 	{
-		for (int x = 0; x < terrain->size.w; x++)
+		for (uint32_t lx = build->first.x + x0; lx < build->first.x + x1; lx++)
 		{
-			float vx = ((float) x - (terrain->size.w / 2.0f)) * terrain->scale_scalar;
-			float vz = ((float) z - (terrain->size.h / 2.0f)) * terrain->scale_scalar;
-			vertices[i].position[0] = vx;
-			vertices[i].position[1] = terrain_get_height(terrain, x, z) * terrain->elevation;
-			vertices[i].position[2] = vz;
-			
-			glm_vec3_copy(GLM_VEC3_ZERO, vertices[i].normal);
-
-			i++;
+			uint32_t x = build->origin.x + lx;
+			uint32_t z = build->origin.y + lz;
+			terrain_vertex_t *vertex = &build->vertices[lx + lz * build->stride];
+			vertex->position[0] = ((float) x - (terrain->size.w / 2.0f)) * terrain->scale_scalar;
+			vertex->position[1] = terrain_get_height(terrain, x, z) * terrain->elevation;
+			vertex->position[2] = ((float) z - (terrain->size.h / 2.0f)) * terrain->scale_scalar;
 		}
 	}
+}
 
-	int vertex = 0;
-	int index = 0;
-	for (int z = 0; z < terrain->size.h - 1; z++)
+static void add_triangle_normal(const terrain_vertex_t *vertices, int a, int b, int c, vec3 normal)
+{
+	vec3 p, ba, ca;
+	glm_vec3_sub((float *)vertices[b].position, (float *)vertices[a].position, ba);
+	glm_vec3_sub((float *)vertices[c].position, (float *)vertices[a].position, ca);
+	glm_vec3_cross(ba, ca, p);
+	glm_vec3_add(normal, p, normal);
+}
+
+static void build_normals(void *user_pointer, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	mesh_build_t *build = user_pointer;
+	int w = (int)build->terrain->size.w;
+	int h = (int)build->terrain->size.h;
+	int ox = (int)build->origin.x;
+	int oz = (int)build->origin.y;
+	int stride = (int)build->stride;
+
+	for (int z = oz + (int)(build->first.y + z0); z < oz + (int)(build->first.y + z1); z++)
 	{
-		for (int x = 0; x < terrain->size.w - 1; x++)
+		for (int x = ox + (int)(build->first.x + x0); x < ox + (int)(build->first.x + x1); x++)
 		{
-			vec3 p, ba, ca;
-			int a, b, c;
-
-			// -- tri 1
-			// indices
-			a = vertex;
-			b = vertex + (terrain->size.w - 1) + 1;
-			c = vertex + 1;
-			indices[index + 0] = a;
-			indices[index + 1] = b;
-			indices[index + 2] = c;
-
-			// normals
-			glm_vec3_sub(vertices[b].position, vertices[a].position, ba);
-			glm_vec3_sub(vertices[c].position, vertices[a].position, ca);
-			glm_vec3_cross(ba, ca, p);
-
-			glm_vec3_add(vertices[a].normal, p, vertices[a].normal);
-			glm_vec3_add(vertices[b].normal, p, vertices[b].normal);
-			glm_vec3_add(vertices[c].normal, p, vertices[c].normal);
-
-			// -- tri 2
-			// indices
-			a = vertex + 1;
-			b = vertex + (terrain->size.w - 1) + 1;
-			c = vertex + (terrain->size.w - 1) + 2;
-			indices[index + 3] = a;
-			indices[index + 4] = b;
-			indices[index + 5] = c;
-
-			// normals
-			glm_vec3_sub(vertices[b].position, vertices[a].position, ba);
-			glm_vec3_sub(vertices[c].position, vertices[a].position, ca);
-			glm_vec3_cross(ba, ca, p);
-
-			glm_vec3_add(vertices[a].normal, p, vertices[a].normal);
-			glm_vec3_add(vertices[b].normal, p, vertices[b].normal);
-			glm_vec3_add(vertices[c].normal, p, vertices[c].normal);
-
-			vertex++;
-			index += 6;
+			// every vertex gathers the faces around it in the order the
+			// quads are laid out, each quad split into two triangles. indices
+			// are into the vertices built, rows of stride from origin on
+			int v = (x - ox) + (z - oz) * stride;
+			vec3 normal = GLM_VEC3_ZERO_INIT;
+			for (int qz = z - 1; qz <= z; qz++)
+			{
+				for (int qx = x - 1; qx <= x; qx++)
+				{
+					if (qx < 0 || qz < 0 || qx >= w - 1 || qz >= h - 1) continue;
+
+					int q = (qx - ox) + (qz - oz) * stride;
+					if (v == q || v == q + stride || v == q + 1) add_triangle_normal(build->vertices, q, q + stride, q + 1, normal);
+					if (v == q + 1 || v == q + stride || v == q + stride + 1) add_triangle_normal(build->vertices, q + 1, q + stride, q + stride + 1, normal);
+				}
+			}
+
+			glm_vec3_normalize(normal);
+			glm_vec3_copy(normal, build->vertices[v].normal);
 		}
-		vertex++;
 	}
+}
+
+static void build_indices(void *user_pointer, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	mesh_build_t *build = user_pointer;
+	int w = (int)build->terrain->size.w;
 
-	for (int i = 0; i < vertex_count; i++)
+	for (int z = (int)z0; z < (int)z1; z++)
 	{
-		glm_vec3_normalize(vertices[i].normal);
+		for (int x = (int)x0; x < (int)x1; x++)
+		{
+			int q = x + z * w;
+			int *index = &build->indices[(x + z * (w - 1)) * 6];
+			index[0] = q;
+			index[1] = q + w;
+			index[2] = q + 1;
+			index[3] = q + 1;
+			index[4] = q + w;
+			index[5] = q + w + 1;
+		}
 	}
+}
+
+void terrain_update_mesh(terrain_t *terrain)
+{
+	if (terrain->mesh == NULL) return;
+
+	size_t vertex_count = terrain->size.w * terrain->size.h;
+	size_t index_count = (terrain->size.w - 1) * (terrain->size.h - 1) * 6;
+
+	mesh_build_t build = {
+		.terrain = terrain,
+		.vertices = malloc(vertex_count * sizeof(terrain_vertex_t)),
+		.indices = malloc(index_count * sizeof(int)),
+		.stride = terrain->size.w,
+	};
+
+	// positions first, the normals of a row need the rows around it
+	job_system_t *jobs = job_system_shared();
+	job_parallel_for_2d(jobs, terrain->size.w, terrain->size.h, terrain->size.w, TERRAIN_JOB_ROWS, build_positions, &build);
+	job_parallel_for_2d(jobs, terrain->size.w, terrain->size.h, terrain->size.w, TERRAIN_JOB_ROWS, build_normals, &build);
+	job_parallel_for_2d(jobs, terrain->size.w - 1, terrain->size.h - 1, terrain->size.w - 1, TERRAIN_JOB_ROWS, build_indices, &build);
 
 	mesh_set_data(terrain->mesh, &(mesh_desc_t){
-		.vertices = vertices,
+		.vertices = build.vertices,
 		.vertices_size = vertex_count * sizeof(terrain_vertex_t),
-		.indices = indices,
+		.indices = build.indices,
 		.indices_size = index_count * sizeof(int),
 		.index_count = index_count,
 	});
 
-	free(vertices);
-	free(indices);
+	free(build.vertices);
+	free(build.indices);
+}
+
+void terrain_update_mesh_region(terrain_t *terrain, uvec2 origin, uvec2 size)
+{
+	if (terrain->mesh == NULL || size.w == 0 || size.h == 0) return;
+	HE_ASSERT(origin.x + size.w <= terrain->size.w && origin.y + size.h <= terrain->size.h, "Region outside terrain bounds");
+
+	// the mesh has to be rebuilt as a whole once it no longer fits the map
+	uint32_t w = terrain->size.w;
+	uint32_t h = terrain->size.h;
+	if (terrain->mesh->vertices->size != (size_t)w * h * sizeof(terrain_vertex_t))
+	{
+		terrain_update_mesh(terrain);
+		return;
+	}
+
+	// the normals of the vertices around the region change with it, and they
+	// need the positions one vertex further out
+	uint32_t nx0 = origin.x > 0 ? origin.x - 1 : 0;
+	uint32_t nz0 = origin.y > 0 ? origin.y - 1 : 0;
+	uint32_t nx1 = origin.x + size.w < w ? origin.x + size.w + 1 : w;
+	uint32_t nz1 = origin.y + size.h < h ? origin.y + size.h + 1 : h;
+	uint32_t px0 = nx0 > 0 ? nx0 - 1 : 0;
+	uint32_t pz0 = nz0 > 0 ? nz0 - 1 : 0;
+	uint32_t px1 = nx1 < w ? nx1 + 1 : w;
+	uint32_t pz1 = nz1 < h ? nz1 + 1 : h;
+
+	mesh_build_t build = {
+		.terrain = terrain,
+		.vertices = malloc((size_t)(px1 - px0) * (pz1 - pz0) * sizeof(terrain_vertex_t)),
+		.origin = { .x = px0, .y = pz0 },
+		.stride = px1 - px0,
+	};
+
+	job_system_t *jobs = job_system_shared();
+	job_parallel_for_2d(jobs, px1 - px0, pz1 - pz0, px1 - px0, TERRAIN_JOB_ROWS, build_positions, &build);
+	build.first = (uvec2){ .x = nx0 - px0, .y = nz0 - pz0 };
+	job_parallel_for_2d(jobs, nx1 - nx0, nz1 - nz0, nx1 - nx0, TERRAIN_JOB_ROWS, build_normals, &build);
+
+	// only rows that span the whole map are contiguous in the mesh
+	size_t row_size = (size_t)(nx1 - nx0) * sizeof(terrain_vertex_t);
+	if (nx1 - nx0 == w)
+	{
+		mesh_set_vertex_range(terrain->mesh, (size_t)nz0 * w * sizeof(terrain_vertex_t), row_size * (nz1 - nz0),
+			&build.vertices[(nz0 - pz0) * build.stride]);
+	}
+	else
+	{
+		for (uint32_t z = nz0; z < nz1; z++)
+		{
+			mesh_set_vertex_range(terrain->mesh, ((size_t)nx0 + (size_t)z * w) * sizeof(terrain_vertex_t), row_size,
+				&build.vertices[(nx0 - px0) + (z - pz0) * build.stride]);
+		}
+	}
+
+	free(build.vertices);
+}
+
+static bool sample_world_height(terrain_t *terrain, float gx, float gz, float *height)
+{
+	if (!(gx >= 0 && gz >= 0 && gx <= terrain->size.w - 1 && gz <= terrain->size.h - 1)) return false;
+
+	uint32_t ix = (uint32_t)gx < terrain->size.w - 1 ? (uint32_t)gx : terrain->size.w - 2;
+	uint32_t iz = (uint32_t)gz < terrain->size.h - 1 ? (uint32_t)gz : terrain->size.h - 2;
+	float u = gx - ix;
+	float v = gz - iz;
+
+	const float *row = &terrain->height_map[ix + (size_t)iz * terrain->size.w];
+	float top = row[0] + (row[1] - row[0]) * u;
+	float bottom = row[terrain->size.w] + (row[terrain->size.w + 1] - row[terrain->size.w]) * u;
+	*height = (top + (bottom - top) * v) * terrain->elevation + terrain->position[1];
+	return true;
+}
+
+bool terrain_raycast(terrain_t *terrain, const vec3 origin, const vec3 direction, float max_distance, vec2 hit)
+{
+	HE_ASSERT(terrain != NULL, "Cannot raycast NULL");
+
+	// world to grid coordinates, the inverse of build_positions
+	float scale = terrain->scale_scalar;
+	float gx = (origin[0] - terrain->position[0]) / scale + terrain->size.w / 2.0f;
+	float gz = (origin[2] - terrain->position[2]) / scale + terrain->size.h / 2.0f;
+	float dx = direction[0] / scale;
+	float dz = direction[2] / scale;
+
+	// march half a cell at a time until the ray is below the surface, then
+	// narrow the crossing down between the last two samples
+	float step = scale * 0.5f;
+	float last = 0.0f;
+	for (float t = 0.0f; t <= max_distance; t += step)
+	{
+		float height;
+		if (!sample_world_height(terrain, gx + dx * t, gz + dz * t, &height) || origin[1] + direction[1] * t > height)
+		{
+			last = t;
+			continue;
+		}
+
+		float above = last;
+		float below = t;
+		for (int i = 0; i < 16; i++)
+		{
+			float mid = (above + below) * 0.5f;
+			bool under = sample_world_height(terrain, gx + dx * mid, gz + dz * mid, &height) && origin[1] + direction[1] * mid <= height;
+			if (under) below = mid;
+			else above = mid;
+		}
+
+		hit[0] = gx + dx * below;
+		hit[1] = gz + dz * below;
+		return true;
+	}
+	return false;
 }
 
 float terrain_get_height(terrain_t *terrain, uint32_t x, uint32_t y)
@@ -278,33 +529,117 @@ void terrain_set_height(terrain_t *terrain, uint32_t x, uint32_t y, float v)
 	terrain->height_map[x + y * terrain->size.w] = v;
 }
 
-void terrain_resize(terrain_t *terrain, uvec2 size)
+bool terrain_allocate(terrain_t *terrain, uvec2 size)
 {
-	HE_ASSERT(terrain != NULL, "Cannot resize NULL");
+	HE_ASSERT(terrain != NULL, "Cannot allocate NULL");
 	HE_ASSERT(size.w > 0 || size.h > 0, "Invalid terrain size");
 
+	size_t bytes = (size_t)size.w * size.h * sizeof(float);
+
+	// the new storage is set up before the old one goes, so a failure leaves
+	// the terrain as it was
+	if (terrain->storage == TERRAIN_STORAGE_HEAP)
+	{
+		float *heights = malloc(bytes);
+		if (heights == NULL) return false;
+
+		free(terrain->height_map);
+		terrain->height_map = heights;
+		terrain->size = size;
+		return true;
+	}
+
+	// a file the terrain already maps is its own to resize, one it is only
+	// opening has to match the size
+	mapped_file_t *mapping = mapped_file_create(&(mapped_file_desc_t){
+		.path = terrain->storage_path,
+		.mode = terrain->storage == TERRAIN_STORAGE_MAPPED ? MAPPED_FILE_MODE_SHARED : MAPPED_FILE_MODE_PRIVATE,
+		.size = bytes,
+		.resize = terrain->mapping != NULL,
+	});
+	if (mapping == NULL) return false;
+
+	// a private view never writes the file, so the file has to fit the size
+	if (terrain->storage == TERRAIN_STORAGE_MAPPED_PRIVATE && !mapping->existed)
+	{
+		mapped_file_free(mapping);
+		return false;
+	}
+
+	mapped_file_free(terrain->mapping);
+	terrain->mapping = mapping;
+	terrain->height_map = mapping->data;
 	terrain->size = size;
+	terrain_advise(terrain, TERRAIN_ACCESS_RANDOM);
+	return true;
+}
 
-	if (terrain->height_map != NULL) free(terrain->height_map);
-	terrain->height_map = malloc(size.w * size.h * sizeof(float));
+bool terrain_resize(terrain_t *terrain, uvec2 size)
+{
+	HE_ASSERT(terrain != NULL, "Cannot resize NULL");
 
-	for (int x = 0; x < terrain->size.w; x++)
+	if (!terrain_allocate(terrain, size)) return false;
+	terrain_generate(terrain);
+	terrain_update_mesh(terrain);
+	return true;
+}
+
+bool terrain_resample(terrain_t *terrain, uvec2 size, resample_filter_t filter)
+{
+	HE_ASSERT(terrain != NULL, "Cannot resample NULL");
+
+	// remapping resizes the file under the old heights, and a heap map is
+	// replaced, so the old heights are read from a copy
+	uvec2 old_size = terrain->size;
+	size_t bytes = (size_t)old_size.w * old_size.h * sizeof(float);
+	float *old_heights = malloc(bytes);
+	if (old_heights == NULL) return false;
+	memcpy(old_heights, terrain->height_map, bytes);
+
+	if (!terrain_allocate(terrain, size))
 	{
-		for (int z = 0; z < terrain->size.h; z++)
-		{
-			terrain_set_height(terrain, x, z, terrain->noise_function(terrain->seed, (float) x * terrain->scale_scalar, (float) z * terrain->scale_scalar));
-		}
+		free(old_heights);
+		return false;
 	}
+	resample(old_heights, old_size, terrain->height_map, size, filter);
+	free(old_heights);
 
 	terrain_update_mesh(terrain);
+	return true;
 }
 
-void terrain_reset(terrain_t *terrain)
+bool terrain_reset(terrain_t *terrain)
 {
-	terrain_resize(terrain, terrain->size);
+	return terrain_resize(terrain, terrain->size);
 }
 
 uvec2 terrain_get_size(terrain_t *terrain)
 {
 	return terrain->size;
 }
+
+void terrain_advise(terrain_t *terrain, terrain_access_t access)
+{
+	HE_ASSERT(terrain != NULL, "Cannot advise NULL");
+	if (terrain->mapping == NULL) return;
+
+	switch (access)
+	{
+	default:
+	case TERRAIN_ACCESS_NORMAL:
+		mapped_file_advise(terrain->mapping, MAPPED_FILE_ACCESS_NORMAL);
+		break;
+	case TERRAIN_ACCESS_SEQUENTIAL:
+		mapped_file_advise(terrain->mapping, MAPPED_FILE_ACCESS_SEQUENTIAL);
+		break;
+	case TERRAIN_ACCESS_RANDOM:
+		mapped_file_advise(terrain->mapping, MAPPED_FILE_ACCESS_RANDOM);
+		break;
+	}
+}
+
+void terrain_sync(terrain_t *terrain)
+{
+	HE_ASSERT(terrain != NULL, "Cannot sync NULL");
+	if (terrain->mapping != NULL) mapped_file_sync(terrain->mapping);
+}
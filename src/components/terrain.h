@@ -1,12 +1,15 @@
 #ifndef __components_terrain_h__
 #define __components_terrain_h__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <cglm/cglm.h>
 
 #include "gfx/mesh.h"
 #include "gfx/pipeline.h"
+#include "io/mapped_file.h"
+#include "math/resample.h"
 #include "math/types.h"
 #include "camera.h"
 
@@ -14,6 +17,26 @@ typedef float(*terrain_noise_function_t)(int, float, float);
 typedef struct terrain_t terrain_t;
 typedef void(*terrain_erosion_function_t)(terrain_t *);
 
+typedef enum terrain_storage_t
+{
+	TERRAIN_STORAGE_HEAP,
+	// heights live in a raw float file mapped into memory. a missing file is
+	// created, an existing one has to match the size and is used as is.
+	// changes, resizes included, persist without saving
+	TERRAIN_STORAGE_MAPPED,
+	// copy on write view of an existing raw file, which is never modified.
+	// lets several processes share one base map
+	TERRAIN_STORAGE_MAPPED_PRIVATE,
+	TERRAIN_STORAGE_COUNT__,
+} terrain_storage_t;
+
+typedef enum terrain_access_t
+{
+	TERRAIN_ACCESS_NORMAL,
+	TERRAIN_ACCESS_SEQUENTIAL,
+	TERRAIN_ACCESS_RANDOM,
+} terrain_access_t;
+
 typedef struct terrain_desc_t
 {
 	vec3 position;
@@ -22,6 +45,12 @@ typedef struct terrain_desc_t
 	float scale_scalar;
 	float elevation;
 	terrain_noise_function_t noise_function;
+
+	// skip creating any gpu resources. used by the command line tools
+	bool headless;
+
+	terrain_storage_t storage;
+	const char *storage_path;
 } terrain_desc_t;
 
 typedef struct terrain_t
@@ -36,6 +65,10 @@ typedef struct terrain_t
 
 	terrain_noise_function_t noise_function;
 
+	terrain_storage_t storage;
+	char *storage_path;
+	mapped_file_t *mapping;
+
 	mesh_t *mesh;
 	pipeline_t *pipeline;
 #ifndef NDEBUG
@@ -43,17 +76,39 @@ typedef struct terrain_t
 #endif
 } terrain_t;
 
-void terrain_init(const terrain_desc_t *desc, terrain_t **terrain);
+// false if the storage cannot be set up, a mapped file that cannot be
+// mapped or a private base map that does not match the size
+bool terrain_init(const terrain_desc_t *desc, terrain_t **terrain);
 terrain_t *terrain_create(const terrain_desc_t *desc);
+terrain_t *terrain_clone(terrain_t *terrain);
+terrain_t terrain_view(uvec2 size, float *heights);
 void terrain_free(terrain_t *terrain);
 
 void terrain_draw(camera_t *camera, vec3 light_pos, terrain_t *terrain);
 void terrain_update_mesh(terrain_t *terrain);
+// rebuilds the vertices that a change to the heights of the given cells
+// touches and uploads only those
+void terrain_update_mesh_region(terrain_t *terrain, uvec2 origin, uvec2 size);
+// grid coordinates of the first point along a world space ray that is on or
+// below the surface. direction has to be normalized
+bool terrain_raycast(terrain_t *terrain, const vec3 origin, const vec3 direction, float max_distance, vec2 hit);
 
 void terrain_set_height(terrain_t *terrain, uint32_t x, uint32_t y, float v);
 float terrain_get_height(terrain_t *terrain, uint32_t x, uint32_t y);
-void terrain_resize(terrain_t *terrain, uvec2 size);
-void terrain_reset(terrain_t *terrain);
+// storage for a map of the given size, the heights are undefined. false if
+// it cannot be had, the terrain keeps its old size and heights then. a mapped
+// file that already had the size is left as is, see mapping->existed
+bool terrain_allocate(terrain_t *terrain, uvec2 size);
+// fills rows [z0, z1) with noise, lets long generations be split up
+void terrain_generate_rows(terrain_t *terrain, uint32_t z0, uint32_t z1);
+// these fail like terrain_allocate and leave the terrain untouched then
+bool terrain_resize(terrain_t *terrain, uvec2 size);
+// resizes the current heights instead of generating new ones
+bool terrain_resample(terrain_t *terrain, uvec2 size, resample_filter_t filter);
+bool terrain_reset(terrain_t *terrain);
 uvec2 terrain_get_size(terrain_t *terrain);
 
+void terrain_advise(terrain_t *terrain, terrain_access_t access);
+void terrain_sync(terrain_t *terrain);
+
 #endif /* __components_terrain_h__ */
@@ -0,0 +1,62 @@
+#ifndef __core_atomic_h__
+#define __core_atomic_h__
+
+#include <stdint.h>
+
+// minimal atomics. c99 has no <stdatomic.h>, so these wrap the compiler
+// intrinsics directly. the integer operations are sequentially consistent.
+// the float helpers use relaxed ordering: the add is a compare and swap loop
+// that only promises no update is lost, neither orders any other memory
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+static inline int32_t atomic_load_i32(volatile int32_t *p) { return _InterlockedOr((volatile long *)p, 0); }
+static inline void atomic_store_i32(volatile int32_t *p, int32_t v) { _InterlockedExchange((volatile long *)p, v); }
+static inline int32_t atomic_exchange_i32(volatile int32_t *p, int32_t v) { return _InterlockedExchange((volatile long *)p, v); }
+static inline int32_t atomic_fetch_add_i32(volatile int32_t *p, int32_t v) { return _InterlockedExchangeAdd((volatile long *)p, v); }
+static inline int atomic_cas_i32(volatile int32_t *p, int32_t expected, int32_t desired) { return _InterlockedCompareExchange((volatile long *)p, desired, expected) == expected; }
+
+static inline int64_t atomic_load_i64(volatile int64_t *p) { return _InterlockedOr64((volatile long long *)p, 0); }
+static inline void atomic_store_i64(volatile int64_t *p, int64_t v) { _InterlockedExchange64((volatile long long *)p, v); }
+static inline int64_t atomic_fetch_add_i64(volatile int64_t *p, int64_t v) { return _InterlockedExchangeAdd64((volatile long long *)p, v); }
+
+static inline float atomic_load_relaxed_f32(volatile float *p) { return *p; }
+static inline void atomic_add_relaxed_f32(volatile float *p, float v)
+{
+	union { long i; float f; } expected, desired;
+	do
+	{
+		expected.f = *p;
+		desired.f = expected.f + v;
+	} while (_InterlockedCompareExchange((volatile long *)p, desired.i, expected.i) != expected.i);
+}
+#else
+static inline int32_t atomic_load_i32(volatile int32_t *p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+static inline void atomic_store_i32(volatile int32_t *p, int32_t v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+static inline int32_t atomic_exchange_i32(volatile int32_t *p, int32_t v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+static inline int32_t atomic_fetch_add_i32(volatile int32_t *p, int32_t v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+static inline int atomic_cas_i32(volatile int32_t *p, int32_t expected, int32_t desired) { return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+
+static inline int64_t atomic_load_i64(volatile int64_t *p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+static inline void atomic_store_i64(volatile int64_t *p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+static inline int64_t atomic_fetch_add_i64(volatile int64_t *p, int64_t v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+
+static inline float atomic_load_relaxed_f32(volatile float *p)
+{
+	union { int32_t i; float f; } v;
+	v.i = __atomic_load_n((volatile int32_t *)p, __ATOMIC_RELAXED);
+	return v.f;
+}
+static inline void atomic_add_relaxed_f32(volatile float *p, float v)
+{
+	union { int32_t i; float f; } expected, desired;
+	expected.i = __atomic_load_n((volatile int32_t *)p, __ATOMIC_RELAXED);
+	do
+	{
+		desired.f = expected.f + v;
+	} while (!__atomic_compare_exchange_n((volatile int32_t *)p, &expected.i, desired.i, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+#endif
+
+#endif /* __core_atomic_h__ */
@@ -0,0 +1,12 @@
+#ifndef __core_crc32_h__
+#define __core_crc32_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32_INIT (0)
+
+// pass the previous result to continue a checksum over several buffers
+uint32_t crc32_update(uint32_t crc, const void *data, size_t size);
+
+#endif /* __core_crc32_h__ */
@@ -0,0 +1,401 @@
+#include "job.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+#include "thread.h"
+#include "debug/assert.h"
+
+#if defined(_MSC_VER)
+#define JOB_THREAD_LOCAL __declspec(thread)
+#else
+#define JOB_THREAD_LOCAL __thread
+#endif
+
+#define JOB_DEQUE_INITIAL_CAPACITY (256)
+
+typedef struct job_range_t
+{
+	job_range_fn_t fn;
+	void *user_pointer;
+	uint32_t w;
+	uint32_t h;
+	uint32_t grain_w;
+	uint32_t grain_h;
+	uint32_t blocks_w;
+} job_range_t;
+
+// either a plain job, or the blocks [begin, end) of a parallel for
+typedef struct job_t
+{
+	job_fn_t fn;
+	void *user_pointer;
+	const job_range_t *range;
+	uint32_t begin;
+	uint32_t end;
+	job_group_t *group;
+} job_t;
+
+typedef struct job_deque_t
+{
+	mutex_t *mutex;
+	job_t *jobs;
+	uint32_t capacity;
+
+	// the owner works at the tail, thieves take from the head
+	uint32_t head;
+	uint32_t tail;
+} job_deque_t;
+
+typedef struct job_worker_t
+{
+	job_system_t *system;
+	int index;
+} job_worker_t;
+
+struct job_system_t
+{
+	int worker_count;
+	bool pin_threads;
+
+	// one deque per worker, plus one shared by every other thread
+	job_deque_t *deques;
+	job_worker_t *workers;
+	thread_t **threads;
+
+	mutex_t *sleep_mutex;
+	cond_t *wake;
+	int sleepers;
+	volatile int32_t queued;
+	bool stop;
+};
+
+static JOB_THREAD_LOCAL job_system_t *current_system;
+static JOB_THREAD_LOCAL int current_index;
+
+static job_system_t *shared_system;
+static volatile int32_t shared_state;
+
+static void deque_push(job_deque_t *deque, const job_t *job)
+{
+	mutex_lock(deque->mutex);
+	if (deque->tail - deque->head == deque->capacity)
+	{
+		// unwrap into a buffer twice the size
+		job_t *jobs = malloc(2 * deque->capacity * sizeof(job_t));
+		for (uint32_t i = deque->head; i != deque->tail; i++)
+		{
+			jobs[i - deque->head] = deque->jobs[i & (deque->capacity - 1)];
+		}
+		free(deque->jobs);
+		deque->jobs = jobs;
+		deque->tail -= deque->head;
+		deque->head = 0;
+		deque->capacity *= 2;
+	}
+	deque->jobs[deque->tail++ & (deque->capacity - 1)] = *job;
+	mutex_unlock(deque->mutex);
+}
+
+static bool deque_pop(job_deque_t *deque, job_t *job)
+{
+	mutex_lock(deque->mutex);
+	bool found = deque->tail != deque->head;
+	if (found) *job = deque->jobs[--deque->tail & (deque->capacity - 1)];
+	mutex_unlock(deque->mutex);
+	return found;
+}
+
+static bool deque_steal(job_deque_t *deque, job_t *job)
+{
+	mutex_lock(deque->mutex);
+	bool found = deque->tail != deque->head;
+	if (found) *job = deque->jobs[deque->head++ & (deque->capacity - 1)];
+	mutex_unlock(deque->mutex);
+	return found;
+}
+
+static int calling_index(job_system_t *system)
+{
+	return current_system == system ? current_index : system->worker_count;
+}
+
+static void submit(job_system_t *system, const job_t *job)
+{
+	atomic_fetch_add_i32(&job->group->pending, 1);
+	deque_push(&system->deques[calling_index(system)], job);
+	atomic_fetch_add_i32(&system->queued, 1);
+
+	mutex_lock(system->sleep_mutex);
+	if (system->sleepers > 0) cond_signal(system->wake);
+	mutex_unlock(system->sleep_mutex);
+}
+
+static bool find_job(job_system_t *system, int index, job_t *job)
+{
+	if (atomic_load_i32(&system->queued) == 0) return false;
+
+	int deque_count = system->worker_count + 1;
+	bool found = deque_pop(&system->deques[index], job);
+	for (int i = 1; !found && i < deque_count; i++)
+	{
+		found = deque_steal(&system->deques[(index + i) % deque_count], job);
+	}
+
+	if (found) atomic_fetch_add_i32(&system->queued, -1);
+	return found;
+}
+
+static void run_range(job_system_t *system, job_t *job)
+{
+	// keep one half, leave the other for whoever gets to it first
+	while (job->end - job->begin > 1)
+	{
+		uint32_t mid = job->begin + (job->end - job->begin) / 2;
+		job_t half = *job;
+		half.begin = mid;
+		submit(system, &half);
+		job->end = mid;
+	}
+
+	const job_range_t *range = job->range;
+	uint32_t x0 = (job->begin % range->blocks_w) * range->grain_w;
+	uint32_t y0 = (job->begin / range->blocks_w) * range->grain_h;
+	uint32_t x1 = x0 + range->grain_w < range->w ? x0 + range->grain_w : range->w;
+	uint32_t y1 = y0 + range->grain_h < range->h ? y0 + range->grain_h : range->h;
+	range->fn(range->user_pointer, x0, y0, x1, y1);
+}
+
+static void run_job(job_system_t *system, job_t *job)
+{
+	if (job->range != NULL) run_range(system, job);
+	else job->fn(job->user_pointer);
+
+	// the group may be gone as soon as pending reaches zero
+	if (atomic_fetch_add_i32(&job->group->pending, -1) == 1)
+	{
+		mutex_lock(system->sleep_mutex);
+		cond_broadcast(system->wake);
+		mutex_unlock(system->sleep_mutex);
+	}
+}
+
+static void worker_thread(void *user_pointer)
+{
+	job_worker_t *worker = user_pointer;
+	job_system_t *system = worker->system;
+
+	current_system = system;
+	current_index = worker->index;
+	if (system->pin_threads) thread_pin_current((worker->index + 1) % thread_hardware_concurrency());
+
+	for (;;)
+	{
+		job_t job;
+		if (find_job(system, worker->index, &job))
+		{
+			run_job(system, &job);
+			continue;
+		}
+
+		mutex_lock(system->sleep_mutex);
+		while (atomic_load_i32(&system->queued) == 0 && !system->stop)
+		{
+			system->sleepers++;
+			cond_wait(system->wake, system->sleep_mutex);
+			system->sleepers--;
+		}
+		bool stop = system->stop && atomic_load_i32(&system->queued) == 0;
+		mutex_unlock(system->sleep_mutex);
+
+		if (stop) return;
+	}
+}
+
+void job_system_init(const job_system_desc_t *desc, job_system_t **system)
+{
+	HE_ASSERT(system != NULL, "Cannot initialize NULL");
+
+	int worker_count = desc != NULL && desc->workers > 0 ? desc->workers : thread_hardware_concurrency() - 1;
+	if (worker_count < 1) worker_count = 1;
+
+	job_system_t *result = calloc(1, sizeof(job_system_t));
+	result->worker_count = worker_count;
+	result->pin_threads = desc != NULL && desc->pin_threads;
+	result->sleep_mutex = mutex_create();
+	result->wake = cond_create();
+
+	result->deques = calloc(worker_count + 1, sizeof(job_deque_t));
+	for (int i = 0; i <= worker_count; i++)
+	{
+		result->deques[i].mutex = mutex_create();
+		result->deques[i].capacity = JOB_DEQUE_INITIAL_CAPACITY;
+		result->deques[i].jobs = malloc(JOB_DEQUE_INITIAL_CAPACITY * sizeof(job_t));
+	}
+
+	result->workers = malloc(worker_count * sizeof(job_worker_t));
+	result->threads = malloc(worker_count * sizeof(thread_t *));
+	for (int i = 0; i < worker_count; i++)
+	{
+		result->workers[i] = (job_worker_t){ .system = result, .index = i };
+		result->threads[i] = thread_create(worker_thread, &result->workers[i]);
+	}
+
+	*system = result;
+}
+
+job_system_t *job_system_create(const job_system_desc_t *desc)
+{
+	job_system_t *system;
+	job_system_init(desc, &system);
+	return system;
+}
+
+void job_system_free(job_system_t *system)
+{
+	if (system == NULL) return;
+
+	mutex_lock(system->sleep_mutex);
+	system->stop = true;
+	cond_broadcast(system->wake);
+	mutex_unlock(system->sleep_mutex);
+
+	for (int i = 0; i < system->worker_count; i++)
+	{
+		thread_join(system->threads[i]);
+	}
+
+	for (int i = 0; i <= system->worker_count; i++)
+	{
+		mutex_free(system->deques[i].mutex);
+		free(system->deques[i].jobs);
+	}
+	free(system->deques);
+	free(system->workers);
+	free(system->threads);
+	cond_free(system->wake);
+	mutex_free(system->sleep_mutex);
+	free(system);
+}
+
+int job_system_worker_count(job_system_t *system)
+{
+	return system->worker_count;
+}
+
+int job_system_worker_index(job_system_t *system)
+{
+	return calling_index(system);
+}
+
+void job_system_shared_init(const job_system_desc_t *desc)
+{
+	HE_VERIFY(atomic_cas_i32(&shared_state, 0, 1), "The shared job system already exists");
+	shared_system = job_system_create(desc);
+	atomic_store_i32(&shared_state, 2);
+}
+
+job_system_t *job_system_shared(void)
+{
+	// whoever gets here first creates it, everyone else waits a moment
+	if (atomic_load_i32(&shared_state) != 2)
+	{
+		if (atomic_cas_i32(&shared_state, 0, 1))
+		{
+			shared_system = job_system_create(NULL);
+			atomic_store_i32(&shared_state, 2);
+		}
+		while (atomic_load_i32(&shared_state) != 2) {}
+	}
+	return shared_system;
+}
+
+void job_system_shared_free(void)
+{
+	if (atomic_load_i32(&shared_state) != 2) return;
+	job_system_free(shared_system);
+	shared_system = NULL;
+	atomic_store_i32(&shared_state, 0);
+}
+
+void job_group_init(job_system_t *system, job_group_t *group)
+{
+	HE_ASSERT(system != NULL, "A job system is required");
+	HE_ASSERT(group != NULL, "Cannot initialize NULL");
+
+	group->system = system;
+	group->pending = 0;
+}
+
+void job_group_run(job_group_t *group, job_fn_t fn, void *user_pointer)
+{
+	HE_ASSERT(fn != NULL, "A job function is required");
+
+	submit(group->system, &(job_t){
+		.fn = fn,
+		.user_pointer = user_pointer,
+		.group = group,
+	});
+}
+
+void job_group_wait(job_group_t *group)
+{
+	job_system_t *system = group->system;
+	int index = calling_index(system);
+
+	while (atomic_load_i32(&group->pending) > 0)
+	{
+		job_t job;
+		if (find_job(system, index, &job))
+		{
+			run_job(system, &job);
+			continue;
+		}
+
+		// whatever is left runs on other threads, sleep until something
+		// finishes or shows up
+		mutex_lock(system->sleep_mutex);
+		while (atomic_load_i32(&group->pending) > 0 && atomic_load_i32(&system->queued) == 0)
+		{
+			system->sleepers++;
+			cond_wait(system->wake, system->sleep_mutex);
+			system->sleepers--;
+		}
+		mutex_unlock(system->sleep_mutex);
+	}
+}
+
+void job_parallel_for_2d(job_system_t *system, uint32_t w, uint32_t h, uint32_t grain_w, uint32_t grain_h,
+	job_range_fn_t fn, void *user_pointer)
+{
+	HE_ASSERT(fn != NULL, "A range function is required");
+	if (w == 0 || h == 0) return;
+
+	job_range_t range = {
+		.fn = fn,
+		.user_pointer = user_pointer,
+		.w = w,
+		.h = h,
+		.grain_w = grain_w > 0 ? grain_w : w,
+		.grain_h = grain_h > 0 ? grain_h : h,
+	};
+	range.blocks_w = (w + range.grain_w - 1) / range.grain_w;
+	uint32_t blocks = range.blocks_w * ((h + range.grain_h - 1) / range.grain_h);
+
+	if (blocks == 1)
+	{
+		fn(user_pointer, 0, 0, w, h);
+		return;
+	}
+
+	job_group_t group;
+	job_group_init(system, &group);
+	submit(system, &(job_t){
+		.range = &range,
+		.begin = 0,
+		.end = blocks,
+		.group = &group,
+	});
+	job_group_wait(&group);
+}
@@ -0,0 +1,58 @@
+#ifndef __core_job_h__
+#define __core_job_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// work stealing job system. every worker owns a deque, pushes and pops its
+// own jobs at the back and steals from the front of the others once it runs
+// dry. a thread waiting on a group runs jobs instead of blocking, so jobs
+// may spawn and wait on jobs of their own
+
+typedef void(*job_fn_t)(void *user_pointer);
+typedef void(*job_range_fn_t)(void *user_pointer, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+typedef struct job_system_t job_system_t;
+
+typedef struct job_system_desc_t
+{
+	// zero picks one less than the hardware concurrency, since the thread
+	// waiting on a group helps out
+	int workers;
+
+	// pin worker n to cpu n + 1, leaving cpu 0 to the thread that submits
+	bool pin_threads;
+} job_system_desc_t;
+
+// jobs that can be waited on together, lives wherever the caller likes
+typedef struct job_group_t
+{
+	job_system_t *system;
+	volatile int32_t pending;
+} job_group_t;
+
+void job_system_init(const job_system_desc_t *desc, job_system_t **system);
+job_system_t *job_system_create(const job_system_desc_t *desc);
+void job_system_free(job_system_t *system);
+
+int job_system_worker_count(job_system_t *system);
+// index of the calling worker, or the worker count on any other thread
+int job_system_worker_index(job_system_t *system);
+
+// the pool every subsystem shares. configure it once at startup, otherwise
+// it is created with the defaults on first use
+void job_system_shared_init(const job_system_desc_t *desc);
+job_system_t *job_system_shared(void);
+void job_system_shared_free(void);
+
+void job_group_init(job_system_t *system, job_group_t *group);
+void job_group_run(job_group_t *group, job_fn_t fn, void *user_pointer);
+void job_group_wait(job_group_t *group);
+
+// runs fn over [0, w) x [0, h) in blocks of at most grain_w x grain_h, and
+// returns once every block ran. blocks are split in halves, so a thief
+// always takes the largest piece of work left
+void job_parallel_for_2d(job_system_t *system, uint32_t w, uint32_t h, uint32_t grain_w, uint32_t grain_h,
+	job_range_fn_t fn, void *user_pointer);
+
+#endif /* __core_job_h__ */
@@ -0,0 +1,124 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// syscall() is not part of posix
+#define _GNU_SOURCE
+#endif
+
+#include "perf_counter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "debug/assert.h"
+
+#if defined(__linux__)
+static int open_event(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+perf_counter_t *perf_counter_create(void)
+{
+	perf_counter_t *counter = calloc(1, sizeof(perf_counter_t));
+
+	for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+	{
+		counter->fds[i] = -1;
+	}
+
+#if defined(__linux__)
+	uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	counter->fds[PERF_COUNTER_CYCLES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	counter->fds[PERF_COUNTER_INSTRUCTIONS] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	counter->fds[PERF_COUNTER_L1D_MISSES] = open_event(PERF_TYPE_HW_CACHE, l1d_read_miss);
+	counter->fds[PERF_COUNTER_LLC_MISSES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+
+	for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+	{
+		counter->available[i] = counter->fds[i] >= 0;
+	}
+
+	return counter;
+}
+
+void perf_counter_free(perf_counter_t *counter)
+{
+	if (counter == NULL) return;
+
+#if defined(__linux__)
+	for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+	{
+		if (counter->fds[i] >= 0) close(counter->fds[i]);
+	}
+#endif
+
+	free(counter);
+}
+
+bool perf_counter_any_available(perf_counter_t *counter)
+{
+	for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+	{
+		if (counter->available[i]) return true;
+	}
+	return false;
+}
+
+const char *perf_counter_event_name(perf_counter_event_t event)
+{
+	switch (event)
+	{
+	case PERF_COUNTER_CYCLES: return "cycles";
+	case PERF_COUNTER_INSTRUCTIONS: return "instructions";
+	case PERF_COUNTER_L1D_MISSES: return "l1d read misses";
+	case PERF_COUNTER_LLC_MISSES: return "llc misses";
+	default: return "unknown";
+	}
+}
+
+void perf_counter_start(perf_counter_t *counter)
+{
+	HE_ASSERT(counter != NULL, "Cannot start NULL");
+
+#if defined(__linux__)
+	for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+	{
+		if (!counter->available[i]) continue;
+		ioctl(counter->fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+void perf_counter_stop(perf_counter_t *counter)
+{
+	HE_ASSERT(counter != NULL, "Cannot stop NULL");
+
+#if defined(__linux__)
+	for (int i = 0; i < PERF_COUNTER_EVENT_COUNT__; i++)
+	{
+		if (!counter->available[i]) continue;
+		ioctl(counter->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+		uint64_t value = 0;
+		if (read(counter->fds[i], &value, sizeof(value)) == sizeof(value)) counter->values[i] = value;
+	}
+#endif
+}
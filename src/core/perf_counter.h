@@ -0,0 +1,37 @@
+#ifndef __core_perf_counter_h__
+#define __core_perf_counter_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// hardware event counters for the calling thread, through perf_event_open on
+// linux. events the kernel or container refuses are simply not available,
+// and nothing is on other platforms
+
+typedef enum perf_counter_event_t
+{
+	PERF_COUNTER_CYCLES,
+	PERF_COUNTER_INSTRUCTIONS,
+	PERF_COUNTER_L1D_MISSES,
+	PERF_COUNTER_LLC_MISSES,
+	PERF_COUNTER_EVENT_COUNT__,
+} perf_counter_event_t;
+
+typedef struct perf_counter_t
+{
+	int fds[PERF_COUNTER_EVENT_COUNT__];
+	bool available[PERF_COUNTER_EVENT_COUNT__];
+	uint64_t values[PERF_COUNTER_EVENT_COUNT__];
+} perf_counter_t;
+
+perf_counter_t *perf_counter_create(void);
+void perf_counter_free(perf_counter_t *counter);
+
+// returns false if no event could be opened at all
+bool perf_counter_any_available(perf_counter_t *counter);
+const char *perf_counter_event_name(perf_counter_event_t event);
+
+void perf_counter_start(perf_counter_t *counter);
+void perf_counter_stop(perf_counter_t *counter);
+
+#endif /* __core_perf_counter_h__ */
@@ -0,0 +1,269 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// sched_setaffinity() is not part of posix
+#define _GNU_SOURCE
+#endif
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "thread.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "debug/assert.h"
+
+struct thread_t
+{
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	thread_fn_t fn;
+	void *user_pointer;
+};
+
+struct mutex_t
+{
+#if defined(_WIN32)
+	SRWLOCK lock;
+#else
+	pthread_mutex_t lock;
+#endif
+};
+
+struct cond_t
+{
+#if defined(_WIN32)
+	CONDITION_VARIABLE cond;
+#else
+	pthread_cond_t cond;
+#endif
+};
+
+struct barrier_t
+{
+	mutex_t *mutex;
+	cond_t *cond;
+	int count;
+	int arrived;
+	uint32_t generation;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+	thread_t *thread = (thread_t *)param;
+	thread->fn(thread->user_pointer);
+	return 0;
+}
+#else
+static void *thread_entry(void *param)
+{
+	thread_t *thread = (thread_t *)param;
+	thread->fn(thread->user_pointer);
+	return NULL;
+}
+#endif
+
+thread_t *thread_create(thread_fn_t fn, void *user_pointer)
+{
+	HE_ASSERT(fn != NULL, "A thread function is required");
+
+	thread_t *thread = malloc(sizeof(thread_t));
+	thread->fn = fn;
+	thread->user_pointer = user_pointer;
+
+#if defined(_WIN32)
+	thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+	HE_VERIFY(thread->handle != NULL, "Failed to create thread");
+#else
+	HE_VERIFY(pthread_create(&thread->handle, NULL, thread_entry, thread) == 0, "Failed to create thread");
+#endif
+
+	return thread;
+}
+
+void thread_join(thread_t *thread)
+{
+	if (thread == NULL) return;
+
+#if defined(_WIN32)
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+
+	free(thread);
+}
+
+int thread_hardware_concurrency(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+bool thread_pin_current(int cpu)
+{
+	HE_ASSERT(cpu >= 0, "Invalid cpu index");
+
+#if defined(_WIN32)
+	if (cpu >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+	if (cpu >= CPU_SETSIZE) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+mutex_t *mutex_create(void)
+{
+	mutex_t *mutex = malloc(sizeof(mutex_t));
+#if defined(_WIN32)
+	InitializeSRWLock(&mutex->lock);
+#else
+	pthread_mutex_init(&mutex->lock, NULL);
+#endif
+	return mutex;
+}
+
+void mutex_free(mutex_t *mutex)
+{
+	if (mutex == NULL) return;
+#if !defined(_WIN32)
+	pthread_mutex_destroy(&mutex->lock);
+#endif
+	free(mutex);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+#if defined(_WIN32)
+	AcquireSRWLockExclusive(&mutex->lock);
+#else
+	pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+#if defined(_WIN32)
+	ReleaseSRWLockExclusive(&mutex->lock);
+#else
+	pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+cond_t *cond_create(void)
+{
+	cond_t *cond = malloc(sizeof(cond_t));
+#if defined(_WIN32)
+	InitializeConditionVariable(&cond->cond);
+#else
+	pthread_cond_init(&cond->cond, NULL);
+#endif
+	return cond;
+}
+
+void cond_free(cond_t *cond)
+{
+	if (cond == NULL) return;
+#if !defined(_WIN32)
+	pthread_cond_destroy(&cond->cond);
+#endif
+	free(cond);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+#if defined(_WIN32)
+	SleepConditionVariableSRW(&cond->cond, &mutex->lock, INFINITE, 0);
+#else
+	pthread_cond_wait(&cond->cond, &mutex->lock);
+#endif
+}
+
+void cond_signal(cond_t *cond)
+{
+#if defined(_WIN32)
+	WakeConditionVariable(&cond->cond);
+#else
+	pthread_cond_signal(&cond->cond);
+#endif
+}
+
+void cond_broadcast(cond_t *cond)
+{
+#if defined(_WIN32)
+	WakeAllConditionVariable(&cond->cond);
+#else
+	pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+barrier_t *barrier_create(int count)
+{
+	HE_ASSERT(count > 0, "A barrier needs at least one thread");
+
+	barrier_t *barrier = malloc(sizeof(barrier_t));
+	barrier->mutex = mutex_create();
+	barrier->cond = cond_create();
+	barrier->count = count;
+	barrier->arrived = 0;
+	barrier->generation = 0;
+	return barrier;
+}
+
+void barrier_free(barrier_t *barrier)
+{
+	if (barrier == NULL) return;
+	cond_free(barrier->cond);
+	mutex_free(barrier->mutex);
+	free(barrier);
+}
+
+void barrier_wait(barrier_t *barrier)
+{
+	mutex_lock(barrier->mutex);
+
+	// the generation tells a wakeup of this round apart from a spurious one
+	uint32_t generation = barrier->generation;
+	if (++barrier->arrived == barrier->count)
+	{
+		barrier->arrived = 0;
+		barrier->generation++;
+		cond_broadcast(barrier->cond);
+	}
+	else
+	{
+		while (generation == barrier->generation)
+		{
+			cond_wait(barrier->cond, barrier->mutex);
+		}
+	}
+
+	mutex_unlock(barrier->mutex);
+}
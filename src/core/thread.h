@@ -0,0 +1,34 @@
+#ifndef __core_thread_h__
+#define __core_thread_h__
+
+#include <stdbool.h>
+
+typedef void(*thread_fn_t)(void *);
+
+typedef struct thread_t thread_t;
+typedef struct mutex_t mutex_t;
+typedef struct cond_t cond_t;
+typedef struct barrier_t barrier_t;
+
+thread_t *thread_create(thread_fn_t fn, void *user_pointer);
+void thread_join(thread_t *thread);
+int thread_hardware_concurrency(void);
+// returns false where pinning is unsupported
+bool thread_pin_current(int cpu);
+
+mutex_t *mutex_create(void);
+void mutex_free(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+cond_t *cond_create(void);
+void cond_free(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+
+barrier_t *barrier_create(int count);
+void barrier_free(barrier_t *barrier);
+void barrier_wait(barrier_t *barrier);
+
+#endif /* __core_thread_h__ */
@@ -0,0 +1,7 @@
+#ifndef __core_timer_h__
+#define __core_timer_h__
+
+// monotonic time in seconds. only meaningful relative to another call
+double timer_now(void);
+
+#endif /* __core_timer_h__ */
@@ -1,12 +1,17 @@
 #include "erosion.h"
 
+#include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
 #include <cglm/cglm.h>
 
+#include "core/atomic.h"
+#include "core/job.h"
+#include "core/timer.h"
 #include "debug/assert.h"
 
 typedef struct drop_t
@@ -16,31 +21,260 @@ typedef struct drop_t
 	float velocity;
 	float water;
 	float sediment;
+	int iteration;
+	int pit_steps;
 } drop_t;
 
-static float rand_x_position_on_terrain(terrain_t *terrain)
+// log2 of the blocks per axis the wavefront sorts drops into
+#define EROSION_WAVEFRONT_BLOCK_BITS (8)
+
+typedef struct wavefront_entry_t
+{
+	uint32_t key;
+	drop_t drop;
+} wavefront_entry_t;
+
+static uint64_t hash_drop(uint32_t seed, uint64_t drop)
 {
-	float random = ((float) rand() / (float) RAND_MAX);
-	return random * (terrain_get_size(terrain).w - 1.1f);
+	// splitmix64 finalizer, every (seed, drop) pair gets an independent value
+	uint64_t z = drop + ((uint64_t)seed << 32) + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
 }
 
-static float rand_y_position_on_terrain(terrain_t *terrain)
+#if defined(_MSC_VER)
+#define EROSION_INLINE static __forceinline
+#else
+#define EROSION_INLINE static inline __attribute__((always_inline))
+#endif
+
+// cells per side of a delta tile
+#define DELTA_TILE_BITS (4)
+#define DELTA_TILE_SIZE (1 << DELTA_TILE_BITS)
+#define DELTA_TILE_CELLS (DELTA_TILE_SIZE * DELTA_TILE_SIZE)
+#define DELTA_MAP_INITIAL_TILES (64)
+#define DELTA_MAP_EMPTY (UINT32_MAX)
+
+// sparse deltas of one lane, a hash from tile to a block of cell deltas.
+// blocks are handed out in the order their tiles are first touched. with a
+// fill map the blocks hold absolute heights instead, copied from the fill
+// map when the tile is first touched, and the keys double as the read set
+typedef struct delta_map_t
+{
+	uint32_t tiles_w;
+
+	const float *fill;
+	int fill_w;
+	int fill_h;
+	uint8_t *dirty;
+
+	// open addressing table of block indices, twice the block capacity
+	uint32_t *slots;
+	uint32_t slot_mask;
+
+	uint32_t *keys;
+	float *blocks;
+	uint32_t count;
+	uint32_t capacity;
+
+	uint32_t last_key;
+	uint32_t last_block;
+} delta_map_t;
+
+static uint32_t delta_map_hash(uint32_t key)
 {
-	float random = ((float) rand() / (float) RAND_MAX);
-	return random * (terrain_get_size(terrain).h - 1.1f);
+	return key * 0x9E3779B1u;
 }
 
-static float height_at(terrain_t *t, int x, int y)
+static void delta_map_init(delta_map_t *map, uint32_t tiles_w, uint32_t capacity)
 {
-	return terrain_get_height(t, (uint32_t)x, (uint32_t)y);
+	uint32_t tiles = DELTA_MAP_INITIAL_TILES;
+	while (tiles < capacity) tiles *= 2;
+
+	memset(map, 0, sizeof(delta_map_t));
+	map->tiles_w = tiles_w;
+	map->capacity = tiles;
+	map->slot_mask = 2 * tiles - 1;
+	map->slots = malloc(2 * tiles * sizeof(uint32_t));
+	map->keys = malloc(tiles * sizeof(uint32_t));
+	map->dirty = malloc(tiles);
+	map->blocks = malloc((size_t)tiles * DELTA_TILE_CELLS * sizeof(float));
+	memset(map->slots, 0xFF, 2 * tiles * sizeof(uint32_t));
+	map->last_key = DELTA_MAP_EMPTY;
 }
 
-static float set_height_at(terrain_t *t, int x, int y, float v)
+static void delta_map_free(delta_map_t *map)
 {
-	terrain_set_height(t, (uint32_t)x, (uint32_t)y, v);
+	free(map->slots);
+	free(map->keys);
+	free(map->dirty);
+	free(map->blocks);
 }
 
-static float get_drop_height(terrain_t *t, vec2 pos)
+static void delta_map_clear(delta_map_t *map)
+{
+	memset(map->slots, 0xFF, (map->slot_mask + 1) * sizeof(uint32_t));
+	map->count = 0;
+	map->last_key = DELTA_MAP_EMPTY;
+}
+
+static uint32_t delta_map_find(delta_map_t *map, uint32_t key)
+{
+	for (uint32_t slot = delta_map_hash(key) & map->slot_mask;; slot = (slot + 1) & map->slot_mask)
+	{
+		uint32_t block = map->slots[slot];
+		if (block == DELTA_MAP_EMPTY || map->keys[block] == key) return block;
+	}
+}
+
+static void delta_map_place(delta_map_t *map, uint32_t block)
+{
+	uint32_t slot = delta_map_hash(map->keys[block]) & map->slot_mask;
+	while (map->slots[slot] != DELTA_MAP_EMPTY)
+	{
+		slot = (slot + 1) & map->slot_mask;
+	}
+	map->slots[slot] = block;
+}
+
+static uint32_t delta_map_insert(delta_map_t *map, uint32_t key)
+{
+	if (map->count == map->capacity)
+	{
+		map->capacity *= 2;
+		map->keys = realloc(map->keys, map->capacity * sizeof(uint32_t));
+		map->dirty = realloc(map->dirty, map->capacity);
+		map->blocks = realloc(map->blocks, (size_t)map->capacity * DELTA_TILE_CELLS * sizeof(float));
+
+		map->slot_mask = 2 * map->capacity - 1;
+		map->slots = realloc(map->slots, 2 * map->capacity * sizeof(uint32_t));
+		memset(map->slots, 0xFF, 2 * map->capacity * sizeof(uint32_t));
+		for (uint32_t b = 0; b < map->count; b++)
+		{
+			delta_map_place(map, b);
+		}
+	}
+
+	uint32_t block = map->count++;
+	map->keys[block] = key;
+	map->dirty[block] = 0;
+
+	float *cells = &map->blocks[(size_t)block * DELTA_TILE_CELLS];
+	if (map->fill != NULL)
+	{
+		// cells past the map edge are never read, only the overlap is copied
+		int x0 = (int)(key % map->tiles_w) * DELTA_TILE_SIZE;
+		int y0 = (int)(key / map->tiles_w) * DELTA_TILE_SIZE;
+		int w = map->fill_w - x0 < DELTA_TILE_SIZE ? map->fill_w - x0 : DELTA_TILE_SIZE;
+		int h = map->fill_h - y0 < DELTA_TILE_SIZE ? map->fill_h - y0 : DELTA_TILE_SIZE;
+		for (int y = 0; y < h; y++)
+		{
+			memcpy(&cells[y * DELTA_TILE_SIZE], &map->fill[x0 + (y0 + y) * map->fill_w], w * sizeof(float));
+		}
+	}
+	else
+	{
+		memset(cells, 0, DELTA_TILE_CELLS * sizeof(float));
+	}
+
+	delta_map_place(map, block);
+	return block;
+}
+
+EROSION_INLINE float *delta_map_cell(delta_map_t *map, int x, int y, bool insert)
+{
+	uint32_t key = ((uint32_t)x >> DELTA_TILE_BITS) + ((uint32_t)y >> DELTA_TILE_BITS) * map->tiles_w;
+
+	// drops stay in the same tile for several accesses in a row
+	uint32_t block = map->last_block;
+	if (key != map->last_key)
+	{
+		block = delta_map_find(map, key);
+		if (block == DELTA_MAP_EMPTY)
+		{
+			if (!insert) return NULL;
+			block = delta_map_insert(map, key);
+		}
+		map->last_key = key;
+		map->last_block = block;
+	}
+
+	uint32_t cell = ((uint32_t)x & (DELTA_TILE_SIZE - 1)) + ((uint32_t)y & (DELTA_TILE_SIZE - 1)) * DELTA_TILE_SIZE;
+	return &map->blocks[(size_t)block * DELTA_TILE_CELLS + cell];
+}
+
+EROSION_INLINE float delta_map_get(delta_map_t *map, int x, int y)
+{
+	float *cell = delta_map_cell(map, x, y, false);
+	return cell != NULL ? *cell : 0.0f;
+}
+
+EROSION_INLINE void delta_map_add(delta_map_t *map, int x, int y, float v)
+{
+	*delta_map_cell(map, x, y, true) += v;
+}
+
+// what the kernel reads and writes. directly that is the height map itself.
+// with deltas the heights stay frozen and every write lands in a private
+// delta map instead, reads see the heights plus the deltas. an overlay
+// copies every touched tile into a private map and works on the copy.
+// atomic fields are shared between threads and every write is an atomic add
+typedef enum field_mode_t
+{
+	FIELD_DIRECT,
+	FIELD_DELTAS,
+	FIELD_OVERLAY,
+	FIELD_ATOMIC,
+	FIELD_MODE_COUNT__,
+} field_mode_t;
+
+typedef struct height_field_t
+{
+	float *heights;
+	int w;
+	int h;
+	field_mode_t mode;
+	delta_map_t *deltas;
+} height_field_t;
+
+static height_field_t field_from_terrain(terrain_t *terrain)
+{
+	return (height_field_t){
+		.heights = terrain->height_map,
+		.w = (int)terrain->size.w,
+		.h = (int)terrain->size.h,
+	};
+}
+
+EROSION_INLINE float height_at(height_field_t *f, int x, int y, const field_mode_t mode)
+{
+	if (mode == FIELD_OVERLAY) return *delta_map_cell(f->deltas, x, y, true);
+	if (mode == FIELD_ATOMIC) return atomic_load_relaxed_f32(&f->heights[x + y * f->w]);
+
+	float v = f->heights[x + y * f->w];
+	if (mode == FIELD_DELTAS) v += delta_map_get(f->deltas, x, y);
+	return v;
+}
+
+EROSION_INLINE void set_height_at(height_field_t *f, int x, int y, float old, float v, const field_mode_t mode)
+{
+	if (mode == FIELD_OVERLAY)
+	{
+		*delta_map_cell(f->deltas, x, y, true) = v;
+		f->deltas->dirty[f->deltas->last_block] = 1;
+	}
+	else if (mode == FIELD_DELTAS) delta_map_add(f->deltas, x, y, v - old);
+	else if (mode == FIELD_ATOMIC)
+	{
+		// brush cells outside the radius have no weight, skip their compare and
+		// swap loop
+		if (v != old) atomic_add_relaxed_f32(&f->heights[x + y * f->w], v - old);
+	}
+	else f->heights[x + y * f->w] = v;
+}
+
+EROSION_INLINE float get_drop_height(height_field_t *f, vec2 pos, const field_mode_t mode)
 {
 	int ix = (int) pos[0];
 	int iz = (int) pos[1];
@@ -48,13 +282,13 @@ static float get_drop_height(terrain_t *t, vec2 pos)
 	float u = pos[0] - ix;
 	float v = pos[1] - iz;
 
-	return height_at(t, ix,     iz    ) * (1 - u) * (1 - v) +
-		   height_at(t, ix + 1, iz    ) * u       * (1 - v) +
-		   height_at(t, ix,     iz + 1) * (1 - u) * v +
-		   height_at(t, ix + 1, iz + 1) * u       * v;
+	return height_at(f, ix,     iz    , mode) * (1 - u) * (1 - v) +
+		   height_at(f, ix + 1, iz    , mode) * u       * (1 - v) +
+		   height_at(f, ix,     iz + 1, mode) * (1 - u) * v +
+		   height_at(f, ix + 1, iz + 1, mode) * u       * v;
 }
 
-static void deposit_terrain(terrain_t *t, vec2 pos, float amount)
+EROSION_INLINE void deposit_terrain(height_field_t *f, vec2 pos, float amount, const field_mode_t mode)
 {
 	int ix = (int)pos[0];
 	int iz = (int)pos[1];
@@ -63,147 +297,1149 @@ static void deposit_terrain(terrain_t *t, vec2 pos, float amount)
 	float v = pos[1] - iz;
 
 	float cells[2][2] = {
-		{ height_at(t, ix, iz    ), height_at(t, ix + 1, iz    ) },
-		{ height_at(t, ix, iz + 1), height_at(t, ix + 1, iz + 1) },
+		{ height_at(f, ix, iz    , mode), height_at(f, ix + 1, iz    , mode) },
+		{ height_at(f, ix, iz + 1, mode), height_at(f, ix + 1, iz + 1, mode) },
 	};
 
-	set_height_at(t, ix,     iz    , cells[0][0] + (amount * (1 - u) * (1 - v)));
-	set_height_at(t, ix + 1, iz    , cells[0][1] + (amount * u       * (1 - v)));
-	set_height_at(t, ix,     iz + 1, cells[1][0] + (amount * (1 - u) * v      ));
-	set_height_at(t, ix + 1, iz + 1, cells[1][1] + (amount * u       * v      ));
+	set_height_at(f, ix,     iz    , cells[0][0], cells[0][0] + (amount * (1 - u) * (1 - v)), mode);
+	set_height_at(f, ix + 1, iz    , cells[0][1], cells[0][1] + (amount * u       * (1 - v)), mode);
+	set_height_at(f, ix,     iz + 1, cells[1][0], cells[1][0] + (amount * (1 - u) * v      ), mode);
+	set_height_at(f, ix + 1, iz + 1, cells[1][1], cells[1][1] + (amount * u       * v      ), mode);
 }
 
-static float erode_terrain(terrain_t *t, vec2 pos, int radius, float amount)
+// radii with an unrolled brush, anything else takes the generic path
+#define EROSION_MAX_SPECIALIZED_RADIUS (8)
+
+typedef float(*erosion_brush_t)(height_field_t *, vec2, int, float, erosion_stats_t *);
+
+// generic brushes up to this radius keep their weights on the stack
+#define EROSION_MAX_STACK_RADIUS (16)
+
+// inlined into every brush below. with a constant radius the loops have a
+// fixed trip count and get unrolled. brushes fully inside the map skip the
+// bounds checks, the summation order is the same either way
+EROSION_INLINE float erode_brush(height_field_t *f, vec2 pos, const int radius, float amount, float *weights, erosion_stats_t *stats, const field_mode_t mode)
 {
 	int ix = (int)pos[0];
 	int iz = (int)pos[1];
+	int w = f->w;
+	int h = f->h;
 
 	float weight_sum = 0;
-	float *weights = malloc(((radius + 1) * 2) * ((radius + 1) * 2) * sizeof(float));
+	float eroded = 0;
+
+	if (ix >= radius && iz >= radius && ix + radius < w && iz + radius < h)
+	{
+		int i = 0;
+		for (int x = -radius; x <= radius; x++)
+		{
+			for (int z = -radius; z <= radius; z++)
+			{
+				float dx = pos[0] - (ix + x + 0.5f);
+				float dz = pos[1] - (iz + z + 0.5f);
+				float weight = fmaxf(radius - sqrtf(dx * dx + dz * dz), 0);
+				weights[i++] = weight;
+				weight_sum += weight;
+			}
+		}
+
+		i = 0;
+		for (int x = -radius; x <= radius; x++)
+		{
+			for (int z = -radius; z <= radius; z++)
+			{
+				float height = height_at(f, ix + x, iz + z, mode);
+				float we = amount * (weights[i++] / weight_sum);
+				float erode = height > we ? we : height;
+				set_height_at(f, ix + x, iz + z, height, height - erode, mode);
+				eroded += erode;
+			}
+		}
+
+		return eroded;
+	}
 
 	// calculate relevant weights for the erosion
 	int i = 0;
+	uint32_t clipped = 0;
 	for (int x = -radius; x <= radius; x++)
 	{
 		int coord_x = ix + x;
-		if (coord_x < 0 || coord_x >= terrain_get_size(t).w) continue;
+		if (coord_x < 0 || coord_x >= w)
+		{
+			clipped += radius * 2 + 1;
+			continue;
+		}
 
 		for (int z = -radius; z <= radius; z++)
 		{
 			int coord_z = iz + z;
-			if (coord_z < 0 || coord_z >= terrain_get_size(t).h) continue;
+			if (coord_z < 0 || coord_z >= h)
+			{
+				clipped++;
+				continue;
+			}
 
 			// calculate the weight based on the distance from the erosion center
-			float distance = glm_vec2_distance(pos, (vec2) { coord_x + 0.5f, coord_z + 0.5f });
-			float weight = fmax(radius - distance, 0);
-			weights[i] = weight;
+			float dx = pos[0] - (coord_x + 0.5f);
+			float dz = pos[1] - (coord_z + 0.5f);
+			float weight = fmaxf(radius - sqrtf(dx * dx + dz * dz), 0);
+			weights[i++] = weight;
 			weight_sum += weight;
-			i++;
 		}
 	}
 
-	float eroded = 0;
-
 	// erode the requested amount based on the calculated weights
 	i = 0;
 	for (int x = -radius; x <= radius; x++)
 	{
 		int coord_x = ix + x;
-		if (coord_x < 0 || coord_x >= terrain_get_size(t).w) continue;
+		if (coord_x < 0 || coord_x >= w) continue;
 
 		for (int z = -radius; z <= radius; z++)
 		{
 			int coord_z = iz + z;
-			if (coord_z < 0 || coord_z >= terrain_get_size(t).h) continue;
+			if (coord_z < 0 || coord_z >= h) continue;
 
 			// calculate the exact value to erode the current point
-			float h = height_at(t, coord_x, coord_z);
-			float we = amount * (weights[i] / weight_sum);
-			float erode = h > we ? we : h;
-
-			// erode
-			set_height_at(t, coord_x, coord_z, h - erode);
+			float height = height_at(f, coord_x, coord_z, mode);
+			float we = amount * (weights[i++] / weight_sum);
+			float erode = height > we ? we : height;
+			set_height_at(f, coord_x, coord_z, height, height - erode, mode);
 			eroded += erode;
-			i++;
 		}
 	}
 
-	free(weights);
+	if (clipped > stats->max_brush_clip) stats->max_brush_clip = clipped;
 
 	return eroded;
 }
 
-void hydraulic_erosion(terrain_t *terrain, const erosion_desc_t *params)
+#define EROSION_DEFINE_BRUSH(R) \
+	static float erode_terrain_r##R(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats) \
+	{ \
+		float weights[(2 * R + 1) * (2 * R + 1)]; \
+		(void)radius; \
+		return erode_brush(f, pos, R, amount, weights, stats, FIELD_DIRECT); \
+	} \
+	static float erode_deltas_r##R(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats) \
+	{ \
+		float weights[(2 * R + 1) * (2 * R + 1)]; \
+		(void)radius; \
+		return erode_brush(f, pos, R, amount, weights, stats, FIELD_DELTAS); \
+	} \
+	static float erode_overlay_r##R(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats) \
+	{ \
+		float weights[(2 * R + 1) * (2 * R + 1)]; \
+		(void)radius; \
+		return erode_brush(f, pos, R, amount, weights, stats, FIELD_OVERLAY); \
+	} \
+	static float erode_atomic_r##R(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats) \
+	{ \
+		float weights[(2 * R + 1) * (2 * R + 1)]; \
+		(void)radius; \
+		return erode_brush(f, pos, R, amount, weights, stats, FIELD_ATOMIC); \
+	}
+
+EROSION_DEFINE_BRUSH(1)
+EROSION_DEFINE_BRUSH(2)
+EROSION_DEFINE_BRUSH(3)
+EROSION_DEFINE_BRUSH(4)
+EROSION_DEFINE_BRUSH(5)
+EROSION_DEFINE_BRUSH(6)
+EROSION_DEFINE_BRUSH(7)
+EROSION_DEFINE_BRUSH(8)
+
+#undef EROSION_DEFINE_BRUSH
+
+EROSION_INLINE float erode_generic(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats, const field_mode_t mode)
+{
+	float stack_weights[(2 * EROSION_MAX_STACK_RADIUS + 1) * (2 * EROSION_MAX_STACK_RADIUS + 1)];
+	if (radius <= EROSION_MAX_STACK_RADIUS) return erode_brush(f, pos, radius, amount, stack_weights, stats, mode);
+
+	float *weights = malloc((size_t)(2 * radius + 1) * (2 * radius + 1) * sizeof(float));
+	float eroded = erode_brush(f, pos, radius, amount, weights, stats, mode);
+	free(weights);
+	return eroded;
+}
+
+static float erode_terrain_generic(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats)
 {
-	// create a drop on a random position on the terrain
-	drop_t drop = (drop_t) {
-		.pos = { rand_x_position_on_terrain(terrain), rand_y_position_on_terrain(terrain) },
+	return erode_generic(f, pos, radius, amount, stats, FIELD_DIRECT);
+}
+
+static float erode_deltas_generic(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats)
+{
+	return erode_generic(f, pos, radius, amount, stats, FIELD_DELTAS);
+}
+
+static float erode_overlay_generic(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats)
+{
+	return erode_generic(f, pos, radius, amount, stats, FIELD_OVERLAY);
+}
+
+static float erode_atomic_generic(height_field_t *f, vec2 pos, int radius, float amount, erosion_stats_t *stats)
+{
+	return erode_generic(f, pos, radius, amount, stats, FIELD_ATOMIC);
+}
+
+static erosion_brush_t select_brush(int radius, field_mode_t mode)
+{
+	static const erosion_brush_t generic[FIELD_MODE_COUNT__] = {
+		erode_terrain_generic, erode_deltas_generic, erode_overlay_generic, erode_atomic_generic,
+	};
+	static const erosion_brush_t brushes[FIELD_MODE_COUNT__][EROSION_MAX_SPECIALIZED_RADIUS + 1] = {
+		{
+			NULL,
+			erode_terrain_r1, erode_terrain_r2, erode_terrain_r3, erode_terrain_r4,
+			erode_terrain_r5, erode_terrain_r6, erode_terrain_r7, erode_terrain_r8,
+		},
+		{
+			NULL,
+			erode_deltas_r1, erode_deltas_r2, erode_deltas_r3, erode_deltas_r4,
+			erode_deltas_r5, erode_deltas_r6, erode_deltas_r7, erode_deltas_r8,
+		},
+		{
+			NULL,
+			erode_overlay_r1, erode_overlay_r2, erode_overlay_r3, erode_overlay_r4,
+			erode_overlay_r5, erode_overlay_r6, erode_overlay_r7, erode_overlay_r8,
+		},
+		{
+			NULL,
+			erode_atomic_r1, erode_atomic_r2, erode_atomic_r3, erode_atomic_r4,
+			erode_atomic_r5, erode_atomic_r6, erode_atomic_r7, erode_atomic_r8,
+		},
+	};
+
+	if (radius >= 1 && radius <= EROSION_MAX_SPECIALIZED_RADIUS) return brushes[mode][radius];
+	return generic[mode];
+}
+
+void erosion_state_init(erosion_state_t *state, uint32_t seed)
+{
+	memset(state, 0, sizeof(erosion_state_t));
+	state->seed = seed;
+}
+
+bool erosion_desc_valid(const erosion_desc_t *params)
+{
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+
+	float rates[] = { params->inertia, params->capacity, params->min_capacity, params->deposition, params->erosion,
+		params->gravity, params->evaporation, params->min_water, params->min_velocity };
+	for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+	{
+		if (!isfinite(rates[i]) || rates[i] < 0.0f) return false;
+	}
+
+	// tile halos add the lifetime and radius, that sum has to stay an int
+	return params->inertia <= 1.0f && params->radius >= 1 && params->radius <= EROSION_MAX_RADIUS &&
+		params->drop_lifetime >= 0 && params->drop_lifetime <= INT_MAX - EROSION_MAX_RADIUS - 2 && params->max_pit_steps >= 0;
+}
+
+void erosion_spawn_position(uvec2 size, uint32_t seed, uint64_t drop, vec2 pos)
+{
+	uint64_t h = hash_drop(seed, drop);
+
+	// use 24 bits per axis, that is all the precision a float in [0, 1) has
+	float rx = (float)(h >> 40) / (float)(1 << 24);
+	float ry = (float)((h >> 16) & 0xFFFFFF) / (float)(1 << 24);
+
+	pos[0] = rx * (size.w - 1.1f);
+	pos[1] = ry * (size.h - 1.1f);
+}
+
+static void drop_spawn(drop_t *drop, vec2 start)
+{
+	*drop = (drop_t) {
+		.pos = { start[0], start[1] },
 		.water = 1.0f,
 		.velocity = 1.0f,
 	};
+}
+
+// advances the drop by one step of its lifetime, returns false once it died
+EROSION_INLINE bool drop_step_impl(height_field_t *field, const erosion_desc_t *params, erosion_brush_t erode_terrain, drop_t *drop, erosion_stats_t *stats, const field_mode_t mode)
+{
+	int ix = (int)drop->pos[0];
+	int iz = (int)drop->pos[1];
+
+	float u = drop->pos[0] - ix;
+	float v = drop->pos[1] - iz;
+
+	float neighbors[2][2] = {
+		{ height_at(field, ix, iz    , mode), height_at(field, ix + 1, iz    , mode) },
+		{ height_at(field, ix, iz + 1, mode), height_at(field, ix + 1, iz + 1, mode) },
+	};
+
+	// calculate the gradient of the slope the drop is currently on
+	vec2 gradient = GLM_VEC2_ZERO_INIT;
+	gradient[0] = ((neighbors[0][1] - neighbors[0][0]) * (1 - v)) + ((neighbors[1][1] - neighbors[1][0]) * v);
+	gradient[1] = ((neighbors[1][0] - neighbors[0][0]) * (1 - u)) + ((neighbors[1][1] - neighbors[0][1]) * u);
+
+	// calculate the direction on the drop based on its current direction as well as the slope
+	drop->direction[0] = (drop->direction[0] * params->inertia) - (gradient[0] * (1 - params->inertia));
+	drop->direction[1] = (drop->direction[1] * params->inertia) - (gradient[1] * (1 - params->inertia));
+	glm_vec2_normalize(drop->direction);
+
+	// move the drop
+	vec2 old_pos; glm_vec2_copy(drop->pos, old_pos);
+	glm_vec2_add(drop->pos, drop->direction, drop->pos);
+
+	// kill the drop if it has left the map bounds or stopped
+	if (drop->pos[0] < 0 || drop->pos[0] >= field->w - 1 ||
+		drop->pos[1] < 0 || drop->pos[1] >= field->h - 1)
+	{
+		stats->out_of_bounds_kills++;
+		return false;
+	}
+	if (drop->direction[0] == 0 && drop->direction[1] == 0) return false;
+
+	stats->steps++;
+
+	// find the height difference between the last and current position
+	float height_dif = get_drop_height(field, drop->pos, mode) - get_drop_height(field, old_pos, mode);
+
+	// calculate the capacity of the droplet based on its speed, water content and the capacity modifier
+	float capacity = fmax((-height_dif) * drop->velocity * drop->water * params->capacity, params->min_capacity);
+	HE_ASSERT(!isnan(capacity), "Failed to calculate capacity");
 
-	for (int iteration = 0; iteration < params->drop_lifetime; iteration++)
+	float changed = 0;
+	if (height_dif > 0)
 	{
-		int ix = (int)drop.pos[0];
-		int iz = (int)drop.pos[1];
+		// the drop is in a pit if it cannot carry enough sediment to fill it
+		drop->pit_steps = drop->sediment < height_dif ? drop->pit_steps + 1 : 0;
 
-		float u = drop.pos[0] - ix;
-		float v = drop.pos[1] - iz;
+		// try to equal height
+		float deposit = fmin(drop->sediment, height_dif);
+		drop->sediment -= deposit;
+		deposit_terrain(field, old_pos, deposit, mode);
+		stats->deposited += deposit;
+		changed = deposit;
+	}
+	else if (drop->sediment > capacity)
+	{
+		drop->pit_steps = 0;
+
+		// deposit sediment
+		float deposit = (drop->sediment - capacity) * params->deposition;
+		drop->sediment -= deposit;
+		deposit_terrain(field, old_pos, deposit, mode);
+		stats->deposited += deposit;
+		changed = deposit;
+	}
+	else
+	{
+		drop->pit_steps = 0;
+
+		// erode terrain
+		float erode = fmin((capacity - drop->sediment) * params->erosion, -height_dif);
+		changed = erode_terrain(field, old_pos, params->radius, erode, stats);
+		stats->eroded += changed;
+		drop->sediment += changed;
+	}
+
+	if (changed != 0) stats->effective_steps++;
+	else stats->noop_steps++;
+
+	// update drop velocity and water content
+	drop->velocity = sqrt(drop->velocity * drop->velocity + height_dif * params->gravity);
+	drop->water *= (1 - params->evaporation);
+
+	// kill the drop early if it can no longer meaningfully change the terrain.
+	// the negated comparisons also catch a velocity that collapsed to nan
+	uint64_t *reason = NULL;
+	if (params->min_water > 0 && !(drop->water >= params->min_water)) reason = &stats->water_kills;
+	else if (params->min_velocity > 0 && !(drop->velocity >= params->min_velocity)) reason = &stats->velocity_kills;
+	else if (params->max_pit_steps > 0 && drop->pit_steps >= params->max_pit_steps) reason = &stats->pit_kills;
+
+	if (reason != NULL)
+	{
+		(*reason)++;
+		stats->saved_steps += params->drop_lifetime - (drop->iteration + 1);
+		return false;
+	}
+
+	drop->iteration++;
+	return true;
+}
+
+static bool drop_step(height_field_t *field, const erosion_desc_t *params, erosion_brush_t erode_terrain, drop_t *drop, erosion_stats_t *stats)
+{
+	return drop_step_impl(field, params, erode_terrain, drop, stats, FIELD_DIRECT);
+}
+
+static bool drop_step_deltas(height_field_t *field, const erosion_desc_t *params, erosion_brush_t erode_terrain, drop_t *drop, erosion_stats_t *stats)
+{
+	return drop_step_impl(field, params, erode_terrain, drop, stats, FIELD_DELTAS);
+}
+
+static bool drop_step_overlay(height_field_t *field, const erosion_desc_t *params, erosion_brush_t erode_terrain, drop_t *drop, erosion_stats_t *stats)
+{
+	return drop_step_impl(field, params, erode_terrain, drop, stats, FIELD_OVERLAY);
+}
+
+static bool drop_step_atomic(height_field_t *field, const erosion_desc_t *params, erosion_brush_t erode_terrain, drop_t *drop, erosion_stats_t *stats)
+{
+	return drop_step_impl(field, params, erode_terrain, drop, stats, FIELD_ATOMIC);
+}
+
+static void simulate_drop(height_field_t *field, const erosion_desc_t *params, erosion_brush_t erode_terrain, vec2 start, erosion_stats_t *stats)
+{
+	erosion_stats_t local = { .drops = 1 };
+
+	drop_t drop;
+	drop_spawn(&drop, start);
+	if (field->mode == FIELD_OVERLAY)
+	{
+		while (drop.iteration < params->drop_lifetime && drop_step_overlay(field, params, erode_terrain, &drop, &local)) {}
+	}
+	else if (field->mode == FIELD_DELTAS)
+	{
+		while (drop.iteration < params->drop_lifetime && drop_step_deltas(field, params, erode_terrain, &drop, &local)) {}
+	}
+	else if (field->mode == FIELD_ATOMIC)
+	{
+		while (drop.iteration < params->drop_lifetime && drop_step_atomic(field, params, erode_terrain, &drop, &local)) {}
+	}
+	else
+	{
+		while (drop.iteration < params->drop_lifetime && drop_step(field, params, erode_terrain, &drop, &local)) {}
+	}
+
+	if (stats != NULL) erosion_stats_merge(stats, &local);
+}
 
-		float neighbors[2][2] = {
-			{ height_at(terrain, ix, iz    ), height_at(terrain, ix + 1, iz    ) },
-			{ height_at(terrain, ix, iz + 1), height_at(terrain, ix + 1, iz + 1) },
-		};
+void hydraulic_erosion(terrain_t *terrain, const erosion_desc_t *params, vec2 start, erosion_stats_t *stats)
+{
+	height_field_t field = field_from_terrain(terrain);
+	simulate_drop(&field, params, select_brush(params->radius, FIELD_DIRECT), start, stats);
+}
 
-		// calculate the gradient of the slope the drop is currently on
-		vec2 gradient = GLM_VEC2_ZERO_INIT;
-		gradient[0] = ((neighbors[0][1] - neighbors[0][0]) * (1 - v)) + ((neighbors[1][1] - neighbors[1][0]) * v);
-		gradient[1] = ((neighbors[1][0] - neighbors[0][0]) * (1 - u)) + ((neighbors[1][1] - neighbors[0][1]) * u);
+void erosion_run(terrain_t *terrain, const erosion_desc_t *params, erosion_state_t *state, int drops)
+{
+	// accumulate into a private copy so the caller's stats are only touched once per run
+	erosion_stats_t local = { 0 };
 
-		// calculate the direction on the drop based on its current direction as well as the slope
-		drop.direction[0] = (drop.direction[0] * params->inertia) - (gradient[0] * (1 - params->inertia));
-		drop.direction[1] = (drop.direction[1] * params->inertia) - (gradient[1] * (1 - params->inertia));
-		glm_vec2_normalize(drop.direction);
+	height_field_t field = field_from_terrain(terrain);
+	erosion_brush_t brush = select_brush(params->radius, FIELD_DIRECT);
 
-		// move the drop
-		vec2 old_pos; glm_vec2_copy(drop.pos, old_pos);
-		glm_vec2_add(drop.pos, drop.direction, drop.pos);
+	double start = timer_now();
+	for (int i = 0; i < drops; i++)
+	{
+		vec2 pos;
+		erosion_spawn_position(terrain_get_size(terrain), state->seed, state->next_drop++, pos);
+		simulate_drop(&field, params, brush, pos, &local);
+	}
+	local.simulate_seconds = timer_now() - start;
 
-		// kill the drop if it has left the map bounds or stopped
-		if (drop.pos[0] < 0 || drop.pos[0] >= terrain_get_size(terrain).w - 1 ||
-			drop.pos[1] < 0 || drop.pos[1] >= terrain_get_size(terrain).h - 1 ||
-			(drop.direction[0] == 0 && drop.direction[1] == 0)) break;
+	erosion_stats_merge(&state->stats, &local);
+}
 
-		// find the height difference between the last and current position
-		float height_dif = get_drop_height(terrain, drop.pos) - get_drop_height(terrain, old_pos);
+static bool region_spawn_position(const erosion_region_t *region, const float bounds[4], uint32_t seed, uint64_t drop, vec2 pos)
+{
+	for (uint32_t attempt = 0; attempt < EROSION_REGION_SPAWN_ATTEMPTS; attempt++)
+	{
+		uint64_t h = hash_drop(seed, drop * EROSION_REGION_SPAWN_ATTEMPTS + attempt);
+		float rx = (float)(h >> 40) / (float)(1 << 24);
+		float ry = (float)((h >> 16) & 0xFFFFFF) / (float)(1 << 24);
+		pos[0] = bounds[0] + rx * (bounds[2] - bounds[0]);
+		pos[1] = bounds[1] + ry * (bounds[3] - bounds[1]);
+		if (region->mask == NULL) return true;
+
+		// the low bits are still unused, they decide against the weight
+		uint32_t mx = (uint32_t)pos[0] - region->origin.x;
+		uint32_t mz = (uint32_t)pos[1] - region->origin.y;
+		if (mx >= region->size.w) mx = region->size.w - 1;
+		if (mz >= region->size.h) mz = region->size.h - 1;
+		if ((float)(h & 0xFFFF) / (float)(1 << 16) < region->mask[mx + mz * region->size.w]) return true;
+	}
+	return false;
+}
 
-		// calculate the capacity of the droplet based on its speed, water content and the capacity modifier
-		float capacity = fmax((-height_dif) * drop.velocity * drop.water * params->capacity, params->min_capacity);
-		HE_ASSERT(!isnan(capacity), "Failed to calculate capacity");
+void erosion_run_region(terrain_t *terrain, const erosion_desc_t *params, const erosion_region_t *region,
+	erosion_state_t *state, int drops, erosion_region_t *changed)
+{
+	HE_ASSERT(terrain != NULL, "A terrain is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(region != NULL, "An erosion region is required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
 
-		if (height_dif > 0)
+	if (changed != NULL) *changed = (erosion_region_t){ 0 };
+
+	// the rectangle clipped to where erosion_spawn_position may place drops
+	uvec2 size = terrain_get_size(terrain);
+	float bounds[4] = {
+		(float)region->origin.x,
+		(float)region->origin.y,
+		fminf((float)region->origin.x + region->size.w, size.w - 1.1f),
+		fminf((float)region->origin.y + region->size.h, size.h - 1.1f),
+	};
+	if (bounds[2] <= bounds[0] || bounds[3] <= bounds[1])
+	{
+		state->next_drop += drops;
+		return;
+	}
+
+	erosion_stats_t local = { 0 };
+	height_field_t field = field_from_terrain(terrain);
+	erosion_brush_t brush = select_brush(params->radius, FIELD_DIRECT);
+
+	// every position a drop stepped from, the cells around them are the only
+	// ones it could have changed
+	float lo[2] = { FLT_MAX, FLT_MAX };
+	float hi[2] = { -FLT_MAX, -FLT_MAX };
+
+	double start = timer_now();
+	for (int i = 0; i < drops; i++)
+	{
+		vec2 pos;
+		if (!region_spawn_position(region, bounds, state->seed, state->next_drop++, pos)) continue;
+
+		drop_t drop;
+		drop_spawn(&drop, pos);
+		local.drops++;
+		while (drop.iteration < params->drop_lifetime)
+		{
+			lo[0] = fminf(lo[0], drop.pos[0]); hi[0] = fmaxf(hi[0], drop.pos[0]);
+			lo[1] = fminf(lo[1], drop.pos[1]); hi[1] = fmaxf(hi[1], drop.pos[1]);
+			if (!drop_step(&field, params, brush, &drop, &local)) break;
+		}
+	}
+	local.simulate_seconds = timer_now() - start;
+
+	erosion_stats_merge(&state->stats, &local);
+
+	if (changed != NULL && local.drops > 0)
+	{
+		// deposits reach one cell past the position, erosion the brush radius
+		int reach = params->radius > 1 ? params->radius : 1;
+		int x0 = (int)lo[0] - reach, z0 = (int)lo[1] - reach;
+		int x1 = (int)hi[0] + reach + 1, z1 = (int)hi[1] + reach + 1;
+		if (x0 < 0) x0 = 0;
+		if (z0 < 0) z0 = 0;
+		if (x1 > (int)size.w - 1) x1 = (int)size.w - 1;
+		if (z1 > (int)size.h - 1) z1 = (int)size.h - 1;
+		changed->origin = (uvec2){ .x = (uint32_t)x0, .y = (uint32_t)z0 };
+		changed->size = (uvec2){ .w = (uint32_t)(x1 - x0 + 1), .h = (uint32_t)(z1 - z0 + 1) };
+	}
+}
+
+static uint32_t morton_spread(uint32_t v)
+{
+	v &= 0xFFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+// counting sort by key, stable so drops in the same block keep their order
+static void wavefront_sort(wavefront_entry_t **entries, wavefront_entry_t **scratch, uint32_t count, uint32_t *histogram, uint32_t buckets)
+{
+	memset(histogram, 0, buckets * sizeof(uint32_t));
+	for (uint32_t i = 0; i < count; i++)
+	{
+		histogram[(*entries)[i].key]++;
+	}
+
+	uint32_t offset = 0;
+	for (uint32_t b = 0; b < buckets; b++)
+	{
+		uint32_t n = histogram[b];
+		histogram[b] = offset;
+		offset += n;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		(*scratch)[histogram[(*entries)[i].key]++] = (*entries)[i];
+	}
+
+	wavefront_entry_t *swap = *entries;
+	*entries = *scratch;
+	*scratch = swap;
+}
+
+void erosion_run_wavefront(terrain_t *terrain, const erosion_desc_t *params, const erosion_wavefront_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_wavefront_stats_t *stats)
+{
+	HE_ASSERT(terrain != NULL, "A terrain is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
+
+	uint32_t pool_size = desc != NULL && desc->pool_size > 0 ? desc->pool_size : EROSION_WAVEFRONT_DEFAULT_POOL;
+	// a short run never fills the pool, so the slots past its drops are not
+	// allocated. every drop still joins in the first round, the result is the same
+	if (drops < pool_size) pool_size = drops > 0 ? (uint32_t)drops : 1;
+	uint32_t sort_interval = desc != NULL && desc->sort_interval > 0 ? desc->sort_interval : 1;
+
+	// sort by blocks of cells rather than single cells, so the key fits a
+	// single counting pass. with up to 256 blocks per axis a block is still
+	// only a handful of cache lines wide
+	uvec2 size = terrain_get_size(terrain);
+	int bits = 0;
+	while ((1u << bits) < size.w || (1u << bits) < size.h) bits++;
+	int shift = bits > EROSION_WAVEFRONT_BLOCK_BITS ? bits - EROSION_WAVEFRONT_BLOCK_BITS : 0;
+	uint32_t buckets = 1u << (2 * (bits - shift));
+	uint32_t *histogram = malloc(buckets * sizeof(uint32_t));
+
+	wavefront_entry_t *entries = malloc(pool_size * sizeof(wavefront_entry_t));
+	wavefront_entry_t *scratch = malloc(pool_size * sizeof(wavefront_entry_t));
+	height_field_t field = field_from_terrain(terrain);
+	erosion_brush_t brush = select_brush(params->radius, FIELD_DIRECT);
+
+	erosion_stats_t local = { 0 };
+	erosion_wavefront_stats_t local_wavefront = { 0 };
+
+	uint32_t count = 0;
+	uint64_t remaining = drops;
+	uint64_t round = 0;
+
+	double start = timer_now();
+	while (count > 0 || remaining > 0)
+	{
+		// keep the pool full, new drops join the wave where others died
+		while (count < pool_size && remaining > 0)
+		{
+			vec2 pos;
+			erosion_spawn_position(size, state->seed, state->next_drop++, pos);
+			drop_spawn(&entries[count++].drop, pos);
+			local.drops++;
+			remaining--;
+		}
+
+		if (round % sort_interval == 0)
+		{
+			double sort_start = timer_now();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				drop_t *drop = &entries[i].drop;
+				entries[i].key = morton_spread((uint32_t)drop->pos[0] >> shift) | (morton_spread((uint32_t)drop->pos[1] >> shift) << 1);
+			}
+			wavefront_sort(&entries, &scratch, count, histogram, buckets);
+			local_wavefront.sort_seconds += timer_now() - sort_start;
+		}
+
+		// advance everyone by one step, compacting the survivors in place
+		uint32_t alive = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			drop_t *drop = &entries[i].drop;
+			if (drop->iteration < params->drop_lifetime && drop_step(&field, params, brush, drop, &local))
+			{
+				entries[alive++] = entries[i];
+			}
+		}
+
+		local_wavefront.occupancy += (double)count / pool_size;
+		count = alive;
+		round++;
+	}
+	local.simulate_seconds = timer_now() - start;
+	local_wavefront.rounds = round;
+
+	erosion_stats_merge(&state->stats, &local);
+	if (stats != NULL)
+	{
+		stats->rounds += local_wavefront.rounds;
+		stats->sort_seconds += local_wavefront.sort_seconds;
+		stats->occupancy += local_wavefront.occupancy;
+	}
+
+	free(histogram);
+	free(entries);
+	free(scratch);
+}
+
+typedef struct delta_lane_t
+{
+	delta_map_t map;
+	erosion_stats_t stats;
+} delta_lane_t;
+
+typedef struct delta_run_t
+{
+	height_field_t base;
+	const erosion_desc_t *params;
+	erosion_brush_t brush;
+	uint32_t seed;
+
+	delta_lane_t *lanes;
+	uint32_t lane_count;
+	uint32_t workers;
+
+	// the current epoch
+	uint64_t first_drop;
+	uint64_t count;
+} delta_run_t;
+
+typedef struct delta_job_t
+{
+	delta_run_t *run;
+	uint32_t index;
+} delta_job_t;
+
+static void delta_simulate_lane(delta_run_t *run, uint32_t lane)
+{
+	delta_lane_t *l = &run->lanes[lane];
+	delta_map_clear(&l->map);
+
+	// every lane runs a contiguous slice of the epoch in drop order
+	uint64_t first = run->first_drop + run->count * lane / run->lane_count;
+	uint64_t last = run->first_drop + run->count * (lane + 1) / run->lane_count;
+
+	height_field_t field = run->base;
+	field.mode = FIELD_DELTAS;
+	field.deltas = &l->map;
+
+	uvec2 size = { .w = (uint32_t)field.w, .h = (uint32_t)field.h };
+	for (uint64_t drop = first; drop < last; drop++)
+	{
+		vec2 pos;
+		erosion_spawn_position(size, run->seed, drop, pos);
+		simulate_drop(&field, run->params, run->brush, pos, &l->stats);
+	}
+}
+
+static void delta_simulate_job(void *user_pointer)
+{
+	delta_job_t *job = user_pointer;
+	for (uint32_t lane = job->index; lane < job->run->lane_count; lane += job->run->workers)
+	{
+		delta_simulate_lane(job->run, lane);
+	}
+}
+
+static void delta_reduce_job(void *user_pointer)
+{
+	delta_job_t *job = user_pointer;
+	delta_run_t *run = job->run;
+
+	// each job owns whole rows of tiles and adds the lanes in a fixed
+	// order, so every cell sees the same sums no matter who reduced it
+	for (uint32_t lane = 0; lane < run->lane_count; lane++)
+	{
+		delta_map_t *map = &run->lanes[lane].map;
+		for (uint32_t b = 0; b < map->count; b++)
+		{
+			uint32_t tx = map->keys[b] % map->tiles_w;
+			uint32_t ty = map->keys[b] / map->tiles_w;
+			if (ty % run->workers != job->index) continue;
+
+			const float *block = &map->blocks[(size_t)b * DELTA_TILE_CELLS];
+			int x0 = (int)tx * DELTA_TILE_SIZE;
+			int y0 = (int)ty * DELTA_TILE_SIZE;
+			int x1 = x0 + DELTA_TILE_SIZE < run->base.w ? x0 + DELTA_TILE_SIZE : run->base.w;
+			int y1 = y0 + DELTA_TILE_SIZE < run->base.h ? y0 + DELTA_TILE_SIZE : run->base.h;
+			for (int y = y0; y < y1; y++)
+			{
+				for (int x = x0; x < x1; x++)
+				{
+					run->base.heights[x + y * run->base.w] += block[(x - x0) + (y - y0) * DELTA_TILE_SIZE];
+				}
+			}
+		}
+	}
+}
+
+void erosion_run_deltas(terrain_t *terrain, const erosion_desc_t *params, const erosion_delta_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_delta_stats_t *stats)
+{
+	HE_ASSERT(terrain != NULL, "A terrain is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
+
+	job_system_t *jobs = job_system_shared();
+	uint32_t epoch = desc != NULL && desc->epoch_drops > 0 ? desc->epoch_drops : EROSION_DELTA_DEFAULT_EPOCH;
+	uint32_t lane_count = desc != NULL && desc->lanes > 0 ? desc->lanes : EROSION_DELTA_DEFAULT_LANES;
+	int workers = desc != NULL && desc->workers > 0 ? desc->workers : job_system_worker_count(jobs) + 1;
+	if ((uint32_t)workers > lane_count) workers = (int)lane_count;
+
+	delta_run_t run = {
+		.base = field_from_terrain(terrain),
+		.params = params,
+		.brush = select_brush(params->radius, FIELD_DELTAS),
+		.seed = state->seed,
+		.lane_count = lane_count,
+		.workers = (uint32_t)workers,
+	};
+
+	uint32_t tiles_w = (terrain->size.w + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+	run.lanes = calloc(lane_count, sizeof(delta_lane_t));
+	for (uint32_t i = 0; i < lane_count; i++)
+	{
+		delta_map_init(&run.lanes[i].map, tiles_w, DELTA_MAP_INITIAL_TILES);
+	}
+
+	delta_job_t *args = malloc(workers * sizeof(delta_job_t));
+	for (int i = 0; i < workers; i++)
+	{
+		args[i] = (delta_job_t){ .run = &run, .index = (uint32_t)i };
+	}
+
+	job_group_t group;
+	job_group_init(jobs, &group);
+
+	uint64_t epochs = 0;
+	double reduce_seconds = 0;
+	uint32_t peak_tiles = 0;
+	double start = timer_now();
+	for (uint64_t done = 0; done < drops; done += run.count)
+	{
+		run.first_drop = state->next_drop + done;
+		run.count = drops - done < epoch ? drops - done : epoch;
+
+		for (int i = 0; i < workers; i++)
+		{
+			job_group_run(&group, delta_simulate_job, &args[i]);
+		}
+		job_group_wait(&group);
+
+		double reduce_start = timer_now();
+		for (int i = 0; i < workers; i++)
 		{
-			// try to equal height
-			float deposit = fmin(drop.sediment, height_dif);
-			drop.sediment -= deposit;
-			deposit_terrain(terrain, old_pos, deposit);
+			job_group_run(&group, delta_reduce_job, &args[i]);
 		}
-		else if (drop.sediment > capacity)
+		job_group_wait(&group);
+		reduce_seconds += timer_now() - reduce_start;
+
+		for (uint32_t lane = 0; lane < lane_count; lane++)
+		{
+			if (run.lanes[lane].map.count > peak_tiles) peak_tiles = run.lanes[lane].map.count;
+		}
+		epochs++;
+	}
+	double seconds = timer_now() - start;
+
+	// merged in lane order, so even the floating point totals are repeatable
+	erosion_stats_t local = { 0 };
+	for (uint32_t i = 0; i < lane_count; i++)
+	{
+		erosion_stats_merge(&local, &run.lanes[i].stats);
+		delta_map_free(&run.lanes[i].map);
+	}
+	local.simulate_seconds = seconds;
+	erosion_stats_merge(&state->stats, &local);
+	state->next_drop += drops;
+
+	if (stats != NULL)
+	{
+		stats->epochs += epochs;
+		stats->reduce_seconds += reduce_seconds;
+		if (peak_tiles > stats->peak_tiles) stats->peak_tiles = peak_tiles;
+	}
+
+	free(args);
+	free(run.lanes);
+}
+
+typedef struct speculative_drop_t
+{
+	delta_map_t map;
+	erosion_stats_t stats;
+} speculative_drop_t;
+
+typedef struct speculative_run_t
+{
+	height_field_t base;
+	const erosion_desc_t *params;
+	erosion_brush_t brush;
+	uint32_t seed;
+
+	speculative_drop_t *drops;
+
+	// the current batch
+	uint64_t first_drop;
+	uint32_t count;
+} speculative_run_t;
+
+static void speculative_simulate(speculative_run_t *run, uint32_t slot)
+{
+	speculative_drop_t *d = &run->drops[slot];
+	delta_map_clear(&d->map);
+	memset(&d->stats, 0, sizeof(erosion_stats_t));
+
+	height_field_t field = run->base;
+	field.mode = FIELD_OVERLAY;
+	field.deltas = &d->map;
+
+	vec2 pos;
+	uvec2 size = { .w = (uint32_t)field.w, .h = (uint32_t)field.h };
+	erosion_spawn_position(size, run->seed, run->first_drop + slot, pos);
+	simulate_drop(&field, run->params, run->brush, pos, &d->stats);
+}
+
+static void speculative_simulate_range(void *user_pointer, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	(void)y0; (void)y1;
+	for (uint32_t slot = x0; slot < x1; slot++)
+	{
+		speculative_simulate(user_pointer, slot);
+	}
+}
+
+// a drop is invalid once an earlier drop of the same batch wrote a tile it
+// read, every tile it touched is in its map
+static bool speculative_conflicts(const delta_map_t *map, const uint64_t *written, uint64_t batch)
+{
+	for (uint32_t b = 0; b < map->count; b++)
+	{
+		if (written[map->keys[b]] == batch) return true;
+	}
+	return false;
+}
+
+static void speculative_commit(height_field_t *base, const delta_map_t *map, uint64_t *written, uint64_t batch)
+{
+	for (uint32_t b = 0; b < map->count; b++)
+	{
+		if (!map->dirty[b]) continue;
+
+		uint32_t key = map->keys[b];
+		written[key] = batch;
+
+		const float *block = &map->blocks[(size_t)b * DELTA_TILE_CELLS];
+		int x0 = (int)(key % map->tiles_w) * DELTA_TILE_SIZE;
+		int y0 = (int)(key / map->tiles_w) * DELTA_TILE_SIZE;
+		int w = base->w - x0 < DELTA_TILE_SIZE ? base->w - x0 : DELTA_TILE_SIZE;
+		int h = base->h - y0 < DELTA_TILE_SIZE ? base->h - y0 : DELTA_TILE_SIZE;
+		for (int y = 0; y < h; y++)
+		{
+			memcpy(&base->heights[x0 + (y0 + y) * base->w], &block[y * DELTA_TILE_SIZE], w * sizeof(float));
+		}
+	}
+}
+
+void erosion_run_speculative(terrain_t *terrain, const erosion_desc_t *params, const erosion_speculative_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_speculative_stats_t *stats)
+{
+	HE_ASSERT(terrain != NULL, "A terrain is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
+
+	job_system_t *jobs = job_system_shared();
+	int workers = desc != NULL && desc->workers > 0 ? desc->workers : job_system_worker_count(jobs) + 1;
+	uint32_t batch_size = desc != NULL && desc->batch_drops > 0 ? desc->batch_drops : EROSION_SPECULATIVE_DEFAULT_BATCH * (uint32_t)workers;
+
+	speculative_run_t run = {
+		.base = field_from_terrain(terrain),
+		.params = params,
+		.brush = select_brush(params->radius, FIELD_OVERLAY),
+		.seed = state->seed,
+	};
+
+	// a drop moves at most one cell per step, so its lifetime and brush
+	// bound the tiles it can touch. size the maps for that up front, up to
+	// a point, so they rarely grow while the workers run
+	uint32_t tiles_w = (terrain->size.w + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+	uint32_t tiles_h = (terrain->size.h + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+	uint32_t reach = (uint32_t)params->drop_lifetime + (uint32_t)params->radius + 2;
+	uint32_t span = 2 * reach / DELTA_TILE_SIZE + 2;
+	uint32_t capacity = span < 16 ? span * span : 256;
+
+	run.drops = calloc(batch_size, sizeof(speculative_drop_t));
+	for (uint32_t i = 0; i < batch_size; i++)
+	{
+		delta_map_init(&run.drops[i].map, tiles_w, capacity);
+		run.drops[i].map.fill = run.base.heights;
+		run.drops[i].map.fill_w = run.base.w;
+		run.drops[i].map.fill_h = run.base.h;
+	}
+
+	// batch that last wrote each tile, batches count from one
+	uint64_t *written = calloc((size_t)tiles_w * tiles_h, sizeof(uint64_t));
+
+	erosion_stats_t local = { 0 };
+	erosion_speculative_stats_t local_speculative = { 0 };
+
+	double start = timer_now();
+	for (uint64_t done = 0; done < drops; done += run.count)
+	{
+		run.first_drop = state->next_drop + done;
+		run.count = drops - done < batch_size ? (uint32_t)(drops - done) : batch_size;
+
+		uint32_t grain = (run.count + (uint32_t)workers - 1) / (uint32_t)workers;
+		job_parallel_for_2d(jobs, run.count, 1, grain, 1, speculative_simulate_range, &run);
+
+		// validate and commit in drop order. a conflicting drop runs again
+		// on the heights every earlier drop has been committed to
+		double commit_start = timer_now();
+		uint64_t batch = ++local_speculative.batches;
+		for (uint32_t slot = 0; slot < run.count; slot++)
 		{
-			// deposit sediment
-			float deposit = (drop.sediment - capacity) * params->deposition;
-			drop.sediment -= deposit;
-			deposit_terrain(terrain, old_pos, deposit);
+			speculative_drop_t *d = &run.drops[slot];
+			if (speculative_conflicts(&d->map, written, batch))
+			{
+				speculative_simulate(&run, slot);
+				local_speculative.replays++;
+			}
+
+			speculative_commit(&run.base, &d->map, written, batch);
+			erosion_stats_merge(&local, &d->stats);
+			if (d->map.count > local_speculative.peak_tiles) local_speculative.peak_tiles = d->map.count;
 		}
-		else
+		local_speculative.commit_seconds += timer_now() - commit_start;
+	}
+	local.simulate_seconds = timer_now() - start;
+
+	erosion_stats_merge(&state->stats, &local);
+	state->next_drop += drops;
+
+	if (stats != NULL)
+	{
+		stats->batches += local_speculative.batches;
+		stats->replays += local_speculative.replays;
+		stats->commit_seconds += local_speculative.commit_seconds;
+		if (local_speculative.peak_tiles > stats->peak_tiles) stats->peak_tiles = local_speculative.peak_tiles;
+	}
+
+	for (uint32_t i = 0; i < batch_size; i++)
+	{
+		delta_map_free(&run.drops[i].map);
+	}
+	free(written);
+	free(run.drops);
+}
+
+typedef struct atomic_run_t
+{
+	height_field_t field;
+	const erosion_desc_t *params;
+	erosion_brush_t brush;
+	uint32_t seed;
+
+	uint64_t first_drop;
+	uint64_t drops;
+	uint32_t chunk;
+	volatile int64_t next_chunk;
+} atomic_run_t;
+
+typedef struct atomic_job_t
+{
+	atomic_run_t *run;
+	erosion_stats_t stats;
+} atomic_job_t;
+
+static void atomic_job(void *user_pointer)
+{
+	atomic_job_t *job = user_pointer;
+	atomic_run_t *run = job->run;
+
+	uvec2 size = { .w = (uint32_t)run->field.w, .h = (uint32_t)run->field.h };
+	for (;;)
+	{
+		uint64_t first = (uint64_t)atomic_fetch_add_i64(&run->next_chunk, 1) * run->chunk;
+		if (first >= run->drops) return;
+
+		uint64_t last = first + run->chunk < run->drops ? first + run->chunk : run->drops;
+		for (uint64_t drop = first; drop < last; drop++)
 		{
-			// erode terrain
-			float erode = fmin((capacity - drop.sediment) * params->erosion, -height_dif);
-			drop.sediment += erode_terrain(terrain, old_pos, params->radius, erode);
+			vec2 pos;
+			erosion_spawn_position(size, run->seed, run->first_drop + drop, pos);
+			simulate_drop(&run->field, run->params, run->brush, pos, &job->stats);
 		}
+	}
+}
+
+void erosion_run_atomic(terrain_t *terrain, const erosion_desc_t *params, const erosion_atomic_desc_t *desc,
+	erosion_state_t *state, uint64_t drops)
+{
+	HE_ASSERT(terrain != NULL, "A terrain is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
+
+	job_system_t *jobs = job_system_shared();
+	int workers = desc != NULL && desc->workers > 0 ? desc->workers : job_system_worker_count(jobs) + 1;
+
+	atomic_run_t run = {
+		.field = field_from_terrain(terrain),
+		.params = params,
+		.brush = select_brush(params->radius, FIELD_ATOMIC),
+		.seed = state->seed,
+		.first_drop = state->next_drop,
+		.drops = drops,
+		.chunk = desc != NULL && desc->chunk_drops > 0 ? desc->chunk_drops : EROSION_ATOMIC_DEFAULT_CHUNK,
+	};
 
-		// update drop velocity and water content
-		drop.velocity = sqrt(drop.velocity * drop.velocity + height_dif * params->gravity);
-		drop.water *= (1 - params->evaporation);
+	// with a single worker there is nobody to race with
+	if (workers > 1) run.field.mode = FIELD_ATOMIC;
+	else run.brush = select_brush(params->radius, FIELD_DIRECT);
+
+	// every job claims chunks until none are left, so at most this many run
+	atomic_job_t *args = calloc(workers, sizeof(atomic_job_t));
+	job_group_t group;
+	job_group_init(jobs, &group);
+
+	double start = timer_now();
+	for (int i = 0; i < workers; i++)
+	{
+		args[i].run = &run;
+		job_group_run(&group, atomic_job, &args[i]);
+	}
+	job_group_wait(&group);
+
+	erosion_stats_t local = { 0 };
+	for (int i = 0; i < workers; i++)
+	{
+		erosion_stats_merge(&local, &args[i].stats);
 	}
+	local.simulate_seconds = timer_now() - start;
+	erosion_stats_merge(&state->stats, &local);
+	state->next_drop += drops;
+
+	free(args);
+}
+
+void erosion_stats_merge(erosion_stats_t *dst, const erosion_stats_t *src)
+{
+	dst->drops += src->drops;
+	dst->steps += src->steps;
+	dst->effective_steps += src->effective_steps;
+	dst->noop_steps += src->noop_steps;
+	dst->saved_steps += src->saved_steps;
+	dst->water_kills += src->water_kills;
+	dst->velocity_kills += src->velocity_kills;
+	dst->pit_kills += src->pit_kills;
+	dst->out_of_bounds_kills += src->out_of_bounds_kills;
+	dst->eroded += src->eroded;
+	dst->deposited += src->deposited;
+	if (src->max_brush_clip > dst->max_brush_clip) dst->max_brush_clip = src->max_brush_clip;
+	dst->simulate_seconds += src->simulate_seconds;
+	dst->mesh_seconds += src->mesh_seconds;
+}
+
+double erosion_stats_avg_path_length(const erosion_stats_t *stats)
+{
+	// drops move one cell per step, so the path length is the step count
+	return stats->drops > 0 ? (double)stats->steps / (double)stats->drops : 0.0;
+}
+
+void erosion_stats_print(const erosion_stats_t *stats, FILE *file)
+{
+	fprintf(file, "drops:               %llu\n", (unsigned long long)stats->drops);
+	fprintf(file, "steps:               %llu (%llu effective, %llu no-op, %llu saved)\n",
+		(unsigned long long)stats->steps, (unsigned long long)stats->effective_steps,
+		(unsigned long long)stats->noop_steps, (unsigned long long)stats->saved_steps);
+	fprintf(file, "avg path length:     %.2f\n", erosion_stats_avg_path_length(stats));
+	fprintf(file, "kills:               %llu out of bounds, %llu water, %llu velocity, %llu pit\n",
+		(unsigned long long)stats->out_of_bounds_kills, (unsigned long long)stats->water_kills,
+		(unsigned long long)stats->velocity_kills, (unsigned long long)stats->pit_kills);
+	fprintf(file, "eroded / deposited:  %f / %f\n", stats->eroded, stats->deposited);
+	fprintf(file, "max brush clip:      %u cells\n", stats->max_brush_clip);
+	fprintf(file, "simulate / mesh:     %fs / %fs\n", stats->simulate_seconds, stats->mesh_seconds);
+}
+
+void erosion_stats_write_json(const erosion_stats_t *stats, FILE *file)
+{
+	fprintf(file, "{\"drops\": %llu, \"steps\": %llu, \"effective_steps\": %llu, \"noop_steps\": %llu, \"saved_steps\": %llu, ",
+		(unsigned long long)stats->drops, (unsigned long long)stats->steps, (unsigned long long)stats->effective_steps,
+		(unsigned long long)stats->noop_steps, (unsigned long long)stats->saved_steps);
+	fprintf(file, "\"avg_path_length\": %f, ", erosion_stats_avg_path_length(stats));
+	fprintf(file, "\"out_of_bounds_kills\": %llu, \"water_kills\": %llu, \"velocity_kills\": %llu, \"pit_kills\": %llu, ",
+		(unsigned long long)stats->out_of_bounds_kills, (unsigned long long)stats->water_kills,
+		(unsigned long long)stats->velocity_kills, (unsigned long long)stats->pit_kills);
+	fprintf(file, "\"eroded\": %f, \"deposited\": %f, \"max_brush_clip\": %u, ", stats->eroded, stats->deposited, stats->max_brush_clip);
+	fprintf(file, "\"simulate_seconds\": %f, \"mesh_seconds\": %f}", stats->simulate_seconds, stats->mesh_seconds);
 }
@@ -1,6 +1,10 @@
 #ifndef __erosion_h__
 #define __erosion_h__
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
 #include "components/terrain.h"
 
 typedef struct erosion_desc_t
@@ -14,6 +18,11 @@ typedef struct erosion_desc_t
 	int radius;
 	float gravity;
 	float evaporation;
+
+	// early termination thresholds. a value of zero disables the check
+	float min_water;
+	float min_velocity;
+	int max_pit_steps;
 } erosion_desc_t;
 
 #define EROSION_DEFAULT_DESC (erosion_desc_t) {\
@@ -26,8 +35,191 @@ typedef struct erosion_desc_t
 	.radius = 3,\
 	.gravity = 4.0f,\
 	.evaporation = 0.05f,\
+	.min_water = 0.0f,\
+	.min_velocity = 0.0f,\
+	.max_pit_steps = 0,\
 	}
 
-void hydraulic_erosion(terrain_t *terrain, const erosion_desc_t *params);
+// larger brushes fall back to a heap allocated weight table per step
+#define EROSION_MAX_RADIUS (1024)
+
+typedef struct erosion_stats_t
+{
+	uint64_t drops;
+	uint64_t steps;
+
+	// steps that changed the terrain vs steps that did not
+	uint64_t effective_steps;
+	uint64_t noop_steps;
+
+	// lifetime steps skipped by early termination
+	uint64_t saved_steps;
+
+	uint64_t water_kills;
+	uint64_t velocity_kills;
+	uint64_t pit_kills;
+	uint64_t out_of_bounds_kills;
+
+	double eroded;
+	double deposited;
+
+	// most brush cells cut off by the map edge in a single erosion step
+	uint32_t max_brush_clip;
+
+	// wall clock time spent in each phase of a run
+	double simulate_seconds;
+	double mesh_seconds;
+} erosion_stats_t;
+
+// everything needed to continue a run bit-identically, besides the terrain
+// and the erosion parameters. drop n always spawns at the same position for a
+// given seed, no matter how the run was split up
+typedef struct erosion_state_t
+{
+	uint32_t seed;
+	uint64_t next_drop;
+	erosion_stats_t stats;
+} erosion_state_t;
+
+// wavefront scheduling keeps a pool of drops in flight and advances all of
+// them one step at a time, sorted along a morton curve by the cell they are
+// in, so drops close to each other hit the same cache lines. the result
+// differs from the serial order but is deterministic for a given pool size
+#define EROSION_WAVEFRONT_DEFAULT_POOL (1 << 20)
+
+typedef struct erosion_wavefront_desc_t
+{
+	// drops in flight, zero picks the default
+	uint32_t pool_size;
+
+	// steps between re-sorts, zero sorts every step
+	uint32_t sort_interval;
+} erosion_wavefront_desc_t;
+
+typedef struct erosion_wavefront_stats_t
+{
+	uint64_t rounds;
+	double sort_seconds;
+
+	// sum of the pool fill ratio over all rounds
+	double occupancy;
+} erosion_wavefront_stats_t;
+
+// delta mode runs drops in parallel lanes against heights frozen for an
+// epoch. each lane sees its own changes through a private sparse delta map,
+// and the maps are added to the heights in lane order at the end of every
+// epoch. the result depends on the epoch and lane count, not on the number
+// of workers, and no atomics are involved
+#define EROSION_DELTA_DEFAULT_EPOCH (1 << 14)
+#define EROSION_DELTA_DEFAULT_LANES (16)
+
+typedef struct erosion_delta_desc_t
+{
+	// drops between reductions, zero picks the default
+	uint32_t epoch_drops;
+
+	// delta maps an epoch is split into, zero picks the default
+	uint32_t lanes;
+
+	// jobs an epoch is split into, zero picks the size of the shared job
+	// system. never more than the lanes
+	int workers;
+} erosion_delta_desc_t;
+
+typedef struct erosion_delta_stats_t
+{
+	uint64_t epochs;
+	double reduce_seconds;
+
+	// most tiles a single lane touched in one epoch
+	uint32_t peak_tiles;
+} erosion_delta_stats_t;
+
+// speculative mode runs a batch of drops concurrently, each on a private
+// copy of the tiles it touches. the copies are committed in drop order, and
+// a drop that read a tile an earlier drop of its batch wrote is run again on
+// the committed heights. the result is identical to erosion_run
+#define EROSION_SPECULATIVE_DEFAULT_BATCH (64)
+
+typedef struct erosion_speculative_desc_t
+{
+	// drops between commits, zero picks the default per worker
+	uint32_t batch_drops;
+
+	// jobs running at once, zero picks the size of the shared job system
+	int workers;
+} erosion_speculative_desc_t;
+
+typedef struct erosion_speculative_stats_t
+{
+	uint64_t batches;
+
+	// drops that conflicted with an earlier one and ran a second time
+	uint64_t replays;
+	double commit_seconds;
+
+	// most tiles a single drop touched
+	uint32_t peak_tiles;
+} erosion_speculative_stats_t;
+
+// atomic mode shares the height map between all workers with no
+// partitioning at all, every height change is an atomic float add. it is the
+// fastest parallel mode but neither repeatable nor equal to erosion_run, and
+// racing erosions can take a cell slightly below zero. meant for previews
+#define EROSION_ATOMIC_DEFAULT_CHUNK (256)
+
+typedef struct erosion_atomic_desc_t
+{
+	// drops a worker claims at a time, zero picks the default
+	uint32_t chunk_drops;
+
+	// jobs running at once, zero picks the size of the shared job system
+	int workers;
+} erosion_atomic_desc_t;
+
+// region runs only spawn drops inside a rectangle of cells, optionally
+// weighted by a mask. the drops are free to flow out of it, so neighbouring
+// valleys pick up what they carry off. drop n tries a fixed sequence of spawn
+// points for a given seed, a drop that finds no point the mask accepts is
+// skipped but still counted in next_drop
+#define EROSION_REGION_SPAWN_ATTEMPTS (16)
+
+typedef struct erosion_region_t
+{
+	uvec2 origin;
+	uvec2 size;
+
+	// spawn weights in [0, 1] for the cells of the rectangle, row by row. NULL
+	// spawns evenly over all of it
+	const float *mask;
+} erosion_region_t;
+
+void erosion_state_init(erosion_state_t *state, uint32_t seed);
+
+// false for parameters the simulation does not accept: negative or non finite
+// rates, inertia above 1, a radius outside [1, EROSION_MAX_RADIUS] or a
+// negative lifetime or pit step count
+bool erosion_desc_valid(const erosion_desc_t *params);
+
+void erosion_spawn_position(uvec2 size, uint32_t seed, uint64_t drop, vec2 pos);
+void hydraulic_erosion(terrain_t *terrain, const erosion_desc_t *params, vec2 start, erosion_stats_t *stats);
+void erosion_run(terrain_t *terrain, const erosion_desc_t *params, erosion_state_t *state, int drops);
+// changed receives the cells the run may have modified, an empty region if
+// none. it may be NULL
+void erosion_run_region(terrain_t *terrain, const erosion_desc_t *params, const erosion_region_t *region,
+	erosion_state_t *state, int drops, erosion_region_t *changed);
+void erosion_run_wavefront(terrain_t *terrain, const erosion_desc_t *params, const erosion_wavefront_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_wavefront_stats_t *stats);
+void erosion_run_deltas(terrain_t *terrain, const erosion_desc_t *params, const erosion_delta_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_delta_stats_t *stats);
+void erosion_run_speculative(terrain_t *terrain, const erosion_desc_t *params, const erosion_speculative_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_speculative_stats_t *stats);
+void erosion_run_atomic(terrain_t *terrain, const erosion_desc_t *params, const erosion_atomic_desc_t *desc,
+	erosion_state_t *state, uint64_t drops);
+
+void erosion_stats_merge(erosion_stats_t *dst, const erosion_stats_t *src);
+double erosion_stats_avg_path_length(const erosion_stats_t *stats);
+void erosion_stats_print(const erosion_stats_t *stats, FILE *file);
+void erosion_stats_write_json(const erosion_stats_t *stats, FILE *file);
 
 #endif /* __erosion_h__ */
@@ -0,0 +1,584 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "erosion_parallel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#define EROSION_PARALLEL_HAS_PROCESSES
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "core/atomic.h"
+#include "core/job.h"
+#include "core/thread.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "erosion_tiled.h"
+
+#define EROSION_PARALLEL_PHASES (4)
+#define EROSION_PARALLEL_DROPS_PER_TILE (64)
+#define EROSION_PARALLEL_MIN_BATCH (1 << 16)
+#define EROSION_PARALLEL_MAX_BATCH (1 << 22)
+
+// how often the coordinator checks on its worker processes
+#define EROSION_PARALLEL_POLL_NS (100 * 1000 * 1000)
+
+// everything the workers share. for the process backend it lives in shared
+// memory, and the pointers stay valid in the workers since they are forked
+typedef struct parallel_block_t
+{
+	erosion_desc_t params;
+	uvec2 size;
+	uint32_t tile_size;
+	uvec2 tiles;
+	uint32_t seed;
+	uint32_t workers;
+
+	// the current batch, sorted by the tile each drop spawns in
+	uint64_t first_drop;
+	uint32_t count;
+	volatile int32_t next_item[EROSION_PARALLEL_PHASES];
+	volatile int32_t stop;
+
+	erosion_stats_t *stats;
+	uint32_t *tile_start;
+	uint32_t *order;
+	float *heights;
+} parallel_block_t;
+
+#if defined(EROSION_PARALLEL_HAS_PROCESSES)
+typedef struct process_barrier_t
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count;
+	int arrived;
+	uint32_t generation;
+	int32_t abort;
+} process_barrier_t;
+
+typedef struct parallel_context_t
+{
+	parallel_block_t *block;
+	process_barrier_t *process_barrier;
+	pid_t *pids;
+} parallel_context_t;
+#endif
+
+typedef struct phase_job_t
+{
+	parallel_block_t *block;
+	uint32_t phase;
+	uint32_t index;
+} phase_job_t;
+
+static size_t align_up(size_t size)
+{
+	return (size + 63) & ~(size_t)63;
+}
+
+#if defined(EROSION_PARALLEL_HAS_PROCESSES)
+static bool any_worker_died(parallel_context_t *ctx)
+{
+	for (uint32_t i = 0; i < ctx->block->workers; i++)
+	{
+		int status;
+		if (ctx->pids[i] > 0 && waitpid(ctx->pids[i], &status, WNOHANG) == ctx->pids[i])
+		{
+			ctx->pids[i] = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void recover_lock(process_barrier_t *barrier, int result)
+{
+	// a worker that died holding the robust lock leaves it inconsistent
+	// instead of locked forever
+#if defined(__linux__)
+	if (result == EOWNERDEAD)
+	{
+		barrier->abort = 1;
+		pthread_mutex_consistent(&barrier->mutex);
+	}
+#else
+	(void)barrier;
+	(void)result;
+#endif
+}
+
+static bool process_barrier_wait(parallel_context_t *ctx, bool coordinator)
+{
+	process_barrier_t *barrier = ctx->process_barrier;
+	recover_lock(barrier, pthread_mutex_lock(&barrier->mutex));
+
+	uint32_t generation = barrier->generation;
+	if (++barrier->arrived == barrier->count)
+	{
+		barrier->arrived = 0;
+		barrier->generation++;
+		pthread_cond_broadcast(&barrier->cond);
+	}
+
+	while (generation == barrier->generation && !barrier->abort)
+	{
+		if (!coordinator)
+		{
+			recover_lock(barrier, pthread_cond_wait(&barrier->cond, &barrier->mutex));
+			continue;
+		}
+
+		// the coordinator wakes up regularly to notice crashed workers, which
+		// would otherwise never arrive
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += EROSION_PARALLEL_POLL_NS;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		int result = pthread_cond_timedwait(&barrier->cond, &barrier->mutex, &deadline);
+		recover_lock(barrier, result);
+		if (result == ETIMEDOUT && any_worker_died(ctx)) barrier->abort = 1;
+		if (barrier->abort) pthread_cond_broadcast(&barrier->cond);
+	}
+
+	bool ok = !barrier->abort;
+	pthread_mutex_unlock(&barrier->mutex);
+	return ok;
+}
+#endif
+
+static uint32_t phase_items(parallel_block_t *block, uint32_t phase, uint32_t *columns)
+{
+	uint32_t px = phase & 1;
+	uint32_t py = phase >> 1;
+	*columns = (block->tiles.w - px + 1) / 2;
+	return *columns * ((block->tiles.h - py + 1) / 2);
+}
+
+static void simulate_tile(parallel_block_t *block, uint32_t phase, uint32_t columns, uint32_t item, erosion_stats_t *stats)
+{
+	uint32_t tx = (phase & 1) + 2 * (item % columns);
+	uint32_t ty = (phase >> 1) + 2 * (item / columns);
+	uint32_t tile = tx + ty * block->tiles.w;
+
+	terrain_t view = terrain_view(block->size, block->heights);
+	for (uint32_t i = block->tile_start[tile]; i < block->tile_start[tile + 1]; i++)
+	{
+		vec2 pos;
+		erosion_spawn_position(block->size, block->seed, block->first_drop + block->order[i], pos);
+		hydraulic_erosion(&view, &block->params, pos, stats);
+	}
+}
+
+static void simulate_phase(parallel_block_t *block, uint32_t phase, erosion_stats_t *stats)
+{
+	uint32_t columns;
+	int32_t items = (int32_t)phase_items(block, phase, &columns);
+
+	// tiles are handed out dynamically, which tile a worker gets does not
+	// change the result
+	for (;;)
+	{
+		int32_t item = atomic_fetch_add_i32(&block->next_item[phase], 1);
+		if (item >= items) break;
+		simulate_tile(block, phase, columns, (uint32_t)item, stats);
+	}
+}
+
+static void sort_batch(parallel_block_t *block, uint32_t *tiles)
+{
+	uint32_t tile_count = block->tiles.w * block->tiles.h;
+	uint32_t *start = block->tile_start;
+
+	// stable counting sort, drops within a tile still run in index order
+	memset(start, 0, (tile_count + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < block->count; i++)
+	{
+		vec2 pos;
+		erosion_spawn_position(block->size, block->seed, block->first_drop + i, pos);
+		tiles[i] = (uint32_t)pos[0] / block->tile_size + ((uint32_t)pos[1] / block->tile_size) * block->tiles.w;
+		start[tiles[i] + 1]++;
+	}
+	for (uint32_t t = 0; t < tile_count; t++)
+	{
+		start[t + 1] += start[t];
+	}
+	for (uint32_t i = 0; i < block->count; i++)
+	{
+		block->order[start[tiles[i]]++] = i;
+	}
+	for (uint32_t t = tile_count; t > 0; t--)
+	{
+		start[t] = start[t - 1];
+	}
+	start[0] = 0;
+}
+
+static void prepare_batch(parallel_block_t *block, uint32_t *tiles, uint64_t first_drop, uint32_t count)
+{
+	block->first_drop = first_drop;
+	block->count = count;
+	sort_batch(block, tiles);
+	for (int p = 0; p < EROSION_PARALLEL_PHASES; p++)
+	{
+		block->next_item[p] = 0;
+	}
+}
+
+static size_t block_bytes(parallel_block_t *block, uint32_t batch, bool heights)
+{
+	size_t tile_count = (size_t)block->tiles.w * block->tiles.h;
+	size_t bytes = align_up(sizeof(parallel_block_t));
+	bytes += align_up(block->workers * sizeof(erosion_stats_t));
+	bytes += align_up((tile_count + 1) * sizeof(uint32_t));
+	bytes += align_up(batch * sizeof(uint32_t));
+	if (heights) bytes += align_up((size_t)block->size.w * block->size.h * sizeof(float));
+	return bytes;
+}
+
+static parallel_block_t *carve_block(void *memory, const parallel_block_t *layout, uint32_t batch, float *heights)
+{
+	// stats, buckets and optionally the heights follow the block itself
+	char *cursor = memory;
+	parallel_block_t *block = memory;
+	*block = *layout;
+	cursor += align_up(sizeof(parallel_block_t));
+
+	size_t tile_count = (size_t)block->tiles.w * block->tiles.h;
+	block->stats = (erosion_stats_t *)cursor;
+	memset(block->stats, 0, block->workers * sizeof(erosion_stats_t));
+	cursor += align_up(block->workers * sizeof(erosion_stats_t));
+	block->tile_start = (uint32_t *)cursor;
+	cursor += align_up((tile_count + 1) * sizeof(uint32_t));
+	block->order = (uint32_t *)cursor;
+	cursor += align_up(batch * sizeof(uint32_t));
+	block->heights = heights != NULL ? heights : (float *)cursor;
+
+	return block;
+}
+
+static void phase_job(void *user_pointer)
+{
+	phase_job_t *job = user_pointer;
+	simulate_phase(job->block, job->phase, &job->block->stats[job->index]);
+}
+
+static bool run_threads(terrain_t *terrain, const parallel_block_t *layout, erosion_state_t *state, uint64_t drops, uint32_t batch, erosion_parallel_stats_t *stats)
+{
+	// threads work on the terrain directly, the tiles of every phase run as
+	// jobs on the shared job system
+	void *memory = malloc(block_bytes((parallel_block_t *)layout, batch, false));
+	parallel_block_t *block = carve_block(memory, layout, batch, terrain->height_map);
+	uint32_t *tiles = malloc(batch * sizeof(uint32_t));
+	phase_job_t *args = malloc(layout->workers * sizeof(phase_job_t));
+
+	job_group_t group;
+	job_group_init(job_system_shared(), &group);
+
+	double start = timer_now();
+	for (uint64_t done = 0; done < drops; done += block->count)
+	{
+		double sort_start = timer_now();
+		prepare_batch(block, tiles, state->next_drop, (uint32_t)(drops - done < batch ? drops - done : batch));
+		stats->sort_seconds += timer_now() - sort_start;
+
+		for (uint32_t phase = 0; phase < EROSION_PARALLEL_PHASES; phase++)
+		{
+			for (uint32_t i = 0; i < layout->workers; i++)
+			{
+				args[i] = (phase_job_t){ .block = block, .phase = phase, .index = i };
+				job_group_run(&group, phase_job, &args[i]);
+			}
+			job_group_wait(&group);
+		}
+
+		state->next_drop += block->count;
+		stats->batches++;
+	}
+	stats->simulate_seconds += timer_now() - start - stats->sort_seconds;
+
+	for (uint32_t i = 0; i < layout->workers; i++)
+	{
+		erosion_stats_merge(&state->stats, &block->stats[i]);
+	}
+
+	free(args);
+	free(tiles);
+	free(memory);
+	return true;
+}
+
+#if defined(EROSION_PARALLEL_HAS_PROCESSES)
+static void *shared_alloc(size_t bytes)
+{
+	static volatile int32_t counter = 0;
+
+	char name[64];
+	snprintf(name, sizeof(name), "/hydraulic_erosion_%ld_%d", (long)getpid(), (int)atomic_fetch_add_i32(&counter, 1));
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) return NULL;
+
+	// the mapping keeps the segment alive, so nothing is left behind even if
+	// the coordinator crashes
+	shm_unlink(name);
+
+	void *memory = MAP_FAILED;
+	if (ftruncate(fd, (off_t)bytes) == 0) memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return memory == MAP_FAILED ? NULL : memory;
+}
+
+static bool init_process_barrier(process_barrier_t *barrier, int count)
+{
+	pthread_mutexattr_t mutex_attr;
+	pthread_mutexattr_init(&mutex_attr);
+	pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+#if defined(__linux__)
+	pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+#endif
+	bool ok = pthread_mutex_init(&barrier->mutex, &mutex_attr) == 0;
+	pthread_mutexattr_destroy(&mutex_attr);
+
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+	ok = ok && pthread_cond_init(&barrier->cond, &cond_attr) == 0;
+	pthread_condattr_destroy(&cond_attr);
+
+	barrier->count = count;
+	barrier->arrived = 0;
+	barrier->generation = 0;
+	barrier->abort = 0;
+	return ok;
+}
+
+static void worker_loop(parallel_context_t *ctx, uint32_t index)
+{
+	parallel_block_t *block = ctx->block;
+
+	for (;;)
+	{
+		if (!process_barrier_wait(ctx, false) || block->stop) return;
+
+		for (uint32_t phase = 0; phase < EROSION_PARALLEL_PHASES; phase++)
+		{
+			simulate_phase(block, phase, &block->stats[index]);
+			if (!process_barrier_wait(ctx, false)) return;
+		}
+	}
+}
+
+static bool coordinate(parallel_context_t *ctx, erosion_state_t *state, uint64_t drops, uint32_t batch, erosion_parallel_stats_t *stats)
+{
+	parallel_block_t *block = ctx->block;
+	uint32_t *tiles = malloc(batch * sizeof(uint32_t));
+	uint64_t next_drop = state->next_drop;
+	bool ok = true;
+
+	double start = timer_now();
+	uint64_t done = 0;
+	while (ok && done < drops)
+	{
+		double sort_start = timer_now();
+		prepare_batch(block, tiles, next_drop, (uint32_t)(drops - done < batch ? drops - done : batch));
+		stats->sort_seconds += timer_now() - sort_start;
+
+		// release the workers, then wait for every phase to finish
+		ok = process_barrier_wait(ctx, true);
+		for (int p = 0; ok && p < EROSION_PARALLEL_PHASES; p++)
+		{
+			ok = process_barrier_wait(ctx, true);
+		}
+
+		next_drop += block->count;
+		done += block->count;
+		stats->batches++;
+	}
+
+	if (ok)
+	{
+		block->stop = 1;
+		ok = process_barrier_wait(ctx, true);
+		state->next_drop = next_drop;
+	}
+	stats->simulate_seconds += timer_now() - start - stats->sort_seconds;
+
+	free(tiles);
+	return ok;
+}
+
+static bool run_processes(terrain_t *terrain, const parallel_block_t *layout, erosion_state_t *state, uint64_t drops, uint32_t batch, erosion_parallel_stats_t *stats)
+{
+	size_t bytes = align_up(sizeof(process_barrier_t)) + block_bytes((parallel_block_t *)layout, batch, true);
+	char *memory = shared_alloc(bytes);
+	if (memory == NULL) return false;
+
+	parallel_context_t ctx = {
+		.process_barrier = (process_barrier_t *)memory,
+		.block = carve_block(memory + align_up(sizeof(process_barrier_t)), layout, batch, NULL),
+		.pids = calloc(layout->workers, sizeof(pid_t)),
+	};
+
+	bool ok = init_process_barrier(ctx.process_barrier, (int)layout->workers + 1);
+	memcpy(ctx.block->heights, terrain->height_map, (size_t)layout->size.w * layout->size.h * sizeof(float));
+
+	// flush stdio so the workers do not inherit and repeat buffered output
+	fflush(NULL);
+
+	for (uint32_t i = 0; ok && i < layout->workers; i++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			worker_loop(&ctx, i);
+			_exit(0);
+		}
+		ctx.pids[i] = pid;
+		ok = pid > 0;
+	}
+
+	erosion_state_t result = *state;
+	ok = ok && coordinate(&ctx, &result, drops, batch, stats);
+
+	if (!ok)
+	{
+		// release anyone still waiting and make sure nobody keeps running
+		recover_lock(ctx.process_barrier, pthread_mutex_lock(&ctx.process_barrier->mutex));
+		ctx.process_barrier->abort = 1;
+		pthread_cond_broadcast(&ctx.process_barrier->cond);
+		pthread_mutex_unlock(&ctx.process_barrier->mutex);
+		for (uint32_t i = 0; i < layout->workers; i++)
+		{
+			if (ctx.pids[i] > 0) kill(ctx.pids[i], SIGKILL);
+		}
+	}
+
+	for (uint32_t i = 0; i < layout->workers; i++)
+	{
+		int status;
+		if (ctx.pids[i] > 0 && waitpid(ctx.pids[i], &status, 0) == ctx.pids[i])
+		{
+			ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		}
+	}
+
+	if (ok)
+	{
+		memcpy(terrain->height_map, ctx.block->heights, (size_t)layout->size.w * layout->size.h * sizeof(float));
+		for (uint32_t i = 0; i < layout->workers; i++)
+		{
+			erosion_stats_merge(&result.stats, &ctx.block->stats[i]);
+		}
+		*state = result;
+	}
+
+	free(ctx.pids);
+	munmap(memory, bytes);
+	return ok;
+}
+#endif
+
+bool erosion_parallel_supported(erosion_parallel_backend_t backend)
+{
+#if defined(EROSION_PARALLEL_HAS_PROCESSES)
+	return backend < EROSION_PARALLEL_BACKEND_COUNT__;
+#else
+	return backend == EROSION_PARALLEL_THREADS;
+#endif
+}
+
+uint32_t erosion_parallel_min_tile_size(const erosion_desc_t *params)
+{
+	// tiles of one color are a full tile apart, which has to cover the reach
+	// of droplets from both sides
+	return 2 * erosion_tiled_default_halo(params);
+}
+
+bool erosion_parallel_run(terrain_t *terrain, const erosion_desc_t *params, const erosion_parallel_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_parallel_stats_t *stats)
+{
+	HE_ASSERT(terrain != NULL, "A terrain is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(desc != NULL, "A parallel erosion description is required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
+
+	if (!erosion_parallel_supported(desc->backend)) return false;
+
+	uint32_t min_tile_size = erosion_parallel_min_tile_size(params);
+	uint32_t tile_size = desc->tile_size > min_tile_size ? desc->tile_size : min_tile_size;
+
+	parallel_block_t layout = {
+		.params = *params,
+		.size = terrain->size,
+		.tile_size = tile_size,
+		.tiles = {
+			.w = (terrain->size.w + tile_size - 1) / tile_size,
+			.h = (terrain->size.h + tile_size - 1) / tile_size,
+		},
+		.seed = state->seed,
+		.workers = (uint32_t)(desc->workers > 0 ? desc->workers :
+			desc->backend == EROSION_PARALLEL_THREADS ? job_system_worker_count(job_system_shared()) + 1 : thread_hardware_concurrency()),
+	};
+
+	uint64_t batch = desc->batch_size;
+	if (batch == 0)
+	{
+		batch = (uint64_t)layout.tiles.w * layout.tiles.h * EROSION_PARALLEL_DROPS_PER_TILE;
+		if (batch < EROSION_PARALLEL_MIN_BATCH) batch = EROSION_PARALLEL_MIN_BATCH;
+		if (batch > EROSION_PARALLEL_MAX_BATCH) batch = EROSION_PARALLEL_MAX_BATCH;
+	}
+	if (batch > drops) batch = drops;
+	if (batch == 0) return true;
+
+	erosion_parallel_stats_t local_stats = { .workers = layout.workers, .tile_size = tile_size };
+
+	double start = timer_now();
+	bool ok = false;
+	switch (desc->backend)
+	{
+	case EROSION_PARALLEL_THREADS:
+		ok = run_threads(terrain, &layout, state, drops, (uint32_t)batch, &local_stats);
+		break;
+#if defined(EROSION_PARALLEL_HAS_PROCESSES)
+	case EROSION_PARALLEL_PROCESSES:
+		ok = run_processes(terrain, &layout, state, drops, (uint32_t)batch, &local_stats);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (ok)
+	{
+		state->stats.simulate_seconds += timer_now() - start;
+		if (stats != NULL)
+		{
+			stats->workers = local_stats.workers;
+			stats->tile_size = local_stats.tile_size;
+			stats->batches += local_stats.batches;
+			stats->sort_seconds += local_stats.sort_seconds;
+			stats->simulate_seconds += local_stats.simulate_seconds;
+		}
+	}
+
+	return ok;
+}
@@ -0,0 +1,56 @@
+#ifndef __erosion_parallel_h__
+#define __erosion_parallel_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "erosion.h"
+
+// parallel erosion driver. the map is cut into tiles at least twice as wide
+// as a droplet can reach and colored in a 2x2 pattern. tiles of one color
+// never touch the same cell, so their droplets run concurrently without
+// locks while the four colors run one after another. the result depends on
+// the tile size, but not on the number of workers
+
+typedef enum erosion_parallel_backend_t
+{
+	EROSION_PARALLEL_THREADS,
+	// worker processes forked over a heightmap in posix shared memory. a
+	// crashing worker fails the run instead of taking the caller with it
+	EROSION_PARALLEL_PROCESSES,
+	EROSION_PARALLEL_BACKEND_COUNT__,
+} erosion_parallel_backend_t;
+
+typedef struct erosion_parallel_desc_t
+{
+	erosion_parallel_backend_t backend;
+
+	// zero picks the size of the shared job system for threads, and the
+	// hardware concurrency for processes
+	int workers;
+
+	// zero picks the smallest safe tile size
+	uint32_t tile_size;
+
+	// drops sorted into tiles at a time, zero picks one from the tile count
+	uint32_t batch_size;
+} erosion_parallel_desc_t;
+
+typedef struct erosion_parallel_stats_t
+{
+	uint32_t workers;
+	uint32_t tile_size;
+	uint64_t batches;
+	double sort_seconds;
+	double simulate_seconds;
+} erosion_parallel_stats_t;
+
+bool erosion_parallel_supported(erosion_parallel_backend_t backend);
+uint32_t erosion_parallel_min_tile_size(const erosion_desc_t *params);
+
+// returns false if the backend is unsupported or a worker died. the terrain
+// and state are left untouched in that case
+bool erosion_parallel_run(terrain_t *terrain, const erosion_desc_t *params, const erosion_parallel_desc_t *desc,
+	erosion_state_t *state, uint64_t drops, erosion_parallel_stats_t *stats);
+
+#endif /* __erosion_parallel_h__ */
@@ -0,0 +1,195 @@
+#include "erosion_preview.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/atomic.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "math/resample.h"
+
+// drops run between two checks for a newer preview, one delta epoch
+#define EROSION_PREVIEW_CHUNK_DROPS EROSION_DELTA_DEFAULT_EPOCH
+// keeps a preview at around 100 ms whatever the full run would take
+#define EROSION_PREVIEW_MAX_DROPS (1 << 16)
+
+static int scale_steps(int value, float stride)
+{
+	int scaled = (int)roundf((float)value / stride);
+	return scaled > 1 ? scaled : 1;
+}
+
+static float *run_preview(erosion_preview_t *preview, const erosion_desc_t *params, uint64_t drops)
+{
+	size_t count = (size_t)preview->size.w * preview->size.h;
+	float *heights = malloc(count * sizeof(float));
+	memcpy(heights, preview->base, count * sizeof(float));
+
+	terrain_t view = terrain_view(preview->size, heights);
+	erosion_state_t state;
+	erosion_state_init(&state, preview->seed);
+
+	// delta mode is parallel and repeatable, the same parameters always give
+	// the same preview
+	for (uint64_t done = 0; done < drops && !atomic_load_i32(&preview->cancel); done += EROSION_PREVIEW_CHUNK_DROPS)
+	{
+		uint64_t chunk = drops - done < EROSION_PREVIEW_CHUNK_DROPS ? drops - done : EROSION_PREVIEW_CHUNK_DROPS;
+		erosion_run_deltas(&view, params, NULL, &state, chunk, NULL);
+	}
+
+	if (atomic_load_i32(&preview->cancel))
+	{
+		free(heights);
+		return NULL;
+	}
+	return heights;
+}
+
+static void preview_thread(void *user_pointer)
+{
+	erosion_preview_t *preview = user_pointer;
+
+	mutex_lock(preview->mutex);
+	while (true)
+	{
+		while (!preview->quit && !preview->has_pending) cond_wait(preview->wake, preview->mutex);
+		if (preview->quit) break;
+
+		erosion_desc_t params = preview->pending;
+		uint64_t drops = preview->pending_drops;
+		preview->has_pending = false;
+		atomic_store_i32(&preview->cancel, 0);
+		mutex_unlock(preview->mutex);
+
+		double start = timer_now();
+		float *heights = run_preview(preview, &params, drops);
+		double seconds = timer_now() - start;
+
+		mutex_lock(preview->mutex);
+		if (heights != NULL && !preview->has_pending)
+		{
+			free(preview->result);
+			preview->result = heights;
+			preview->preview_seconds = seconds;
+		}
+		else
+		{
+			free(heights);
+		}
+	}
+	mutex_unlock(preview->mutex);
+}
+
+void erosion_preview_init(const erosion_preview_desc_t *desc, erosion_preview_t **preview)
+{
+	HE_ASSERT(preview != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "An erosion preview description is required");
+	HE_ASSERT(desc->base != NULL, "A base height map is required");
+	HE_ASSERT(desc->base_size.w >= 2 && desc->base_size.h >= 2, "Invalid base size");
+
+	erosion_preview_t *result = calloc(1, sizeof(erosion_preview_t));
+
+	// never upsample, a small map is previewed as is
+	uint32_t longest = desc->base_size.w > desc->base_size.h ? desc->base_size.w : desc->base_size.h;
+	uint32_t target = desc->size > 0 ? desc->size : EROSION_PREVIEW_DEFAULT_SIZE;
+	if (target > longest) target = longest;
+	float ratio = (float)(target - 1) / (float)(longest - 1);
+	result->size.w = (uint32_t)roundf((float)(desc->base_size.w - 1) * ratio) + 1;
+	result->size.h = (uint32_t)roundf((float)(desc->base_size.h - 1) * ratio) + 1;
+	if (result->size.w < 2) result->size.w = 2;
+	if (result->size.h < 2) result->size.h = 2;
+	result->stride = 1.0f / ratio;
+	result->seed = desc->seed;
+
+	result->base = malloc((size_t)result->size.w * result->size.h * sizeof(float));
+	resample(desc->base, desc->base_size, result->base, result->size, RESAMPLE_FILTER_BILINEAR);
+
+	result->mutex = mutex_create();
+	result->wake = cond_create();
+	result->thread = thread_create(preview_thread, result);
+
+	*preview = result;
+}
+
+erosion_preview_t *erosion_preview_create(const erosion_preview_desc_t *desc)
+{
+	erosion_preview_t *preview;
+	erosion_preview_init(desc, &preview);
+	return preview;
+}
+
+void erosion_preview_free(erosion_preview_t *preview)
+{
+	if (preview == NULL) return;
+
+	mutex_lock(preview->mutex);
+	preview->quit = true;
+	preview->has_pending = false;
+	atomic_store_i32(&preview->cancel, 1);
+	cond_signal(preview->wake);
+	mutex_unlock(preview->mutex);
+	thread_join(preview->thread);
+
+	free(preview->result);
+	free(preview->base);
+	cond_free(preview->wake);
+	mutex_free(preview->mutex);
+	free(preview);
+}
+
+void erosion_preview_submit(erosion_preview_t *preview, const erosion_desc_t *params, uint64_t drops)
+{
+	HE_ASSERT(preview != NULL, "Cannot submit to NULL");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+
+	// drops per area match the full run, cells per step shrink with the map
+	erosion_desc_t scaled = *params;
+	scaled.radius = scale_steps(params->radius, preview->stride);
+	scaled.drop_lifetime = scale_steps(params->drop_lifetime, preview->stride);
+	scaled.max_pit_steps = params->max_pit_steps > 0 ? scale_steps(params->max_pit_steps, preview->stride) : 0;
+	double area = (double)preview->stride * preview->stride;
+	uint64_t scaled_drops = (uint64_t)ceil((double)drops / area);
+	if (scaled_drops > EROSION_PREVIEW_MAX_DROPS) scaled_drops = EROSION_PREVIEW_MAX_DROPS;
+
+	mutex_lock(preview->mutex);
+	preview->pending = scaled;
+	preview->pending_drops = scaled_drops;
+	preview->has_pending = true;
+	atomic_store_i32(&preview->cancel, 1);
+	cond_signal(preview->wake);
+	mutex_unlock(preview->mutex);
+}
+
+bool erosion_preview_poll(erosion_preview_t *preview, terrain_t *terrain)
+{
+	HE_ASSERT(preview != NULL, "Cannot poll NULL");
+	HE_ASSERT(terrain != NULL, "A terrain to update is required");
+
+	mutex_lock(preview->mutex);
+	float *heights = preview->result;
+	preview->result = NULL;
+	mutex_unlock(preview->mutex);
+	if (heights == NULL) return false;
+
+	if (terrain->storage == TERRAIN_STORAGE_HEAP)
+	{
+		free(terrain->height_map);
+		terrain->height_map = heights;
+		terrain->size = preview->size;
+	}
+	else
+	{
+		// a preview that cannot be stored is dropped, the next one tries again
+		if (!terrain_allocate(terrain, preview->size))
+		{
+			free(heights);
+			return false;
+		}
+		memcpy(terrain->height_map, heights, (size_t)preview->size.w * preview->size.h * sizeof(float));
+		free(heights);
+	}
+
+	terrain_update_mesh(terrain);
+	return true;
+}
@@ -0,0 +1,68 @@
+#ifndef __erosion_preview_h__
+#define __erosion_preview_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "components/terrain.h"
+#include "core/thread.h"
+#include "erosion.h"
+
+// reruns erosion on a downsampled copy of a base height map on a background
+// thread, so parameter changes can be judged without a full resolution run.
+// every submit starts over from the base with a fixed drop seed, a newer one
+// stops the running preview at its next chunk of drops. the render thread
+// picks the result up with erosion_preview_poll
+
+#define EROSION_PREVIEW_DEFAULT_SIZE (256)
+
+typedef struct erosion_preview_desc_t
+{
+	// the map to preview on, only read during init
+	const float *base;
+	uvec2 base_size;
+
+	// longest side of the preview map, zero picks the default
+	uint32_t size;
+	uint32_t seed;
+} erosion_preview_desc_t;
+
+typedef struct erosion_preview_t
+{
+	uvec2 size;
+	// base samples per preview sample along the longest side
+	float stride;
+	uint32_t seed;
+	float *base;
+
+	thread_t *thread;
+	mutex_t *mutex;
+	cond_t *wake;
+
+	// only touched with the mutex held
+	erosion_desc_t pending;
+	uint64_t pending_drops;
+	bool has_pending;
+	bool quit;
+	float *result;
+	double preview_seconds;
+
+	// raised by submits, the running preview checks it between chunks
+	volatile int32_t cancel;
+} erosion_preview_t;
+
+void erosion_preview_init(const erosion_preview_desc_t *desc, erosion_preview_t **preview);
+erosion_preview_t *erosion_preview_create(const erosion_preview_desc_t *desc);
+void erosion_preview_free(erosion_preview_t *preview);
+
+// the drop count is meant for the full map and is scaled down by the area
+// ratio, capped so a preview stays interactive. the brush radius and drop
+// lifetime are scaled down by the stride
+void erosion_preview_submit(erosion_preview_t *preview, const erosion_desc_t *params, uint64_t drops);
+
+// copies the latest finished preview into terrain, resizing it to the
+// preview size, and rebuilds its mesh. false if there was none or terrain
+// could not be resized
+bool erosion_preview_poll(erosion_preview_t *preview, terrain_t *terrain);
+
+#endif /* __erosion_preview_h__ */
@@ -0,0 +1,272 @@
+#include "erosion_sweep.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/crc32.h"
+#include "core/job.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "io/checkpoint.h"
+
+// drops handed to erosion_run at a time, it takes an int
+#define EROSION_SWEEP_CHUNK (1 << 20)
+
+static const char *param_names[EROSION_SWEEP_PARAM_COUNT__] = {
+	"inertia", "capacity", "min_capacity", "deposition", "erosion", "evaporation", "gravity", "radius", "lifetime",
+};
+
+typedef struct sweep_run_t
+{
+	terrain_t *base;
+	const erosion_sweep_desc_t *desc;
+	erosion_sweep_result_t *results;
+} sweep_run_t;
+
+typedef struct sweep_job_t
+{
+	sweep_run_t *run;
+	uint32_t index;
+} sweep_job_t;
+
+static float get_param(const erosion_desc_t *params, erosion_sweep_param_t param)
+{
+	switch (param)
+	{
+	case EROSION_SWEEP_INERTIA:      return params->inertia;
+	case EROSION_SWEEP_CAPACITY:     return params->capacity;
+	case EROSION_SWEEP_MIN_CAPACITY: return params->min_capacity;
+	case EROSION_SWEEP_DEPOSITION:   return params->deposition;
+	case EROSION_SWEEP_EROSION:      return params->erosion;
+	case EROSION_SWEEP_EVAPORATION:  return params->evaporation;
+	case EROSION_SWEEP_GRAVITY:      return params->gravity;
+	case EROSION_SWEEP_RADIUS:       return (float)params->radius;
+	case EROSION_SWEEP_LIFETIME:     return (float)params->drop_lifetime;
+	default:                         return 0.0f;
+	}
+}
+
+static void set_param(erosion_desc_t *params, erosion_sweep_param_t param, float v)
+{
+	switch (param)
+	{
+	case EROSION_SWEEP_INERTIA:      params->inertia = v; break;
+	case EROSION_SWEEP_CAPACITY:     params->capacity = v; break;
+	case EROSION_SWEEP_MIN_CAPACITY: params->min_capacity = v; break;
+	case EROSION_SWEEP_DEPOSITION:   params->deposition = v; break;
+	case EROSION_SWEEP_EROSION:      params->erosion = v; break;
+	case EROSION_SWEEP_EVAPORATION:  params->evaporation = v; break;
+	case EROSION_SWEEP_GRAVITY:      params->gravity = v; break;
+	case EROSION_SWEEP_RADIUS:       params->radius = (int)lroundf(v); break;
+	case EROSION_SWEEP_LIFETIME:     params->drop_lifetime = (int)lroundf(v); break;
+	default: break;
+	}
+}
+
+const char *erosion_sweep_param_name(erosion_sweep_param_t param)
+{
+	return param < EROSION_SWEEP_PARAM_COUNT__ ? param_names[param] : "unknown";
+}
+
+bool erosion_sweep_axis_parse(const char *spec, erosion_sweep_axis_t *axis)
+{
+	HE_ASSERT(spec != NULL, "A sweep spec is required");
+	HE_ASSERT(axis != NULL, "Cannot parse into NULL");
+
+	const char *equals = strchr(spec, '=');
+	if (equals == NULL) return false;
+
+	size_t name_len = (size_t)(equals - spec);
+	int param = 0;
+	while (param < EROSION_SWEEP_PARAM_COUNT__ && (strlen(param_names[param]) != name_len || strncmp(spec, param_names[param], name_len) != 0))
+	{
+		param++;
+	}
+	if (param == EROSION_SWEEP_PARAM_COUNT__) return false;
+
+	char *end;
+	axis->param = (erosion_sweep_param_t)param;
+	axis->first = strtof(equals + 1, &end);
+	axis->last = axis->first;
+	axis->steps = 1;
+	if (end == equals + 1) return false;
+
+	if (*end == ':')
+	{
+		const char *cursor = end + 1;
+		axis->last = strtof(cursor, &end);
+		if (end == cursor) return false;
+		axis->steps = 2;
+	}
+	if (*end == ':')
+	{
+		const char *cursor = end + 1;
+		long steps = strtol(cursor, &end, 10);
+		if (end == cursor || steps < 1) return false;
+		axis->steps = (uint32_t)steps;
+	}
+	if (*end != '\0') return false;
+
+	// every rule of erosion_desc_valid bounds a single parameter to a range,
+	// so the steps in between are valid once both ends are
+	erosion_desc_t first = EROSION_DEFAULT_DESC, last = EROSION_DEFAULT_DESC;
+	set_param(&first, axis->param, axis->first);
+	set_param(&last, axis->param, axis->last);
+	return erosion_desc_valid(&first) && erosion_desc_valid(&last);
+}
+
+uint32_t erosion_sweep_config_count(const erosion_sweep_desc_t *desc)
+{
+	uint32_t count = 1;
+	for (uint32_t a = 0; a < desc->axis_count; a++)
+	{
+		count *= desc->axes[a].steps;
+	}
+	return count;
+}
+
+void erosion_sweep_config(const erosion_sweep_desc_t *desc, uint32_t index, erosion_desc_t *params)
+{
+	*params = desc->base;
+	for (uint32_t a = desc->axis_count; a-- > 0;)
+	{
+		const erosion_sweep_axis_t *axis = &desc->axes[a];
+		uint32_t step = index % axis->steps;
+		index /= axis->steps;
+
+		float t = axis->steps > 1 ? (float)step / (float)(axis->steps - 1) : 0.0f;
+		set_param(params, axis->param, axis->first + (axis->last - axis->first) * t);
+	}
+}
+
+static void sweep_job(void *user_pointer)
+{
+	sweep_job_t *job = user_pointer;
+	const erosion_sweep_desc_t *desc = job->run->desc;
+	terrain_t *base = job->run->base;
+	erosion_sweep_result_t *result = &job->run->results[job->index];
+
+	erosion_sweep_config(desc, job->index, &result->params);
+
+	terrain_t *terrain = terrain_clone(base);
+	erosion_state_t state;
+	erosion_state_init(&state, desc->seed);
+
+	double start = timer_now();
+	for (uint64_t done = 0; done < desc->drops; done += EROSION_SWEEP_CHUNK)
+	{
+		uint64_t remaining = desc->drops - done;
+		erosion_run(terrain, &result->params, &state, remaining < EROSION_SWEEP_CHUNK ? (int)remaining : EROSION_SWEEP_CHUNK);
+	}
+	result->seconds = timer_now() - start;
+	result->stats = state.stats;
+
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+	result->checksum = crc32_update(CRC32_INIT, terrain->height_map, count * sizeof(float));
+
+	double change_sq = 0;
+	result->min_height = terrain->height_map[0];
+	result->max_height = terrain->height_map[0];
+	for (size_t i = 0; i < count; i++)
+	{
+		float h = terrain->height_map[i];
+		double change = (double)h - base->height_map[i];
+		change_sq += change * change;
+		if (h < result->min_height) result->min_height = h;
+		if (h > result->max_height) result->max_height = h;
+	}
+	result->rms_change = sqrt(change_sq / count);
+
+	result->saved = true;
+	if (desc->output_dir != NULL)
+	{
+		size_t path_len = strlen(desc->output_dir) + 32;
+		char *path = malloc(path_len);
+		snprintf(path, path_len, "%s/sweep_%04u.hecp", desc->output_dir, job->index);
+		result->saved = checkpoint_save(path, terrain, &result->params, &state);
+		free(path);
+	}
+
+	terrain_free(terrain);
+}
+
+void erosion_sweep_run(terrain_t *base, const erosion_sweep_desc_t *desc, erosion_sweep_result_t *results)
+{
+	HE_ASSERT(base != NULL, "A base terrain is required");
+	HE_ASSERT(desc != NULL, "A sweep description is required");
+	HE_ASSERT(results != NULL, "Sweep results are required");
+	HE_ASSERT(desc->axis_count <= EROSION_SWEEP_MAX_AXES, "Too many sweep axes");
+
+	sweep_run_t run = {
+		.base = base,
+		.desc = desc,
+		.results = results,
+	};
+
+	// one job per config, so at most one copy per running job is alive
+	uint32_t count = erosion_sweep_config_count(desc);
+	sweep_job_t *jobs = malloc(count * sizeof(sweep_job_t));
+
+	job_group_t group;
+	job_group_init(job_system_shared(), &group);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		jobs[i] = (sweep_job_t){ .run = &run, .index = i };
+		job_group_run(&group, sweep_job, &jobs[i]);
+	}
+	job_group_wait(&group);
+
+	free(jobs);
+}
+
+void erosion_sweep_print_table(const erosion_sweep_desc_t *desc, const erosion_sweep_result_t *results, FILE *file)
+{
+	fprintf(file, "%5s", "#");
+	for (uint32_t a = 0; a < desc->axis_count; a++)
+	{
+		fprintf(file, " %12s", erosion_sweep_param_name(desc->axes[a].param));
+	}
+	fprintf(file, " %9s %12s %9s %12s %12s %10s %10s %10s %8s\n",
+		"seconds", "drops/s", "avg path", "eroded", "deposited", "rms dh", "min", "max", "checksum");
+
+	uint32_t count = erosion_sweep_config_count(desc);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const erosion_sweep_result_t *r = &results[i];
+		fprintf(file, "%5u", i);
+		for (uint32_t a = 0; a < desc->axis_count; a++)
+		{
+			fprintf(file, " %12g", get_param(&r->params, desc->axes[a].param));
+		}
+		fprintf(file, " %9.3f %12.0f %9.2f %12.3f %12.3f %10.5f %10.4f %10.4f %08x%s\n",
+			r->seconds, r->seconds > 0 ? r->stats.drops / r->seconds : 0.0, erosion_stats_avg_path_length(&r->stats),
+			r->stats.eroded, r->stats.deposited, r->rms_change, r->min_height, r->max_height, r->checksum,
+			r->saved ? "" : " (not saved)");
+	}
+}
+
+void erosion_sweep_write_csv(const erosion_sweep_desc_t *desc, const erosion_sweep_result_t *results, FILE *file)
+{
+	fprintf(file, "index");
+	for (uint32_t a = 0; a < desc->axis_count; a++)
+	{
+		fprintf(file, ",%s", erosion_sweep_param_name(desc->axes[a].param));
+	}
+	fprintf(file, ",seconds,drops,steps,avg_path_length,eroded,deposited,rms_change,min_height,max_height,checksum,saved\n");
+
+	uint32_t count = erosion_sweep_config_count(desc);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const erosion_sweep_result_t *r = &results[i];
+		fprintf(file, "%u", i);
+		for (uint32_t a = 0; a < desc->axis_count; a++)
+		{
+			fprintf(file, ",%g", get_param(&r->params, desc->axes[a].param));
+		}
+		fprintf(file, ",%f,%llu,%llu,%f,%f,%f,%f,%f,%f,%08x,%d\n",
+			r->seconds, (unsigned long long)r->stats.drops, (unsigned long long)r->stats.steps,
+			erosion_stats_avg_path_length(&r->stats), r->stats.eroded, r->stats.deposited, r->rms_change,
+			r->min_height, r->max_height, r->checksum, r->saved ? 1 : 0);
+	}
+}
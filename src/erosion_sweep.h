@@ -0,0 +1,88 @@
+#ifndef __erosion_sweep_h__
+#define __erosion_sweep_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "erosion.h"
+
+// parameter sweeps. every combination of the swept values runs the same
+// drops on its own copy of one base terrain, concurrently on the shared job
+// system. only the configs currently running hold a copy, the base is never
+// written
+
+#define EROSION_SWEEP_MAX_AXES (8)
+
+typedef enum erosion_sweep_param_t
+{
+	EROSION_SWEEP_INERTIA,
+	EROSION_SWEEP_CAPACITY,
+	EROSION_SWEEP_MIN_CAPACITY,
+	EROSION_SWEEP_DEPOSITION,
+	EROSION_SWEEP_EROSION,
+	EROSION_SWEEP_EVAPORATION,
+	EROSION_SWEEP_GRAVITY,
+	EROSION_SWEEP_RADIUS,
+	EROSION_SWEEP_LIFETIME,
+	EROSION_SWEEP_PARAM_COUNT__,
+} erosion_sweep_param_t;
+
+// steps values spread evenly from first to last, both included. integer
+// parameters are rounded
+typedef struct erosion_sweep_axis_t
+{
+	erosion_sweep_param_t param;
+	float first;
+	float last;
+	uint32_t steps;
+} erosion_sweep_axis_t;
+
+typedef struct erosion_sweep_desc_t
+{
+	// everything that is not swept
+	erosion_desc_t base;
+
+	erosion_sweep_axis_t axes[EROSION_SWEEP_MAX_AXES];
+	uint32_t axis_count;
+
+	uint32_t seed;
+	uint64_t drops;
+
+	// directory every finished config is checkpointed to, NULL writes nothing
+	const char *output_dir;
+} erosion_sweep_desc_t;
+
+typedef struct erosion_sweep_result_t
+{
+	erosion_desc_t params;
+	erosion_stats_t stats;
+	double seconds;
+	uint32_t checksum;
+
+	float min_height;
+	float max_height;
+	// root mean square height change against the base terrain
+	double rms_change;
+
+	// false if the checkpoint could not be written
+	bool saved;
+} erosion_sweep_result_t;
+
+const char *erosion_sweep_param_name(erosion_sweep_param_t param);
+
+// parses name=first[:last[:steps]], e.g. inertia=0.05:0.3:6 or radius=2:5:4.
+// false as well for values erosion_desc_valid would reject
+bool erosion_sweep_axis_parse(const char *spec, erosion_sweep_axis_t *axis);
+
+uint32_t erosion_sweep_config_count(const erosion_sweep_desc_t *desc);
+// the last axis changes fastest
+void erosion_sweep_config(const erosion_sweep_desc_t *desc, uint32_t index, erosion_desc_t *params);
+
+// results needs room for erosion_sweep_config_count entries
+void erosion_sweep_run(terrain_t *base, const erosion_sweep_desc_t *desc, erosion_sweep_result_t *results);
+
+void erosion_sweep_print_table(const erosion_sweep_desc_t *desc, const erosion_sweep_result_t *results, FILE *file);
+void erosion_sweep_write_csv(const erosion_sweep_desc_t *desc, const erosion_sweep_result_t *results, FILE *file);
+
+#endif /* __erosion_sweep_h__ */
@@ -0,0 +1,148 @@
+#include "erosion_tiled.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/timer.h"
+#include "debug/assert.h"
+
+// droplets are bucketed in batches, enough for a good number per tile while
+// keeping the bucket arrays bounded
+#define EROSION_TILED_DROPS_PER_TILE (64)
+#define EROSION_TILED_MIN_BATCH (1 << 16)
+#define EROSION_TILED_MAX_BATCH (1 << 24)
+
+uint32_t erosion_tiled_default_halo(const erosion_desc_t *params)
+{
+	// a drop moves one cell per step and its brush reaches radius further
+	return (uint32_t)(params->drop_lifetime + params->radius + 2);
+}
+
+static void simulate_window(tile_store_t *store, const erosion_desc_t *params, uint32_t halo, uint32_t tx, uint32_t ty,
+	const vec2 *positions, const uint32_t *order, uint32_t first, uint32_t count, float *window,
+	erosion_stats_t *erosion_stats, erosion_tiled_stats_t *stats)
+{
+	uint32_t ts = store->tile_size;
+
+	uint32_t x0 = tx * ts > halo ? tx * ts - halo : 0;
+	uint32_t y0 = ty * ts > halo ? ty * ts - halo : 0;
+	uint32_t x1 = (tx + 1) * ts + halo < store->size.w ? (tx + 1) * ts + halo : store->size.w;
+	uint32_t y1 = (ty + 1) * ts + halo < store->size.h ? (ty + 1) * ts + halo : store->size.h;
+	uvec2 size = { .w = x1 - x0, .h = y1 - y0 };
+
+	double start = timer_now();
+	tile_store_read_region(store, x0, y0, size.w, size.h, window);
+	double gathered = timer_now();
+
+	terrain_t view = terrain_view(size, window);
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const float *pos = positions[order[i]];
+		vec2 local = { pos[0] - (float)x0, pos[1] - (float)y0 };
+		hydraulic_erosion(&view, params, local, erosion_stats);
+	}
+	double simulated = timer_now();
+
+	tile_store_write_region(store, x0, y0, size.w, size.h, window);
+	double scattered = timer_now();
+
+	stats->windows++;
+	stats->gather_seconds += gathered - start;
+	stats->simulate_seconds += simulated - gathered;
+	stats->scatter_seconds += scattered - simulated;
+}
+
+void erosion_tiled_run(tile_store_t *store, const erosion_desc_t *params, uint32_t halo, erosion_state_t *state, uint64_t drops, erosion_tiled_stats_t *stats)
+{
+	HE_ASSERT(store != NULL, "A tile store is required");
+	HE_ASSERT(params != NULL, "Erosion parameters are required");
+	HE_ASSERT(state != NULL, "An erosion state is required");
+
+	if (halo == 0) halo = erosion_tiled_default_halo(params);
+
+	erosion_tiled_stats_t local_stats = { 0 };
+	erosion_stats_t erosion_stats = { 0 };
+
+	uint32_t ts = store->tile_size;
+	uint32_t tile_count = store->tiles.w * store->tiles.h;
+
+	uint64_t batch = (uint64_t)tile_count * EROSION_TILED_DROPS_PER_TILE;
+	if (batch < EROSION_TILED_MIN_BATCH) batch = EROSION_TILED_MIN_BATCH;
+	if (batch > EROSION_TILED_MAX_BATCH) batch = EROSION_TILED_MAX_BATCH;
+	if (batch > drops) batch = drops;
+
+	vec2 *positions = malloc(batch * sizeof(vec2));
+	uint32_t *tiles = malloc(batch * sizeof(uint32_t));
+	uint32_t *order = malloc(batch * sizeof(uint32_t));
+	uint32_t *offsets = malloc((tile_count + 1) * sizeof(uint32_t));
+
+	size_t window_side = (size_t)ts + 2 * halo;
+	float *window = malloc(window_side * window_side * sizeof(float));
+
+	uint64_t done = 0;
+	while (done < drops)
+	{
+		uint32_t count = (uint32_t)(drops - done < batch ? drops - done : batch);
+
+		// spawn the batch and counting sort it by tile. the sort is stable, so
+		// drops within a tile still run in index order
+		memset(offsets, 0, (tile_count + 1) * sizeof(uint32_t));
+		for (uint32_t i = 0; i < count; i++)
+		{
+			erosion_spawn_position(store->size, state->seed, state->next_drop + i, positions[i]);
+			uint32_t tx = (uint32_t)positions[i][0] / ts;
+			uint32_t ty = (uint32_t)positions[i][1] / ts;
+			tiles[i] = tx + ty * store->tiles.w;
+			offsets[tiles[i] + 1]++;
+		}
+		for (uint32_t t = 0; t < tile_count; t++)
+		{
+			offsets[t + 1] += offsets[t];
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			order[offsets[tiles[i]]++] = i;
+		}
+		// offsets[t] now holds the end of bucket t, and thereby the start of t + 1
+		for (uint32_t t = tile_count; t > 0; t--)
+		{
+			offsets[t] = offsets[t - 1];
+		}
+		offsets[0] = 0;
+
+		// walk the tiles in a serpentine so consecutive windows share tiles
+		for (uint32_t ty = 0; ty < store->tiles.h; ty++)
+		{
+			for (uint32_t i = 0; i < store->tiles.w; i++)
+			{
+				uint32_t tx = (ty % 2 == 0) ? i : store->tiles.w - 1 - i;
+				uint32_t tile = tx + ty * store->tiles.w;
+				uint32_t first = offsets[tile];
+				uint32_t bucket = offsets[tile + 1] - first;
+				if (bucket == 0) continue;
+
+				simulate_window(store, params, halo, tx, ty, positions, order, first, bucket, window, &erosion_stats, &local_stats);
+			}
+		}
+
+		state->next_drop += count;
+		done += count;
+	}
+
+	free(window);
+	free(offsets);
+	free(order);
+	free(tiles);
+	free(positions);
+
+	erosion_stats.simulate_seconds = local_stats.simulate_seconds;
+	erosion_stats_merge(&state->stats, &erosion_stats);
+
+	if (stats != NULL)
+	{
+		stats->windows += local_stats.windows;
+		stats->gather_seconds += local_stats.gather_seconds;
+		stats->simulate_seconds += local_stats.simulate_seconds;
+		stats->scatter_seconds += local_stats.scatter_seconds;
+	}
+}
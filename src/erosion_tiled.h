@@ -0,0 +1,26 @@
+#ifndef __erosion_tiled_h__
+#define __erosion_tiled_h__
+
+#include <stdint.h>
+
+#include "erosion.h"
+#include "io/tile_store.h"
+
+// out of core erosion driver. droplets are bucketed by the tile they spawn
+// in, and each tile is simulated on a window of the tile plus a halo read
+// from the tile store, then written back so the halo reaches its neighbours.
+// with the default halo no droplet can leave its window, so only the tiles
+// around the current one have to be in memory
+
+typedef struct erosion_tiled_stats_t
+{
+	uint64_t windows;
+	double gather_seconds;
+	double simulate_seconds;
+	double scatter_seconds;
+} erosion_tiled_stats_t;
+
+uint32_t erosion_tiled_default_halo(const erosion_desc_t *params);
+void erosion_tiled_run(tile_store_t *store, const erosion_desc_t *params, uint32_t halo, erosion_state_t *state, uint64_t drops, erosion_tiled_stats_t *stats);
+
+#endif /* __erosion_tiled_h__ */
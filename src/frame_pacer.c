@@ -0,0 +1,84 @@
+#include "frame_pacer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "debug/assert.h"
+
+// drops run on the first frame, before anything has been measured
+#define FRAME_PACER_PROBE_DROPS (64)
+#define FRAME_PACER_SMOOTHING (0.2)
+
+static double smooth(double average, double sample)
+{
+	if (average <= 0) return sample;
+	return average + (sample - average) * FRAME_PACER_SMOOTHING;
+}
+
+void frame_pacer_init(frame_pacer_t *pacer, const frame_pacer_desc_t *desc)
+{
+	HE_ASSERT(pacer != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A frame pacer description is required");
+	HE_ASSERT(desc->duration > 0, "Duration must be positive");
+
+	memset(pacer, 0, sizeof(frame_pacer_t));
+	pacer->total_drops = desc->total_drops;
+	pacer->duration = desc->duration;
+	pacer->frame_budget_ms = desc->frame_budget_ms;
+}
+
+int frame_pacer_target(const frame_pacer_t *pacer)
+{
+	double progress = fmin(pacer->elapsed / pacer->duration, 1.0);
+	return (int)(pacer->total_drops * progress);
+}
+
+int frame_pacer_next(frame_pacer_t *pacer, float delta_seconds)
+{
+	pacer->elapsed += delta_seconds;
+
+	int remaining = pacer->total_drops - pacer->scheduled;
+	int behind = frame_pacer_target(pacer) - pacer->scheduled;
+	if (remaining <= 0 || behind <= 0) return 0;
+
+	int drops = behind;
+	if (pacer->drops_per_ms <= 0)
+	{
+		if (drops > FRAME_PACER_PROBE_DROPS) drops = FRAME_PACER_PROBE_DROPS;
+	}
+	else
+	{
+		// whatever the mesh update does not use of the budget goes to droplets
+		double budget = fmax(pacer->frame_budget_ms - pacer->mesh_ms, 0.0);
+		int affordable = (int)fmax(budget * pacer->drops_per_ms, 1.0);
+		if (drops > affordable) drops = affordable;
+	}
+
+	if (drops > remaining) drops = remaining;
+	pacer->scheduled += drops;
+	return drops;
+}
+
+void frame_pacer_report(frame_pacer_t *pacer, int drops, double simulate_ms, double mesh_ms)
+{
+	if (drops <= 0) return;
+
+	if (simulate_ms > 0) pacer->drops_per_ms = smooth(pacer->drops_per_ms, drops / simulate_ms);
+	pacer->mesh_ms = smooth(pacer->mesh_ms, mesh_ms);
+}
+
+float frame_pacer_estimated_remaining(const frame_pacer_t *pacer)
+{
+	int remaining = pacer->total_drops - pacer->scheduled;
+	if (remaining <= 0) return 0.0f;
+
+	// time left on the clock, or longer if the budget cannot keep up
+	float on_schedule = (float)fmax(pacer->duration - pacer->elapsed, 0.0);
+	double budget = fmax(pacer->frame_budget_ms - pacer->mesh_ms, 0.0);
+	double per_frame = budget * pacer->drops_per_ms;
+	if (per_frame <= 0) return on_schedule;
+
+	// a frame that uses up its budget takes at least the budget itself
+	float limited = (float)(remaining / per_frame * (pacer->frame_budget_ms / 1000.0));
+	return limited > on_schedule ? limited : on_schedule;
+}
@@ -0,0 +1,40 @@
+#ifndef __frame_pacer_h__
+#define __frame_pacer_h__
+
+#include <stdint.h>
+
+// decides how many droplets to simulate each frame when animating. it
+// measures how fast droplets and mesh updates actually are and fills a
+// fixed per frame time budget, so the ui keeps its frame rate while the run
+// tracks the requested duration as closely as the budget allows
+
+typedef struct frame_pacer_desc_t
+{
+	int total_drops;
+	float duration;
+	float frame_budget_ms;
+} frame_pacer_desc_t;
+
+typedef struct frame_pacer_t
+{
+	int total_drops;
+	float duration;
+	float frame_budget_ms;
+
+	int scheduled;
+	double elapsed;
+
+	// moving averages of the measured costs
+	double drops_per_ms;
+	double mesh_ms;
+} frame_pacer_t;
+
+void frame_pacer_init(frame_pacer_t *pacer, const frame_pacer_desc_t *desc);
+
+int frame_pacer_next(frame_pacer_t *pacer, float delta_seconds);
+void frame_pacer_report(frame_pacer_t *pacer, int drops, double simulate_ms, double mesh_ms);
+
+int frame_pacer_target(const frame_pacer_t *pacer);
+float frame_pacer_estimated_remaining(const frame_pacer_t *pacer);
+
+#endif /* __frame_pacer_h__ */
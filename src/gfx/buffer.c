@@ -119,3 +119,15 @@ void buffer_set_data(buffer_t *buffer, size_t size, void *data)
 	// restore previous buffer
 	buffer_bind(last_buf);
 }
+
+void buffer_set_sub_data(buffer_t *buffer, size_t offset, size_t size, const void *data)
+{
+	context_t *ctx = context_get_bound();
+	HE_ASSERT(ctx != NULL, "A bound context is required");
+	HE_ASSERT(buffer != NULL, "Cannot set data of NULL");
+	HE_ASSERT(offset + size <= buffer->size, "Data outside of the buffer");
+
+	buffer_t *last_buf = buffer_bind(buffer);
+	glBufferSubData(get_gl_buffer_target(buffer->type), offset, size, data);
+	buffer_bind(last_buf);
+}
@@ -46,5 +46,7 @@ buffer_t *buffer_bind(buffer_t *buffer);
 buffer_t *buffer_bind_to(buffer_type_t to, buffer_t *buffer);
 
 void buffer_set_data(buffer_t *buffer, size_t size, void *data);
+// overwrites part of the storage set by buffer_set_data
+void buffer_set_sub_data(buffer_t *buffer, size_t offset, size_t size, const void *data);
 
 #endif /* __gfx_buffer_h__ */
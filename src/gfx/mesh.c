@@ -60,6 +60,14 @@ void mesh_set_data(mesh_t *mesh, const mesh_desc_t *desc)
 	mesh->index_count = desc->index_count;
 }
 
+void mesh_set_vertex_range(mesh_t *mesh, size_t offset, size_t size, const void *vertices)
+{
+	HE_ASSERT(mesh != NULL, "Cannot set data of NULL");
+	HE_ASSERT(mesh->dynamic, "Cannot edit data of static mesh");
+
+	buffer_set_sub_data(mesh->vertices, offset, size, vertices);
+}
+
 void mesh_draw(mesh_t *mesh)
 {
 	HE_ASSERT(mesh != NULL, "Cannot draw NULL");
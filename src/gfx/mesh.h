@@ -35,6 +35,8 @@ mesh_t *mesh_create(const mesh_desc_t *desc);
 void mesh_free(mesh_t *mesh);
 
 void mesh_set_data(mesh_t *mesh, const mesh_desc_t *desc);
+// replaces size bytes of vertex data from offset on, the layout stays
+void mesh_set_vertex_range(mesh_t *mesh, size_t offset, size_t size, const void *vertices);
 
 void mesh_draw(mesh_t *mesh);
 
@@ -89,7 +89,8 @@ bool shader_init(const shader_desc_t *desc, shader_t **shader)
 	result->id = glCreateShader(get_gl_shader_type(desc->type));
 	result->type = desc->type;
 
-	glShaderSource(result->id, 1, &desc->source, NULL);
+	GLint length = (GLint)desc->source_size;
+	glShaderSource(result->id, 1, &desc->source, desc->source_size > 0 ? &length : NULL);
 	glCompileShader(result->id);
 
 	GLint success;
@@ -21,6 +21,8 @@ typedef enum shader_type_t
 typedef struct shader_desc_t
 {
 	const char *source;
+	// zero if source is null terminated
+	size_t source_size;
 	shader_type_t type;
 } shader_desc_t;
 
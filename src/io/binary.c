@@ -0,0 +1,163 @@
+#include "binary.h"
+
+#include <string.h>
+
+static bool write_le(FILE *file, uint64_t v, int bytes)
+{
+	uint8_t buffer[8];
+	for (int i = 0; i < bytes; i++)
+	{
+		buffer[i] = (uint8_t)(v >> (i * 8));
+	}
+	return fwrite(buffer, 1, bytes, file) == (size_t)bytes;
+}
+
+static bool read_le(FILE *file, uint64_t *v, int bytes)
+{
+	uint8_t buffer[8];
+	if (fread(buffer, 1, bytes, file) != (size_t)bytes) return false;
+
+	*v = 0;
+	for (int i = 0; i < bytes; i++)
+	{
+		*v |= (uint64_t)buffer[i] << (i * 8);
+	}
+	return true;
+}
+
+bool binary_write_u16(FILE *file, uint16_t v) { return write_le(file, v, 2); }
+bool binary_write_u32(FILE *file, uint32_t v) { return write_le(file, v, 4); }
+bool binary_write_u64(FILE *file, uint64_t v) { return write_le(file, v, 8); }
+bool binary_write_i32(FILE *file, int32_t v) { return write_le(file, (uint32_t)v, 4); }
+
+bool binary_write_f32(FILE *file, float v)
+{
+	uint32_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return write_le(file, bits, 4);
+}
+
+bool binary_write_f64(FILE *file, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return write_le(file, bits, 8);
+}
+
+bool binary_write_f32_array(FILE *file, const float *v, size_t count)
+{
+	if (binary_host_is_little_endian())
+	{
+		return fwrite(v, sizeof(float), count, file) == count;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!binary_write_f32(file, v[i])) return false;
+	}
+	return true;
+}
+
+bool binary_read_u16(FILE *file, uint16_t *v)
+{
+	uint64_t r;
+	if (!read_le(file, &r, 2)) return false;
+	*v = (uint16_t)r;
+	return true;
+}
+
+bool binary_read_u32(FILE *file, uint32_t *v)
+{
+	uint64_t r;
+	if (!read_le(file, &r, 4)) return false;
+	*v = (uint32_t)r;
+	return true;
+}
+
+bool binary_read_u64(FILE *file, uint64_t *v)
+{
+	return read_le(file, v, 8);
+}
+
+bool binary_read_i32(FILE *file, int32_t *v)
+{
+	uint32_t r;
+	if (!binary_read_u32(file, &r)) return false;
+	*v = (int32_t)r;
+	return true;
+}
+
+bool binary_read_f32(FILE *file, float *v)
+{
+	uint32_t bits;
+	if (!binary_read_u32(file, &bits)) return false;
+	memcpy(v, &bits, sizeof(bits));
+	return true;
+}
+
+bool binary_read_f64(FILE *file, double *v)
+{
+	uint64_t bits;
+	if (!binary_read_u64(file, &bits)) return false;
+	memcpy(v, &bits, sizeof(bits));
+	return true;
+}
+
+bool binary_read_f32_array(FILE *file, float *v, size_t count)
+{
+	if (binary_host_is_little_endian())
+	{
+		return fread(v, sizeof(float), count, file) == count;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!binary_read_f32(file, &v[i])) return false;
+	}
+	return true;
+}
+
+void binary_store_u32(uint8_t *dest, uint32_t v)
+{
+	dest[0] = (uint8_t)v;
+	dest[1] = (uint8_t)(v >> 8);
+	dest[2] = (uint8_t)(v >> 16);
+	dest[3] = (uint8_t)(v >> 24);
+}
+
+void binary_store_u64(uint8_t *dest, uint64_t v)
+{
+	binary_store_u32(dest, (uint32_t)v);
+	binary_store_u32(dest + 4, (uint32_t)(v >> 32));
+}
+
+void binary_store_f32(uint8_t *dest, float v)
+{
+	uint32_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	binary_store_u32(dest, bits);
+}
+
+uint32_t binary_load_u32(const uint8_t *src)
+{
+	return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+uint64_t binary_load_u64(const uint8_t *src)
+{
+	return (uint64_t)binary_load_u32(src) | ((uint64_t)binary_load_u32(src + 4) << 32);
+}
+
+float binary_load_f32(const uint8_t *src)
+{
+	uint32_t bits = binary_load_u32(src);
+	float v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+bool binary_host_is_little_endian(void)
+{
+	const uint16_t probe = 1;
+	return *(const uint8_t *)&probe == 1;
+}
@@ -0,0 +1,35 @@
+#ifndef __io_binary_h__
+#define __io_binary_h__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// little endian serialization helpers shared by the binary file formats
+
+bool binary_write_u16(FILE *file, uint16_t v);
+bool binary_write_u32(FILE *file, uint32_t v);
+bool binary_write_u64(FILE *file, uint64_t v);
+bool binary_write_i32(FILE *file, int32_t v);
+bool binary_write_f32(FILE *file, float v);
+bool binary_write_f64(FILE *file, double v);
+bool binary_write_f32_array(FILE *file, const float *v, size_t count);
+
+bool binary_read_u16(FILE *file, uint16_t *v);
+bool binary_read_u32(FILE *file, uint32_t *v);
+bool binary_read_u64(FILE *file, uint64_t *v);
+bool binary_read_i32(FILE *file, int32_t *v);
+bool binary_read_f32(FILE *file, float *v);
+bool binary_read_f64(FILE *file, double *v);
+bool binary_read_f32_array(FILE *file, float *v, size_t count);
+
+void binary_store_u32(uint8_t *dest, uint32_t v);
+void binary_store_u64(uint8_t *dest, uint64_t v);
+void binary_store_f32(uint8_t *dest, float v);
+uint32_t binary_load_u32(const uint8_t *src);
+uint64_t binary_load_u64(const uint8_t *src);
+float binary_load_f32(const uint8_t *src);
+bool binary_host_is_little_endian(void);
+
+#endif /* __io_binary_h__ */
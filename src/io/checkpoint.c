@@ -0,0 +1,429 @@
+#include "checkpoint.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/crc32.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "io/binary.h"
+#include "io/height_codec.h"
+
+static uint32_t heights_crc(const float *heights, size_t count)
+{
+	// the checksum covers the little endian bytes as they are stored on disk
+	if (binary_host_is_little_endian())
+	{
+		return crc32_update(CRC32_INIT, heights, count * sizeof(float));
+	}
+
+	uint32_t crc = CRC32_INIT;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t bits;
+		uint8_t bytes[4];
+		memcpy(&bits, &heights[i], sizeof(bits));
+		binary_store_u32(bytes, bits);
+		crc = crc32_update(crc, bytes, sizeof(bytes));
+	}
+	return crc;
+}
+
+static bool write_params(FILE *file, const erosion_desc_t *p)
+{
+	bool ok = true;
+	ok &= binary_write_i32(file, p->drop_lifetime);
+	ok &= binary_write_f32(file, p->inertia);
+	ok &= binary_write_f32(file, p->capacity);
+	ok &= binary_write_f32(file, p->min_capacity);
+	ok &= binary_write_f32(file, p->deposition);
+	ok &= binary_write_f32(file, p->erosion);
+	ok &= binary_write_i32(file, p->radius);
+	ok &= binary_write_f32(file, p->gravity);
+	ok &= binary_write_f32(file, p->evaporation);
+	ok &= binary_write_f32(file, p->min_water);
+	ok &= binary_write_f32(file, p->min_velocity);
+	ok &= binary_write_i32(file, p->max_pit_steps);
+	return ok;
+}
+
+static bool read_params(FILE *file, erosion_desc_t *p)
+{
+	bool ok = true;
+	ok &= binary_read_i32(file, &p->drop_lifetime);
+	ok &= binary_read_f32(file, &p->inertia);
+	ok &= binary_read_f32(file, &p->capacity);
+	ok &= binary_read_f32(file, &p->min_capacity);
+	ok &= binary_read_f32(file, &p->deposition);
+	ok &= binary_read_f32(file, &p->erosion);
+	ok &= binary_read_i32(file, &p->radius);
+	ok &= binary_read_f32(file, &p->gravity);
+	ok &= binary_read_f32(file, &p->evaporation);
+	ok &= binary_read_f32(file, &p->min_water);
+	ok &= binary_read_f32(file, &p->min_velocity);
+	ok &= binary_read_i32(file, &p->max_pit_steps);
+	return ok;
+}
+
+static bool write_state(FILE *file, const erosion_state_t *s)
+{
+	bool ok = true;
+	ok &= binary_write_u32(file, s->seed);
+	ok &= binary_write_u64(file, s->next_drop);
+	ok &= binary_write_u64(file, s->stats.drops);
+	ok &= binary_write_u64(file, s->stats.steps);
+	ok &= binary_write_u64(file, s->stats.effective_steps);
+	ok &= binary_write_u64(file, s->stats.noop_steps);
+	ok &= binary_write_u64(file, s->stats.saved_steps);
+	ok &= binary_write_u64(file, s->stats.water_kills);
+	ok &= binary_write_u64(file, s->stats.velocity_kills);
+	ok &= binary_write_u64(file, s->stats.pit_kills);
+	ok &= binary_write_u64(file, s->stats.out_of_bounds_kills);
+	ok &= binary_write_f64(file, s->stats.eroded);
+	ok &= binary_write_f64(file, s->stats.deposited);
+	ok &= binary_write_u32(file, s->stats.max_brush_clip);
+	ok &= binary_write_f64(file, s->stats.simulate_seconds);
+	ok &= binary_write_f64(file, s->stats.mesh_seconds);
+	return ok;
+}
+
+static bool read_state(FILE *file, erosion_state_t *s)
+{
+	bool ok = true;
+	memset(s, 0, sizeof(erosion_state_t));
+	ok &= binary_read_u32(file, &s->seed);
+	ok &= binary_read_u64(file, &s->next_drop);
+	ok &= binary_read_u64(file, &s->stats.drops);
+	ok &= binary_read_u64(file, &s->stats.steps);
+	ok &= binary_read_u64(file, &s->stats.effective_steps);
+	ok &= binary_read_u64(file, &s->stats.noop_steps);
+	ok &= binary_read_u64(file, &s->stats.saved_steps);
+	ok &= binary_read_u64(file, &s->stats.water_kills);
+	ok &= binary_read_u64(file, &s->stats.velocity_kills);
+	ok &= binary_read_u64(file, &s->stats.pit_kills);
+	ok &= binary_read_u64(file, &s->stats.out_of_bounds_kills);
+	ok &= binary_read_f64(file, &s->stats.eroded);
+	ok &= binary_read_f64(file, &s->stats.deposited);
+	ok &= binary_read_u32(file, &s->stats.max_brush_clip);
+	ok &= binary_read_f64(file, &s->stats.simulate_seconds);
+	ok &= binary_read_f64(file, &s->stats.mesh_seconds);
+	return ok;
+}
+
+// encoded is a height codec stream of the snapshot, or NULL to store it raw
+static bool write_checkpoint(const char *path, const checkpoint_data_t *data, const uint8_t *encoded, size_t encoded_size)
+{
+	// write next to the target and rename, so a crash mid-write never
+	// destroys the previous checkpoint
+	size_t tmp_len = strlen(path) + 5;
+	char *tmp_path = malloc(tmp_len);
+	snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+	FILE *file = fopen(tmp_path, "wb");
+	if (file == NULL)
+	{
+		free(tmp_path);
+		return false;
+	}
+
+	size_t count = (size_t)data->size.w * data->size.h;
+
+	bool ok = fwrite(CHECKPOINT_MAGIC, 1, 4, file) == 4;
+	ok &= binary_write_u32(file, CHECKPOINT_VERSION);
+	ok &= binary_write_u32(file, data->size.w);
+	ok &= binary_write_u32(file, data->size.h);
+	ok &= binary_write_i32(file, data->terrain_seed);
+	ok &= binary_write_f32(file, data->scale_scalar);
+	ok &= binary_write_f32(file, data->elevation);
+	ok &= write_params(file, &data->params);
+	ok &= write_state(file, &data->state);
+	ok &= binary_write_u32(file, heights_crc(data->heights, count));
+	if (encoded != NULL)
+	{
+		ok &= binary_write_u32(file, CHECKPOINT_HEIGHTS_CODEC);
+		ok &= binary_write_u64(file, encoded_size);
+		ok &= fwrite(encoded, 1, encoded_size, file) == encoded_size;
+	}
+	else
+	{
+		ok &= binary_write_u32(file, CHECKPOINT_HEIGHTS_RAW);
+		ok &= binary_write_f32_array(file, data->heights, count);
+	}
+	ok &= fclose(file) == 0;
+
+	if (ok)
+	{
+		remove(path);
+		ok = rename(tmp_path, path) == 0;
+	}
+	else
+	{
+		remove(tmp_path);
+	}
+
+	free(tmp_path);
+	return ok;
+}
+
+static void fill_data(checkpoint_data_t *data, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state)
+{
+	data->size = terrain->size;
+	data->terrain_seed = terrain->seed;
+	data->scale_scalar = terrain->scale_scalar;
+	data->elevation = terrain->elevation;
+	data->params = *params;
+	data->state = *state;
+}
+
+bool checkpoint_save(const char *path, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state)
+{
+	HE_ASSERT(path != NULL, "A checkpoint path is required");
+	HE_ASSERT(terrain != NULL, "Cannot save NULL terrain");
+
+	checkpoint_data_t data;
+	fill_data(&data, terrain, params, state);
+	data.heights = terrain->height_map;
+	return write_checkpoint(path, &data, NULL, 0);
+}
+
+bool checkpoint_load(const char *path, terrain_t *terrain, erosion_desc_t *params, erosion_state_t *state)
+{
+	HE_ASSERT(path != NULL, "A checkpoint path is required");
+	HE_ASSERT(terrain != NULL, "Cannot load into NULL terrain");
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return false;
+
+	char magic[4];
+	uint32_t version = 0;
+	uvec2 size;
+	int32_t terrain_seed;
+	float scale_scalar, elevation;
+	erosion_desc_t loaded_params;
+	erosion_state_t loaded_state;
+	uint32_t crc;
+	uint32_t heights = CHECKPOINT_HEIGHTS_RAW;
+	uint64_t encoded_size = 0;
+
+	bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, CHECKPOINT_MAGIC, 4) == 0;
+	ok = ok && binary_read_u32(file, &version) && version >= 1 && version <= CHECKPOINT_VERSION;
+	ok = ok && binary_read_u32(file, &size.w) && binary_read_u32(file, &size.h);
+	ok = ok && size.w >= 2 && size.h >= 2 && (size_t)size.w <= SIZE_MAX / sizeof(float) / size.h;
+	ok = ok && binary_read_i32(file, &terrain_seed);
+	ok = ok && binary_read_f32(file, &scale_scalar) && binary_read_f32(file, &elevation);
+	// the crc only covers the heights, the parameters are checked on their own
+	ok = ok && read_params(file, &loaded_params) && erosion_desc_valid(&loaded_params);
+	ok = ok && read_state(file, &loaded_state);
+	ok = ok && binary_read_u32(file, &crc);
+	if (ok && version >= 2)
+	{
+		ok = binary_read_u32(file, &heights) && heights < CHECKPOINT_HEIGHTS_COUNT__;
+		if (ok && heights == CHECKPOINT_HEIGHTS_CODEC) ok = binary_read_u64(file, &encoded_size) && (size_t)encoded_size == encoded_size;
+	}
+
+	if (!ok)
+	{
+		fclose(file);
+		return false;
+	}
+
+	// decode aside and check the crc first, a truncated or corrupt checkpoint
+	// leaves the terrain as it was
+	size_t count = (size_t)size.w * size.h;
+	float *loaded = malloc(count * sizeof(float));
+	ok = loaded != NULL;
+	if (ok && heights == CHECKPOINT_HEIGHTS_CODEC)
+	{
+		uint8_t *encoded = malloc((size_t)encoded_size);
+		ok = encoded != NULL && fread(encoded, 1, (size_t)encoded_size, file) == encoded_size;
+		ok = ok && height_codec_decode(encoded, (size_t)encoded_size, loaded, size, NULL);
+		free(encoded);
+	}
+	else if (ok)
+	{
+		ok = binary_read_f32_array(file, loaded, count);
+	}
+	ok = ok && heights_crc(loaded, count) == crc;
+	fclose(file);
+
+	ok = ok && terrain_allocate(terrain, size);
+	if (ok) memcpy(terrain->height_map, loaded, count * sizeof(float));
+	free(loaded);
+	if (!ok) return false;
+
+	terrain->seed = terrain_seed;
+	terrain->scale_scalar = scale_scalar;
+	terrain->elevation = elevation;
+	terrain_update_mesh(terrain);
+
+	if (params != NULL) *params = loaded_params;
+	if (state != NULL) *state = loaded_state;
+	return true;
+}
+
+static void writer_thread(void *user_pointer)
+{
+	checkpoint_writer_t *writer = (checkpoint_writer_t *)user_pointer;
+
+	mutex_lock(writer->mutex);
+	while (true)
+	{
+		while (!writer->pending && !writer->quit)
+		{
+			cond_wait(writer->wake, writer->mutex);
+		}
+		if (!writer->pending) break;
+
+		// the snapshot belongs to this thread until pending is cleared
+		mutex_unlock(writer->mutex);
+		double start = timer_now();
+		const checkpoint_data_t *snapshot = &writer->snapshot;
+		uint64_t raw_bytes = (uint64_t)snapshot->size.w * snapshot->size.h * sizeof(float);
+		size_t encoded_size = 0;
+		if (writer->compress)
+		{
+			size_t bound = height_codec_bound(snapshot->size, 0);
+			if (bound > writer->encoded_capacity)
+			{
+				free(writer->encoded);
+				writer->encoded = malloc(bound);
+				writer->encoded_capacity = bound;
+			}
+			encoded_size = height_codec_encode(snapshot->heights, snapshot->size, 0, writer->encoded, writer->encoded_capacity, NULL);
+		}
+		bool ok = write_checkpoint(writer->path, snapshot, encoded_size > 0 ? writer->encoded : NULL, encoded_size);
+		double seconds = timer_now() - start;
+		mutex_lock(writer->mutex);
+
+		if (ok)
+		{
+			writer->written++;
+			writer->raw_bytes += raw_bytes;
+			writer->stored_bytes += encoded_size > 0 ? encoded_size : raw_bytes;
+		}
+		else
+		{
+			writer->failed++;
+		}
+		writer->write_seconds += seconds;
+		writer->pending = false;
+		cond_broadcast(writer->done);
+	}
+	mutex_unlock(writer->mutex);
+}
+
+void checkpoint_writer_init(const checkpoint_writer_desc_t *desc, checkpoint_writer_t **writer)
+{
+	HE_ASSERT(writer != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A checkpoint writer description is required");
+	HE_ASSERT(desc->path != NULL, "A checkpoint path is required");
+
+	checkpoint_writer_t *result = calloc(1, sizeof(checkpoint_writer_t));
+
+	size_t path_len = strlen(desc->path) + 1;
+	result->path = malloc(path_len);
+	memcpy(result->path, desc->path, path_len);
+
+	result->interval_drops = desc->interval_drops;
+	result->interval_seconds = desc->interval_seconds;
+	result->compress = desc->compress;
+	result->last_time = timer_now();
+
+	result->mutex = mutex_create();
+	result->wake = cond_create();
+	result->done = cond_create();
+	result->thread = thread_create(writer_thread, result);
+
+	*writer = result;
+}
+
+checkpoint_writer_t *checkpoint_writer_create(const checkpoint_writer_desc_t *desc)
+{
+	checkpoint_writer_t *writer;
+	checkpoint_writer_init(desc, &writer);
+	return writer;
+}
+
+void checkpoint_writer_free(checkpoint_writer_t *writer)
+{
+	if (writer == NULL) return;
+
+	// finish the pending checkpoint before shutting down
+	mutex_lock(writer->mutex);
+	writer->quit = true;
+	cond_signal(writer->wake);
+	mutex_unlock(writer->mutex);
+
+	thread_join(writer->thread);
+	cond_free(writer->done);
+	cond_free(writer->wake);
+	mutex_free(writer->mutex);
+	free(writer->snapshot.heights);
+	free(writer->encoded);
+	free(writer->path);
+	free(writer);
+}
+
+bool checkpoint_writer_poll(checkpoint_writer_t *writer, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state)
+{
+	HE_ASSERT(writer != NULL, "Cannot poll NULL");
+
+	bool due_drops = writer->interval_drops > 0 && state->next_drop - writer->last_drop >= writer->interval_drops;
+	bool due_time = writer->interval_seconds > 0 && timer_now() - writer->last_time >= writer->interval_seconds;
+
+	if (!due_drops && !due_time) return false;
+	return checkpoint_writer_submit(writer, terrain, params, state);
+}
+
+bool checkpoint_writer_submit(checkpoint_writer_t *writer, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state)
+{
+	HE_ASSERT(writer != NULL, "Cannot submit to NULL");
+
+	mutex_lock(writer->mutex);
+	if (writer->pending)
+	{
+		// never wait for the disk, just try again on the next poll
+		writer->skipped++;
+		mutex_unlock(writer->mutex);
+		return false;
+	}
+	mutex_unlock(writer->mutex);
+
+	// the writer thread is idle, so the snapshot can be refilled without the lock
+	double start = timer_now();
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+	if (count > writer->snapshot_capacity)
+	{
+		free(writer->snapshot.heights);
+		writer->snapshot.heights = malloc(count * sizeof(float));
+		writer->snapshot_capacity = count;
+	}
+	fill_data(&writer->snapshot, terrain, params, state);
+	memcpy(writer->snapshot.heights, terrain->height_map, count * sizeof(float));
+	double seconds = timer_now() - start;
+
+	writer->last_drop = state->next_drop;
+	writer->last_time = timer_now();
+
+	mutex_lock(writer->mutex);
+	writer->copy_seconds += seconds;
+	writer->pending = true;
+	cond_signal(writer->wake);
+	mutex_unlock(writer->mutex);
+
+	return true;
+}
+
+void checkpoint_writer_flush(checkpoint_writer_t *writer)
+{
+	HE_ASSERT(writer != NULL, "Cannot flush NULL");
+
+	mutex_lock(writer->mutex);
+	while (writer->pending)
+	{
+		cond_wait(writer->done, writer->mutex);
+	}
+	mutex_unlock(writer->mutex);
+}
@@ -0,0 +1,92 @@
+#ifndef __io_checkpoint_h__
+#define __io_checkpoint_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "components/terrain.h"
+#include "core/thread.h"
+#include "erosion.h"
+
+#define CHECKPOINT_MAGIC "HECP"
+#define CHECKPOINT_VERSION (2)
+
+// how the heights follow the header. version 1 files are always raw
+typedef enum checkpoint_heights_t
+{
+	CHECKPOINT_HEIGHTS_RAW,
+	// a size, then a height codec stream
+	CHECKPOINT_HEIGHTS_CODEC,
+	CHECKPOINT_HEIGHTS_COUNT__,
+} checkpoint_heights_t;
+
+bool checkpoint_save(const char *path, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state);
+bool checkpoint_load(const char *path, terrain_t *terrain, erosion_desc_t *params, erosion_state_t *state);
+
+typedef struct checkpoint_writer_desc_t
+{
+	const char *path;
+
+	// write a checkpoint whenever either interval has passed. zero disables it
+	uint64_t interval_drops;
+	double interval_seconds;
+
+	// compress the heights with the height codec on the writer thread
+	bool compress;
+} checkpoint_writer_desc_t;
+
+typedef struct checkpoint_data_t
+{
+	uvec2 size;
+	int terrain_seed;
+	float scale_scalar;
+	float elevation;
+	erosion_desc_t params;
+	erosion_state_t state;
+	float *heights;
+} checkpoint_data_t;
+
+typedef struct checkpoint_writer_t
+{
+	char *path;
+	uint64_t interval_drops;
+	double interval_seconds;
+	bool compress;
+
+	uint64_t last_drop;
+	double last_time;
+
+	// snapshot owned by the writer thread while pending is set
+	checkpoint_data_t snapshot;
+	size_t snapshot_capacity;
+	bool pending;
+	bool quit;
+
+	// reused between compressed checkpoints, only touched by the writer thread
+	uint8_t *encoded;
+	size_t encoded_capacity;
+
+	thread_t *thread;
+	mutex_t *mutex;
+	cond_t *wake;
+	cond_t *done;
+
+	// counters for reporting, only touched with the mutex held
+	uint32_t written;
+	uint32_t failed;
+	uint32_t skipped;
+	double copy_seconds;
+	double write_seconds;
+	uint64_t raw_bytes;
+	uint64_t stored_bytes;
+} checkpoint_writer_t;
+
+void checkpoint_writer_init(const checkpoint_writer_desc_t *desc, checkpoint_writer_t **writer);
+checkpoint_writer_t *checkpoint_writer_create(const checkpoint_writer_desc_t *desc);
+void checkpoint_writer_free(checkpoint_writer_t *writer);
+
+bool checkpoint_writer_poll(checkpoint_writer_t *writer, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state);
+bool checkpoint_writer_submit(checkpoint_writer_t *writer, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state);
+void checkpoint_writer_flush(checkpoint_writer_t *writer);
+
+#endif /* __io_checkpoint_h__ */
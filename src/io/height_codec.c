@@ -0,0 +1,834 @@
+#include "height_codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/job.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "io/binary.h"
+
+// magic, version, width, height, tile size and tile count
+#define HEADER_SIZE (24)
+#define PLANE_COUNT (4)
+// a stage byte and a payload size per plane
+#define PLANE_HEADER_SIZE (5)
+// the predictor byte, then the planes
+#define TILE_HEADER_SIZE (1 + PLANE_COUNT * PLANE_HEADER_SIZE)
+
+#define MIN_TILE_SIZE (8)
+#define MAX_TILE_SIZE (4096)
+
+#define HUFFMAN_SYMBOLS (256)
+#define HUFFMAN_MAX_BITS (12)
+// a 4 bit code length per byte value
+#define HUFFMAN_LENGTHS_SIZE (HUFFMAN_SYMBOLS / 2)
+
+// shorter runs are cheaper left inside a literal
+#define RLE_MIN_RUN (4)
+
+static const char *predictor_names[HEIGHT_CODEC_PREDICTOR_COUNT__] = { "left", "up", "paeth", "med" };
+static const char *stage_names[HEIGHT_CODEC_STAGE_COUNT__] = { "raw", "rle", "huffman" };
+
+typedef struct codec_scratch_t
+{
+	uint32_t *samples;
+	// one row
+	uint32_t *residuals;
+	uint8_t *planes;
+	uint16_t *table;
+} codec_scratch_t;
+
+typedef struct codec_run_t
+{
+	uvec2 size;
+	uint32_t tile_size;
+	uvec2 tiles;
+
+	const float *heights;
+	float *out;
+
+	// encoded tiles are written to fixed size slots first and packed after
+	uint8_t *slots;
+	size_t slot_size;
+	const uint8_t *src;
+	uint64_t *offsets;
+	uint32_t *tile_sizes;
+
+	uint8_t *predictors;
+	uint8_t *stages;
+	uint8_t *ok;
+} codec_run_t;
+
+const char *height_codec_predictor_name(height_codec_predictor_t predictor)
+{
+	return predictor < HEIGHT_CODEC_PREDICTOR_COUNT__ ? predictor_names[predictor] : "unknown";
+}
+
+const char *height_codec_stage_name(height_codec_stage_t stage)
+{
+	return stage < HEIGHT_CODEC_STAGE_COUNT__ ? stage_names[stage] : "unknown";
+}
+
+// floats as integers that sort like the floats, so nearby heights are
+// nearby integers on both sides of zero
+static uint32_t to_ordered(float h)
+{
+	uint32_t bits;
+	memcpy(&bits, &h, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+static float from_ordered(uint32_t u)
+{
+	uint32_t bits = (u & 0x80000000u) ? u & 0x7fffffffu : ~u;
+	float h;
+	memcpy(&h, &bits, sizeof(h));
+	return h;
+}
+
+static uint32_t zigzag(uint32_t d)
+{
+	return (d << 1) ^ (0u - (d >> 31));
+}
+
+static uint32_t unzigzag(uint32_t z)
+{
+	return (z >> 1) ^ (0u - (z & 1));
+}
+
+static uint32_t paeth(uint32_t a, uint32_t b, uint32_t c)
+{
+	int64_t p = (int64_t)a + b - c;
+	int64_t pa = llabs(p - a);
+	int64_t pb = llabs(p - b);
+	int64_t pc = llabs(p - c);
+	if (pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
+static uint32_t med(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t lo = a < b ? a : b;
+	uint32_t hi = a < b ? b : a;
+	if (c >= hi) return lo;
+	if (c <= lo) return hi;
+	// lands between a and b, so it cannot wrap
+	return a + b - c;
+}
+
+// zigzagged residuals of one row. the first row is always predicted from
+// the left and the first column from above, whatever the predictor
+static void residual_row(height_codec_predictor_t predictor, const uint32_t *row, const uint32_t *above, uint32_t w, uint32_t *z)
+{
+	if (above == NULL)
+	{
+		z[0] = zigzag(row[0]);
+		for (uint32_t x = 1; x < w; x++) z[x] = zigzag(row[x] - row[x - 1]);
+		return;
+	}
+
+	z[0] = zigzag(row[0] - above[0]);
+	switch (predictor)
+	{
+	case HEIGHT_CODEC_PREDICTOR_LEFT:
+		for (uint32_t x = 1; x < w; x++) z[x] = zigzag(row[x] - row[x - 1]);
+		break;
+	case HEIGHT_CODEC_PREDICTOR_UP:
+		for (uint32_t x = 1; x < w; x++) z[x] = zigzag(row[x] - above[x]);
+		break;
+	case HEIGHT_CODEC_PREDICTOR_PAETH:
+		for (uint32_t x = 1; x < w; x++) z[x] = zigzag(row[x] - paeth(row[x - 1], above[x], above[x - 1]));
+		break;
+	default:
+		for (uint32_t x = 1; x < w; x++) z[x] = zigzag(row[x] - med(row[x - 1], above[x], above[x - 1]));
+		break;
+	}
+}
+
+// the inverse, z holds the residuals and is overwritten by the samples
+static void restore_row(height_codec_predictor_t predictor, uint32_t *z, const uint32_t *above, uint32_t w)
+{
+	if (above == NULL)
+	{
+		z[0] = unzigzag(z[0]);
+		for (uint32_t x = 1; x < w; x++) z[x] = z[x - 1] + unzigzag(z[x]);
+		return;
+	}
+
+	z[0] = above[0] + unzigzag(z[0]);
+	switch (predictor)
+	{
+	case HEIGHT_CODEC_PREDICTOR_LEFT:
+		for (uint32_t x = 1; x < w; x++) z[x] = z[x - 1] + unzigzag(z[x]);
+		break;
+	case HEIGHT_CODEC_PREDICTOR_UP:
+		for (uint32_t x = 1; x < w; x++) z[x] = above[x] + unzigzag(z[x]);
+		break;
+	case HEIGHT_CODEC_PREDICTOR_PAETH:
+		for (uint32_t x = 1; x < w; x++) z[x] = paeth(z[x - 1], above[x], above[x - 1]) + unzigzag(z[x]);
+		break;
+	default:
+		for (uint32_t x = 1; x < w; x++) z[x] = med(z[x - 1], above[x], above[x - 1]) + unzigzag(z[x]);
+		break;
+	}
+}
+
+static size_t put_varint(uint8_t *dest, size_t pos, uint32_t v)
+{
+	do
+	{
+		uint8_t byte = v & 0x7f;
+		v >>= 7;
+		if (dest != NULL) dest[pos] = byte | (v != 0 ? 0x80 : 0);
+		pos++;
+	} while (v != 0);
+	return pos;
+}
+
+static bool get_varint(const uint8_t *src, size_t size, size_t *pos, uint32_t *v)
+{
+	*v = 0;
+	for (uint32_t shift = 0; shift < 32; shift += 7)
+	{
+		if (*pos >= size) return false;
+		uint8_t byte = src[(*pos)++];
+		*v |= (uint32_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+static size_t put_literals(const uint8_t *src, size_t count, uint8_t *dest, size_t pos)
+{
+	pos = put_varint(dest, pos, (uint32_t)count << 1);
+	if (dest != NULL) memcpy(dest + pos, src, count);
+	return pos + count;
+}
+
+// tokens are a varint of the length shifted left once, the low bit set for
+// a run. a run is followed by its byte, a literal by its bytes. a NULL dest
+// only measures
+static size_t rle_encode(const uint8_t *src, size_t n, uint8_t *dest)
+{
+	size_t pos = 0;
+	size_t literal = 0;
+	size_t i = 0;
+	while (i < n)
+	{
+		size_t run = 1;
+		while (i + run < n && src[i + run] == src[i]) run++;
+
+		if (run >= RLE_MIN_RUN)
+		{
+			if (i > literal) pos = put_literals(src + literal, i - literal, dest, pos);
+			pos = put_varint(dest, pos, (uint32_t)run << 1 | 1);
+			if (dest != NULL) dest[pos] = src[i];
+			pos++;
+			literal = i + run;
+		}
+		i += run;
+	}
+	if (n > literal) pos = put_literals(src + literal, n - literal, dest, pos);
+	return pos;
+}
+
+static bool rle_decode(const uint8_t *src, size_t size, uint8_t *dest, size_t n)
+{
+	size_t pos = 0;
+	size_t out = 0;
+	while (pos < size)
+	{
+		uint32_t token;
+		if (!get_varint(src, size, &pos, &token)) return false;
+
+		size_t count = token >> 1;
+		if (count > n - out) return false;
+		if (token & 1)
+		{
+			if (pos >= size) return false;
+			memset(dest + out, src[pos++], count);
+		}
+		else
+		{
+			if (count > size - pos) return false;
+			memcpy(dest + out, src + pos, count);
+			pos += count;
+		}
+		out += count;
+	}
+	return out == n;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// code lengths limited to HUFFMAN_MAX_BITS. false if fewer than two byte
+// values occur, a run length coding wins those anyway
+static bool huffman_lengths(const uint32_t *freq, uint8_t *lengths)
+{
+	memset(lengths, 0, HUFFMAN_SYMBOLS);
+
+	// ascending by frequency, the symbol in the low byte
+	uint64_t order[HUFFMAN_SYMBOLS];
+	uint32_t n = 0;
+	for (uint32_t s = 0; s < HUFFMAN_SYMBOLS; s++)
+	{
+		if (freq[s] > 0) order[n++] = (uint64_t)freq[s] << 8 | s;
+	}
+	if (n < 2) return false;
+	qsort(order, n, sizeof(uint64_t), compare_u64);
+
+	// leaves come sorted and merged nodes are made in nondecreasing weight,
+	// so the two lightest nodes are always at the front of either queue
+	uint64_t weight[2 * HUFFMAN_SYMBOLS];
+	uint32_t parent[2 * HUFFMAN_SYMBOLS];
+	for (uint32_t i = 0; i < n; i++) weight[i] = order[i] >> 8;
+
+	uint32_t leaf = 0;
+	uint32_t node = n;
+	uint32_t next = n;
+	while (next < 2 * n - 1)
+	{
+		uint32_t pick[2];
+		for (int k = 0; k < 2; k++)
+		{
+			if (leaf < n && (node >= next || weight[leaf] <= weight[node])) pick[k] = leaf++;
+			else pick[k] = node++;
+		}
+		weight[next] = weight[pick[0]] + weight[pick[1]];
+		parent[pick[0]] = next;
+		parent[pick[1]] = next;
+		next++;
+	}
+
+	// parents are made after their children, so walk back from the root
+	uint32_t depth[2 * HUFFMAN_SYMBOLS];
+	depth[next - 1] = 0;
+	for (uint32_t i = next - 1; i-- > 0;)
+	{
+		depth[i] = depth[parent[i]] + 1;
+	}
+
+	uint32_t count[HUFFMAN_MAX_BITS + 1] = { 0 };
+	for (uint32_t i = 0; i < n; i++)
+	{
+		count[depth[i] < HUFFMAN_MAX_BITS ? depth[i] : HUFFMAN_MAX_BITS]++;
+	}
+
+	// clamping oversubscribes the code space. drop a longest code and split
+	// a shorter one in two until it fits again
+	uint32_t total = 0;
+	for (uint32_t l = 1; l <= HUFFMAN_MAX_BITS; l++)
+	{
+		total += count[l] << (HUFFMAN_MAX_BITS - l);
+	}
+	while (total > (1u << HUFFMAN_MAX_BITS))
+	{
+		count[HUFFMAN_MAX_BITS]--;
+		for (uint32_t l = HUFFMAN_MAX_BITS - 1; l > 0; l--)
+		{
+			if (count[l] == 0) continue;
+			count[l]--;
+			count[l + 1] += 2;
+			break;
+		}
+		total--;
+	}
+
+	// shortest codes to the most frequent symbols
+	uint32_t s = n;
+	for (uint32_t l = 1; l <= HUFFMAN_MAX_BITS; l++)
+	{
+		for (uint32_t c = count[l]; c > 0; c--)
+		{
+			lengths[order[--s] & 0xff] = (uint8_t)l;
+		}
+	}
+	return true;
+}
+
+// canonical codes, bit reversed since the stream is read from the low bit
+static void huffman_codes(const uint8_t *lengths, uint16_t *codes)
+{
+	uint32_t count[HUFFMAN_MAX_BITS + 1] = { 0 };
+	for (uint32_t s = 0; s < HUFFMAN_SYMBOLS; s++) count[lengths[s]]++;
+	count[0] = 0;
+
+	uint32_t next[HUFFMAN_MAX_BITS + 1];
+	uint32_t code = 0;
+	for (uint32_t l = 1; l <= HUFFMAN_MAX_BITS; l++)
+	{
+		code = (code + count[l - 1]) << 1;
+		next[l] = code;
+	}
+
+	for (uint32_t s = 0; s < HUFFMAN_SYMBOLS; s++)
+	{
+		uint32_t len = lengths[s];
+		if (len == 0) continue;
+
+		uint32_t c = next[len]++;
+		uint32_t reversed = 0;
+		for (uint32_t b = 0; b < len; b++) reversed |= ((c >> b) & 1) << (len - 1 - b);
+		codes[s] = (uint16_t)reversed;
+	}
+}
+
+static size_t huffman_encode(const uint8_t *src, size_t n, const uint8_t *lengths, uint8_t *dest)
+{
+	uint16_t codes[HUFFMAN_SYMBOLS];
+	huffman_codes(lengths, codes);
+
+	for (uint32_t i = 0; i < HUFFMAN_LENGTHS_SIZE; i++)
+	{
+		dest[i] = (uint8_t)(lengths[2 * i] | lengths[2 * i + 1] << 4);
+	}
+
+	size_t pos = HUFFMAN_LENGTHS_SIZE;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		bits |= (uint64_t)codes[src[i]] << count;
+		count += lengths[src[i]];
+		while (count >= 8)
+		{
+			dest[pos++] = (uint8_t)bits;
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+	if (count > 0) dest[pos++] = (uint8_t)bits;
+	return pos;
+}
+
+static bool huffman_decode(const uint8_t *src, size_t size, uint8_t *dest, size_t n, uint16_t *table)
+{
+	if (size < HUFFMAN_LENGTHS_SIZE) return false;
+
+	uint8_t lengths[HUFFMAN_SYMBOLS];
+	for (uint32_t i = 0; i < HUFFMAN_LENGTHS_SIZE; i++)
+	{
+		lengths[2 * i] = src[i] & 0x0f;
+		lengths[2 * i + 1] = src[i] >> 4;
+	}
+	for (uint32_t s = 0; s < HUFFMAN_SYMBOLS; s++)
+	{
+		if (lengths[s] > HUFFMAN_MAX_BITS) return false;
+	}
+
+	uint16_t codes[HUFFMAN_SYMBOLS];
+	huffman_codes(lengths, codes);
+
+	// every possible next HUFFMAN_MAX_BITS bits map to a symbol and its
+	// length, a zero length marks bits no code starts with
+	memset(table, 0, (1u << HUFFMAN_MAX_BITS) * sizeof(uint16_t));
+	for (uint32_t s = 0; s < HUFFMAN_SYMBOLS; s++)
+	{
+		uint32_t len = lengths[s];
+		if (len == 0) continue;
+		for (uint32_t fill = codes[s]; fill < (1u << HUFFMAN_MAX_BITS); fill += 1u << len)
+		{
+			table[fill] = (uint16_t)(s | len << 8);
+		}
+	}
+
+	size_t pos = HUFFMAN_LENGTHS_SIZE;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+	uint64_t used = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		// past the end reads zeros, overruns are caught below
+		while (count <= 56)
+		{
+			bits |= (uint64_t)(pos < size ? src[pos] : 0) << count;
+			pos++;
+			count += 8;
+		}
+
+		uint16_t entry = table[bits & ((1u << HUFFMAN_MAX_BITS) - 1)];
+		uint32_t len = entry >> 8;
+		if (len == 0) return false;
+
+		dest[i] = (uint8_t)entry;
+		bits >>= len;
+		count -= len;
+		used += len;
+	}
+	return used <= (uint64_t)(size - HUFFMAN_LENGTHS_SIZE) * 8;
+}
+
+static size_t encode_plane(const uint8_t *plane, size_t n, uint8_t *dest, uint8_t *stage)
+{
+	uint32_t freq[HUFFMAN_SYMBOLS] = { 0 };
+	for (size_t i = 0; i < n; i++) freq[plane[i]]++;
+
+	uint8_t lengths[HUFFMAN_SYMBOLS];
+	size_t huffman_size = SIZE_MAX;
+	if (huffman_lengths(freq, lengths))
+	{
+		uint64_t bits = 0;
+		for (uint32_t s = 0; s < HUFFMAN_SYMBOLS; s++) bits += (uint64_t)freq[s] * lengths[s];
+		huffman_size = HUFFMAN_LENGTHS_SIZE + (size_t)((bits + 7) / 8);
+	}
+	size_t rle_size = rle_encode(plane, n, NULL);
+
+	// ties go to the cheaper stage to decode
+	uint8_t *payload = dest + PLANE_HEADER_SIZE;
+	size_t size;
+	if (n <= rle_size && n <= huffman_size)
+	{
+		*stage = HEIGHT_CODEC_STAGE_RAW;
+		memcpy(payload, plane, n);
+		size = n;
+	}
+	else if (rle_size <= huffman_size)
+	{
+		*stage = HEIGHT_CODEC_STAGE_RLE;
+		size = rle_encode(plane, n, payload);
+	}
+	else
+	{
+		*stage = HEIGHT_CODEC_STAGE_HUFFMAN;
+		size = huffman_encode(plane, n, lengths, payload);
+	}
+
+	dest[0] = *stage;
+	binary_store_u32(dest + 1, (uint32_t)size);
+	return PLANE_HEADER_SIZE + size;
+}
+
+static size_t encode_tile(codec_run_t *run, uint32_t tx, uint32_t ty, codec_scratch_t *scratch)
+{
+	size_t index = (size_t)ty * run->tiles.w + tx;
+	uint32_t x0 = tx * run->tile_size;
+	uint32_t y0 = ty * run->tile_size;
+	uint32_t w = run->size.w - x0 < run->tile_size ? run->size.w - x0 : run->tile_size;
+	uint32_t h = run->size.h - y0 < run->tile_size ? run->size.h - y0 : run->tile_size;
+	size_t n = (size_t)w * h;
+
+	uint32_t *samples = scratch->samples;
+	for (uint32_t y = 0; y < h; y++)
+	{
+		const float *row = run->heights + (size_t)(y0 + y) * run->size.w + x0;
+		for (uint32_t x = 0; x < w; x++) samples[(size_t)y * w + x] = to_ordered(row[x]);
+	}
+
+	// the predictor with the smallest residuals, the way png picks filters.
+	// every eighth row is plenty to tell them apart
+	uint32_t *residuals = scratch->residuals;
+	uint64_t cost[HEIGHT_CODEC_PREDICTOR_COUNT__] = { 0 };
+	for (uint32_t y = 1; y < h; y += 8)
+	{
+		for (int p = 0; p < HEIGHT_CODEC_PREDICTOR_COUNT__; p++)
+		{
+			residual_row((height_codec_predictor_t)p, samples + (size_t)y * w, samples + (size_t)(y - 1) * w, w, residuals);
+			for (uint32_t x = 0; x < w; x++) cost[p] += residuals[x];
+		}
+	}
+	height_codec_predictor_t predictor = HEIGHT_CODEC_PREDICTOR_LEFT;
+	for (int p = 1; p < HEIGHT_CODEC_PREDICTOR_COUNT__; p++)
+	{
+		if (cost[p] < cost[predictor]) predictor = (height_codec_predictor_t)p;
+	}
+
+	uint8_t *planes = scratch->planes;
+	for (uint32_t y = 0; y < h; y++)
+	{
+		residual_row(predictor, samples + (size_t)y * w, y > 0 ? samples + (size_t)(y - 1) * w : NULL, w, residuals);
+		size_t i = (size_t)y * w;
+		for (uint32_t x = 0; x < w; x++)
+		{
+			uint32_t z = residuals[x];
+			planes[i + x] = (uint8_t)z;
+			planes[n + i + x] = (uint8_t)(z >> 8);
+			planes[2 * n + i + x] = (uint8_t)(z >> 16);
+			planes[3 * n + i + x] = (uint8_t)(z >> 24);
+		}
+	}
+
+	uint8_t *dest = run->slots + index * run->slot_size;
+	dest[0] = (uint8_t)predictor;
+	run->predictors[index] = (uint8_t)predictor;
+
+	size_t pos = 1;
+	for (int k = 0; k < PLANE_COUNT; k++)
+	{
+		pos += encode_plane(planes + k * n, n, dest + pos, &run->stages[index * PLANE_COUNT + k]);
+	}
+	return pos;
+}
+
+static bool decode_tile(codec_run_t *run, uint32_t tx, uint32_t ty, codec_scratch_t *scratch)
+{
+	size_t index = (size_t)ty * run->tiles.w + tx;
+	const uint8_t *src = run->src + run->offsets[index];
+	size_t size = run->tile_sizes[index];
+
+	uint32_t x0 = tx * run->tile_size;
+	uint32_t y0 = ty * run->tile_size;
+	uint32_t w = run->size.w - x0 < run->tile_size ? run->size.w - x0 : run->tile_size;
+	uint32_t h = run->size.h - y0 < run->tile_size ? run->size.h - y0 : run->tile_size;
+	size_t n = (size_t)w * h;
+
+	if (size < TILE_HEADER_SIZE || src[0] >= HEIGHT_CODEC_PREDICTOR_COUNT__) return false;
+	height_codec_predictor_t predictor = (height_codec_predictor_t)src[0];
+
+	uint8_t *planes = scratch->planes;
+	size_t pos = 1;
+	for (int k = 0; k < PLANE_COUNT; k++)
+	{
+		if (size - pos < PLANE_HEADER_SIZE) return false;
+		uint8_t stage = src[pos];
+		size_t payload = binary_load_u32(src + pos + 1);
+		pos += PLANE_HEADER_SIZE;
+		if (payload > size - pos) return false;
+
+		bool ok = false;
+		switch (stage)
+		{
+		case HEIGHT_CODEC_STAGE_RAW:
+			ok = payload == n;
+			if (ok) memcpy(planes + k * n, src + pos, n);
+			break;
+		case HEIGHT_CODEC_STAGE_RLE:
+			ok = rle_decode(src + pos, payload, planes + k * n, n);
+			break;
+		case HEIGHT_CODEC_STAGE_HUFFMAN:
+			ok = huffman_decode(src + pos, payload, planes + k * n, n, scratch->table);
+			break;
+		default:
+			break;
+		}
+		if (!ok) return false;
+		pos += payload;
+	}
+	if (pos != size) return false;
+
+	uint32_t *samples = scratch->samples;
+	for (uint32_t y = 0; y < h; y++)
+	{
+		uint32_t *row = samples + (size_t)y * w;
+		size_t i = (size_t)y * w;
+		for (uint32_t x = 0; x < w; x++)
+		{
+			row[x] = planes[i + x] | (uint32_t)planes[n + i + x] << 8 | (uint32_t)planes[2 * n + i + x] << 16 | (uint32_t)planes[3 * n + i + x] << 24;
+		}
+		restore_row(predictor, row, y > 0 ? row - w : NULL, w);
+
+		float *out = run->out + (size_t)(y0 + y) * run->size.w + x0;
+		for (uint32_t x = 0; x < w; x++) out[x] = from_ordered(row[x]);
+	}
+	return true;
+}
+
+static void scratch_init(codec_scratch_t *scratch, uint32_t tile_size)
+{
+	// per call rather than per worker, a thread waiting on some other group
+	// may pick up a tile of this run while another such thread runs one too
+	size_t pixels = (size_t)tile_size * tile_size;
+	scratch->samples = malloc(pixels * sizeof(uint32_t));
+	scratch->residuals = malloc(tile_size * sizeof(uint32_t));
+	scratch->planes = malloc(pixels * PLANE_COUNT);
+	scratch->table = malloc((1u << HUFFMAN_MAX_BITS) * sizeof(uint16_t));
+}
+
+static void scratch_free(codec_scratch_t *scratch)
+{
+	free(scratch->samples);
+	free(scratch->residuals);
+	free(scratch->planes);
+	free(scratch->table);
+}
+
+static void encode_tiles(void *user_pointer, uint32_t tx0, uint32_t ty0, uint32_t tx1, uint32_t ty1)
+{
+	codec_run_t *run = user_pointer;
+	codec_scratch_t scratch;
+	scratch_init(&scratch, run->tile_size);
+	for (uint32_t ty = ty0; ty < ty1; ty++)
+	{
+		for (uint32_t tx = tx0; tx < tx1; tx++)
+		{
+			run->tile_sizes[(size_t)ty * run->tiles.w + tx] = (uint32_t)encode_tile(run, tx, ty, &scratch);
+		}
+	}
+	scratch_free(&scratch);
+}
+
+static void decode_tiles(void *user_pointer, uint32_t tx0, uint32_t ty0, uint32_t tx1, uint32_t ty1)
+{
+	codec_run_t *run = user_pointer;
+	codec_scratch_t scratch;
+	scratch_init(&scratch, run->tile_size);
+	for (uint32_t ty = ty0; ty < ty1; ty++)
+	{
+		for (uint32_t tx = tx0; tx < tx1; tx++)
+		{
+			run->ok[(size_t)ty * run->tiles.w + tx] = decode_tile(run, tx, ty, &scratch);
+		}
+	}
+	scratch_free(&scratch);
+}
+
+static uvec2 tile_grid(uvec2 size, uint32_t tile_size)
+{
+	return (uvec2){ .w = (size.w + tile_size - 1) / tile_size, .h = (size.h + tile_size - 1) / tile_size };
+}
+
+static size_t slot_size(uint32_t tile_size)
+{
+	// a raw plane is the worst any stage is allowed to do
+	return TILE_HEADER_SIZE + (size_t)tile_size * tile_size * PLANE_COUNT;
+}
+
+size_t height_codec_bound(uvec2 size, uint32_t tile_size)
+{
+	if (tile_size == 0) tile_size = HEIGHT_CODEC_DEFAULT_TILE_SIZE;
+	uvec2 tiles = tile_grid(size, tile_size);
+	size_t count = (size_t)tiles.w * tiles.h;
+	return HEADER_SIZE + count * sizeof(uint32_t) + count * slot_size(tile_size);
+}
+
+size_t height_codec_encode(const float *heights, uvec2 size, uint32_t tile_size, uint8_t *dest, size_t capacity, height_codec_stats_t *stats)
+{
+	HE_ASSERT(heights != NULL, "Cannot encode NULL heights");
+	HE_ASSERT(dest != NULL, "An encode destination is required");
+
+	if (tile_size == 0) tile_size = HEIGHT_CODEC_DEFAULT_TILE_SIZE;
+	HE_ASSERT(tile_size >= MIN_TILE_SIZE && tile_size <= MAX_TILE_SIZE, "Codec tile size out of range");
+
+	if (capacity < height_codec_bound(size, tile_size)) return 0;
+
+	double start = timer_now();
+
+	uvec2 tiles = tile_grid(size, tile_size);
+	size_t count = (size_t)tiles.w * tiles.h;
+	size_t data_start = HEADER_SIZE + count * sizeof(uint32_t);
+
+	codec_run_t run = {
+		.size = size,
+		.tile_size = tile_size,
+		.tiles = tiles,
+		.heights = heights,
+		.slots = dest + data_start,
+		.slot_size = slot_size(tile_size),
+		.tile_sizes = malloc(count * sizeof(uint32_t)),
+		.predictors = malloc(count),
+		.stages = malloc(count * PLANE_COUNT),
+	};
+	job_parallel_for_2d(job_system_shared(), tiles.w, tiles.h, 1, 1, encode_tiles, &run);
+
+	memcpy(dest, HEIGHT_CODEC_MAGIC, 4);
+	binary_store_u32(dest + 4, HEIGHT_CODEC_VERSION);
+	binary_store_u32(dest + 8, size.w);
+	binary_store_u32(dest + 12, size.h);
+	binary_store_u32(dest + 16, tile_size);
+	binary_store_u32(dest + 20, (uint32_t)count);
+
+	// pack the slots, every tile only ever moves towards the front
+	size_t pos = data_start;
+	for (size_t i = 0; i < count; i++)
+	{
+		binary_store_u32(dest + HEADER_SIZE + i * sizeof(uint32_t), run.tile_sizes[i]);
+		memmove(dest + pos, run.slots + i * run.slot_size, run.tile_sizes[i]);
+		pos += run.tile_sizes[i];
+	}
+
+	if (stats != NULL)
+	{
+		stats->raw_bytes = (uint64_t)size.w * size.h * sizeof(float);
+		stats->encoded_bytes = pos;
+		stats->tiles = (uint32_t)count;
+		memset(stats->predictors, 0, sizeof(stats->predictors));
+		memset(stats->stages, 0, sizeof(stats->stages));
+		for (size_t i = 0; i < count; i++)
+		{
+			stats->predictors[run.predictors[i]]++;
+			for (int k = 0; k < PLANE_COUNT; k++) stats->stages[run.stages[i * PLANE_COUNT + k]]++;
+		}
+		stats->encode_seconds = timer_now() - start;
+	}
+
+	free(run.stages);
+	free(run.predictors);
+	free(run.tile_sizes);
+	return pos;
+}
+
+bool height_codec_peek(const uint8_t *src, size_t src_size, uvec2 *size)
+{
+	HE_ASSERT(src != NULL, "Cannot peek NULL");
+	HE_ASSERT(size != NULL, "Cannot peek into NULL");
+
+	if (src_size < HEADER_SIZE || memcmp(src, HEIGHT_CODEC_MAGIC, 4) != 0) return false;
+	if (binary_load_u32(src + 4) != HEIGHT_CODEC_VERSION) return false;
+
+	size->w = binary_load_u32(src + 8);
+	size->h = binary_load_u32(src + 12);
+	return size->w > 0 && size->h > 0;
+}
+
+bool height_codec_decode(const uint8_t *src, size_t src_size, float *heights, uvec2 size, height_codec_stats_t *stats)
+{
+	HE_ASSERT(heights != NULL, "Cannot decode into NULL");
+
+	double start = timer_now();
+
+	uvec2 stored;
+	if (!height_codec_peek(src, src_size, &stored) || stored.w != size.w || stored.h != size.h) return false;
+
+	uint32_t tile_size = binary_load_u32(src + 16);
+	if (tile_size < MIN_TILE_SIZE || tile_size > MAX_TILE_SIZE) return false;
+
+	uvec2 tiles = tile_grid(size, tile_size);
+	size_t count = (size_t)tiles.w * tiles.h;
+	if (binary_load_u32(src + 20) != count) return false;
+	if ((src_size - HEADER_SIZE) / sizeof(uint32_t) < count) return false;
+
+	codec_run_t run = {
+		.size = size,
+		.tile_size = tile_size,
+		.tiles = tiles,
+		.out = heights,
+		.src = src,
+		.offsets = malloc(count * sizeof(uint64_t)),
+		.tile_sizes = malloc(count * sizeof(uint32_t)),
+		.ok = malloc(count),
+	};
+
+	bool ok = true;
+	uint64_t offset = HEADER_SIZE + count * sizeof(uint32_t);
+	for (size_t i = 0; i < count && ok; i++)
+	{
+		run.tile_sizes[i] = binary_load_u32(src + HEADER_SIZE + i * sizeof(uint32_t));
+		run.offsets[i] = offset;
+		offset += run.tile_sizes[i];
+		ok = offset <= src_size;
+	}
+
+	if (ok)
+	{
+		job_parallel_for_2d(job_system_shared(), tiles.w, tiles.h, 1, 1, decode_tiles, &run);
+		for (size_t i = 0; i < count && ok; i++) ok = run.ok[i];
+	}
+
+	if (ok && stats != NULL)
+	{
+		stats->raw_bytes = (uint64_t)size.w * size.h * sizeof(float);
+		stats->encoded_bytes = offset;
+		stats->tiles = (uint32_t)count;
+		stats->decode_seconds = timer_now() - start;
+	}
+
+	free(run.ok);
+	free(run.tile_sizes);
+	free(run.offsets);
+	return ok;
+}
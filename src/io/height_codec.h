@@ -0,0 +1,70 @@
+#ifndef __io_height_codec_h__
+#define __io_height_codec_h__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "math/types.h"
+
+// lossless compression for float height maps. the map is cut into square
+// tiles that are coded independently, on every core at once. a tile turns its
+// floats into order preserving integers, predicts every sample from its
+// neighbours with whichever predictor fits the tile best, and splits the
+// residuals into four byte planes. smooth terrain leaves the upper planes
+// almost empty, so each plane is stored raw, run length coded or huffman
+// coded, whichever is smallest. there is no checksum, the formats that embed
+// a stream verify the decoded heights
+
+#define HEIGHT_CODEC_MAGIC "HEHC"
+#define HEIGHT_CODEC_VERSION (1)
+#define HEIGHT_CODEC_DEFAULT_TILE_SIZE (256)
+
+typedef enum height_codec_predictor_t
+{
+	HEIGHT_CODEC_PREDICTOR_LEFT,
+	HEIGHT_CODEC_PREDICTOR_UP,
+	HEIGHT_CODEC_PREDICTOR_PAETH,
+	// median edge detector, paeth that leans towards the gradient
+	HEIGHT_CODEC_PREDICTOR_MED,
+	HEIGHT_CODEC_PREDICTOR_COUNT__,
+} height_codec_predictor_t;
+
+typedef enum height_codec_stage_t
+{
+	HEIGHT_CODEC_STAGE_RAW,
+	HEIGHT_CODEC_STAGE_RLE,
+	HEIGHT_CODEC_STAGE_HUFFMAN,
+	HEIGHT_CODEC_STAGE_COUNT__,
+} height_codec_stage_t;
+
+typedef struct height_codec_stats_t
+{
+	uint64_t raw_bytes;
+	uint64_t encoded_bytes;
+	uint32_t tiles;
+	// tiles per predictor and byte planes per stage
+	uint32_t predictors[HEIGHT_CODEC_PREDICTOR_COUNT__];
+	uint32_t stages[HEIGHT_CODEC_STAGE_COUNT__];
+	double encode_seconds;
+	double decode_seconds;
+} height_codec_stats_t;
+
+const char *height_codec_predictor_name(height_codec_predictor_t predictor);
+const char *height_codec_stage_name(height_codec_stage_t stage);
+
+// largest possible encoding of a map, zero tile_size picks the default
+size_t height_codec_bound(uvec2 size, uint32_t tile_size);
+
+// returns the encoded size, or zero if dest is smaller than the bound. stats
+// may be NULL, otherwise the encode fields are filled in
+size_t height_codec_encode(const float *heights, uvec2 size, uint32_t tile_size, uint8_t *dest, size_t capacity, height_codec_stats_t *stats);
+
+// the map size of an encoding, without decoding it
+bool height_codec_peek(const uint8_t *src, size_t src_size, uvec2 *size);
+
+// heights has to hold the map size that height_codec_peek reports. false on
+// a size mismatch or a corrupt stream. stats may be NULL
+bool height_codec_decode(const uint8_t *src, size_t src_size, float *heights, uvec2 size, height_codec_stats_t *stats);
+
+#endif /* __io_height_codec_h__ */
@@ -0,0 +1,894 @@
+#include "heightmap.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/crc32.h"
+#include "debug/assert.h"
+#include "io/binary.h"
+
+#define HEIGHTMAP_FILE_BUFFER (1 << 20)
+// enough digits to read back the exact floats
+#define HEIGHTMAP_RANGE_FORMAT "min=%.9g max=%.9g"
+#define HEIGHTMAP_RANGE_SCAN "min=%g max=%g"
+// longest side a file may declare, keeps a corrupt header from asking for
+// more memory than any terrain this loads into
+#define HEIGHTMAP_MAX_SIDE (1 << 16)
+
+#define PNG_TEXT_KEYWORD "heightmap"
+#define PNG_STORED_BLOCK_MAX (65535)
+#define PNG_READ_BUFFER (1 << 16)
+#define PNG_WINDOW_SIZE (1 << 15)
+#define PNG_MAX_CHUNK (1u << 31)
+// chunks before the image data that are read whole, larger ones are skipped
+#define PNG_MAX_HEADER_CHUNK (1 << 16)
+
+static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static const char *format_names[HEIGHTMAP_FORMAT_COUNT__] = { "raw", "pgm", "png" };
+
+// shared by every format, heights are quantized against the recorded range
+typedef struct heightmap_range_t
+{
+	float min;
+	float max;
+	float scale;
+} heightmap_range_t;
+
+static void store_be16(uint8_t *dest, uint16_t v)
+{
+	dest[0] = (uint8_t)(v >> 8);
+	dest[1] = (uint8_t)v;
+}
+
+static void store_be32(uint8_t *dest, uint32_t v)
+{
+	dest[0] = (uint8_t)(v >> 24);
+	dest[1] = (uint8_t)(v >> 16);
+	dest[2] = (uint8_t)(v >> 8);
+	dest[3] = (uint8_t)v;
+}
+
+static uint32_t load_be32(const uint8_t *src)
+{
+	return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+}
+
+static heightmap_range_t find_range(terrain_t *terrain)
+{
+	const float *heights = terrain->height_map;
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+
+	heightmap_range_t range = { heights[0], heights[0], 0.0f };
+	for (size_t i = 1; i < count; i++)
+	{
+		if (heights[i] < range.min) range.min = heights[i];
+		if (heights[i] > range.max) range.max = heights[i];
+	}
+	if (range.max > range.min) range.scale = 65535.0f / (range.max - range.min);
+	return range;
+}
+
+static uint16_t quantize(const heightmap_range_t *range, float h)
+{
+	float v = (h - range->min) * range->scale + 0.5f;
+	return v >= 65535.0f ? 65535 : v <= 0.0f ? 0 : (uint16_t)v;
+}
+
+static void fill_info(heightmap_info_t *info, terrain_t *terrain, float min, float max, bool recorded)
+{
+	if (info == NULL) return;
+	info->size = terrain->size;
+	info->min_height = min;
+	info->max_height = max;
+	info->recorded_range = recorded;
+}
+
+static bool parse_range(const char *text, float *min, float *max)
+{
+	return sscanf(text, HEIGHTMAP_RANGE_SCAN, min, max) == 2 && *max >= *min;
+}
+
+heightmap_format_t heightmap_format_from_path(const char *path)
+{
+	const char *dot = strrchr(path, '.');
+	if (dot == NULL) return HEIGHTMAP_FORMAT_COUNT__;
+
+	char ext[8] = { 0 };
+	for (int i = 0; i < 7 && dot[i + 1] != '\0'; i++)
+	{
+		ext[i] = (char)tolower((unsigned char)dot[i + 1]);
+	}
+
+	if (strcmp(ext, "raw") == 0 || strcmp(ext, "r32") == 0 || strcmp(ext, "f32") == 0) return HEIGHTMAP_FORMAT_RAW;
+	if (strcmp(ext, "pgm") == 0) return HEIGHTMAP_FORMAT_PGM;
+	if (strcmp(ext, "png") == 0) return HEIGHTMAP_FORMAT_PNG;
+	return HEIGHTMAP_FORMAT_COUNT__;
+}
+
+const char *heightmap_format_name(heightmap_format_t format)
+{
+	return format < HEIGHTMAP_FORMAT_COUNT__ ? format_names[format] : "unknown";
+}
+
+static bool save_raw(FILE *file, terrain_t *terrain)
+{
+	return binary_write_f32_array(file, terrain->height_map, (size_t)terrain->size.w * terrain->size.h);
+}
+
+static bool save_pgm(FILE *file, terrain_t *terrain, const heightmap_range_t *range)
+{
+	uint32_t w = terrain->size.w;
+	bool ok = fprintf(file, "P5\n# " HEIGHTMAP_RANGE_FORMAT "\n%u %u\n65535\n", range->min, range->max, w, terrain->size.h) > 0;
+
+	uint8_t *row = malloc((size_t)w * 2);
+	for (uint32_t y = 0; ok && y < terrain->size.h; y++)
+	{
+		const float *heights = terrain->height_map + (size_t)y * w;
+		for (uint32_t x = 0; x < w; x++)
+		{
+			store_be16(row + 2 * x, quantize(range, heights[x]));
+		}
+		ok = fwrite(row, 1, (size_t)w * 2, file) == (size_t)w * 2;
+	}
+	free(row);
+	return ok;
+}
+
+static bool write_png_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size)
+{
+	uint8_t header[8];
+	store_be32(header, size);
+	memcpy(header + 4, type, 4);
+
+	uint8_t footer[4];
+	store_be32(footer, crc32_update(crc32_update(CRC32_INIT, header + 4, 4), data, size));
+
+	bool ok = fwrite(header, 1, 8, file) == 8;
+	ok = ok && (size == 0 || fwrite(data, 1, size, file) == size);
+	return ok && fwrite(footer, 1, 4, file) == 4;
+}
+
+static uint32_t adler32_update(uint32_t adler, const uint8_t *data, size_t size)
+{
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+	while (size > 0)
+	{
+		// largest run that cannot overflow b before the modulo
+		size_t run = size < 5552 ? size : 5552;
+		size -= run;
+		while (run-- > 0)
+		{
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+static bool save_png(FILE *file, terrain_t *terrain, const heightmap_range_t *range)
+{
+	uint32_t w = terrain->size.w;
+	uint32_t h = terrain->size.h;
+
+	uint8_t ihdr[13];
+	store_be32(ihdr, w);
+	store_be32(ihdr + 4, h);
+	ihdr[8] = 16; // bit depth
+	ihdr[9] = 0;  // greyscale
+	ihdr[10] = 0; // deflate
+	ihdr[11] = 0; // adaptive filtering
+	ihdr[12] = 0; // no interlacing
+
+	char text[64];
+	int text_len = snprintf(text, sizeof(text), PNG_TEXT_KEYWORD "%c" HEIGHTMAP_RANGE_FORMAT, '\0', range->min, range->max);
+
+	bool ok = fwrite(png_signature, 1, sizeof(png_signature), file) == sizeof(png_signature);
+	ok = ok && write_png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+	ok = ok && write_png_chunk(file, "tEXt", (const uint8_t *)text, (uint32_t)text_len);
+
+	// every row goes out as its own IDAT chunk holding stored deflate blocks,
+	// so nothing but the row itself is ever buffered. the zlib header rides
+	// along with the first row and the adler32 with the last
+	size_t row_bytes = 1 + (size_t)w * 2;
+	size_t blocks = (row_bytes + PNG_STORED_BLOCK_MAX - 1) / PNG_STORED_BLOCK_MAX;
+	uint8_t *row = malloc(row_bytes);
+	uint8_t *chunk = malloc(2 + 5 * blocks + row_bytes + 4);
+	uint32_t adler = 1;
+
+	for (uint32_t y = 0; ok && y < h; y++)
+	{
+		const float *heights = terrain->height_map + (size_t)y * w;
+		row[0] = 0; // no filter, stored blocks would not benefit
+		for (uint32_t x = 0; x < w; x++)
+		{
+			store_be16(row + 1 + 2 * x, quantize(range, heights[x]));
+		}
+		adler = adler32_update(adler, row, row_bytes);
+
+		size_t size = 0;
+		if (y == 0)
+		{
+			// deflate with a 32k window, no preset dictionary, fastest level
+			chunk[size++] = 0x78;
+			chunk[size++] = 0x01;
+		}
+		for (size_t offset = 0; offset < row_bytes; offset += PNG_STORED_BLOCK_MAX)
+		{
+			uint16_t len = (uint16_t)(row_bytes - offset < PNG_STORED_BLOCK_MAX ? row_bytes - offset : PNG_STORED_BLOCK_MAX);
+			uint16_t nlen = (uint16_t)~len;
+			bool final = y == h - 1 && offset + len == row_bytes;
+			chunk[size++] = final ? 1 : 0;
+			chunk[size++] = (uint8_t)len;
+			chunk[size++] = (uint8_t)(len >> 8);
+			chunk[size++] = (uint8_t)nlen;
+			chunk[size++] = (uint8_t)(nlen >> 8);
+			memcpy(chunk + size, row + offset, len);
+			size += len;
+		}
+		if (y == h - 1)
+		{
+			store_be32(chunk + size, adler);
+			size += 4;
+		}
+
+		ok = write_png_chunk(file, "IDAT", chunk, (uint32_t)size);
+	}
+
+	ok = ok && write_png_chunk(file, "IEND", NULL, 0);
+	free(chunk);
+	free(row);
+	return ok;
+}
+
+bool heightmap_save(const char *path, heightmap_format_t format, terrain_t *terrain, heightmap_info_t *info)
+{
+	HE_ASSERT(path != NULL, "A heightmap path is required");
+	HE_ASSERT(terrain != NULL, "Cannot save NULL terrain");
+	HE_ASSERT(format < HEIGHTMAP_FORMAT_COUNT__, "Invalid heightmap format");
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) return false;
+	setvbuf(file, NULL, _IOFBF, HEIGHTMAP_FILE_BUFFER);
+
+	// one pass for the range, one to write. both read the map in order
+	terrain_advise(terrain, TERRAIN_ACCESS_SEQUENTIAL);
+	heightmap_range_t range = find_range(terrain);
+
+	bool ok = false;
+	switch (format)
+	{
+	case HEIGHTMAP_FORMAT_RAW: ok = save_raw(file, terrain); break;
+	case HEIGHTMAP_FORMAT_PGM: ok = save_pgm(file, terrain, &range); break;
+	case HEIGHTMAP_FORMAT_PNG: ok = save_png(file, terrain, &range); break;
+	default: break;
+	}
+	terrain_advise(terrain, TERRAIN_ACCESS_RANDOM);
+
+	ok &= fclose(file) == 0;
+	if (!ok) remove(path);
+	else fill_info(info, terrain, range.min, range.max, true);
+	return ok;
+}
+
+static bool load_raw(FILE *file, terrain_t *terrain, heightmap_info_t *info)
+{
+	if (fseek(file, 0, SEEK_END) != 0) return false;
+	long length = ftell(file);
+	if (length <= 0 || length % sizeof(float) != 0 || fseek(file, 0, SEEK_SET) != 0) return false;
+
+	// no header, so either the current size fits or the map is square
+	size_t count = (size_t)length / sizeof(float);
+	uvec2 size = terrain->size;
+	if ((size_t)size.w * size.h != count)
+	{
+		uint32_t side = (uint32_t)sqrt((double)count);
+		while ((size_t)side * side > count) side--;
+		while ((size_t)(side + 1) * (side + 1) <= count) side++;
+		if ((size_t)side * side != count || side < 2) return false;
+		size = (uvec2){ .w = side, .h = side };
+	}
+
+	if (!terrain_allocate(terrain, size)) return false;
+	if (!binary_read_f32_array(file, terrain->height_map, count)) return false;
+
+	heightmap_range_t range = find_range(terrain);
+	fill_info(info, terrain, range.min, range.max, true);
+	return true;
+}
+
+// reads one whitespace separated header token, collecting the comments on the way
+static bool pgm_token(FILE *file, char *token, size_t capacity, float *min, float *max, bool *recorded)
+{
+	int c = fgetc(file);
+	while (c != EOF && (isspace(c) || c == '#'))
+	{
+		if (c == '#')
+		{
+			char comment[128];
+			if (fgets(comment, sizeof(comment), file) == NULL) return false;
+			const char *text = comment;
+			while (*text == ' ') text++;
+			if (parse_range(text, min, max)) *recorded = true;
+
+			// drop the rest of a comment too long for the buffer
+			if (strchr(comment, '\n') == NULL)
+			{
+				while ((c = fgetc(file)) != EOF && c != '\n') {}
+			}
+		}
+		c = fgetc(file);
+	}
+
+	size_t len = 0;
+	while (c != EOF && !isspace(c) && len + 1 < capacity)
+	{
+		token[len++] = (char)c;
+		c = fgetc(file);
+	}
+	token[len] = '\0';
+	// the single whitespace after maxval is part of the header, anything
+	// before it was consumed with the token
+	return len > 0;
+}
+
+static bool load_pgm(FILE *file, terrain_t *terrain, heightmap_info_t *info)
+{
+	char magic[16], width[16], height[16], maxval_token[16];
+	float min = 0.0f, max = 1.0f;
+	bool recorded = false;
+
+	bool ok = pgm_token(file, magic, sizeof(magic), &min, &max, &recorded) && strcmp(magic, "P5") == 0;
+	ok = ok && pgm_token(file, width, sizeof(width), &min, &max, &recorded);
+	ok = ok && pgm_token(file, height, sizeof(height), &min, &max, &recorded);
+	ok = ok && pgm_token(file, maxval_token, sizeof(maxval_token), &min, &max, &recorded);
+	if (!ok) return false;
+
+	long w = strtol(width, NULL, 10);
+	long h = strtol(height, NULL, 10);
+	long maxval = strtol(maxval_token, NULL, 10);
+	if (w < 2 || h < 2 || w > HEIGHTMAP_MAX_SIDE || h > HEIGHTMAP_MAX_SIDE || maxval < 1 || maxval > 65535) return false;
+
+	if (!terrain_allocate(terrain, (uvec2){ .w = (uint32_t)w, .h = (uint32_t)h })) return false;
+
+	size_t sample_bytes = maxval > 255 ? 2 : 1;
+	size_t row_bytes = (size_t)w * sample_bytes;
+	uint8_t *row = malloc(row_bytes);
+	float scale = (max - min) / (float)maxval;
+
+	for (long y = 0; ok && y < h; y++)
+	{
+		ok = fread(row, 1, row_bytes, file) == row_bytes;
+
+		float *heights = terrain->height_map + (size_t)y * w;
+		for (long x = 0; ok && x < w; x++)
+		{
+			uint32_t v = sample_bytes == 2 ? ((uint32_t)row[2 * x] << 8) | row[2 * x + 1] : row[x];
+			heights[x] = min + (float)v * scale;
+		}
+	}
+	free(row);
+
+	if (ok) fill_info(info, terrain, min, max, recorded);
+	return ok;
+}
+
+// streaming png decoder. idat data is pulled through a small buffer, inflated
+// into the 32k window and handed out row by row, so only two rows of the
+// image are held at once
+
+typedef struct png_huffman_t
+{
+	uint16_t count[16];
+	uint16_t symbol[288];
+} png_huffman_t;
+
+typedef struct png_reader_t
+{
+	FILE *file;
+	bool ok;
+
+	// the idat chunk being read
+	uint32_t chunk_left;
+	uint32_t crc;
+	uint8_t buffer[PNG_READ_BUFFER];
+	uint32_t buffer_pos;
+	uint32_t buffer_size;
+
+	uint32_t bits;
+	int bit_count;
+
+	uint8_t window[PNG_WINDOW_SIZE];
+	uint32_t window_pos;
+
+	// rows are unfiltered against the previous one as soon as they are complete
+	uint32_t w;
+	uint32_t h;
+	uint32_t bpp;
+	bool wide;
+	size_t row_bytes;
+	size_t row_pos;
+	uint8_t *row;
+	uint8_t *prev;
+	uint32_t y;
+
+	terrain_t *terrain;
+	float min;
+	float scale;
+} png_reader_t;
+
+static bool png_finish_chunk(png_reader_t *r)
+{
+	uint8_t crc[4];
+	return fread(crc, 1, 4, r->file) == 4 && load_be32(crc) == r->crc;
+}
+
+// checks the crc of a chunk nothing is needed from without holding it whole
+static bool png_skip_chunk(png_reader_t *r, uint32_t size)
+{
+	while (size > 0)
+	{
+		size_t part = size < PNG_READ_BUFFER ? size : PNG_READ_BUFFER;
+		if (fread(r->buffer, 1, part, r->file) != part) return false;
+		r->crc = crc32_update(r->crc, r->buffer, part);
+		size -= (uint32_t)part;
+	}
+	return png_finish_chunk(r);
+}
+
+static uint8_t png_next_byte(png_reader_t *r)
+{
+	if (r->buffer_pos == r->buffer_size)
+	{
+		// consecutive idat chunks form one zlib stream
+		while (r->ok && r->chunk_left == 0)
+		{
+			uint8_t header[8];
+			r->ok = png_finish_chunk(r) && fread(header, 1, 8, r->file) == 8 && memcmp(header + 4, "IDAT", 4) == 0;
+			r->chunk_left = load_be32(header);
+			r->crc = crc32_update(CRC32_INIT, header + 4, 4);
+			r->ok = r->ok && r->chunk_left < PNG_MAX_CHUNK;
+		}
+		if (!r->ok) return 0;
+
+		r->buffer_size = r->chunk_left < PNG_READ_BUFFER ? r->chunk_left : PNG_READ_BUFFER;
+		r->buffer_pos = 0;
+		r->ok = fread(r->buffer, 1, r->buffer_size, r->file) == r->buffer_size;
+		r->crc = crc32_update(r->crc, r->buffer, r->buffer_size);
+		r->chunk_left -= r->buffer_size;
+		if (!r->ok) return 0;
+	}
+	return r->buffer[r->buffer_pos++];
+}
+
+static uint32_t png_read_bits(png_reader_t *r, int count)
+{
+	while (r->bit_count < count)
+	{
+		r->bits |= (uint32_t)png_next_byte(r) << r->bit_count;
+		r->bit_count += 8;
+	}
+	uint32_t v = r->bits & ((1u << count) - 1);
+	r->bits >>= count;
+	r->bit_count -= count;
+	return v;
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+	int p = (int)a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+static void png_emit_row(png_reader_t *r)
+{
+	uint8_t *row = r->row + 1;
+	const uint8_t *prev = r->prev + 1;
+	size_t bytes = r->row_bytes - 1;
+	uint32_t bpp = r->bpp;
+
+	switch (r->row[0])
+	{
+	case 0: break;
+	case 1: for (size_t i = bpp; i < bytes; i++) row[i] += row[i - bpp]; break;
+	case 2: for (size_t i = 0; i < bytes; i++) row[i] += prev[i]; break;
+	case 3:
+		for (size_t i = 0; i < bytes; i++) row[i] += (uint8_t)(((i >= bpp ? row[i - bpp] : 0) + prev[i]) / 2);
+		break;
+	case 4:
+		for (size_t i = 0; i < bytes; i++) row[i] += paeth(i >= bpp ? row[i - bpp] : 0, prev[i], i >= bpp ? prev[i - bpp] : 0);
+		break;
+	default: r->ok = false; return;
+	}
+
+	// the first channel is the height, whatever else there is gets dropped
+	float *heights = r->terrain->height_map + (size_t)r->y * r->w;
+	for (uint32_t x = 0; x < r->w; x++)
+	{
+		const uint8_t *sample = row + (size_t)x * bpp;
+		uint32_t v = r->wide ? ((uint32_t)sample[0] << 8) | sample[1] : sample[0];
+		heights[x] = r->min + (float)v * r->scale;
+	}
+
+	uint8_t *swap = r->prev;
+	r->prev = r->row;
+	r->row = swap;
+	r->row_pos = 0;
+	r->y++;
+}
+
+static void png_put(png_reader_t *r, uint8_t b)
+{
+	r->window[r->window_pos++ & (PNG_WINDOW_SIZE - 1)] = b;
+
+	// anything past the last row is ignored
+	if (r->y == r->h) return;
+	r->row[r->row_pos++] = b;
+	if (r->row_pos == r->row_bytes) png_emit_row(r);
+}
+
+static int png_huffman_build(png_huffman_t *huffman, const uint8_t *lengths, int n)
+{
+	memset(huffman->count, 0, sizeof(huffman->count));
+	for (int i = 0; i < n; i++) huffman->count[lengths[i]]++;
+	if (huffman->count[0] == n) return 0;
+
+	// a negative result means the lengths describe too many codes
+	int left = 1;
+	for (int len = 1; len < 16; len++)
+	{
+		left = (left << 1) - huffman->count[len];
+		if (left < 0) return left;
+	}
+
+	uint16_t offsets[16];
+	offsets[1] = 0;
+	for (int len = 1; len < 15; len++) offsets[len + 1] = offsets[len] + huffman->count[len];
+	for (int i = 0; i < n; i++)
+	{
+		if (lengths[i] != 0) huffman->symbol[offsets[lengths[i]]++] = (uint16_t)i;
+	}
+	return left;
+}
+
+static int png_huffman_decode(png_reader_t *r, const png_huffman_t *huffman)
+{
+	// canonical codes, one bit at a time
+	int code = 0, first = 0, index = 0;
+	for (int len = 1; len < 16; len++)
+	{
+		code |= (int)png_read_bits(r, 1);
+		int count = huffman->count[len];
+		if (code - count < first) return huffman->symbol[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	r->ok = false;
+	return -1;
+}
+
+static void png_inflate_codes(png_reader_t *r, const png_huffman_t *lengths, const png_huffman_t *distances)
+{
+	static const uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const uint8_t distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	while (r->ok)
+	{
+		int symbol = png_huffman_decode(r, lengths);
+		if (symbol < 256)
+		{
+			if (symbol >= 0) png_put(r, (uint8_t)symbol);
+			continue;
+		}
+		if (symbol == 256) return;
+
+		symbol -= 257;
+		if (symbol >= 29)
+		{
+			r->ok = false;
+			return;
+		}
+		uint32_t len = length_base[symbol] + png_read_bits(r, length_extra[symbol]);
+
+		int distance_symbol = png_huffman_decode(r, distances);
+		if (distance_symbol < 0 || distance_symbol >= 30)
+		{
+			r->ok = false;
+			return;
+		}
+		uint32_t distance = distance_base[distance_symbol] + png_read_bits(r, distance_extra[distance_symbol]);
+		if (distance > r->window_pos)
+		{
+			r->ok = false;
+			return;
+		}
+
+		while (len-- > 0)
+		{
+			png_put(r, r->window[(r->window_pos - distance) & (PNG_WINDOW_SIZE - 1)]);
+		}
+	}
+}
+
+static void png_inflate_stored(png_reader_t *r)
+{
+	// stored blocks start on a byte boundary
+	r->bits = 0;
+	r->bit_count = 0;
+
+	uint8_t header[4];
+	for (int i = 0; i < 4; i++) header[i] = png_next_byte(r);
+	uint16_t len = (uint16_t)(header[0] | (header[1] << 8));
+	uint16_t nlen = (uint16_t)(header[2] | (header[3] << 8));
+	// nlen is the ones complement of len
+	if ((len ^ nlen) != 0xFFFF) r->ok = false;
+
+	for (uint32_t i = 0; r->ok && i < len; i++) png_put(r, png_next_byte(r));
+}
+
+static void png_inflate_fixed(png_reader_t *r)
+{
+	uint8_t lengths[288];
+	for (int i = 0; i < 144; i++) lengths[i] = 8;
+	for (int i = 144; i < 256; i++) lengths[i] = 9;
+	for (int i = 256; i < 280; i++) lengths[i] = 7;
+	for (int i = 280; i < 288; i++) lengths[i] = 8;
+
+	png_huffman_t length_codes, distance_codes;
+	png_huffman_build(&length_codes, lengths, 288);
+	for (int i = 0; i < 30; i++) lengths[i] = 5;
+	png_huffman_build(&distance_codes, lengths, 30);
+
+	png_inflate_codes(r, &length_codes, &distance_codes);
+}
+
+static void png_inflate_dynamic(png_reader_t *r)
+{
+	static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	int length_count = (int)png_read_bits(r, 5) + 257;
+	int distance_count = (int)png_read_bits(r, 5) + 1;
+	int code_count = (int)png_read_bits(r, 4) + 4;
+	if (length_count > 286 || distance_count > 30)
+	{
+		r->ok = false;
+		return;
+	}
+
+	uint8_t lengths[320] = { 0 };
+	for (int i = 0; i < code_count; i++) lengths[order[i]] = (uint8_t)png_read_bits(r, 3);
+
+	png_huffman_t length_codes, distance_codes;
+	if (png_huffman_build(&length_codes, lengths, 19) != 0)
+	{
+		r->ok = false;
+		return;
+	}
+
+	// code lengths of both tables, with runs
+	int total = length_count + distance_count;
+	for (int i = 0; r->ok && i < total;)
+	{
+		int symbol = png_huffman_decode(r, &length_codes);
+		if (symbol < 0) return;
+		if (symbol < 16)
+		{
+			lengths[i++] = (uint8_t)symbol;
+			continue;
+		}
+
+		uint8_t value = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (i == 0)
+			{
+				r->ok = false;
+				return;
+			}
+			value = lengths[i - 1];
+			repeat = 3 + (int)png_read_bits(r, 2);
+		}
+		else if (symbol == 17) repeat = 3 + (int)png_read_bits(r, 3);
+		else repeat = 11 + (int)png_read_bits(r, 7);
+
+		if (i + repeat > total)
+		{
+			r->ok = false;
+			return;
+		}
+		while (repeat-- > 0) lengths[i++] = value;
+	}
+	if (!r->ok || lengths[256] == 0)
+	{
+		r->ok = false;
+		return;
+	}
+
+	// incomplete codes are allowed, a missing code fails when decoded
+	if (png_huffman_build(&length_codes, lengths, length_count) < 0 ||
+		png_huffman_build(&distance_codes, lengths + length_count, distance_count) < 0)
+	{
+		r->ok = false;
+		return;
+	}
+
+	png_inflate_codes(r, &length_codes, &distance_codes);
+}
+
+static void png_inflate(png_reader_t *r)
+{
+	uint8_t cmf = png_next_byte(r);
+	uint8_t flg = png_next_byte(r);
+	if ((cmf & 0x0F) != 8 || (flg & 0x20) != 0 || ((cmf << 8) | flg) % 31 != 0)
+	{
+		r->ok = false;
+		return;
+	}
+
+	bool final = false;
+	while (r->ok && !final && r->y < r->h)
+	{
+		final = png_read_bits(r, 1) != 0;
+		switch (png_read_bits(r, 2))
+		{
+		case 0: png_inflate_stored(r); break;
+		case 1: png_inflate_fixed(r); break;
+		case 2: png_inflate_dynamic(r); break;
+		default: r->ok = false; break;
+		}
+	}
+}
+
+static bool load_png(FILE *file, terrain_t *terrain, heightmap_info_t *info)
+{
+	uint8_t signature[8];
+	if (fread(signature, 1, 8, file) != 8 || memcmp(signature, png_signature, 8) != 0) return false;
+
+	png_reader_t *r = calloc(1, sizeof(png_reader_t));
+	r->file = file;
+	r->ok = true;
+
+	float min = 0.0f, max = 1.0f;
+	bool recorded = false;
+	uint32_t channels = 0;
+	uint8_t depth = 0;
+
+	// everything up to the first idat, the range may be anywhere in between
+	for (;;)
+	{
+		uint8_t header[8];
+		r->ok = fread(header, 1, 8, file) == 8;
+		uint32_t size = load_be32(header);
+		r->ok = r->ok && size < PNG_MAX_CHUNK;
+		if (!r->ok) break;
+
+		r->crc = crc32_update(CRC32_INIT, header + 4, 4);
+		if (memcmp(header + 4, "IDAT", 4) == 0)
+		{
+			r->chunk_left = size;
+			break;
+		}
+
+		// only ihdr and the range text are used, both are small
+		if (size > PNG_MAX_HEADER_CHUNK)
+		{
+			r->ok = png_skip_chunk(r, size);
+			if (!r->ok) break;
+			continue;
+		}
+
+		uint8_t *data = malloc(size + 1);
+		if (data == NULL)
+		{
+			r->ok = false;
+			break;
+		}
+		r->ok = fread(data, 1, size, file) == size;
+		r->crc = crc32_update(r->crc, data, size);
+		r->ok = r->ok && png_finish_chunk(r);
+		data[size] = '\0';
+
+		if (r->ok && memcmp(header + 4, "IHDR", 4) == 0 && size == 13)
+		{
+			static const uint8_t channel_counts[7] = { 1, 0, 3, 0, 2, 0, 4 };
+			r->w = load_be32(data);
+			r->h = load_be32(data + 4);
+			depth = data[8];
+			channels = data[9] < 7 ? channel_counts[data[9]] : 0;
+			// palettes and interlacing are not worth supporting for heightmaps
+			r->ok = channels > 0 && (depth == 8 || depth == 16) && data[10] == 0 && data[11] == 0 && data[12] == 0;
+		}
+		else if (r->ok && memcmp(header + 4, "tEXt", 4) == 0 && size > sizeof(PNG_TEXT_KEYWORD) &&
+			memcmp(data, PNG_TEXT_KEYWORD, sizeof(PNG_TEXT_KEYWORD)) == 0)
+		{
+			recorded = parse_range((const char *)data + sizeof(PNG_TEXT_KEYWORD), &min, &max);
+		}
+		else if (memcmp(header + 4, "IEND", 4) == 0)
+		{
+			r->ok = false;
+		}
+		free(data);
+
+		if (!r->ok) break;
+	}
+
+	bool ok = r->ok && channels > 0 && r->w >= 2 && r->h >= 2 && r->w <= HEIGHTMAP_MAX_SIDE && r->h <= HEIGHTMAP_MAX_SIDE;
+	ok = ok && terrain_allocate(terrain, (uvec2){ .w = r->w, .h = r->h });
+	if (ok)
+	{
+		r->wide = depth == 16;
+		r->bpp = channels * (depth / 8);
+		r->row_bytes = 1 + (size_t)r->w * r->bpp;
+		r->row = malloc(r->row_bytes);
+		r->prev = calloc(r->row_bytes, 1);
+		r->terrain = terrain;
+		r->min = min;
+		r->scale = (max - min) / (r->wide ? 65535.0f : 255.0f);
+
+		r->ok = r->row != NULL && r->prev != NULL;
+		if (r->ok) png_inflate(r);
+		ok = r->ok && r->y == r->h;
+
+		free(r->row);
+		free(r->prev);
+	}
+	free(r);
+
+	if (ok) fill_info(info, terrain, min, max, recorded);
+	return ok;
+}
+
+bool heightmap_load(const char *path, heightmap_format_t format, terrain_t *terrain, heightmap_info_t *info)
+{
+	HE_ASSERT(path != NULL, "A heightmap path is required");
+	HE_ASSERT(terrain != NULL, "Cannot load into NULL terrain");
+	HE_ASSERT(format < HEIGHTMAP_FORMAT_COUNT__, "Invalid heightmap format");
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return false;
+	setvbuf(file, NULL, _IOFBF, HEIGHTMAP_FILE_BUFFER);
+
+	// decode into a heap view of its own and only take it over once the
+	// whole file has been read, a file that breaks off leaves the terrain as
+	// it was. a raw file of unknown size falls back to the current size
+	terrain_t decoded = terrain_view(terrain->size, NULL);
+	bool ok = false;
+	switch (format)
+	{
+	case HEIGHTMAP_FORMAT_RAW: ok = load_raw(file, &decoded, info); break;
+	case HEIGHTMAP_FORMAT_PGM: ok = load_pgm(file, &decoded, info); break;
+	case HEIGHTMAP_FORMAT_PNG: ok = load_png(file, &decoded, info); break;
+	default: break;
+	}
+	fclose(file);
+
+	if (ok && terrain->storage == TERRAIN_STORAGE_HEAP)
+	{
+		free(terrain->height_map);
+		terrain->height_map = decoded.height_map;
+		terrain->size = decoded.size;
+		decoded.height_map = NULL;
+	}
+	else if (ok)
+	{
+		ok = terrain_allocate(terrain, decoded.size);
+		if (ok) memcpy(terrain->height_map, decoded.height_map, (size_t)decoded.size.w * decoded.size.h * sizeof(float));
+	}
+	free(decoded.height_map);
+
+	if (ok) terrain_update_mesh(terrain);
+	return ok;
+}
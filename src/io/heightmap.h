@@ -0,0 +1,50 @@
+#ifndef __io_heightmap_h__
+#define __io_heightmap_h__
+
+#include <stdbool.h>
+
+#include "components/terrain.h"
+#include "math/types.h"
+
+// heightmap export and import. files are written and read one row at a time,
+// so neither direction needs a buffer the size of the map besides the terrain
+// itself. the 16 bit formats spread the heights over the full sample range and
+// record the min and max next to them, so an import restores the original
+// heights up to the quantization step
+
+typedef enum heightmap_format_t
+{
+	// little endian float32, no header. exact, but the size is not stored
+	HEIGHTMAP_FORMAT_RAW,
+	// binary 16 bit pgm (P5), range in a header comment
+	HEIGHTMAP_FORMAT_PGM,
+	// 16 bit greyscale png, range in a tEXt chunk
+	HEIGHTMAP_FORMAT_PNG,
+	HEIGHTMAP_FORMAT_COUNT__,
+} heightmap_format_t;
+
+typedef struct heightmap_info_t
+{
+	uvec2 size;
+	float min_height;
+	float max_height;
+
+	// false if an imported file did not record its range, its samples are
+	// then spread over 0..1
+	bool recorded_range;
+} heightmap_info_t;
+
+// .raw, .r32 or .f32, .pgm and .png. HEIGHTMAP_FORMAT_COUNT__ for anything else
+heightmap_format_t heightmap_format_from_path(const char *path);
+const char *heightmap_format_name(heightmap_format_t format);
+
+// info may be NULL
+bool heightmap_save(const char *path, heightmap_format_t format, terrain_t *terrain, heightmap_info_t *info);
+
+// resizes the terrain to the file and rebuilds its mesh. a raw file keeps the
+// terrain size if its length matches, otherwise it has to be square. png
+// imports also take 8 bit and colour images, using the first channel. the
+// terrain is left untouched unless the whole file could be read
+bool heightmap_load(const char *path, heightmap_format_t format, terrain_t *terrain, heightmap_info_t *info);
+
+#endif /* __io_heightmap_h__ */
@@ -0,0 +1,200 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "mapped_file.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "debug/assert.h"
+
+#if defined(_WIN32)
+static bool map_file(const mapped_file_desc_t *desc, mapped_file_t *result)
+{
+	bool write = desc->mode == MAPPED_FILE_MODE_SHARED;
+	HANDLE file = CreateFileA(desc->path,
+		write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	bool created = write && GetLastError() != ERROR_ALREADY_EXISTS;
+
+	LARGE_INTEGER existing;
+	GetFileSizeEx(file, &existing);
+
+	// an existing file holds someone's data, it is only resized when asked to
+	size_t size = desc->size > 0 ? desc->size : (size_t)existing.QuadPart;
+	result->existed = (size_t)existing.QuadPart == size;
+	bool resize = write && !result->existed && (created || desc->resize);
+	LARGE_INTEGER end = { .QuadPart = (LONGLONG)size };
+	if (size == 0 || (!write && (size_t)existing.QuadPart < size) || (write && !result->existed && !resize) ||
+		(resize && (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file))))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	DWORD protect = write ? PAGE_READWRITE : (desc->mode == MAPPED_FILE_MODE_PRIVATE ? PAGE_WRITECOPY : PAGE_READONLY);
+	HANDLE mapping = CreateFileMappingA(file, NULL, protect, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	DWORD access = write ? FILE_MAP_WRITE : (desc->mode == MAPPED_FILE_MODE_PRIVATE ? FILE_MAP_COPY : FILE_MAP_READ);
+	result->data = MapViewOfFile(mapping, access, 0, 0, size);
+	if (result->data == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	result->size = size;
+	result->file_handle = file;
+	result->mapping_handle = mapping;
+	return true;
+}
+#else
+static bool map_file(const mapped_file_desc_t *desc, mapped_file_t *result)
+{
+	bool write = desc->mode == MAPPED_FILE_MODE_SHARED;
+	bool created = false;
+	int fd = open(desc->path, write ? O_RDWR : O_RDONLY);
+	if (fd < 0 && write && errno == ENOENT)
+	{
+		fd = open(desc->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+		created = fd >= 0;
+	}
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	// an existing file holds someone's data, it is only resized when asked to
+	size_t size = desc->size > 0 ? desc->size : (size_t)st.st_size;
+	result->existed = (size_t)st.st_size == size;
+	bool resize = write && !result->existed && (created || desc->resize);
+	if (size == 0 || (!write && (size_t)st.st_size < size) || (write && !result->existed && !resize) ||
+		(resize && ftruncate(fd, (off_t)size) != 0))
+	{
+		close(fd);
+		return false;
+	}
+
+	int prot = desc->mode == MAPPED_FILE_MODE_READ ? PROT_READ : PROT_READ | PROT_WRITE;
+	int flags = write ? MAP_SHARED : MAP_PRIVATE;
+	void *data = mmap(NULL, size, prot, flags, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+
+	result->data = data;
+	result->size = size;
+	result->fd = fd;
+	return true;
+}
+#endif
+
+bool mapped_file_init(const mapped_file_desc_t *desc, mapped_file_t **file)
+{
+	HE_ASSERT(file != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A mapped file description is required");
+	HE_ASSERT(desc->path != NULL, "A path to map is required");
+	HE_ASSERT(desc->mode < MAPPED_FILE_MODE_COUNT__, "Invalid mapping mode");
+
+	mapped_file_t *result = calloc(1, sizeof(mapped_file_t));
+	result->mode = desc->mode;
+
+	if (!map_file(desc, result))
+	{
+		free(result);
+		return false;
+	}
+
+	*file = result;
+	return true;
+}
+
+mapped_file_t *mapped_file_create(const mapped_file_desc_t *desc)
+{
+	mapped_file_t *file;
+	if (!mapped_file_init(desc, &file)) return NULL;
+	return file;
+}
+
+void mapped_file_free(mapped_file_t *file)
+{
+	if (file == NULL) return;
+
+#if defined(_WIN32)
+	UnmapViewOfFile(file->data);
+	CloseHandle((HANDLE)file->mapping_handle);
+	CloseHandle((HANDLE)file->file_handle);
+#else
+	munmap(file->data, file->size);
+	close(file->fd);
+#endif
+
+	free(file);
+}
+
+void mapped_file_advise(mapped_file_t *file, mapped_file_access_t access)
+{
+	HE_ASSERT(file != NULL, "Cannot advise NULL");
+
+#if defined(_WIN32)
+	// windows has no equivalent hint for views of files
+	(void)access;
+#else
+	int advice = POSIX_MADV_NORMAL;
+	switch (access)
+	{
+	default:
+	case MAPPED_FILE_ACCESS_NORMAL:
+		advice = POSIX_MADV_NORMAL;
+		break;
+	case MAPPED_FILE_ACCESS_SEQUENTIAL:
+		advice = POSIX_MADV_SEQUENTIAL;
+		break;
+	case MAPPED_FILE_ACCESS_RANDOM:
+		advice = POSIX_MADV_RANDOM;
+		break;
+	}
+	posix_madvise(file->data, file->size, advice);
+#endif
+}
+
+void mapped_file_sync(mapped_file_t *file)
+{
+	HE_ASSERT(file != NULL, "Cannot sync NULL");
+	if (file->mode != MAPPED_FILE_MODE_SHARED) return;
+
+#if defined(_WIN32)
+	FlushViewOfFile(file->data, 0);
+	FlushFileBuffers((HANDLE)file->file_handle);
+#else
+	msync(file->data, file->size, MS_SYNC);
+#endif
+}
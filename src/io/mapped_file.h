@@ -0,0 +1,62 @@
+#ifndef __io_mapped_file_h__
+#define __io_mapped_file_h__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum mapped_file_mode_t
+{
+	// writes go to the file and are visible to every process mapping it
+	MAPPED_FILE_MODE_SHARED,
+	// writes stay private to this mapping, the file is never modified
+	MAPPED_FILE_MODE_PRIVATE,
+	// read only view of an existing file
+	MAPPED_FILE_MODE_READ,
+	MAPPED_FILE_MODE_COUNT__,
+} mapped_file_mode_t;
+
+typedef enum mapped_file_access_t
+{
+	MAPPED_FILE_ACCESS_NORMAL,
+	MAPPED_FILE_ACCESS_SEQUENTIAL,
+	MAPPED_FILE_ACCESS_RANDOM,
+	MAPPED_FILE_ACCESS_COUNT__,
+} mapped_file_access_t;
+
+typedef struct mapped_file_desc_t
+{
+	const char *path;
+	mapped_file_mode_t mode;
+
+	// size of the mapping, zero maps the whole existing file. a shared file
+	// that does not exist yet is created with this size, an existing one of
+	// another size fails to map unless resize is set
+	size_t size;
+	bool resize;
+} mapped_file_desc_t;
+
+typedef struct mapped_file_t
+{
+	void *data;
+	size_t size;
+	mapped_file_mode_t mode;
+
+	// true if the file already had the requested size before mapping it
+	bool existed;
+
+#if defined(_WIN32)
+	void *file_handle;
+	void *mapping_handle;
+#else
+	int fd;
+#endif
+} mapped_file_t;
+
+bool mapped_file_init(const mapped_file_desc_t *desc, mapped_file_t **file);
+mapped_file_t *mapped_file_create(const mapped_file_desc_t *desc);
+void mapped_file_free(mapped_file_t *file);
+
+void mapped_file_advise(mapped_file_t *file, mapped_file_access_t access);
+void mapped_file_sync(mapped_file_t *file);
+
+#endif /* __io_mapped_file_h__ */
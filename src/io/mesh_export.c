@@ -0,0 +1,535 @@
+#include "mesh_export.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/job.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "io/binary.h"
+
+// encoded bytes a band aims for, a batch holds one band per thread
+#define MESH_EXPORT_BAND_BYTES (1 << 22)
+
+// worst case text of a vertex and its normal, and of a face
+#define OBJ_VERTEX_BOUND (160)
+#define OBJ_TRIANGLE_BOUND (80)
+#define PLY_VERTEX_SIZE (24)
+#define PLY_TRIANGLE_SIZE (13)
+#define GLB_VERTEX_SIZE (24)
+#define GLB_TRIANGLE_SIZE (12)
+
+#define GLB_MAGIC (0x46546C67u)
+#define GLB_CHUNK_JSON (0x4E4F534Au)
+#define GLB_CHUNK_BIN (0x004E4942u)
+#define GLB_HEADER_SIZE (12)
+#define GLB_CHUNK_HEADER_SIZE (8)
+#define GLB_JSON_CAPACITY (4096)
+
+static const char *format_names[MESH_EXPORT_FORMAT_COUNT__] = { "obj", "ply", "glb" };
+
+// the exported grid, vertex i, j sits on sample grid_x(i), grid_z(j)
+typedef struct export_grid_t
+{
+	terrain_t *terrain;
+	mesh_export_format_t format;
+	uint32_t stride;
+	uint32_t w;
+	uint32_t h;
+} export_grid_t;
+
+typedef struct export_band_t
+{
+	const export_grid_t *grid;
+	bool triangles;
+	uint32_t row0;
+	uint32_t row1;
+
+	uint8_t *data;
+	size_t capacity;
+	size_t size;
+	// positions of the band and the rows around it, for the normals
+	vec3 *positions;
+} export_band_t;
+
+typedef struct export_batch_t
+{
+	export_band_t *bands;
+	uint32_t count;
+} export_batch_t;
+
+mesh_export_format_t mesh_export_format_from_path(const char *path)
+{
+	const char *dot = strrchr(path, '.');
+	if (dot == NULL) return MESH_EXPORT_FORMAT_COUNT__;
+
+	char ext[8] = { 0 };
+	for (int i = 0; i < 7 && dot[i + 1] != '\0'; i++)
+	{
+		ext[i] = (char)tolower((unsigned char)dot[i + 1]);
+	}
+
+	for (int format = 0; format < MESH_EXPORT_FORMAT_COUNT__; format++)
+	{
+		if (strcmp(ext, format_names[format]) == 0) return (mesh_export_format_t)format;
+	}
+	return MESH_EXPORT_FORMAT_COUNT__;
+}
+
+const char *mesh_export_format_name(mesh_export_format_t format)
+{
+	return format < MESH_EXPORT_FORMAT_COUNT__ ? format_names[format] : "unknown";
+}
+
+static uint32_t grid_x(const export_grid_t *grid, uint32_t i)
+{
+	return i == grid->w - 1 ? grid->terrain->size.w - 1 : i * grid->stride;
+}
+
+static uint32_t grid_z(const export_grid_t *grid, uint32_t j)
+{
+	return j == grid->h - 1 ? grid->terrain->size.h - 1 : j * grid->stride;
+}
+
+// same arithmetic as terrain_update_mesh, so a full resolution export
+// matches the drawn mesh exactly
+static void grid_position(const export_grid_t *grid, uint32_t i, uint32_t j, vec3 position)
+{
+	terrain_t *terrain = grid->terrain;
+	uint32_t x = grid_x(grid, i);
+	uint32_t z = grid_z(grid, j);
+	position[0] = ((float) x - (terrain->size.w / 2.0f)) * terrain->scale_scalar;
+	position[1] = terrain->height_map[x + (size_t)z * terrain->size.w] * terrain->elevation;
+	position[2] = ((float) z - (terrain->size.h / 2.0f)) * terrain->scale_scalar;
+}
+
+static void add_triangle_normal(vec3 a, vec3 b, vec3 c, vec3 normal)
+{
+	vec3 p, ba, ca;
+	glm_vec3_sub(b, a, ba);
+	glm_vec3_sub(c, a, ca);
+	glm_vec3_cross(ba, ca, p);
+	glm_vec3_add(normal, p, normal);
+}
+
+static char *format_u64(char *dest, uint64_t v)
+{
+	char digits[20];
+	int count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v != 0);
+
+	while (count > 0) *dest++ = digits[--count];
+	return dest;
+}
+
+// six decimals without the trailing zeros, printf is the bottleneck otherwise
+static char *format_float(char *dest, float v)
+{
+	double d = v;
+	if (!(fabs(d) < 1e12)) return dest + sprintf(dest, "%g", d);
+
+	int64_t fixed = llround(d * 1e6);
+	if (fixed < 0)
+	{
+		*dest++ = '-';
+		fixed = -fixed;
+	}
+	dest = format_u64(dest, (uint64_t)fixed / 1000000);
+
+	uint32_t fraction = (uint32_t)((uint64_t)fixed % 1000000);
+	if (fraction == 0) return dest;
+
+	char digits[6];
+	for (int i = 5; i >= 0; i--)
+	{
+		digits[i] = (char)('0' + fraction % 10);
+		fraction /= 10;
+	}
+	int count = 6;
+	while (digits[count - 1] == '0') count--;
+
+	*dest++ = '.';
+	memcpy(dest, digits, count);
+	return dest + count;
+}
+
+static char *format_vec3(char *dest, const char *prefix, vec3 v)
+{
+	size_t len = strlen(prefix);
+	memcpy(dest, prefix, len);
+	dest += len;
+	for (int i = 0; i < 3; i++)
+	{
+		*dest++ = ' ';
+		dest = format_float(dest, v[i]);
+	}
+	*dest++ = '\n';
+	return dest;
+}
+
+static uint8_t *store_vertex(mesh_export_format_t format, uint8_t *dest, vec3 position, vec3 normal)
+{
+	if (format == MESH_EXPORT_FORMAT_OBJ)
+	{
+		char *text = format_vec3((char *)dest, "v", position);
+		return (uint8_t *)format_vec3(text, "vn", normal);
+	}
+
+	// ply and glb share the interleaved layout of terrain_vertex_t
+	for (int i = 0; i < 3; i++) binary_store_f32(dest + 4 * i, position[i]);
+	for (int i = 0; i < 3; i++) binary_store_f32(dest + 12 + 4 * i, normal[i]);
+	return dest + PLY_VERTEX_SIZE;
+}
+
+static uint8_t *store_triangle(mesh_export_format_t format, uint8_t *dest, uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t indices[3] = { a, b, c };
+	switch (format)
+	{
+	case MESH_EXPORT_FORMAT_OBJ:
+	{
+		// obj counts from one, and names the normal of every corner too
+		char *text = (char *)dest;
+		*text++ = 'f';
+		for (int i = 0; i < 3; i++)
+		{
+			*text++ = ' ';
+			text = format_u64(text, (uint64_t)indices[i] + 1);
+			*text++ = '/';
+			*text++ = '/';
+			text = format_u64(text, (uint64_t)indices[i] + 1);
+		}
+		*text++ = '\n';
+		return (uint8_t *)text;
+	}
+	case MESH_EXPORT_FORMAT_PLY:
+		*dest++ = 3;
+		// fall through
+	default:
+		for (int i = 0; i < 3; i++) binary_store_u32(dest + 4 * i, indices[i]);
+		return dest + 12;
+	}
+}
+
+static void encode_vertices(export_band_t *band)
+{
+	const export_grid_t *grid = band->grid;
+	int w = (int)grid->w;
+	int h = (int)grid->h;
+
+	// positions of the band plus one row either side
+	int first = band->row0 > 0 ? (int)band->row0 - 1 : 0;
+	int last = band->row1 < grid->h ? (int)band->row1 + 1 : h;
+	for (int j = first; j < last; j++)
+	{
+		for (int i = 0; i < w; i++) grid_position(grid, (uint32_t)i, (uint32_t)j, band->positions[i + (j - first) * w]);
+	}
+
+	uint8_t *dest = band->data;
+	for (int z = (int)band->row0; z < (int)band->row1; z++)
+	{
+		for (int x = 0; x < w; x++)
+		{
+			// the faces around the vertex in the order terrain_update_mesh
+			// gathers them
+			int v = x + (z - first) * w;
+			vec3 normal = GLM_VEC3_ZERO_INIT;
+			for (int qz = z - 1; qz <= z; qz++)
+			{
+				for (int qx = x - 1; qx <= x; qx++)
+				{
+					if (qx < 0 || qz < 0 || qx >= w - 1 || qz >= h - 1) continue;
+
+					int q = qx + (qz - first) * w;
+					vec3 *p = band->positions;
+					if (v == q || v == q + w || v == q + 1) add_triangle_normal(p[q], p[q + w], p[q + 1], normal);
+					if (v == q + 1 || v == q + w || v == q + w + 1) add_triangle_normal(p[q + 1], p[q + w], p[q + w + 1], normal);
+				}
+			}
+
+			glm_vec3_normalize(normal);
+			dest = store_vertex(grid->format, dest, band->positions[v], normal);
+		}
+	}
+	band->size = (size_t)(dest - band->data);
+}
+
+static void encode_triangles(export_band_t *band)
+{
+	const export_grid_t *grid = band->grid;
+	uint32_t w = grid->w;
+
+	uint8_t *dest = band->data;
+	for (uint32_t z = band->row0; z < band->row1; z++)
+	{
+		for (uint32_t x = 0; x < w - 1; x++)
+		{
+			uint32_t q = x + z * w;
+			dest = store_triangle(grid->format, dest, q, q + w, q + 1);
+			dest = store_triangle(grid->format, dest, q + 1, q + w, q + w + 1);
+		}
+	}
+	band->size = (size_t)(dest - band->data);
+}
+
+static void encode_band(void *user_pointer)
+{
+	export_band_t *band = user_pointer;
+	if (band->triangles) encode_triangles(band);
+	else encode_vertices(band);
+}
+
+static size_t row_bound(const export_grid_t *grid, bool triangles)
+{
+	size_t vertex = grid->format == MESH_EXPORT_FORMAT_OBJ ? OBJ_VERTEX_BOUND : PLY_VERTEX_SIZE;
+	size_t triangle = grid->format == MESH_EXPORT_FORMAT_OBJ ? OBJ_TRIANGLE_BOUND
+		: grid->format == MESH_EXPORT_FORMAT_PLY ? PLY_TRIANGLE_SIZE : GLB_TRIANGLE_SIZE;
+	return triangles ? (size_t)(grid->w - 1) * 2 * triangle : (size_t)grid->w * vertex;
+}
+
+// encodes a batch of bands while the previous batch is written
+static bool write_rows(FILE *file, const export_grid_t *grid, bool triangles, export_batch_t batches[2], uint32_t batch_bands, uint64_t *bytes)
+{
+	uint32_t rows = triangles ? grid->h - 1 : grid->h;
+	size_t bound = row_bound(grid, triangles);
+	uint32_t band_rows = (uint32_t)(MESH_EXPORT_BAND_BYTES / bound);
+	if (band_rows == 0) band_rows = 1;
+	if (band_rows > rows) band_rows = rows;
+
+	job_system_t *jobs = job_system_shared();
+	export_batch_t *encoding = &batches[0];
+	export_batch_t *writing = &batches[1];
+	writing->count = 0;
+
+	bool ok = true;
+	uint32_t next = 0;
+	while (ok && (next < rows || writing->count > 0))
+	{
+		job_group_t group;
+		job_group_init(jobs, &group);
+
+		encoding->count = 0;
+		while (next < rows && encoding->count < batch_bands)
+		{
+			export_band_t *band = &encoding->bands[encoding->count++];
+			band->grid = grid;
+			band->triangles = triangles;
+			band->row0 = next;
+			band->row1 = next + band_rows < rows ? next + band_rows : rows;
+			next = band->row1;
+
+			size_t capacity = (size_t)(band->row1 - band->row0) * bound;
+			if (capacity > band->capacity)
+			{
+				free(band->data);
+				band->data = malloc(capacity);
+				band->capacity = capacity;
+			}
+			job_group_run(&group, encode_band, band);
+		}
+
+		for (uint32_t i = 0; i < writing->count; i++)
+		{
+			ok = ok && fwrite(writing->bands[i].data, 1, writing->bands[i].size, file) == writing->bands[i].size;
+			*bytes += writing->bands[i].size;
+		}
+		job_group_wait(&group);
+
+		export_batch_t *swap = encoding;
+		encoding = writing;
+		writing = swap;
+	}
+	return ok;
+}
+
+static void find_bounds(const export_grid_t *grid, vec3 min, vec3 max)
+{
+	grid_position(grid, 0, 0, min);
+	glm_vec3_copy(min, max);
+
+	for (uint32_t j = 0; j < grid->h; j++)
+	{
+		for (uint32_t i = 0; i < grid->w; i++)
+		{
+			vec3 position;
+			grid_position(grid, i, j, position);
+			for (int k = 0; k < 3; k++)
+			{
+				if (position[k] < min[k]) min[k] = position[k];
+				if (position[k] > max[k]) max[k] = position[k];
+			}
+		}
+	}
+}
+
+static bool write_obj_header(FILE *file, const export_grid_t *grid, uint64_t *bytes)
+{
+	terrain_t *terrain = grid->terrain;
+	int len = fprintf(file, "# terrain %ux%u, every %u samples\no terrain\n", terrain->size.w, terrain->size.h, grid->stride);
+	*bytes += len > 0 ? (uint64_t)len : 0;
+	return len > 0;
+}
+
+static bool write_ply_header(FILE *file, const export_grid_t *grid, uint64_t vertices, uint64_t triangles, uint64_t *bytes)
+{
+	terrain_t *terrain = grid->terrain;
+	int len = fprintf(file,
+		"ply\n"
+		"format binary_little_endian 1.0\n"
+		"comment terrain %ux%u, every %u samples\n"
+		"element vertex %llu\n"
+		"property float x\nproperty float y\nproperty float z\n"
+		"property float nx\nproperty float ny\nproperty float nz\n"
+		"element face %llu\n"
+		"property list uchar uint vertex_indices\n"
+		"end_header\n",
+		terrain->size.w, terrain->size.h, grid->stride, (unsigned long long)vertices, (unsigned long long)triangles);
+	*bytes += len > 0 ? (uint64_t)len : 0;
+	return len > 0;
+}
+
+// the json chunk has to know the accessor bounds, so glb files read the
+// heights once before writing
+static bool write_glb_header(FILE *file, const export_grid_t *grid, uint64_t vertices, uint64_t triangles, uint64_t *bytes)
+{
+	vec3 min, max;
+	find_bounds(grid, min, max);
+
+	uint64_t vertex_bytes = vertices * GLB_VERTEX_SIZE;
+	uint64_t index_bytes = triangles * GLB_TRIANGLE_SIZE;
+	char json[GLB_JSON_CAPACITY];
+	int len = snprintf(json, sizeof(json),
+		"{\"asset\":{\"version\":\"2.0\",\"generator\":\"hydraulic erosion\"},"
+		"\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0,\"name\":\"terrain\"}],"
+		"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"mode\":4}]}],"
+		"\"buffers\":[{\"byteLength\":%llu}],"
+		"\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu,\"byteStride\":%d,\"target\":34962},"
+		"{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34963}],"
+		"\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\","
+		"\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+		"{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+		"{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}]}",
+		(unsigned long long)(vertex_bytes + index_bytes), (unsigned long long)vertex_bytes, GLB_VERTEX_SIZE,
+		(unsigned long long)vertex_bytes, (unsigned long long)index_bytes, (unsigned long long)vertices,
+		min[0], min[1], min[2], max[0], max[1], max[2], (unsigned long long)vertices, (unsigned long long)triangles * 3);
+	if (len < 0 || len >= GLB_JSON_CAPACITY - 3) return false;
+
+	// chunks are 4 byte aligned, json pads with spaces
+	while (len % 4 != 0) json[len++] = ' ';
+
+	uint64_t total = GLB_HEADER_SIZE + 2 * GLB_CHUNK_HEADER_SIZE + (uint64_t)len + vertex_bytes + index_bytes;
+	if (total > UINT32_MAX) return false;
+
+	uint8_t header[GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE];
+	binary_store_u32(header, GLB_MAGIC);
+	binary_store_u32(header + 4, 2);
+	binary_store_u32(header + 8, (uint32_t)total);
+	binary_store_u32(header + 12, (uint32_t)len);
+	binary_store_u32(header + 16, GLB_CHUNK_JSON);
+
+	uint8_t bin[GLB_CHUNK_HEADER_SIZE];
+	binary_store_u32(bin, (uint32_t)(vertex_bytes + index_bytes));
+	binary_store_u32(bin + 4, GLB_CHUNK_BIN);
+
+	*bytes += sizeof(header) + (uint64_t)len + sizeof(bin);
+	bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	ok = ok && fwrite(json, 1, (size_t)len, file) == (size_t)len;
+	return ok && fwrite(bin, 1, sizeof(bin), file) == sizeof(bin);
+}
+
+bool mesh_export(terrain_t *terrain, const mesh_export_desc_t *desc, mesh_export_stats_t *stats)
+{
+	HE_ASSERT(terrain != NULL, "Cannot export NULL terrain");
+	HE_ASSERT(desc != NULL && desc->path != NULL, "A mesh export path is required");
+	HE_ASSERT(desc->format < MESH_EXPORT_FORMAT_COUNT__, "Invalid mesh export format");
+	HE_ASSERT(terrain->size.w >= 2 && terrain->size.h >= 2, "A mesh needs at least 2x2 samples");
+
+	double start = timer_now();
+
+	export_grid_t grid = {
+		.terrain = terrain,
+		.format = desc->format,
+		.stride = desc->stride > 1 ? desc->stride : 1,
+	};
+	grid.w = (terrain->size.w - 1 + grid.stride - 1) / grid.stride + 1;
+	grid.h = (terrain->size.h - 1 + grid.stride - 1) / grid.stride + 1;
+
+	// indices are 32 bit in every format
+	uint64_t vertices = (uint64_t)grid.w * grid.h;
+	uint64_t triangles = (uint64_t)(grid.w - 1) * (grid.h - 1) * 2;
+	if (vertices > UINT32_MAX) return false;
+
+	FILE *file = fopen(desc->path, "wb");
+	if (file == NULL) return false;
+
+	terrain_advise(terrain, TERRAIN_ACCESS_SEQUENTIAL);
+
+	bool ok = false;
+	uint64_t bytes = 0;
+	switch (desc->format)
+	{
+	case MESH_EXPORT_FORMAT_OBJ: ok = write_obj_header(file, &grid, &bytes); break;
+	case MESH_EXPORT_FORMAT_PLY: ok = write_ply_header(file, &grid, vertices, triangles, &bytes); break;
+	case MESH_EXPORT_FORMAT_GLB: ok = write_glb_header(file, &grid, vertices, triangles, &bytes); break;
+	default: break;
+	}
+
+	// one band per thread and batch, two batches in flight
+	uint32_t batch_bands = (uint32_t)job_system_worker_count(job_system_shared()) + 1;
+	export_batch_t batches[2];
+	for (int i = 0; i < 2; i++)
+	{
+		batches[i].bands = calloc(batch_bands, sizeof(export_band_t));
+		batches[i].count = 0;
+	}
+
+	// the vertex bands keep their positions for the normals, sized once
+	uint32_t band_rows = (uint32_t)(MESH_EXPORT_BAND_BYTES / row_bound(&grid, false));
+	if (band_rows == 0) band_rows = 1;
+	if (band_rows > grid.h) band_rows = grid.h;
+	for (int i = 0; i < 2; i++)
+	{
+		for (uint32_t b = 0; b < batch_bands; b++)
+		{
+			batches[i].bands[b].positions = malloc((size_t)(band_rows + 2) * grid.w * sizeof(vec3));
+		}
+	}
+
+	ok = ok && write_rows(file, &grid, false, batches, batch_bands, &bytes);
+	ok = ok && write_rows(file, &grid, true, batches, batch_bands, &bytes);
+
+	for (int i = 0; i < 2; i++)
+	{
+		for (uint32_t b = 0; b < batch_bands; b++)
+		{
+			free(batches[i].bands[b].data);
+			free(batches[i].bands[b].positions);
+		}
+		free(batches[i].bands);
+	}
+	terrain_advise(terrain, TERRAIN_ACCESS_RANDOM);
+
+	ok &= fclose(file) == 0;
+	if (!ok)
+	{
+		remove(desc->path);
+		return false;
+	}
+
+	if (stats != NULL)
+	{
+		stats->grid = (uvec2){ .w = grid.w, .h = grid.h };
+		stats->vertices = vertices;
+		stats->triangles = triangles;
+		stats->bytes = bytes;
+		stats->seconds = timer_now() - start;
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef __io_mesh_export_h__
+#define __io_mesh_export_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "components/terrain.h"
+#include "math/types.h"
+
+// terrain mesh export. the mesh is built straight from the height map with
+// the same positions, normals and triangles as terrain_update_mesh, a band of
+// rows at a time. bands are encoded on the job system while the band before
+// is written, so memory stays bounded by a few bands whatever the map size
+
+typedef enum mesh_export_format_t
+{
+	// wavefront obj, text with positions, normals and faces
+	MESH_EXPORT_FORMAT_OBJ,
+	// binary little endian ply
+	MESH_EXPORT_FORMAT_PLY,
+	// binary gltf 2.0, interleaved vertices and 32 bit indices. limited to
+	// 4 GB, about 8192x8192 vertices
+	MESH_EXPORT_FORMAT_GLB,
+	MESH_EXPORT_FORMAT_COUNT__,
+} mesh_export_format_t;
+
+typedef struct mesh_export_desc_t
+{
+	const char *path;
+	mesh_export_format_t format;
+
+	// keep every stride'th sample in both directions, the last row and column
+	// are always kept. zero or one exports every sample
+	uint32_t stride;
+} mesh_export_desc_t;
+
+typedef struct mesh_export_stats_t
+{
+	uvec2 grid;
+	uint64_t vertices;
+	uint64_t triangles;
+	uint64_t bytes;
+	double seconds;
+} mesh_export_stats_t;
+
+// .obj, .ply and .glb. MESH_EXPORT_FORMAT_COUNT__ for anything else
+mesh_export_format_t mesh_export_format_from_path(const char *path);
+const char *mesh_export_format_name(mesh_export_format_t format);
+
+// false if the file cannot be written or the mesh is too large for the
+// format, the file is removed then. stats may be NULL
+bool mesh_export(terrain_t *terrain, const mesh_export_desc_t *desc, mesh_export_stats_t *stats);
+
+#endif /* __io_mesh_export_h__ */
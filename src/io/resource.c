@@ -0,0 +1,81 @@
+#include "resource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug/assert.h"
+
+#define RESOURCE_MAX_PATH (512)
+
+#if defined(HE_EMBED_RESOURCES)
+// generated at configure time, see EMBED_RESOURCES in CMakeLists.txt
+extern const resource_embedded_t resource_embedded[];
+extern const size_t resource_embedded_count;
+#endif
+
+static const resource_embedded_t *find_embedded(const char *name)
+{
+#if defined(HE_EMBED_RESOURCES)
+	for (size_t i = 0; i < resource_embedded_count; i++)
+	{
+		if (strcmp(resource_embedded[i].name, name) == 0) return &resource_embedded[i];
+	}
+#else
+	(void)name;
+#endif
+	return NULL;
+}
+
+bool resource_init(const resource_desc_t *desc, resource_t **resource)
+{
+	HE_ASSERT(resource != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A resource description is required");
+	HE_ASSERT(desc->name != NULL, "A resource name is required");
+
+	resource_t *result = calloc(1, sizeof(resource_t));
+
+	const resource_embedded_t *embedded = find_embedded(desc->name);
+	if (embedded != NULL)
+	{
+		result->data = (const char *)embedded->data;
+		result->size = embedded->size;
+		*resource = result;
+		return true;
+	}
+
+	char path[RESOURCE_MAX_PATH];
+	int len = snprintf(path, sizeof(path), RESOURCE_DIRECTORY "%s", desc->name);
+	if (len > 0 && len < (int)sizeof(path))
+	{
+		result->mapping = mapped_file_create(&(mapped_file_desc_t){
+			.path = path,
+			.mode = MAPPED_FILE_MODE_READ,
+		});
+	}
+	if (result->mapping == NULL)
+	{
+		free(result);
+		return false;
+	}
+
+	result->data = result->mapping->data;
+	result->size = result->mapping->size;
+	*resource = result;
+	return true;
+}
+
+resource_t *resource_create(const resource_desc_t *desc)
+{
+	resource_t *resource;
+	if (!resource_init(desc, &resource)) return NULL;
+	return resource;
+}
+
+void resource_free(resource_t *resource)
+{
+	if (resource == NULL) return;
+
+	mapped_file_free(resource->mapping);
+	free(resource);
+}
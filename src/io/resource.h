@@ -0,0 +1,44 @@
+#ifndef __io_resource_h__
+#define __io_resource_h__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "io/mapped_file.h"
+
+// read only program resources, named by their path below res/. builds with
+// EMBED_RESOURCES compile them into the binary and hand out views of that
+// copy, so nothing depends on the working directory. anything not embedded is
+// memory mapped from res/ instead. either way the data is never copied
+
+#define RESOURCE_DIRECTORY "res/"
+
+// one entry of the table the build generates from the resource list
+typedef struct resource_embedded_t
+{
+	const char *name;
+	const unsigned char *data;
+	size_t size;
+} resource_embedded_t;
+
+typedef struct resource_desc_t
+{
+	const char *name;
+} resource_desc_t;
+
+typedef struct resource_t
+{
+	// not null terminated
+	const char *data;
+	size_t size;
+
+	// only set for resources mapped from disk
+	mapped_file_t *mapping;
+} resource_t;
+
+// false if the resource is neither embedded nor found in res/
+bool resource_init(const resource_desc_t *desc, resource_t **resource);
+resource_t *resource_create(const resource_desc_t *desc);
+void resource_free(resource_t *resource);
+
+#endif /* __io_resource_h__ */
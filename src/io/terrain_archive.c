@@ -0,0 +1,653 @@
+#if !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "terrain_archive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/crc32.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "io/binary.h"
+
+#define TERRAIN_ARCHIVE_HEADER_SIZE (128)
+#define TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE (16)
+#define TERRAIN_ARCHIVE_TILE_ENTRY_SIZE (24)
+#define TERRAIN_ARCHIVE_ALIGNMENT (4096)
+#define TERRAIN_ARCHIVE_MAX_LEVELS (32)
+#define TERRAIN_ARCHIVE_FILE_BUFFER (1 << 20)
+
+// header layout, everything little endian. the crc covers the header up to
+// itself and both tables
+#define HEADER_MAGIC (0)
+#define HEADER_VERSION (4)
+#define HEADER_WIDTH (8)
+#define HEADER_HEIGHT (12)
+#define HEADER_TILE_SIZE (16)
+#define HEADER_LEVEL_COUNT (20)
+#define HEADER_TILE_COUNT (24)
+#define HEADER_TERRAIN_SEED (28)
+#define HEADER_SCALE (32)
+#define HEADER_ELEVATION (36)
+#define HEADER_MIN_HEIGHT (40)
+#define HEADER_MAX_HEIGHT (44)
+#define HEADER_EROSION_SEED (48)
+#define HEADER_DROPS (56)
+#define HEADER_PARAMS (64)
+#define HEADER_DATA_OFFSET (112)
+#define HEADER_CRC (124)
+
+static size_t tile_floats(uint32_t tile_size)
+{
+	return (size_t)tile_size * tile_size;
+}
+
+static uint32_t plan_levels(uvec2 size, uint32_t tile_size, terrain_archive_level_t *levels)
+{
+	uint32_t count = 0;
+	uint32_t first_tile = 0;
+	while (count < TERRAIN_ARCHIVE_MAX_LEVELS)
+	{
+		terrain_archive_level_t *level = &levels[count++];
+		level->size = size;
+		level->tiles.w = (size.w + tile_size - 1) / tile_size;
+		level->tiles.h = (size.h + tile_size - 1) / tile_size;
+		level->first_tile = first_tile;
+		first_tile += level->tiles.w * level->tiles.h;
+
+		if (size.w <= tile_size && size.h <= tile_size) break;
+		size.w = (size.w + 1) / 2;
+		size.h = (size.h + 1) / 2;
+	}
+	return count;
+}
+
+static void store_params(uint8_t *dest, const erosion_desc_t *p)
+{
+	binary_store_u32(dest + 0, (uint32_t)p->drop_lifetime);
+	binary_store_f32(dest + 4, p->inertia);
+	binary_store_f32(dest + 8, p->capacity);
+	binary_store_f32(dest + 12, p->min_capacity);
+	binary_store_f32(dest + 16, p->deposition);
+	binary_store_f32(dest + 20, p->erosion);
+	binary_store_u32(dest + 24, (uint32_t)p->radius);
+	binary_store_f32(dest + 28, p->gravity);
+	binary_store_f32(dest + 32, p->evaporation);
+	binary_store_f32(dest + 36, p->min_water);
+	binary_store_f32(dest + 40, p->min_velocity);
+	binary_store_u32(dest + 44, (uint32_t)p->max_pit_steps);
+}
+
+static void load_params(const uint8_t *src, erosion_desc_t *p)
+{
+	p->drop_lifetime = (int)binary_load_u32(src + 0);
+	p->inertia = binary_load_f32(src + 4);
+	p->capacity = binary_load_f32(src + 8);
+	p->min_capacity = binary_load_f32(src + 12);
+	p->deposition = binary_load_f32(src + 16);
+	p->erosion = binary_load_f32(src + 20);
+	p->radius = (int)binary_load_u32(src + 24);
+	p->gravity = binary_load_f32(src + 28);
+	p->evaporation = binary_load_f32(src + 32);
+	p->min_water = binary_load_f32(src + 36);
+	p->min_velocity = binary_load_f32(src + 40);
+	p->max_pit_steps = (int)binary_load_u32(src + 44);
+}
+
+// 2x2 box filter, the last row and column repeat on odd sizes
+static void downsample(const float *src, uvec2 src_size, float *dest, uvec2 size)
+{
+	for (uint32_t y = 0; y < size.h; y++)
+	{
+		const float *row0 = src + (size_t)(2 * y) * src_size.w;
+		const float *row1 = 2 * y + 1 < src_size.h ? row0 + src_size.w : row0;
+		for (uint32_t x = 0; x < size.w; x++)
+		{
+			uint32_t x0 = 2 * x;
+			uint32_t x1 = x0 + 1 < src_size.w ? x0 + 1 : x0;
+			dest[(size_t)y * size.w + x] = 0.25f * (row0[x0] + row0[x1] + row1[x0] + row1[x1]);
+		}
+	}
+}
+
+// copies one tile out of a level, clamping at the edges, and returns its range
+// of the real cells
+static void pack_tile(const float *heights, uvec2 size, uint32_t tile_size, uint32_t tx, uint32_t ty, float *tile, float *min, float *max)
+{
+	uint32_t x0 = tx * tile_size;
+	uint32_t y0 = ty * tile_size;
+	*min = heights[(size_t)y0 * size.w + x0];
+	*max = *min;
+
+	for (uint32_t y = 0; y < tile_size; y++)
+	{
+		uint32_t sy = y0 + y < size.h ? y0 + y : size.h - 1;
+		const float *row = heights + (size_t)sy * size.w;
+		for (uint32_t x = 0; x < tile_size; x++)
+		{
+			uint32_t sx = x0 + x < size.w ? x0 + x : size.w - 1;
+			float h = row[sx];
+			tile[(size_t)y * tile_size + x] = h;
+			if (h < *min) *min = h;
+			if (h > *max) *max = h;
+		}
+	}
+}
+
+static bool write_archive(const char *path, const terrain_archive_data_t *data, uint32_t tile_size)
+{
+	terrain_archive_level_t levels[TERRAIN_ARCHIVE_MAX_LEVELS];
+	uint32_t level_count = plan_levels(data->size, tile_size, levels);
+	uint32_t tile_count = levels[level_count - 1].first_tile + 1;
+
+	size_t tables_end = TERRAIN_ARCHIVE_HEADER_SIZE + (size_t)level_count * TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE
+		+ (size_t)tile_count * TERRAIN_ARCHIVE_TILE_ENTRY_SIZE;
+	size_t data_offset = (tables_end + TERRAIN_ARCHIVE_ALIGNMENT - 1) / TERRAIN_ARCHIVE_ALIGNMENT * TERRAIN_ARCHIVE_ALIGNMENT;
+	size_t tile_bytes = tile_floats(tile_size) * sizeof(float);
+
+	// write next to the target and rename, like checkpoints
+	size_t tmp_len = strlen(path) + 5;
+	char *tmp_path = malloc(tmp_len);
+	snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+	FILE *file = fopen(tmp_path, "wb");
+	if (file == NULL)
+	{
+		free(tmp_path);
+		return false;
+	}
+	setvbuf(file, NULL, _IOFBF, TERRAIN_ARCHIVE_FILE_BUFFER);
+
+	// header and tables are filled in as the tiles go out, the space for
+	// them is reserved first
+	uint8_t *head = calloc(data_offset, 1);
+	bool ok = fwrite(head, 1, data_offset, file) == data_offset;
+
+	float *tile = malloc(tile_bytes);
+	const float *heights = data->heights;
+	float *level_heights = NULL;
+	uint64_t offset = data_offset;
+	float min_height = 0.0f, max_height = 0.0f;
+
+	for (uint32_t l = 0; ok && l < level_count; l++)
+	{
+		const terrain_archive_level_t *level = &levels[l];
+		if (l > 0)
+		{
+			// only the level being written and the one it came from are alive
+			float *next = malloc((size_t)level->size.w * level->size.h * sizeof(float));
+			downsample(heights, levels[l - 1].size, next, level->size);
+			free(level_heights);
+			level_heights = next;
+			heights = next;
+		}
+
+		uint8_t *level_entry = head + TERRAIN_ARCHIVE_HEADER_SIZE + (size_t)l * TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE;
+		binary_store_u32(level_entry, level->size.w);
+		binary_store_u32(level_entry + 4, level->size.h);
+		binary_store_u32(level_entry + 8, level->first_tile);
+
+		for (uint32_t ty = 0; ok && ty < level->tiles.h; ty++)
+		{
+			for (uint32_t tx = 0; ok && tx < level->tiles.w; tx++)
+			{
+				float min, max;
+				pack_tile(heights, level->size, tile_size, tx, ty, tile, &min, &max);
+				if (l == 0)
+				{
+					bool first = tx == 0 && ty == 0;
+					if (first || min < min_height) min_height = min;
+					if (first || max > max_height) max_height = max;
+				}
+
+				if (!binary_host_is_little_endian())
+				{
+					for (size_t i = 0; i < tile_floats(tile_size); i++)
+					{
+						binary_store_f32((uint8_t *)&tile[i], tile[i]);
+					}
+				}
+
+				uint32_t index = level->first_tile + ty * level->tiles.w + tx;
+				uint8_t *entry = head + TERRAIN_ARCHIVE_HEADER_SIZE + (size_t)level_count * TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE
+					+ (size_t)index * TERRAIN_ARCHIVE_TILE_ENTRY_SIZE;
+				binary_store_u64(entry, offset);
+				binary_store_f32(entry + 8, min);
+				binary_store_f32(entry + 12, max);
+				binary_store_u32(entry + 16, crc32_update(CRC32_INIT, tile, tile_bytes));
+
+				ok = fwrite(tile, 1, tile_bytes, file) == tile_bytes;
+				offset += tile_bytes;
+			}
+		}
+	}
+	free(level_heights);
+	free(tile);
+
+	memcpy(head + HEADER_MAGIC, TERRAIN_ARCHIVE_MAGIC, 4);
+	binary_store_u32(head + HEADER_VERSION, TERRAIN_ARCHIVE_VERSION);
+	binary_store_u32(head + HEADER_WIDTH, data->size.w);
+	binary_store_u32(head + HEADER_HEIGHT, data->size.h);
+	binary_store_u32(head + HEADER_TILE_SIZE, tile_size);
+	binary_store_u32(head + HEADER_LEVEL_COUNT, level_count);
+	binary_store_u32(head + HEADER_TILE_COUNT, tile_count);
+	binary_store_u32(head + HEADER_TERRAIN_SEED, (uint32_t)data->terrain_seed);
+	binary_store_f32(head + HEADER_SCALE, data->scale_scalar);
+	binary_store_f32(head + HEADER_ELEVATION, data->elevation);
+	binary_store_f32(head + HEADER_MIN_HEIGHT, min_height);
+	binary_store_f32(head + HEADER_MAX_HEIGHT, max_height);
+	binary_store_u32(head + HEADER_EROSION_SEED, data->erosion_seed);
+	binary_store_u64(head + HEADER_DROPS, data->drops);
+	store_params(head + HEADER_PARAMS, &data->params);
+	binary_store_u64(head + HEADER_DATA_OFFSET, data_offset);
+
+	uint32_t crc = crc32_update(CRC32_INIT, head, HEADER_CRC);
+	crc = crc32_update(crc, head + TERRAIN_ARCHIVE_HEADER_SIZE, tables_end - TERRAIN_ARCHIVE_HEADER_SIZE);
+	binary_store_u32(head + HEADER_CRC, crc);
+
+	ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(head, 1, tables_end, file) == tables_end;
+	ok &= fclose(file) == 0;
+	free(head);
+
+	if (ok)
+	{
+		remove(path);
+		ok = rename(tmp_path, path) == 0;
+	}
+	else
+	{
+		remove(tmp_path);
+	}
+
+	free(tmp_path);
+	return ok;
+}
+
+static void fill_data(terrain_archive_data_t *data, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state)
+{
+	data->size = terrain->size;
+	data->terrain_seed = terrain->seed;
+	data->scale_scalar = terrain->scale_scalar;
+	data->elevation = terrain->elevation;
+	data->params = *params;
+	data->erosion_seed = state->seed;
+	data->drops = state->next_drop;
+}
+
+bool terrain_archive_save(const char *path, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state, uint32_t tile_size)
+{
+	HE_ASSERT(path != NULL, "An archive path is required");
+	HE_ASSERT(terrain != NULL, "Cannot save NULL terrain");
+	HE_ASSERT(tile_size >= 16 && (tile_size & (tile_size - 1)) == 0, "Archive tiles must be a power of two of at least 16");
+
+	terrain_archive_data_t data;
+	fill_data(&data, terrain, params, state);
+	data.heights = terrain->height_map;
+	return write_archive(path, &data, tile_size);
+}
+
+static bool read_archive(terrain_archive_t *archive)
+{
+	const uint8_t *bytes = archive->mapping->data;
+	size_t file_size = archive->mapping->size;
+	if (file_size < TERRAIN_ARCHIVE_HEADER_SIZE) return false;
+	if (memcmp(bytes + HEADER_MAGIC, TERRAIN_ARCHIVE_MAGIC, 4) != 0 || binary_load_u32(bytes + HEADER_VERSION) != TERRAIN_ARCHIVE_VERSION) return false;
+
+	archive->size.w = binary_load_u32(bytes + HEADER_WIDTH);
+	archive->size.h = binary_load_u32(bytes + HEADER_HEIGHT);
+	archive->tile_size = binary_load_u32(bytes + HEADER_TILE_SIZE);
+	archive->level_count = binary_load_u32(bytes + HEADER_LEVEL_COUNT);
+	archive->tile_count = binary_load_u32(bytes + HEADER_TILE_COUNT);
+	if (archive->size.w < 2 || archive->size.h < 2 || archive->tile_size < 16 || (archive->tile_size & (archive->tile_size - 1)) != 0) return false;
+
+	// the tables follow from the size, anything else is a broken file
+	terrain_archive_level_t levels[TERRAIN_ARCHIVE_MAX_LEVELS];
+	uint32_t level_count = plan_levels(archive->size, archive->tile_size, levels);
+	if (level_count != archive->level_count || levels[level_count - 1].first_tile + 1 != archive->tile_count) return false;
+
+	size_t tables_end = TERRAIN_ARCHIVE_HEADER_SIZE + (size_t)level_count * TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE
+		+ (size_t)archive->tile_count * TERRAIN_ARCHIVE_TILE_ENTRY_SIZE;
+	size_t tile_bytes = tile_floats(archive->tile_size) * sizeof(float);
+	if (file_size < tables_end + tile_bytes) return false;
+
+	uint32_t crc = crc32_update(CRC32_INIT, bytes, HEADER_CRC);
+	crc = crc32_update(crc, bytes + TERRAIN_ARCHIVE_HEADER_SIZE, tables_end - TERRAIN_ARCHIVE_HEADER_SIZE);
+	if (crc != binary_load_u32(bytes + HEADER_CRC)) return false;
+
+	archive->terrain_seed = (int)binary_load_u32(bytes + HEADER_TERRAIN_SEED);
+	archive->scale_scalar = binary_load_f32(bytes + HEADER_SCALE);
+	archive->elevation = binary_load_f32(bytes + HEADER_ELEVATION);
+	archive->min_height = binary_load_f32(bytes + HEADER_MIN_HEIGHT);
+	archive->max_height = binary_load_f32(bytes + HEADER_MAX_HEIGHT);
+	archive->erosion_seed = binary_load_u32(bytes + HEADER_EROSION_SEED);
+	archive->drops = binary_load_u64(bytes + HEADER_DROPS);
+	load_params(bytes + HEADER_PARAMS, &archive->params);
+
+	archive->levels = malloc(level_count * sizeof(terrain_archive_level_t));
+	memcpy(archive->levels, levels, level_count * sizeof(terrain_archive_level_t));
+	for (uint32_t l = 0; l < level_count; l++)
+	{
+		const uint8_t *entry = bytes + TERRAIN_ARCHIVE_HEADER_SIZE + (size_t)l * TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE;
+		if (binary_load_u32(entry) != levels[l].size.w || binary_load_u32(entry + 4) != levels[l].size.h) return false;
+	}
+
+	archive->tiles = malloc(archive->tile_count * sizeof(terrain_archive_tile_t));
+	for (uint32_t i = 0; i < archive->tile_count; i++)
+	{
+		const uint8_t *entry = bytes + TERRAIN_ARCHIVE_HEADER_SIZE + (size_t)level_count * TERRAIN_ARCHIVE_LEVEL_ENTRY_SIZE
+			+ (size_t)i * TERRAIN_ARCHIVE_TILE_ENTRY_SIZE;
+		terrain_archive_tile_t *tile = &archive->tiles[i];
+		tile->offset = binary_load_u64(entry);
+		tile->min_height = binary_load_f32(entry + 8);
+		tile->max_height = binary_load_f32(entry + 12);
+		tile->crc = binary_load_u32(entry + 16);
+		if (tile->offset % sizeof(float) != 0 || tile->offset < tables_end || tile->offset > file_size - tile_bytes) return false;
+	}
+	return true;
+}
+
+bool terrain_archive_init(const terrain_archive_desc_t *desc, terrain_archive_t **archive)
+{
+	HE_ASSERT(archive != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "An archive description is required");
+	HE_ASSERT(desc->path != NULL, "An archive path is required");
+
+	terrain_archive_t *result = calloc(1, sizeof(terrain_archive_t));
+	result->mapping = mapped_file_create(&(mapped_file_desc_t){
+		.path = desc->path,
+		.mode = MAPPED_FILE_MODE_READ,
+	});
+
+	bool ok = result->mapping != NULL && read_archive(result);
+	if (ok)
+	{
+		// tiles are fetched in no particular order
+		mapped_file_advise(result->mapping, MAPPED_FILE_ACCESS_RANDOM);
+	}
+	for (uint32_t l = 0; ok && desc->verify && l < result->level_count; l++)
+	{
+		const terrain_archive_level_t *level = &result->levels[l];
+		for (uint32_t i = 0; ok && i < level->tiles.w * level->tiles.h; i++)
+		{
+			ok = terrain_archive_verify_tile(result, l, i % level->tiles.w, i / level->tiles.w);
+		}
+	}
+
+	if (!ok)
+	{
+		terrain_archive_free(result);
+		*archive = NULL;
+		return false;
+	}
+
+	*archive = result;
+	return true;
+}
+
+terrain_archive_t *terrain_archive_create(const terrain_archive_desc_t *desc)
+{
+	terrain_archive_t *archive;
+	terrain_archive_init(desc, &archive);
+	return archive;
+}
+
+void terrain_archive_free(terrain_archive_t *archive)
+{
+	if (archive == NULL) return;
+	mapped_file_free(archive->mapping);
+	free(archive->levels);
+	free(archive->tiles);
+	free(archive);
+}
+
+const terrain_archive_tile_t *terrain_archive_tile(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	HE_ASSERT(archive != NULL, "Cannot look up tiles of NULL");
+	HE_ASSERT(level < archive->level_count, "Archive level out of range");
+	HE_ASSERT(tx < archive->levels[level].tiles.w && ty < archive->levels[level].tiles.h, "Archive tile out of range");
+
+	return &archive->tiles[archive->levels[level].first_tile + ty * archive->levels[level].tiles.w + tx];
+}
+
+static const uint8_t *tile_bytes_of(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	return (const uint8_t *)archive->mapping->data + terrain_archive_tile(archive, level, tx, ty)->offset;
+}
+
+const float *terrain_archive_tile_data(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	if (!binary_host_is_little_endian()) return NULL;
+	return (const float *)tile_bytes_of(archive, level, tx, ty);
+}
+
+bool terrain_archive_verify_tile(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	size_t tile_bytes = tile_floats(archive->tile_size) * sizeof(float);
+	return crc32_update(CRC32_INIT, tile_bytes_of(archive, level, tx, ty), tile_bytes) == terrain_archive_tile(archive, level, tx, ty)->crc;
+}
+
+static bool resolve_region(terrain_archive_t *archive, const terrain_archive_region_t *region, terrain_archive_region_t *out)
+{
+	if (region->level >= archive->level_count) return false;
+
+	uvec2 size = archive->levels[region->level].size;
+	*out = *region;
+	if (region->w == 0 || region->h == 0)
+	{
+		*out = (terrain_archive_region_t){ .level = region->level, .w = size.w, .h = size.h };
+	}
+	return out->x < size.w && out->y < size.h && out->w <= size.w - out->x && out->h <= size.h - out->y;
+}
+
+bool terrain_archive_read_region(terrain_archive_t *archive, const terrain_archive_region_t *region, float *dest)
+{
+	HE_ASSERT(archive != NULL, "Cannot read from NULL");
+	HE_ASSERT(region != NULL, "A region is required");
+
+	terrain_archive_region_t r;
+	if (!resolve_region(archive, region, &r)) return false;
+
+	uint32_t ts = archive->tile_size;
+	bool little_endian = binary_host_is_little_endian();
+
+	// only the tiles under the region are touched, each one checked once
+	for (uint32_t ty = r.y / ts; ty <= (r.y + r.h - 1) / ts; ty++)
+	{
+		for (uint32_t tx = r.x / ts; tx <= (r.x + r.w - 1) / ts; tx++)
+		{
+			if (!terrain_archive_verify_tile(archive, r.level, tx, ty)) return false;
+
+			const uint8_t *tile = tile_bytes_of(archive, r.level, tx, ty);
+			uint32_t x0 = tx * ts > r.x ? tx * ts : r.x;
+			uint32_t y0 = ty * ts > r.y ? ty * ts : r.y;
+			uint32_t x1 = (tx + 1) * ts < r.x + r.w ? (tx + 1) * ts : r.x + r.w;
+			uint32_t y1 = (ty + 1) * ts < r.y + r.h ? (ty + 1) * ts : r.y + r.h;
+
+			for (uint32_t y = y0; y < y1; y++)
+			{
+				const uint8_t *src = tile + (((size_t)(y - ty * ts) * ts) + (x0 - tx * ts)) * sizeof(float);
+				float *row = dest + (size_t)(y - r.y) * r.w + (x0 - r.x);
+				if (little_endian)
+				{
+					memcpy(row, src, (size_t)(x1 - x0) * sizeof(float));
+					continue;
+				}
+				for (uint32_t x = 0; x < x1 - x0; x++)
+				{
+					row[x] = binary_load_f32(src + x * sizeof(float));
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool terrain_archive_load(terrain_archive_t *archive, const terrain_archive_region_t *region, terrain_t *terrain)
+{
+	HE_ASSERT(archive != NULL, "Cannot load from NULL");
+	HE_ASSERT(terrain != NULL, "Cannot load into NULL terrain");
+
+	terrain_archive_region_t r;
+	if (!resolve_region(archive, region, &r) || r.w < 2 || r.h < 2) return false;
+
+	// read aside so a tile failing its crc leaves the terrain as it was
+	uvec2 size = { .w = r.w, .h = r.h };
+	size_t bytes = (size_t)r.w * r.h * sizeof(float);
+	float *heights = malloc(bytes);
+	bool ok = heights != NULL && terrain_archive_read_region(archive, &r, heights);
+	if (ok && terrain->storage == TERRAIN_STORAGE_HEAP)
+	{
+		free(terrain->height_map);
+		terrain->height_map = heights;
+		terrain->size = size;
+		heights = NULL;
+	}
+	else if (ok)
+	{
+		ok = terrain_allocate(terrain, size);
+		if (ok) memcpy(terrain->height_map, heights, bytes);
+	}
+	free(heights);
+	if (!ok) return false;
+
+	terrain->seed = archive->terrain_seed;
+	terrain->scale_scalar = archive->scale_scalar;
+	terrain->elevation = archive->elevation;
+	terrain_update_mesh(terrain);
+	return true;
+}
+
+static void writer_thread(void *user_pointer)
+{
+	terrain_archive_writer_t *writer = (terrain_archive_writer_t *)user_pointer;
+
+	mutex_lock(writer->mutex);
+	while (true)
+	{
+		while (!writer->pending && !writer->quit)
+		{
+			cond_wait(writer->wake, writer->mutex);
+		}
+		if (!writer->pending) break;
+
+		// the snapshot belongs to this thread until pending is cleared
+		mutex_unlock(writer->mutex);
+		double start = timer_now();
+		bool ok = write_archive(writer->path, &writer->snapshot, writer->tile_size);
+		double seconds = timer_now() - start;
+		mutex_lock(writer->mutex);
+
+		if (ok) writer->written++;
+		else writer->failed++;
+		writer->write_seconds += seconds;
+		writer->pending = false;
+		cond_broadcast(writer->done);
+	}
+	mutex_unlock(writer->mutex);
+}
+
+void terrain_archive_writer_init(const terrain_archive_writer_desc_t *desc, terrain_archive_writer_t **writer)
+{
+	HE_ASSERT(writer != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "An archive writer description is required");
+	HE_ASSERT(desc->path != NULL, "An archive path is required");
+
+	terrain_archive_writer_t *result = calloc(1, sizeof(terrain_archive_writer_t));
+
+	size_t path_len = strlen(desc->path) + 1;
+	result->path = malloc(path_len);
+	memcpy(result->path, desc->path, path_len);
+
+	result->tile_size = desc->tile_size > 0 ? desc->tile_size : TERRAIN_ARCHIVE_DEFAULT_TILE_SIZE;
+	HE_ASSERT(result->tile_size >= 16 && (result->tile_size & (result->tile_size - 1)) == 0, "Archive tiles must be a power of two of at least 16");
+
+	result->mutex = mutex_create();
+	result->wake = cond_create();
+	result->done = cond_create();
+	result->thread = thread_create(writer_thread, result);
+
+	*writer = result;
+}
+
+terrain_archive_writer_t *terrain_archive_writer_create(const terrain_archive_writer_desc_t *desc)
+{
+	terrain_archive_writer_t *writer;
+	terrain_archive_writer_init(desc, &writer);
+	return writer;
+}
+
+void terrain_archive_writer_free(terrain_archive_writer_t *writer)
+{
+	if (writer == NULL) return;
+
+	// finish the pending archive before shutting down
+	mutex_lock(writer->mutex);
+	writer->quit = true;
+	cond_signal(writer->wake);
+	mutex_unlock(writer->mutex);
+
+	thread_join(writer->thread);
+	cond_free(writer->done);
+	cond_free(writer->wake);
+	mutex_free(writer->mutex);
+	free(writer->snapshot.heights);
+	free(writer->path);
+	free(writer);
+}
+
+bool terrain_archive_writer_submit(terrain_archive_writer_t *writer, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state)
+{
+	HE_ASSERT(writer != NULL, "Cannot submit to NULL");
+
+	mutex_lock(writer->mutex);
+	if (writer->pending)
+	{
+		writer->skipped++;
+		mutex_unlock(writer->mutex);
+		return false;
+	}
+	mutex_unlock(writer->mutex);
+
+	// the writer thread is idle, so the snapshot can be refilled without the lock
+	size_t count = (size_t)terrain->size.w * terrain->size.h;
+	if (count > writer->snapshot_capacity)
+	{
+		free(writer->snapshot.heights);
+		writer->snapshot.heights = malloc(count * sizeof(float));
+		writer->snapshot_capacity = count;
+	}
+	fill_data(&writer->snapshot, terrain, params, state);
+	memcpy(writer->snapshot.heights, terrain->height_map, count * sizeof(float));
+
+	mutex_lock(writer->mutex);
+	writer->pending = true;
+	cond_signal(writer->wake);
+	mutex_unlock(writer->mutex);
+
+	return true;
+}
+
+bool terrain_archive_writer_busy(terrain_archive_writer_t *writer)
+{
+	HE_ASSERT(writer != NULL, "Cannot query NULL");
+
+	mutex_lock(writer->mutex);
+	bool pending = writer->pending;
+	mutex_unlock(writer->mutex);
+	return pending;
+}
+
+void terrain_archive_writer_flush(terrain_archive_writer_t *writer)
+{
+	HE_ASSERT(writer != NULL, "Cannot flush NULL");
+
+	mutex_lock(writer->mutex);
+	while (writer->pending)
+	{
+		cond_wait(writer->done, writer->mutex);
+	}
+	mutex_unlock(writer->mutex);
+}
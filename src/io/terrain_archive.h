@@ -0,0 +1,156 @@
+#ifndef __io_terrain_archive_h__
+#define __io_terrain_archive_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "components/terrain.h"
+#include "core/thread.h"
+#include "io/mapped_file.h"
+#include "math/types.h"
+#include "erosion.h"
+
+// native terrain container. a fixed header with the terrain and erosion
+// settings, a level table and a tile table, then square tiles of raw little
+// endian floats for every level of a mip pyramid. level 0 is the full map,
+// every further level halves it until a single tile covers it. the tile data
+// starts on a 4 KiB boundary and tiles follow back to back, so with 4 KiB
+// pages tiles of 32 and up start page aligned while smaller ones share pages.
+// every tile carries its own min, max and crc32, so the file is mapped and any
+// tile of any level is reached without reading the rest
+
+#define TERRAIN_ARCHIVE_MAGIC "HETA"
+#define TERRAIN_ARCHIVE_VERSION (1)
+#define TERRAIN_ARCHIVE_EXTENSION ".hta"
+#define TERRAIN_ARCHIVE_DEFAULT_TILE_SIZE (256)
+
+typedef struct terrain_archive_level_t
+{
+	uvec2 size;
+	uvec2 tiles;
+	uint32_t first_tile;
+} terrain_archive_level_t;
+
+typedef struct terrain_archive_tile_t
+{
+	uint64_t offset;
+	float min_height;
+	float max_height;
+	uint32_t crc;
+} terrain_archive_tile_t;
+
+typedef struct terrain_archive_desc_t
+{
+	const char *path;
+
+	// check every tile against its crc up front, otherwise tiles are only
+	// checked when loaded into a terrain
+	bool verify;
+} terrain_archive_desc_t;
+
+typedef struct terrain_archive_t
+{
+	mapped_file_t *mapping;
+
+	uvec2 size;
+	uint32_t tile_size;
+	int terrain_seed;
+	float scale_scalar;
+	float elevation;
+	float min_height;
+	float max_height;
+
+	// the erosion that produced the heights
+	erosion_desc_t params;
+	uint32_t erosion_seed;
+	uint64_t drops;
+
+	uint32_t level_count;
+	terrain_archive_level_t *levels;
+	uint32_t tile_count;
+	terrain_archive_tile_t *tiles;
+} terrain_archive_t;
+
+// a rectangle of one level, a zero width or height means the whole level
+typedef struct terrain_archive_region_t
+{
+	uint32_t level;
+	uint32_t x;
+	uint32_t y;
+	uint32_t w;
+	uint32_t h;
+} terrain_archive_region_t;
+
+bool terrain_archive_save(const char *path, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state, uint32_t tile_size);
+
+bool terrain_archive_init(const terrain_archive_desc_t *desc, terrain_archive_t **archive);
+terrain_archive_t *terrain_archive_create(const terrain_archive_desc_t *desc);
+void terrain_archive_free(terrain_archive_t *archive);
+
+const terrain_archive_tile_t *terrain_archive_tile(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty);
+// tile_size * tile_size floats straight from the mapping, edges padded with
+// the last row and column. NULL on big endian hosts, read a region there
+const float *terrain_archive_tile_data(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty);
+bool terrain_archive_verify_tile(terrain_archive_t *archive, uint32_t level, uint32_t tx, uint32_t ty);
+
+// copies a region into dest, row by row. false if a tile fails its crc
+bool terrain_archive_read_region(terrain_archive_t *archive, const terrain_archive_region_t *region, float *dest);
+// resizes the terrain to the region and fills it from only the tiles it
+// touches, then rebuilds its mesh. the terrain is left untouched unless every
+// tile passed its crc
+bool terrain_archive_load(terrain_archive_t *archive, const terrain_archive_region_t *region, terrain_t *terrain);
+
+typedef struct terrain_archive_writer_desc_t
+{
+	const char *path;
+	// zero picks TERRAIN_ARCHIVE_DEFAULT_TILE_SIZE
+	uint32_t tile_size;
+} terrain_archive_writer_desc_t;
+
+typedef struct terrain_archive_data_t
+{
+	uvec2 size;
+	int terrain_seed;
+	float scale_scalar;
+	float elevation;
+	erosion_desc_t params;
+	uint32_t erosion_seed;
+	uint64_t drops;
+	float *heights;
+} terrain_archive_data_t;
+
+// writes archives on its own thread from a snapshot, so the caller only
+// pays for one copy of the height map
+typedef struct terrain_archive_writer_t
+{
+	char *path;
+	uint32_t tile_size;
+
+	// snapshot owned by the writer thread while pending is set
+	terrain_archive_data_t snapshot;
+	size_t snapshot_capacity;
+	bool pending;
+	bool quit;
+
+	thread_t *thread;
+	mutex_t *mutex;
+	cond_t *wake;
+	cond_t *done;
+
+	// only touched with the mutex held
+	uint32_t written;
+	uint32_t failed;
+	uint32_t skipped;
+	double write_seconds;
+} terrain_archive_writer_t;
+
+void terrain_archive_writer_init(const terrain_archive_writer_desc_t *desc, terrain_archive_writer_t **writer);
+terrain_archive_writer_t *terrain_archive_writer_create(const terrain_archive_writer_desc_t *desc);
+void terrain_archive_writer_free(terrain_archive_writer_t *writer);
+
+// false if the previous archive is still being written
+bool terrain_archive_writer_submit(terrain_archive_writer_t *writer, terrain_t *terrain, const erosion_desc_t *params, const erosion_state_t *state);
+bool terrain_archive_writer_busy(terrain_archive_writer_t *writer);
+void terrain_archive_writer_flush(terrain_archive_writer_t *writer);
+
+#endif /* __io_terrain_archive_h__ */
@@ -0,0 +1,297 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "tile_store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug/assert.h"
+#include "io/binary.h"
+
+#define TILE_STORE_HEADER_SIZE (32)
+
+static bool seek_to(FILE *file, uint64_t offset)
+{
+#if defined(_WIN32)
+	return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static size_t tile_floats(tile_store_t *store)
+{
+	return (size_t)store->tile_size * store->tile_size;
+}
+
+static uint64_t tile_offset(tile_store_t *store, int32_t tile)
+{
+	return TILE_STORE_HEADER_SIZE + (uint64_t)tile * tile_floats(store) * sizeof(float);
+}
+
+static bool write_header(tile_store_t *store)
+{
+	uint8_t header[TILE_STORE_HEADER_SIZE] = { 0 };
+	memcpy(header, TILE_STORE_MAGIC, 4);
+	binary_store_u32(header + 4, TILE_STORE_VERSION);
+	binary_store_u32(header + 8, store->size.w);
+	binary_store_u32(header + 12, store->size.h);
+	binary_store_u32(header + 16, store->tile_size);
+
+	return seek_to(store->file, 0) && fwrite(header, 1, sizeof(header), store->file) == sizeof(header);
+}
+
+static bool read_header(tile_store_t *store)
+{
+	uint8_t header[TILE_STORE_HEADER_SIZE];
+	if (!seek_to(store->file, 0) || fread(header, 1, sizeof(header), store->file) != sizeof(header)) return false;
+	if (memcmp(header, TILE_STORE_MAGIC, 4) != 0 || binary_load_u32(header + 4) != TILE_STORE_VERSION) return false;
+
+	store->size.w = binary_load_u32(header + 8);
+	store->size.h = binary_load_u32(header + 12);
+	store->tile_size = binary_load_u32(header + 16);
+	return store->size.w > 0 && store->size.h > 0 && store->tile_size > 0;
+}
+
+static void write_slot(tile_store_t *store, tile_store_slot_t *slot)
+{
+	HE_VERIFY(seek_to(store->file, tile_offset(store, slot->tile)), "Failed to seek in tile store");
+	HE_VERIFY(binary_write_f32_array(store->file, slot->data, tile_floats(store)), "Failed to write tile");
+	slot->dirty = false;
+	store->stats.page_outs++;
+}
+
+static void read_slot(tile_store_t *store, tile_store_slot_t *slot)
+{
+	HE_VERIFY(seek_to(store->file, tile_offset(store, slot->tile)), "Failed to seek in tile store");
+	HE_VERIFY(binary_read_f32_array(store->file, slot->data, tile_floats(store)), "Failed to read tile");
+	store->stats.page_ins++;
+}
+
+bool tile_store_init(const tile_store_desc_t *desc, tile_store_t **store)
+{
+	HE_ASSERT(store != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A tile store description is required");
+	HE_ASSERT(desc->path != NULL, "A tile store path is required");
+
+	// the cache size is user input, so it is checked in release builds too
+	if (desc->cache_tiles < 4) return false;
+
+	tile_store_t *result = calloc(1, sizeof(tile_store_t));
+	bool create = desc->size.w > 0 && desc->size.h > 0;
+
+	result->file = fopen(desc->path, create ? "w+b" : "r+b");
+	if (result->file == NULL)
+	{
+		free(result);
+		return false;
+	}
+
+	if (create)
+	{
+		HE_ASSERT(desc->tile_size > 0, "A tile size is required to create a tile store");
+		result->size = desc->size;
+		result->tile_size = desc->tile_size;
+		if (!write_header(result))
+		{
+			fclose(result->file);
+			free(result);
+			return false;
+		}
+	}
+	else if (!read_header(result))
+	{
+		fclose(result->file);
+		free(result);
+		return false;
+	}
+
+	result->tiles.w = (result->size.w + result->tile_size - 1) / result->tile_size;
+	result->tiles.h = (result->size.h + result->tile_size - 1) / result->tile_size;
+
+	size_t tile_count = (size_t)result->tiles.w * result->tiles.h;
+	result->resident = malloc(tile_count * sizeof(int32_t));
+	for (size_t i = 0; i < tile_count; i++)
+	{
+		result->resident[i] = -1;
+	}
+
+	result->slot_count = desc->cache_tiles;
+	result->slots = calloc(result->slot_count, sizeof(tile_store_slot_t));
+	for (uint32_t i = 0; i < result->slot_count; i++)
+	{
+		result->slots[i].tile = -1;
+		result->slots[i].data = malloc(tile_floats(result) * sizeof(float));
+	}
+
+	if (create)
+	{
+		// extend the file to its full size so every tile can be read back
+		float *zero = result->slots[0].data;
+		memset(zero, 0, tile_floats(result) * sizeof(float));
+		for (size_t i = 0; i < tile_count; i++)
+		{
+			HE_VERIFY(seek_to(result->file, tile_offset(result, (int32_t)i)), "Failed to seek in tile store");
+			HE_VERIFY(binary_write_f32_array(result->file, zero, tile_floats(result)), "Failed to write tile");
+		}
+	}
+
+	*store = result;
+	return true;
+}
+
+tile_store_t *tile_store_create(const tile_store_desc_t *desc)
+{
+	tile_store_t *store;
+	if (!tile_store_init(desc, &store)) return NULL;
+	return store;
+}
+
+void tile_store_free(tile_store_t *store)
+{
+	if (store == NULL) return;
+
+	tile_store_flush(store);
+	for (uint32_t i = 0; i < store->slot_count; i++)
+	{
+		free(store->slots[i].data);
+	}
+	free(store->slots);
+	free(store->resident);
+	fclose(store->file);
+	free(store);
+}
+
+float *tile_store_acquire(tile_store_t *store, uint32_t tx, uint32_t ty)
+{
+	HE_ASSERT(tx < store->tiles.w && ty < store->tiles.h, "Tile outside the store");
+
+	int32_t tile = (int32_t)(tx + ty * store->tiles.w);
+	int32_t index = store->resident[tile];
+
+	if (index >= 0)
+	{
+		store->stats.hits++;
+	}
+	else
+	{
+		// evict the least recently used tile nobody is holding on to
+		index = -1;
+		for (uint32_t i = 0; i < store->slot_count; i++)
+		{
+			tile_store_slot_t *slot = &store->slots[i];
+			if (slot->pins > 0) continue;
+			if (index < 0 || slot->tile < 0 || slot->last_used < store->slots[index].last_used)
+			{
+				index = (int32_t)i;
+				if (slot->tile < 0) break;
+			}
+		}
+		HE_ASSERT(index >= 0, "Every cached tile is pinned, the cache is too small");
+
+		tile_store_slot_t *slot = &store->slots[index];
+		if (slot->tile >= 0)
+		{
+			if (slot->dirty) write_slot(store, slot);
+			store->resident[slot->tile] = -1;
+			store->stats.evictions++;
+		}
+
+		slot->tile = tile;
+		read_slot(store, slot);
+		store->resident[tile] = index;
+	}
+
+	tile_store_slot_t *slot = &store->slots[index];
+	slot->pins++;
+	slot->last_used = ++store->clock;
+	return slot->data;
+}
+
+void tile_store_release(tile_store_t *store, uint32_t tx, uint32_t ty, bool dirty)
+{
+	int32_t tile = (int32_t)(tx + ty * store->tiles.w);
+	int32_t index = store->resident[tile];
+	HE_ASSERT(index >= 0 && store->slots[index].pins > 0, "Releasing a tile that was not acquired");
+
+	store->slots[index].pins--;
+	store->slots[index].dirty |= dirty;
+}
+
+void tile_store_flush(tile_store_t *store)
+{
+	for (uint32_t i = 0; i < store->slot_count; i++)
+	{
+		tile_store_slot_t *slot = &store->slots[i];
+		if (slot->tile >= 0 && slot->dirty) write_slot(store, slot);
+	}
+	fflush(store->file);
+}
+
+static void copy_region(tile_store_t *store, uint32_t x, uint32_t y, uint32_t w, uint32_t h, float *dest, const float *src)
+{
+	HE_ASSERT(x + w <= store->size.w && y + h <= store->size.h, "Region outside the store");
+
+	uint32_t ts = store->tile_size;
+	for (uint32_t ty = y / ts; ty <= (y + h - 1) / ts; ty++)
+	{
+		for (uint32_t tx = x / ts; tx <= (x + w - 1) / ts; tx++)
+		{
+			float *tile = tile_store_acquire(store, tx, ty);
+
+			// overlap of the region and this tile, in map coordinates
+			uint32_t x0 = tx * ts > x ? tx * ts : x;
+			uint32_t y0 = ty * ts > y ? ty * ts : y;
+			uint32_t x1 = (tx + 1) * ts < x + w ? (tx + 1) * ts : x + w;
+			uint32_t y1 = (ty + 1) * ts < y + h ? (ty + 1) * ts : y + h;
+
+			for (uint32_t row = y0; row < y1; row++)
+			{
+				float *tile_row = tile + (row - ty * ts) * ts + (x0 - tx * ts);
+				size_t region_offset = (size_t)(row - y) * w + (x0 - x);
+				if (dest != NULL) memcpy(dest + region_offset, tile_row, (x1 - x0) * sizeof(float));
+				else memcpy(tile_row, src + region_offset, (x1 - x0) * sizeof(float));
+			}
+
+			tile_store_release(store, tx, ty, dest == NULL);
+		}
+	}
+}
+
+void tile_store_read_region(tile_store_t *store, uint32_t x, uint32_t y, uint32_t w, uint32_t h, float *dest)
+{
+	copy_region(store, x, y, w, h, dest, NULL);
+}
+
+void tile_store_write_region(tile_store_t *store, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const float *src)
+{
+	copy_region(store, x, y, w, h, NULL, src);
+}
+
+void tile_store_generate(tile_store_t *store, tile_store_noise_function_t noise_function, int seed, float scale_scalar)
+{
+	uint32_t ts = store->tile_size;
+	for (uint32_t ty = 0; ty < store->tiles.h; ty++)
+	{
+		for (uint32_t tx = 0; tx < store->tiles.w; tx++)
+		{
+			float *tile = tile_store_acquire(store, tx, ty);
+			for (uint32_t z = 0; z < ts; z++)
+			{
+				for (uint32_t x = 0; x < ts; x++)
+				{
+					uint32_t mx = tx * ts + x;
+					uint32_t mz = ty * ts + z;
+					tile[x + z * ts] = noise_function(seed, (float)mx * scale_scalar, (float)mz * scale_scalar);
+				}
+			}
+			tile_store_release(store, tx, ty, true);
+		}
+	}
+	tile_store_flush(store);
+}
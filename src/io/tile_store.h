@@ -0,0 +1,76 @@
+#ifndef __io_tile_store_h__
+#define __io_tile_store_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "math/types.h"
+
+// heightmap backed by a file of fixed size square tiles, paged in and out
+// through a small lru cache. lets the tiled erosion driver work on terrains
+// much larger than memory
+
+#define TILE_STORE_MAGIC "HETS"
+#define TILE_STORE_VERSION (1)
+
+typedef float(*tile_store_noise_function_t)(int, float, float);
+
+typedef struct tile_store_desc_t
+{
+	const char *path;
+
+	// create a new store of this size, or open an existing one if zero
+	uvec2 size;
+	uint32_t tile_size;
+
+	// at least 4, init fails otherwise
+	uint32_t cache_tiles;
+} tile_store_desc_t;
+
+typedef struct tile_store_stats_t
+{
+	uint64_t hits;
+	uint64_t page_ins;
+	uint64_t page_outs;
+	uint64_t evictions;
+} tile_store_stats_t;
+
+typedef struct tile_store_slot_t
+{
+	int32_t tile;
+	uint32_t pins;
+	bool dirty;
+	uint64_t last_used;
+	float *data;
+} tile_store_slot_t;
+
+typedef struct tile_store_t
+{
+	FILE *file;
+	uvec2 size;
+	uint32_t tile_size;
+	uvec2 tiles;
+
+	tile_store_slot_t *slots;
+	uint32_t slot_count;
+	int32_t *resident;
+	uint64_t clock;
+
+	tile_store_stats_t stats;
+} tile_store_t;
+
+bool tile_store_init(const tile_store_desc_t *desc, tile_store_t **store);
+tile_store_t *tile_store_create(const tile_store_desc_t *desc);
+void tile_store_free(tile_store_t *store);
+
+float *tile_store_acquire(tile_store_t *store, uint32_t tx, uint32_t ty);
+void tile_store_release(tile_store_t *store, uint32_t tx, uint32_t ty, bool dirty);
+void tile_store_flush(tile_store_t *store);
+
+void tile_store_read_region(tile_store_t *store, uint32_t x, uint32_t y, uint32_t w, uint32_t h, float *dest);
+void tile_store_write_region(tile_store_t *store, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const float *src);
+
+void tile_store_generate(tile_store_t *store, tile_store_noise_function_t noise_function, int seed, float scale_scalar);
+
+#endif /* __io_tile_store_h__ */
@@ -0,0 +1,478 @@
+#include "timelapse.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/crc32.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+#include "io/binary.h"
+#include "io/height_codec.h"
+
+// magic, version, width, height, tile size, flags and the drop interval
+#define TIMELAPSE_HEADER_SIZE (32)
+#define TIMELAPSE_FRAME_MAGIC "FRAM"
+// magic, drop and changed tile count
+#define TIMELAPSE_FRAME_HEADER_SIZE (16)
+// tile index and payload size
+#define TIMELAPSE_TILE_HEADER_SIZE (8)
+
+#define TIMELAPSE_FLAG_COMPRESSED (0x1)
+
+static uvec2 tile_grid(uvec2 size, uint32_t tile_size)
+{
+	return (uvec2){ .w = (size.w + tile_size - 1) / tile_size, .h = (size.h + tile_size - 1) / tile_size };
+}
+
+static uvec2 tile_extent(uvec2 size, uint32_t tile_size, uint32_t x0, uint32_t y0)
+{
+	return (uvec2){
+		.w = size.w - x0 < tile_size ? size.w - x0 : tile_size,
+		.h = size.h - y0 < tile_size ? size.h - y0 : tile_size,
+	};
+}
+
+static size_t encoded_capacity(uint32_t tile_size)
+{
+	// a raw tile always fits in the codec bound
+	return height_codec_bound((uvec2){ .w = tile_size, .h = tile_size }, tile_size);
+}
+
+static bool tile_changed(const float *heights, const float *previous, uvec2 size, uint32_t x0, uint32_t y0, uvec2 extent)
+{
+	for (uint32_t y = 0; y < extent.h; y++)
+	{
+		size_t offset = (size_t)(y0 + y) * size.w + x0;
+		if (memcmp(heights + offset, previous + offset, extent.w * sizeof(float)) != 0) return true;
+	}
+	return false;
+}
+
+// the difference of the bit patterns. a drop only nudges a few samples of
+// a tile by a little, so the difference is mostly zeros and small integers
+// that the height codec squeezes far better than the heights themselves
+static void delta_row(const float *heights, const float *previous, uint32_t w, float *dest)
+{
+	for (uint32_t x = 0; x < w; x++)
+	{
+		uint32_t a, b;
+		memcpy(&a, &heights[x], sizeof(a));
+		memcpy(&b, &previous[x], sizeof(b));
+		a -= b;
+		memcpy(&dest[x], &a, sizeof(a));
+	}
+}
+
+static void undelta_row(float *heights, const float *delta, uint32_t w)
+{
+	for (uint32_t x = 0; x < w; x++)
+	{
+		uint32_t a, b;
+		memcpy(&a, &heights[x], sizeof(a));
+		memcpy(&b, &delta[x], sizeof(b));
+		a += b;
+		memcpy(&heights[x], &a, sizeof(a));
+	}
+}
+
+static size_t encode_tile(timelapse_recorder_t *recorder, const float *heights, uint32_t x0, uint32_t y0, uvec2 extent, bool key)
+{
+	float *tile = recorder->tile;
+	for (uint32_t y = 0; y < extent.h; y++)
+	{
+		size_t offset = (size_t)(y0 + y) * recorder->size.w + x0;
+		if (recorder->compress && !key) delta_row(heights + offset, recorder->previous + offset, extent.w, tile + (size_t)y * extent.w);
+		else memcpy(tile + (size_t)y * extent.w, heights + offset, extent.w * sizeof(float));
+		// the next frame is compared against what was recorded
+		memcpy(recorder->previous + offset, heights + offset, extent.w * sizeof(float));
+	}
+
+	size_t count = (size_t)extent.w * extent.h;
+	if (recorder->compress)
+	{
+		return height_codec_encode(tile, extent, recorder->tile_size, recorder->encoded, recorder->encoded_capacity, NULL);
+	}
+
+	if (binary_host_is_little_endian())
+	{
+		memcpy(recorder->encoded, tile, count * sizeof(float));
+	}
+	else
+	{
+		for (size_t i = 0; i < count; i++) binary_store_f32(recorder->encoded + i * sizeof(float), tile[i]);
+	}
+	return count * sizeof(float);
+}
+
+static bool write_frame(timelapse_recorder_t *recorder, const timelapse_frame_t *frame, uint64_t *tiles_written, uint64_t *bytes_written)
+{
+	uvec2 size = recorder->size;
+	uvec2 tiles = tile_grid(size, recorder->tile_size);
+	uint32_t tile_count = tiles.w * tiles.h;
+
+	// the first frame has nothing to compare against and keeps every tile
+	bool key = recorder->previous == NULL;
+	if (key) recorder->previous = malloc((size_t)size.w * size.h * sizeof(float));
+
+	uint32_t changed = 0;
+	for (uint32_t i = 0; i < tile_count; i++)
+	{
+		uint32_t x0 = (i % tiles.w) * recorder->tile_size;
+		uint32_t y0 = (i / tiles.w) * recorder->tile_size;
+		if (key || tile_changed(frame->heights, recorder->previous, size, x0, y0, tile_extent(size, recorder->tile_size, x0, y0)))
+		{
+			recorder->changed[changed++] = i;
+		}
+	}
+
+	uint8_t header[TIMELAPSE_FRAME_HEADER_SIZE];
+	memcpy(header, TIMELAPSE_FRAME_MAGIC, 4);
+	binary_store_u64(header + 4, frame->drop);
+	binary_store_u32(header + 12, changed);
+	bool ok = fwrite(header, 1, sizeof(header), recorder->file) == sizeof(header);
+	uint64_t bytes = sizeof(header);
+
+	uint32_t crc = CRC32_INIT;
+	for (uint32_t c = 0; c < changed && ok; c++)
+	{
+		uint32_t i = recorder->changed[c];
+		uint32_t x0 = (i % tiles.w) * recorder->tile_size;
+		uint32_t y0 = (i / tiles.w) * recorder->tile_size;
+		size_t encoded = encode_tile(recorder, frame->heights, x0, y0, tile_extent(size, recorder->tile_size, x0, y0), key);
+
+		uint8_t tile_header[TIMELAPSE_TILE_HEADER_SIZE];
+		binary_store_u32(tile_header, i);
+		binary_store_u32(tile_header + 4, (uint32_t)encoded);
+		crc = crc32_update(crc, tile_header, sizeof(tile_header));
+		crc = crc32_update(crc, recorder->encoded, encoded);
+
+		ok = encoded > 0;
+		ok = ok && fwrite(tile_header, 1, sizeof(tile_header), recorder->file) == sizeof(tile_header);
+		ok = ok && fwrite(recorder->encoded, 1, encoded, recorder->file) == encoded;
+		bytes += sizeof(tile_header) + encoded;
+	}
+	ok = ok && binary_write_u32(recorder->file, crc);
+	bytes += sizeof(uint32_t);
+
+	*tiles_written = changed;
+	*bytes_written = bytes;
+	return ok;
+}
+
+static void writer_thread(void *user_pointer)
+{
+	timelapse_recorder_t *recorder = (timelapse_recorder_t *)user_pointer;
+	uvec2 grid = tile_grid(recorder->size, recorder->tile_size);
+
+	// a frame that failed half way leaves the file unreadable past it
+	bool broken = false;
+
+	mutex_lock(recorder->mutex);
+	while (true)
+	{
+		while (recorder->count == 0 && !recorder->quit)
+		{
+			cond_wait(recorder->wake, recorder->mutex);
+		}
+		if (recorder->count == 0) break;
+
+		// the head slot belongs to this thread until the count drops
+		timelapse_frame_t *frame = &recorder->queue[recorder->head];
+		mutex_unlock(recorder->mutex);
+
+		double start = timer_now();
+		uint64_t tiles = 0;
+		uint64_t bytes = 0;
+		bool ok = !broken && write_frame(recorder, frame, &tiles, &bytes);
+		if (ok) ok = fflush(recorder->file) == 0;
+		broken |= !ok;
+		double seconds = timer_now() - start;
+
+		mutex_lock(recorder->mutex);
+		if (ok)
+		{
+			recorder->frames++;
+			recorder->tiles_written += tiles;
+			recorder->tiles_total += grid.w * grid.h;
+			recorder->bytes_written += bytes;
+		}
+		else
+		{
+			recorder->failed++;
+		}
+		recorder->write_seconds += seconds;
+		recorder->head = (recorder->head + 1) % recorder->queue_frames;
+		recorder->count--;
+		cond_broadcast(recorder->done);
+	}
+	mutex_unlock(recorder->mutex);
+}
+
+bool timelapse_recorder_init(const timelapse_recorder_desc_t *desc, timelapse_recorder_t **recorder)
+{
+	HE_ASSERT(recorder != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A timelapse recorder description is required");
+	HE_ASSERT(desc->path != NULL, "A timelapse path is required");
+	HE_ASSERT(desc->size.w > 0 && desc->size.h > 0, "A timelapse needs a size");
+
+	uint32_t tile_size = desc->tile_size > 0 ? desc->tile_size : TIMELAPSE_DEFAULT_TILE_SIZE;
+	HE_ASSERT(tile_size >= 8 && tile_size <= 4096, "Timelapse tile size out of range");
+
+	FILE *file = fopen(desc->path, "wb");
+	if (file == NULL) return false;
+
+	uint8_t header[TIMELAPSE_HEADER_SIZE];
+	memcpy(header, TIMELAPSE_MAGIC, 4);
+	binary_store_u32(header + 4, TIMELAPSE_VERSION);
+	binary_store_u32(header + 8, desc->size.w);
+	binary_store_u32(header + 12, desc->size.h);
+	binary_store_u32(header + 16, tile_size);
+	binary_store_u32(header + 20, desc->compress ? TIMELAPSE_FLAG_COMPRESSED : 0);
+	binary_store_u64(header + 24, desc->interval_drops);
+	if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+	{
+		fclose(file);
+		remove(desc->path);
+		return false;
+	}
+
+	timelapse_recorder_t *result = calloc(1, sizeof(timelapse_recorder_t));
+	result->size = desc->size;
+	result->tile_size = tile_size;
+	result->compress = desc->compress;
+	result->interval_drops = desc->interval_drops;
+	result->file = file;
+
+	result->queue_frames = desc->queue_frames > 0 ? desc->queue_frames : TIMELAPSE_DEFAULT_QUEUE_FRAMES;
+	result->queue = calloc(result->queue_frames, sizeof(timelapse_frame_t));
+	size_t bytes = (size_t)desc->size.w * desc->size.h * sizeof(float);
+	for (uint32_t i = 0; i < result->queue_frames; i++)
+	{
+		// touched up front, so the first copies do not pay for page faults
+		result->queue[i].heights = malloc(bytes);
+		memset(result->queue[i].heights, 0, bytes);
+	}
+
+	uvec2 tiles = tile_grid(desc->size, tile_size);
+	result->changed = malloc((size_t)tiles.w * tiles.h * sizeof(uint32_t));
+	result->tile = malloc((size_t)tile_size * tile_size * sizeof(float));
+	result->encoded_capacity = encoded_capacity(tile_size);
+	result->encoded = malloc(result->encoded_capacity);
+
+	result->mutex = mutex_create();
+	result->wake = cond_create();
+	result->done = cond_create();
+	result->thread = thread_create(writer_thread, result);
+
+	*recorder = result;
+	return true;
+}
+
+timelapse_recorder_t *timelapse_recorder_create(const timelapse_recorder_desc_t *desc)
+{
+	timelapse_recorder_t *recorder;
+	return timelapse_recorder_init(desc, &recorder) ? recorder : NULL;
+}
+
+void timelapse_recorder_free(timelapse_recorder_t *recorder)
+{
+	if (recorder == NULL) return;
+
+	mutex_lock(recorder->mutex);
+	recorder->quit = true;
+	cond_signal(recorder->wake);
+	mutex_unlock(recorder->mutex);
+
+	thread_join(recorder->thread);
+	cond_free(recorder->done);
+	cond_free(recorder->wake);
+	mutex_free(recorder->mutex);
+
+	fclose(recorder->file);
+	for (uint32_t i = 0; i < recorder->queue_frames; i++)
+	{
+		free(recorder->queue[i].heights);
+	}
+	free(recorder->queue);
+	free(recorder->changed);
+	free(recorder->previous);
+	free(recorder->tile);
+	free(recorder->encoded);
+	free(recorder);
+}
+
+bool timelapse_recorder_poll(timelapse_recorder_t *recorder, terrain_t *terrain, uint64_t drop)
+{
+	HE_ASSERT(recorder != NULL, "Cannot poll NULL");
+
+	if (recorder->interval_drops == 0 || drop - recorder->last_drop < recorder->interval_drops) return false;
+
+	// keep the cadence even if this frame gets skipped
+	recorder->last_drop = drop;
+	return timelapse_recorder_submit(recorder, terrain, drop);
+}
+
+bool timelapse_recorder_submit(timelapse_recorder_t *recorder, terrain_t *terrain, uint64_t drop)
+{
+	HE_ASSERT(recorder != NULL, "Cannot submit to NULL");
+	HE_ASSERT(terrain->size.w == recorder->size.w && terrain->size.h == recorder->size.h, "Terrain size does not match the timelapse");
+
+	mutex_lock(recorder->mutex);
+	if (recorder->count == recorder->queue_frames)
+	{
+		// never wait for the disk
+		recorder->skipped++;
+		mutex_unlock(recorder->mutex);
+		return false;
+	}
+	uint32_t slot = (recorder->head + recorder->count) % recorder->queue_frames;
+	mutex_unlock(recorder->mutex);
+
+	// slots past the count are only ever touched by the submitting thread
+	double start = timer_now();
+	timelapse_frame_t *frame = &recorder->queue[slot];
+	frame->drop = drop;
+	recorder->queued_drop = drop;
+	memcpy(frame->heights, terrain->height_map, (size_t)terrain->size.w * terrain->size.h * sizeof(float));
+	double seconds = timer_now() - start;
+
+	mutex_lock(recorder->mutex);
+	recorder->copy_seconds += seconds;
+	recorder->count++;
+	cond_signal(recorder->wake);
+	mutex_unlock(recorder->mutex);
+
+	return true;
+}
+
+void timelapse_recorder_flush(timelapse_recorder_t *recorder)
+{
+	HE_ASSERT(recorder != NULL, "Cannot flush NULL");
+
+	mutex_lock(recorder->mutex);
+	while (recorder->count > 0)
+	{
+		cond_wait(recorder->done, recorder->mutex);
+	}
+	mutex_unlock(recorder->mutex);
+}
+
+bool timelapse_init(const timelapse_desc_t *desc, timelapse_t **timelapse)
+{
+	HE_ASSERT(timelapse != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A timelapse description is required");
+	HE_ASSERT(desc->path != NULL, "A timelapse path is required");
+
+	FILE *file = fopen(desc->path, "rb");
+	if (file == NULL) return false;
+
+	uint8_t header[TIMELAPSE_HEADER_SIZE];
+	bool ok = fread(header, 1, sizeof(header), file) == sizeof(header);
+	ok = ok && memcmp(header, TIMELAPSE_MAGIC, 4) == 0 && binary_load_u32(header + 4) == TIMELAPSE_VERSION;
+
+	uvec2 size = { .w = ok ? binary_load_u32(header + 8) : 0, .h = ok ? binary_load_u32(header + 12) : 0 };
+	uint32_t tile_size = ok ? binary_load_u32(header + 16) : 0;
+	ok = ok && size.w > 0 && size.h > 0 && tile_size >= 8 && tile_size <= 4096;
+	if (!ok)
+	{
+		fclose(file);
+		return false;
+	}
+
+	timelapse_t *result = calloc(1, sizeof(timelapse_t));
+	result->file = file;
+	result->size = size;
+	result->tile_size = tile_size;
+	result->compressed = (binary_load_u32(header + 20) & TIMELAPSE_FLAG_COMPRESSED) != 0;
+	result->interval_drops = binary_load_u64(header + 24);
+	result->frame = -1;
+	result->heights = calloc((size_t)size.w * size.h, sizeof(float));
+	result->tile = malloc((size_t)tile_size * tile_size * sizeof(float));
+	result->encoded_capacity = encoded_capacity(tile_size);
+	result->encoded = malloc(result->encoded_capacity);
+
+	*timelapse = result;
+	return true;
+}
+
+timelapse_t *timelapse_create(const timelapse_desc_t *desc)
+{
+	timelapse_t *timelapse;
+	return timelapse_init(desc, &timelapse) ? timelapse : NULL;
+}
+
+void timelapse_free(timelapse_t *timelapse)
+{
+	if (timelapse == NULL) return;
+
+	fclose(timelapse->file);
+	free(timelapse->heights);
+	free(timelapse->tile);
+	free(timelapse->encoded);
+	free(timelapse);
+}
+
+static bool apply_tile(timelapse_t *timelapse, uint32_t index, size_t encoded)
+{
+	uvec2 tiles = tile_grid(timelapse->size, timelapse->tile_size);
+	uint32_t x0 = (index % tiles.w) * timelapse->tile_size;
+	uint32_t y0 = (index / tiles.w) * timelapse->tile_size;
+	uvec2 extent = tile_extent(timelapse->size, timelapse->tile_size, x0, y0);
+	size_t count = (size_t)extent.w * extent.h;
+
+	if (timelapse->compressed)
+	{
+		if (!height_codec_decode(timelapse->encoded, encoded, timelapse->tile, extent, NULL)) return false;
+	}
+	else
+	{
+		if (encoded != count * sizeof(float)) return false;
+		for (size_t i = 0; i < count; i++) timelapse->tile[i] = binary_load_f32(timelapse->encoded + i * sizeof(float));
+	}
+
+	// compressed frames after the first hold differences
+	bool delta = timelapse->compressed && timelapse->frame >= 0;
+	for (uint32_t y = 0; y < extent.h; y++)
+	{
+		float *row = timelapse->heights + (size_t)(y0 + y) * timelapse->size.w + x0;
+		if (delta) undelta_row(row, timelapse->tile + (size_t)y * extent.w, extent.w);
+		else memcpy(row, timelapse->tile + (size_t)y * extent.w, extent.w * sizeof(float));
+	}
+	return true;
+}
+
+bool timelapse_next(timelapse_t *timelapse)
+{
+	HE_ASSERT(timelapse != NULL, "Cannot advance NULL");
+
+	uint8_t header[TIMELAPSE_FRAME_HEADER_SIZE];
+	if (fread(header, 1, sizeof(header), timelapse->file) != sizeof(header)) return false;
+	if (memcmp(header, TIMELAPSE_FRAME_MAGIC, 4) != 0) return false;
+
+	uvec2 tiles = tile_grid(timelapse->size, timelapse->tile_size);
+	uint32_t changed = binary_load_u32(header + 12);
+	if (changed > tiles.w * tiles.h) return false;
+
+	uint32_t crc = CRC32_INIT;
+	for (uint32_t c = 0; c < changed; c++)
+	{
+		uint8_t tile_header[TIMELAPSE_TILE_HEADER_SIZE];
+		if (fread(tile_header, 1, sizeof(tile_header), timelapse->file) != sizeof(tile_header)) return false;
+
+		uint32_t index = binary_load_u32(tile_header);
+		size_t encoded = binary_load_u32(tile_header + 4);
+		if (index >= tiles.w * tiles.h || encoded > timelapse->encoded_capacity) return false;
+		if (fread(timelapse->encoded, 1, encoded, timelapse->file) != encoded) return false;
+
+		crc = crc32_update(crc, tile_header, sizeof(tile_header));
+		crc = crc32_update(crc, timelapse->encoded, encoded);
+		if (!apply_tile(timelapse, index, encoded)) return false;
+	}
+
+	uint32_t stored;
+	if (!binary_read_u32(timelapse->file, &stored) || stored != crc) return false;
+
+	timelapse->frame++;
+	timelapse->drop = binary_load_u64(header + 4);
+	return true;
+}
@@ -0,0 +1,136 @@
+#ifndef __io_timelapse_h__
+#define __io_timelapse_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "components/terrain.h"
+#include "core/thread.h"
+#include "math/types.h"
+#include "erosion.h"
+
+// a recording of how a terrain evolves. the file starts with a header and
+// is followed by frames, the first one with every tile and every further one
+// with only the tiles that changed since the frame before. each frame ends in
+// a crc32 of its tiles. compressed recordings run the tiles through the
+// height codec, after the first frame as differences to the frame before
+
+#define TIMELAPSE_MAGIC "HETL"
+#define TIMELAPSE_VERSION (1)
+#define TIMELAPSE_EXTENSION ".hetl"
+#define TIMELAPSE_DEFAULT_TILE_SIZE (128)
+#define TIMELAPSE_DEFAULT_QUEUE_FRAMES (2)
+
+typedef struct timelapse_recorder_desc_t
+{
+	const char *path;
+	uvec2 size;
+
+	// record a frame whenever this many drops have passed, zero leaves it
+	// to explicit submits
+	uint64_t interval_drops;
+
+	// snapshots waiting for the writer, a frame is dropped rather than
+	// waited for once they are all taken. zero picks the default
+	uint32_t queue_frames;
+	// zero picks TIMELAPSE_DEFAULT_TILE_SIZE
+	uint32_t tile_size;
+	bool compress;
+} timelapse_recorder_desc_t;
+
+typedef struct timelapse_frame_t
+{
+	uint64_t drop;
+	float *heights;
+} timelapse_frame_t;
+
+// records frames on its own thread. the simulation only copies the height
+// map into a free queue slot, finding the changed tiles, encoding and
+// writing happens on the writer thread
+typedef struct timelapse_recorder_t
+{
+	uvec2 size;
+	uint32_t tile_size;
+	bool compress;
+	uint64_t interval_drops;
+	uint64_t last_drop;
+	// drop of the last frame that made it into the queue
+	uint64_t queued_drop;
+
+	// ring of snapshots, the writer owns the count slots from head on
+	timelapse_frame_t *queue;
+	uint32_t queue_frames;
+	uint32_t head;
+	uint32_t count;
+	bool quit;
+
+	// only touched by the writer thread
+	FILE *file;
+	float *previous;
+	uint32_t *changed;
+	float *tile;
+	uint8_t *encoded;
+	size_t encoded_capacity;
+
+	thread_t *thread;
+	mutex_t *mutex;
+	cond_t *wake;
+	cond_t *done;
+
+	// only touched with the mutex held
+	uint32_t frames;
+	uint32_t skipped;
+	uint32_t failed;
+	uint64_t tiles_written;
+	uint64_t tiles_total;
+	uint64_t bytes_written;
+	double copy_seconds;
+	double write_seconds;
+} timelapse_recorder_t;
+
+// false if the file cannot be created
+bool timelapse_recorder_init(const timelapse_recorder_desc_t *desc, timelapse_recorder_t **recorder);
+timelapse_recorder_t *timelapse_recorder_create(const timelapse_recorder_desc_t *desc);
+// writes out every queued frame first
+void timelapse_recorder_free(timelapse_recorder_t *recorder);
+
+// submits a frame if the interval has passed since the last one
+bool timelapse_recorder_poll(timelapse_recorder_t *recorder, terrain_t *terrain, uint64_t drop);
+// false if the queue is full, the frame is counted as skipped
+bool timelapse_recorder_submit(timelapse_recorder_t *recorder, terrain_t *terrain, uint64_t drop);
+void timelapse_recorder_flush(timelapse_recorder_t *recorder);
+
+typedef struct timelapse_desc_t
+{
+	const char *path;
+} timelapse_desc_t;
+
+// plays a recording back one frame at a time
+typedef struct timelapse_t
+{
+	FILE *file;
+	uvec2 size;
+	uint32_t tile_size;
+	bool compressed;
+	uint64_t interval_drops;
+
+	// the current frame, -1 before the first
+	int32_t frame;
+	uint64_t drop;
+	float *heights;
+
+	float *tile;
+	uint8_t *encoded;
+	size_t encoded_capacity;
+} timelapse_t;
+
+bool timelapse_init(const timelapse_desc_t *desc, timelapse_t **timelapse);
+timelapse_t *timelapse_create(const timelapse_desc_t *desc);
+void timelapse_free(timelapse_t *timelapse);
+
+// applies the next frame to heights. false at the end or on a damaged frame,
+// which may have been applied in part
+bool timelapse_next(timelapse_t *timelapse);
+
+#endif /* __io_timelapse_h__ */
@@ -0,0 +1,222 @@
+#include "resample.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/job.h"
+#include "debug/assert.h"
+
+// rows per job in either pass
+#define RESAMPLE_JOB_ROWS (16)
+
+#define RESAMPLE_PI (3.14159265358979323846)
+
+static const char *filter_names[RESAMPLE_FILTER_COUNT__] = { "bilinear", "bicubic", "lanczos" };
+static const double filter_radius[RESAMPLE_FILTER_COUNT__] = { 1.0, 2.0, 3.0 };
+
+// for every output sample the first input sample it reads and the weights of
+// the samples from there on, max_taps apart
+typedef struct resample_taps_t
+{
+	uint32_t *first;
+	uint32_t *count;
+	float *weights;
+	uint32_t max_taps;
+} resample_taps_t;
+
+typedef struct resample_pass_t
+{
+	const float *src;
+	float *dest;
+	uvec2 src_size;
+	uvec2 dest_size;
+	const resample_taps_t *taps;
+} resample_pass_t;
+
+const char *resample_filter_name(resample_filter_t filter)
+{
+	return filter < RESAMPLE_FILTER_COUNT__ ? filter_names[filter] : "unknown";
+}
+
+resample_filter_t resample_filter_from_name(const char *name)
+{
+	for (int filter = 0; filter < RESAMPLE_FILTER_COUNT__; filter++)
+	{
+		if (strcmp(name, filter_names[filter]) == 0) return (resample_filter_t)filter;
+	}
+	return RESAMPLE_FILTER_COUNT__;
+}
+
+static double sinc(double x)
+{
+	if (fabs(x) < 1e-9) return 1.0;
+	x *= RESAMPLE_PI;
+	return sin(x) / x;
+}
+
+static double filter_weight(resample_filter_t filter, double x)
+{
+	x = fabs(x);
+	switch (filter)
+	{
+	case RESAMPLE_FILTER_BILINEAR:
+		return x < 1.0 ? 1.0 - x : 0.0;
+	case RESAMPLE_FILTER_BICUBIC:
+		if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+		if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+		return 0.0;
+	case RESAMPLE_FILTER_LANCZOS:
+		return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+	default:
+		return 0.0;
+	}
+}
+
+static void taps_init(resample_taps_t *taps, uint32_t src, uint32_t dest, resample_filter_t filter)
+{
+	// corners line up, a single sample spreads over the whole output
+	double step = dest > 1 ? (double)(src - 1) / (double)(dest - 1) : 0.0;
+	double stretch = step > 1.0 ? step : 1.0;
+	double support = filter_radius[filter] * stretch;
+
+	taps->max_taps = (uint32_t)ceil(2.0 * support) + 1;
+	taps->first = malloc(dest * sizeof(uint32_t));
+	taps->count = malloc(dest * sizeof(uint32_t));
+	taps->weights = malloc((size_t)dest * taps->max_taps * sizeof(float));
+
+	for (uint32_t i = 0; i < dest; i++)
+	{
+		double center = i * step;
+		int64_t lo = (int64_t)ceil(center - support);
+		int64_t hi = (int64_t)floor(center + support);
+		if (lo < 0) lo = 0;
+		if (hi > (int64_t)src - 1) hi = (int64_t)src - 1;
+		if (hi - lo + 1 > (int64_t)taps->max_taps) hi = lo + taps->max_taps - 1;
+
+		float *weights = taps->weights + (size_t)i * taps->max_taps;
+		double sum = 0.0;
+		for (int64_t k = lo; k <= hi; k++)
+		{
+			double weight = filter_weight(filter, ((double)k - center) / stretch);
+			weights[k - lo] = (float)weight;
+			sum += weight;
+		}
+
+		// weights always add up to one, also where the border cuts them off.
+		// the support reaches the nearest sample, so the sum is never zero
+		uint32_t count = (uint32_t)(hi - lo + 1);
+		for (uint32_t k = 0; k < count; k++) weights[k] = (float)(weights[k] / sum);
+
+		taps->first[i] = (uint32_t)lo;
+		taps->count[i] = count;
+	}
+}
+
+static void taps_free(resample_taps_t *taps)
+{
+	free(taps->first);
+	free(taps->count);
+	free(taps->weights);
+}
+
+static void horizontal_rows(void *user_pointer, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	(void)x0;
+	(void)x1;
+	resample_pass_t *pass = user_pointer;
+	const resample_taps_t *taps = pass->taps;
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		const float *src = pass->src + (size_t)y * pass->src_size.w;
+		float *dest = pass->dest + (size_t)y * pass->dest_size.w;
+		for (uint32_t x = 0; x < pass->dest_size.w; x++)
+		{
+			const float *row = src + taps->first[x];
+			const float *weights = taps->weights + (size_t)x * taps->max_taps;
+			float sum = 0.0f;
+			for (uint32_t k = 0; k < taps->count[x]; k++) sum += weights[k] * row[k];
+			dest[x] = sum;
+		}
+	}
+}
+
+static void vertical_rows(void *user_pointer, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	(void)x0;
+	(void)x1;
+	resample_pass_t *pass = user_pointer;
+	const resample_taps_t *taps = pass->taps;
+	uint32_t w = pass->src_size.w;
+
+	// whole rows are scaled and added, a loop the compiler vectorizes
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		float *dest = pass->dest + (size_t)y * w;
+		const float *weights = taps->weights + (size_t)y * taps->max_taps;
+		memset(dest, 0, w * sizeof(float));
+		for (uint32_t k = 0; k < taps->count[y]; k++)
+		{
+			const float *src = pass->src + (size_t)(taps->first[y] + k) * w;
+			float weight = weights[k];
+			for (uint32_t x = 0; x < w; x++) dest[x] += weight * src[x];
+		}
+	}
+}
+
+static void run_horizontal(const float *src, uvec2 src_size, float *dest, uint32_t dest_w, resample_filter_t filter)
+{
+	resample_taps_t taps;
+	taps_init(&taps, src_size.w, dest_w, filter);
+	resample_pass_t pass = {
+		.src = src,
+		.dest = dest,
+		.src_size = src_size,
+		.dest_size = { .w = dest_w, .h = src_size.h },
+		.taps = &taps,
+	};
+	job_parallel_for_2d(job_system_shared(), 1, src_size.h, 1, RESAMPLE_JOB_ROWS, horizontal_rows, &pass);
+	taps_free(&taps);
+}
+
+static void run_vertical(const float *src, uvec2 src_size, float *dest, uint32_t dest_h, resample_filter_t filter)
+{
+	resample_taps_t taps;
+	taps_init(&taps, src_size.h, dest_h, filter);
+	resample_pass_t pass = {
+		.src = src,
+		.dest = dest,
+		.src_size = src_size,
+		.dest_size = { .w = src_size.w, .h = dest_h },
+		.taps = &taps,
+	};
+	job_parallel_for_2d(job_system_shared(), 1, dest_h, 1, RESAMPLE_JOB_ROWS, vertical_rows, &pass);
+	taps_free(&taps);
+}
+
+void resample(const float *src, uvec2 src_size, float *dest, uvec2 dest_size, resample_filter_t filter)
+{
+	HE_ASSERT(src != NULL && dest != NULL, "Cannot resample NULL");
+	HE_ASSERT(src_size.w > 0 && src_size.h > 0 && dest_size.w > 0 && dest_size.h > 0, "Invalid resample size");
+	HE_ASSERT(filter < RESAMPLE_FILTER_COUNT__, "Invalid resample filter");
+
+	// the pass that shrinks the grid more goes first, keeping the
+	// intermediate grid small
+	size_t horizontal_first = (size_t)dest_size.w * src_size.h;
+	size_t vertical_first = (size_t)src_size.w * dest_size.h;
+	if (horizontal_first <= vertical_first)
+	{
+		float *temp = malloc(horizontal_first * sizeof(float));
+		run_horizontal(src, src_size, temp, dest_size.w, filter);
+		run_vertical(temp, (uvec2){ .w = dest_size.w, .h = src_size.h }, dest, dest_size.h, filter);
+		free(temp);
+	}
+	else
+	{
+		float *temp = malloc(vertical_first * sizeof(float));
+		run_vertical(src, src_size, temp, dest_size.h, filter);
+		run_horizontal(temp, (uvec2){ .w = src_size.w, .h = dest_size.h }, dest, dest_size.w, filter);
+		free(temp);
+	}
+}
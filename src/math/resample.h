@@ -0,0 +1,31 @@
+#ifndef __math_resample_h__
+#define __math_resample_h__
+
+#include <stdbool.h>
+
+#include "math/types.h"
+
+// separable resampling of float grids. the corner samples of both grids line
+// up, so the borders of a height map stay where they are at any size. going
+// down, the filters widen with the scale so every source sample contributes
+// and nothing aliases. both passes run over rows on the job system
+
+typedef enum resample_filter_t
+{
+	RESAMPLE_FILTER_BILINEAR,
+	// catmull-rom, sharper than bilinear. its negative lobes overshoot at
+	// steps, by less than lanczos. use bilinear to keep cliffs in range
+	RESAMPLE_FILTER_BICUBIC,
+	// lanczos with three lobes, the sharpest. overshoots and rings at cliffs
+	RESAMPLE_FILTER_LANCZOS,
+	RESAMPLE_FILTER_COUNT__,
+} resample_filter_t;
+
+const char *resample_filter_name(resample_filter_t filter);
+// RESAMPLE_FILTER_COUNT__ for an unknown name
+resample_filter_t resample_filter_from_name(const char *name);
+
+// src and dest may not overlap, both sizes need at least one sample
+void resample(const float *src, uvec2 src_size, float *dest, uvec2 dest_size, resample_filter_t filter);
+
+#endif /* __math_resample_h__ */
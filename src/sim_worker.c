@@ -0,0 +1,149 @@
+#include "sim_worker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/atomic.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+
+#define SIM_WORKER_BATCH_SIZE (1024)
+#define SIM_WORKER_SLOT_MASK (0x3)
+#define SIM_WORKER_SLOT_DIRTY (0x4)
+
+static void publish(sim_worker_t *worker)
+{
+	size_t bytes = (size_t)worker->sim_terrain->size.w * worker->sim_terrain->size.h * sizeof(float);
+	memcpy(worker->slots[worker->back], worker->sim_terrain->height_map, bytes);
+
+	// hand the filled slot over and take whichever one was shared
+	int32_t previous = atomic_exchange_i32(&worker->shared, worker->back | SIM_WORKER_SLOT_DIRTY);
+	worker->back = previous & SIM_WORKER_SLOT_MASK;
+}
+
+static void worker_thread(void *user_pointer)
+{
+	sim_worker_t *worker = (sim_worker_t *)user_pointer;
+
+	double last_publish = timer_now();
+	while (worker->state.next_drop < (uint64_t)worker->total_drops && !atomic_load_i32(&worker->cancel))
+	{
+		uint64_t remaining = (uint64_t)worker->total_drops - worker->state.next_drop;
+		int drops = remaining < SIM_WORKER_BATCH_SIZE ? (int)remaining : SIM_WORKER_BATCH_SIZE;
+		erosion_run(worker->sim_terrain, &worker->params, &worker->state, drops);
+		atomic_fetch_add_i64(&worker->progress, drops);
+		if (worker->timelapse != NULL) timelapse_recorder_poll(worker->timelapse, worker->sim_terrain, worker->state.next_drop);
+
+		if (timer_now() - last_publish >= worker->publish_interval)
+		{
+			publish(worker);
+			last_publish = timer_now();
+		}
+	}
+
+	// the last snapshot is the result, cancelled or not
+	publish(worker);
+	atomic_store_i32(&worker->finished, 1);
+}
+
+void sim_worker_init(const sim_worker_desc_t *desc, sim_worker_t **worker)
+{
+	HE_ASSERT(worker != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A simulation worker description is required");
+	HE_ASSERT(desc->terrain != NULL, "A terrain to simulate is required");
+
+	sim_worker_t *result = calloc(1, sizeof(sim_worker_t));
+
+	result->sim_terrain = terrain_clone(desc->terrain);
+	result->params = desc->params;
+	result->state = desc->state;
+	result->total_drops = desc->total_drops;
+	result->publish_interval = desc->publish_interval;
+	result->timelapse = desc->timelapse;
+
+	size_t bytes = (size_t)desc->terrain->size.w * desc->terrain->size.h * sizeof(float);
+	for (int i = 0; i < 3; i++)
+	{
+		result->slots[i] = malloc(bytes);
+	}
+	result->back = 0;
+	result->shared = 1;
+	result->front = 2;
+
+	result->thread = thread_create(worker_thread, result);
+
+	*worker = result;
+}
+
+sim_worker_t *sim_worker_create(const sim_worker_desc_t *desc)
+{
+	sim_worker_t *worker;
+	sim_worker_init(desc, &worker);
+	return worker;
+}
+
+void sim_worker_free(sim_worker_t *worker)
+{
+	if (worker == NULL) return;
+
+	sim_worker_cancel(worker);
+	sim_worker_join(worker, NULL);
+
+	for (int i = 0; i < 3; i++)
+	{
+		free(worker->slots[i]);
+	}
+	terrain_free(worker->sim_terrain);
+	free(worker);
+}
+
+bool sim_worker_poll(sim_worker_t *worker, terrain_t *terrain)
+{
+	HE_ASSERT(worker != NULL, "Cannot poll NULL");
+	HE_ASSERT(terrain->size.w == worker->sim_terrain->size.w && terrain->size.h == worker->sim_terrain->size.h, "Terrain was resized during simulation");
+
+	if (!(atomic_load_i32(&worker->shared) & SIM_WORKER_SLOT_DIRTY)) return false;
+
+	worker->front = atomic_exchange_i32(&worker->shared, worker->front) & SIM_WORKER_SLOT_MASK;
+
+	// a mapped height map has to stay where it is, so copy into it
+	if (terrain->mapping != NULL)
+	{
+		memcpy(terrain->height_map, worker->slots[worker->front], (size_t)terrain->size.w * terrain->size.h * sizeof(float));
+		return true;
+	}
+
+	// swap instead of copying. the terrain's old array becomes the free slot,
+	// the worker overwrites it completely before publishing it again
+	float *snapshot = worker->slots[worker->front];
+	worker->slots[worker->front] = terrain->height_map;
+	terrain->height_map = snapshot;
+
+	return true;
+}
+
+void sim_worker_cancel(sim_worker_t *worker)
+{
+	atomic_store_i32(&worker->cancel, 1);
+}
+
+bool sim_worker_finished(sim_worker_t *worker)
+{
+	return atomic_load_i32(&worker->finished) != 0;
+}
+
+int64_t sim_worker_progress(sim_worker_t *worker)
+{
+	return atomic_load_i64(&worker->progress);
+}
+
+void sim_worker_join(sim_worker_t *worker, erosion_state_t *state)
+{
+	if (worker->thread != NULL)
+	{
+		thread_join(worker->thread);
+		worker->thread = NULL;
+	}
+
+	if (state != NULL) *state = worker->state;
+}
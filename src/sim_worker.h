@@ -0,0 +1,63 @@
+#ifndef __sim_worker_h__
+#define __sim_worker_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "components/terrain.h"
+#include "core/thread.h"
+#include "io/timelapse.h"
+#include "erosion.h"
+
+// runs erosion on a private copy of a terrain on a background thread. the
+// worker publishes heightmap snapshots through a lock free triple buffer and
+// the render thread picks up the latest one with sim_worker_poll
+
+typedef struct sim_worker_desc_t
+{
+	terrain_t *terrain;
+	erosion_desc_t params;
+	erosion_state_t state;
+	int total_drops;
+
+	// minimum time between two published snapshots
+	double publish_interval;
+
+	// polled after every batch when set, owned by the caller
+	timelapse_recorder_t *timelapse;
+} sim_worker_desc_t;
+
+typedef struct sim_worker_t
+{
+	terrain_t *sim_terrain;
+	erosion_desc_t params;
+	erosion_state_t state;
+	int total_drops;
+	double publish_interval;
+	timelapse_recorder_t *timelapse;
+
+	// triple buffer. the worker owns slot back, the reader owns slot front and
+	// the shared slot holds the third index plus a flag for unread data
+	float *slots[3];
+	int back;
+	int front;
+	volatile int32_t shared;
+
+	volatile int64_t progress;
+	volatile int32_t cancel;
+	volatile int32_t finished;
+
+	thread_t *thread;
+} sim_worker_t;
+
+void sim_worker_init(const sim_worker_desc_t *desc, sim_worker_t **worker);
+sim_worker_t *sim_worker_create(const sim_worker_desc_t *desc);
+void sim_worker_free(sim_worker_t *worker);
+
+bool sim_worker_poll(sim_worker_t *worker, terrain_t *terrain);
+void sim_worker_cancel(sim_worker_t *worker);
+bool sim_worker_finished(sim_worker_t *worker);
+int64_t sim_worker_progress(sim_worker_t *worker);
+void sim_worker_join(sim_worker_t *worker, erosion_state_t *state);
+
+#endif /* __sim_worker_h__ */
@@ -0,0 +1,208 @@
+#include "terrain_builder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/atomic.h"
+#include "core/timer.h"
+#include "debug/assert.h"
+
+// rows generated between two checks for a newer build
+#define TERRAIN_BUILDER_BAND_ROWS (256)
+
+static float *build_heights(terrain_builder_t *builder, const terrain_build_t *build)
+{
+	// a map too large to allocate is dropped like a cancelled one
+	float *heights = malloc((size_t)build->size.w * build->size.h * sizeof(float));
+	if (heights == NULL) return NULL;
+
+	if (build->source != NULL)
+	{
+		// a resample runs in one go, a newer build only stops it afterwards
+		resample(build->source, build->source_size, heights, build->size, build->filter);
+	}
+	else
+	{
+		terrain_t view = terrain_view(build->size, heights);
+		view.noise_function = builder->noise_function;
+		view.seed = build->seed;
+		view.scale_scalar = build->scale_scalar;
+		for (uint32_t z = 0; z < build->size.h && !atomic_load_i32(&builder->cancel); z += TERRAIN_BUILDER_BAND_ROWS)
+		{
+			uint32_t end = z + TERRAIN_BUILDER_BAND_ROWS < build->size.h ? z + TERRAIN_BUILDER_BAND_ROWS : build->size.h;
+			terrain_generate_rows(&view, z, end);
+		}
+	}
+
+	if (atomic_load_i32(&builder->cancel))
+	{
+		free(heights);
+		return NULL;
+	}
+	return heights;
+}
+
+static void builder_thread(void *user_pointer)
+{
+	terrain_builder_t *builder = user_pointer;
+
+	mutex_lock(builder->mutex);
+	while (true)
+	{
+		while (!builder->quit && !builder->has_pending) cond_wait(builder->wake, builder->mutex);
+		if (builder->quit) break;
+
+		terrain_build_t build = builder->pending;
+		builder->has_pending = false;
+		builder->running = true;
+		atomic_store_i32(&builder->cancel, 0);
+		mutex_unlock(builder->mutex);
+
+		double start = timer_now();
+		float *heights = build_heights(builder, &build);
+		double seconds = timer_now() - start;
+
+		mutex_lock(builder->mutex);
+		builder->running = false;
+		if (heights != NULL && !builder->has_pending)
+		{
+			// an unclaimed older result is replaced
+			free(builder->result);
+			builder->result = heights;
+			builder->result_build = build;
+			builder->build_seconds = seconds;
+			builder->finished++;
+		}
+		else
+		{
+			free(heights);
+			builder->cancelled++;
+		}
+		cond_broadcast(builder->done);
+	}
+	mutex_unlock(builder->mutex);
+}
+
+void terrain_builder_init(const terrain_builder_desc_t *desc, terrain_builder_t **builder)
+{
+	HE_ASSERT(builder != NULL, "Cannot initialize NULL");
+	HE_ASSERT(desc != NULL, "A terrain builder description is required");
+	HE_ASSERT(desc->noise_function != NULL, "A terrain noise function is required");
+
+	terrain_builder_t *result = calloc(1, sizeof(terrain_builder_t));
+	result->noise_function = desc->noise_function;
+	result->mutex = mutex_create();
+	result->wake = cond_create();
+	result->done = cond_create();
+	result->thread = thread_create(builder_thread, result);
+
+	*builder = result;
+}
+
+terrain_builder_t *terrain_builder_create(const terrain_builder_desc_t *desc)
+{
+	terrain_builder_t *builder;
+	terrain_builder_init(desc, &builder);
+	return builder;
+}
+
+void terrain_builder_free(terrain_builder_t *builder)
+{
+	if (builder == NULL) return;
+
+	mutex_lock(builder->mutex);
+	builder->quit = true;
+	builder->has_pending = false;
+	atomic_store_i32(&builder->cancel, 1);
+	cond_signal(builder->wake);
+	mutex_unlock(builder->mutex);
+	thread_join(builder->thread);
+
+	free(builder->result);
+	cond_free(builder->done);
+	cond_free(builder->wake);
+	mutex_free(builder->mutex);
+	free(builder);
+}
+
+void terrain_builder_submit(terrain_builder_t *builder, const terrain_build_t *build)
+{
+	HE_ASSERT(builder != NULL, "Cannot submit to NULL");
+	HE_ASSERT(build != NULL, "A terrain build is required");
+	HE_ASSERT(build->size.w >= 2 && build->size.h >= 2, "Invalid terrain size");
+
+	mutex_lock(builder->mutex);
+	if (builder->has_pending) builder->cancelled++;
+	builder->pending = *build;
+	builder->has_pending = true;
+	atomic_store_i32(&builder->cancel, 1);
+	cond_signal(builder->wake);
+	mutex_unlock(builder->mutex);
+}
+
+void terrain_builder_cancel(terrain_builder_t *builder)
+{
+	HE_ASSERT(builder != NULL, "Cannot cancel NULL");
+
+	mutex_lock(builder->mutex);
+	if (builder->has_pending) builder->cancelled++;
+	builder->has_pending = false;
+	atomic_store_i32(&builder->cancel, 1);
+	mutex_unlock(builder->mutex);
+}
+
+void terrain_builder_flush(terrain_builder_t *builder)
+{
+	HE_ASSERT(builder != NULL, "Cannot flush NULL");
+
+	mutex_lock(builder->mutex);
+	while (builder->has_pending || builder->running) cond_wait(builder->done, builder->mutex);
+	mutex_unlock(builder->mutex);
+}
+
+bool terrain_builder_busy(terrain_builder_t *builder)
+{
+	HE_ASSERT(builder != NULL, "Cannot query NULL");
+
+	mutex_lock(builder->mutex);
+	bool busy = builder->has_pending || builder->running;
+	mutex_unlock(builder->mutex);
+	return busy;
+}
+
+bool terrain_builder_poll(terrain_builder_t *builder, terrain_t *terrain)
+{
+	HE_ASSERT(builder != NULL, "Cannot poll NULL");
+	HE_ASSERT(terrain != NULL, "A terrain to update is required");
+
+	mutex_lock(builder->mutex);
+	float *heights = builder->result;
+	terrain_build_t build = builder->result_build;
+	builder->result = NULL;
+	mutex_unlock(builder->mutex);
+	if (heights == NULL) return false;
+
+	if (terrain->storage == TERRAIN_STORAGE_HEAP)
+	{
+		// the finished map is taken over as is
+		free(terrain->height_map);
+		terrain->height_map = heights;
+		terrain->size = build.size;
+	}
+	else
+	{
+		// a map that cannot be stored is dropped, the next build tries again
+		if (!terrain_allocate(terrain, build.size))
+		{
+			free(heights);
+			return false;
+		}
+		memcpy(terrain->height_map, heights, (size_t)build.size.w * build.size.h * sizeof(float));
+		free(heights);
+	}
+
+	terrain->seed = build.seed;
+	terrain->scale_scalar = build.scale_scalar;
+	terrain_update_mesh(terrain);
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef __terrain_builder_h__
+#define __terrain_builder_h__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "components/terrain.h"
+#include "core/thread.h"
+#include "math/resample.h"
+
+// builds full resolution height maps on a background thread while the
+// settings are still being edited. a new submit replaces a build that has not
+// started yet and stops a running one at its next band of rows, so only the
+// latest settings are ever finished. the render thread picks the result up
+// with terrain_builder_poll
+
+typedef struct terrain_build_t
+{
+	uvec2 size;
+	int seed;
+	float scale_scalar;
+
+	// resample these heights instead of generating noise. they are only read,
+	// and have to outlive the build
+	const float *source;
+	uvec2 source_size;
+	resample_filter_t filter;
+} terrain_build_t;
+
+typedef struct terrain_builder_desc_t
+{
+	terrain_noise_function_t noise_function;
+} terrain_builder_desc_t;
+
+typedef struct terrain_builder_t
+{
+	terrain_noise_function_t noise_function;
+
+	thread_t *thread;
+	mutex_t *mutex;
+	cond_t *wake;
+	cond_t *done;
+
+	// only touched with the mutex held
+	terrain_build_t pending;
+	bool has_pending;
+	bool running;
+	bool quit;
+	float *result;
+	terrain_build_t result_build;
+	uint32_t finished;
+	uint32_t cancelled;
+	double build_seconds;
+
+	// raised by submits and cancels, the running build checks it between bands
+	volatile int32_t cancel;
+} terrain_builder_t;
+
+void terrain_builder_init(const terrain_builder_desc_t *desc, terrain_builder_t **builder);
+terrain_builder_t *terrain_builder_create(const terrain_builder_desc_t *desc);
+void terrain_builder_free(terrain_builder_t *builder);
+
+void terrain_builder_submit(terrain_builder_t *builder, const terrain_build_t *build);
+// drops the pending build and stops the running one
+void terrain_builder_cancel(terrain_builder_t *builder);
+// waits until nothing is pending or running
+void terrain_builder_flush(terrain_builder_t *builder);
+bool terrain_builder_busy(terrain_builder_t *builder);
+
+// moves a finished build into the terrain and rebuilds its mesh. false if
+// there was none or terrain could not be resized
+bool terrain_builder_poll(terrain_builder_t *builder, terrain_t *terrain);
+
+#endif /* __terrain_builder_h__ */
@@ -0,0 +1,95 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "components/terrain.h"
+#include "io/heightmap.h"
+#include "math/noise.h"
+
+// a heightmap that breaks off partway must fail to import and leave the
+// terrain it was loaded into exactly as it was
+
+#define CHECK(CONDITION) if (!(CONDITION)) { fprintf(stderr, "%s:%i: check (%s) failed\n", __FILE__, __LINE__, #CONDITION); return false; }
+
+static terrain_t *create_terrain(uvec2 size, int seed)
+{
+	return terrain_create(&(terrain_desc_t){
+		.size = size,
+		.noise_function = (terrain_noise_function_t)perlin_noise_2d,
+		.seed = seed,
+		.scale_scalar = 0.4f,
+		.elevation = 100.0f,
+		.headless = true,
+	});
+}
+
+static bool truncate_file(const char *path, long keep)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return false;
+	char *bytes = malloc((size_t)keep);
+	bool ok = bytes != NULL && fread(bytes, 1, (size_t)keep, file) == (size_t)keep;
+	fclose(file);
+
+	file = ok ? fopen(path, "wb") : NULL;
+	ok = file != NULL && fwrite(bytes, 1, (size_t)keep, file) == (size_t)keep;
+	if (file != NULL) fclose(file);
+	free(bytes);
+	return ok;
+}
+
+static long file_size(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return -1;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+static bool test_truncated(const char *path)
+{
+	heightmap_format_t format = heightmap_format_from_path(path);
+
+	// the file is larger than the target, so a resize before the decode fails would show
+	terrain_t *source = create_terrain((uvec2){ 48, 48 }, 1);
+	terrain_t *target = create_terrain((uvec2){ 32, 24 }, 2);
+	CHECK(source != NULL && target != NULL);
+	CHECK(heightmap_save(path, format, source, NULL));
+
+	size_t bytes = (size_t)target->size.w * target->size.h * sizeof(float);
+	float *before = malloc(bytes);
+	memcpy(before, target->height_map, bytes);
+
+	CHECK(truncate_file(path, file_size(path) * 3 / 4));
+	CHECK(!heightmap_load(path, format, target, NULL));
+	CHECK(target->size.w == 32 && target->size.h == 24);
+	CHECK(memcmp(before, target->height_map, bytes) == 0);
+
+	// the intact file still imports
+	CHECK(heightmap_save(path, format, source, NULL));
+	CHECK(heightmap_load(path, format, target, NULL));
+	CHECK(target->size.w == 48 && target->size.h == 48);
+
+	free(before);
+	terrain_free(source);
+	terrain_free(target);
+	remove(path);
+	return true;
+}
+
+int main(void)
+{
+	const char *paths[] = { "heightmap_load_test.png", "heightmap_load_test.pgm", "heightmap_load_test.raw" };
+
+	int failed = 0;
+	for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+	{
+		bool ok = test_truncated(paths[i]);
+		printf("%s truncated %s\n", ok ? "passed" : "FAILED", heightmap_format_name(heightmap_format_from_path(paths[i])));
+		failed += !ok;
+	}
+	return failed > 0;
+}
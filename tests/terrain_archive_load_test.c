@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "components/terrain.h"
+#include "io/terrain_archive.h"
+#include "math/noise.h"
+
+// an archive with a tile that fails its crc must fail to load and leave the
+// terrain it was loaded into exactly as it was
+
+#define CHECK(CONDITION) if (!(CONDITION)) { fprintf(stderr, "%s:%i: check (%s) failed\n", __FILE__, __LINE__, #CONDITION); return false; }
+
+static terrain_t *create_terrain(uvec2 size, int seed)
+{
+	return terrain_create(&(terrain_desc_t){
+		.size = size,
+		.noise_function = (terrain_noise_function_t)perlin_noise_2d,
+		.seed = seed,
+		.scale_scalar = 0.4f,
+		.elevation = 100.0f,
+		.headless = true,
+	});
+}
+
+static bool flip_byte(const char *path, uint64_t offset)
+{
+	FILE *file = fopen(path, "r+b");
+	if (file == NULL) return false;
+	int c = fseek(file, (long)offset, SEEK_SET) == 0 ? fgetc(file) : EOF;
+	bool ok = c != EOF && fseek(file, (long)offset, SEEK_SET) == 0 && fputc(c ^ 0xFF, file) != EOF;
+	fclose(file);
+	return ok;
+}
+
+static bool test_corrupt_tile(const char *path)
+{
+	terrain_t *source = create_terrain((uvec2){ 64, 64 }, 1);
+	terrain_t *target = create_terrain((uvec2){ 32, 24 }, 2);
+	CHECK(source != NULL && target != NULL);
+	erosion_desc_t params = EROSION_DEFAULT_DESC;
+	erosion_state_t state;
+	erosion_state_init(&state, 1);
+	CHECK(terrain_archive_save(path, source, &params, &state, 16));
+
+	size_t bytes = (size_t)target->size.w * target->size.h * sizeof(float);
+	float *before = malloc(bytes);
+	memcpy(before, target->height_map, bytes);
+
+	// the last tile of level 0, so every tile before it is read first
+	terrain_archive_t *archive = terrain_archive_create(&(terrain_archive_desc_t){ .path = path });
+	CHECK(archive != NULL);
+	uint64_t offset = terrain_archive_tile(archive, 0, 3, 3)->offset;
+	terrain_archive_free(archive);
+	CHECK(flip_byte(path, offset));
+
+	archive = terrain_archive_create(&(terrain_archive_desc_t){ .path = path });
+	CHECK(archive != NULL);
+	CHECK(!terrain_archive_load(archive, &(terrain_archive_region_t){ 0 }, target));
+	CHECK(target->size.w == 32 && target->size.h == 24);
+	CHECK(memcmp(before, target->height_map, bytes) == 0);
+
+	// the tiles that are intact still load
+	CHECK(terrain_archive_load(archive, &(terrain_archive_region_t){ .x = 0, .y = 0, .w = 48, .h = 48 }, target));
+	CHECK(target->size.w == 48 && target->size.h == 48);
+	terrain_archive_free(archive);
+
+	free(before);
+	terrain_free(source);
+	terrain_free(target);
+	remove(path);
+	return true;
+}
+
+int main(void)
+{
+	bool ok = test_corrupt_tile("terrain_archive_load_test" TERRAIN_ARCHIVE_EXTENSION);
+	printf("%s corrupt tile\n", ok ? "passed" : "FAILED");
+	return !ok;
+}